@@ -0,0 +1,113 @@
+// Memory savings and sampling throughput of compressed animation clips against
+// the raw uniformly keyed clip they were cooked from.
+
+#include "anim_compression.h"
+#include "animation.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+namespace {
+
+constexpr uint32_t JOINTS = 64;
+constexpr uint32_t FRAMES = 30 * 10;  // 10 s at 30 Hz
+constexpr size_t SAMPLES = 20000;
+
+// Smooth looping motion on most joints, a few static ones (fingers, props)
+// and a translating root; roughly what mocap clips look like.
+AnimationClip make_clip()
+{
+  AnimationClip clip;
+  clip.sample_rate = 30.0f;
+  clip.frame_count = FRAMES;
+  clip.joint_count = JOINTS;
+  clip.keys.resize(size_t(FRAMES) * JOINTS);
+  for (uint32_t f = 0; f < FRAMES; ++f)
+  {
+    const float t = float(f) / clip.sample_rate;
+    for (uint32_t j = 0; j < JOINTS; ++j)
+    {
+      Transform &key = clip.keys[f * JOINTS + j];
+      const float freq = 0.5f + float(j % 7) * 0.25f;
+      const float amp = (j % 5 == 4) ? 0.0f : 0.6f;
+      const glm::vec3 axis = glm::normalize(glm::vec3(float(j % 3), 1.0f,
+                                                      float(j % 2)));
+      key.rotation = glm::angleAxis(amp * std::sin(t * freq * 6.2831853f),
+                                    axis);
+      key.translation = (j == 0) ? glm::vec3(t * 1.5f, std::sin(t * 4.0f) * 0.05f,
+                                             0.0f)
+                                 : glm::vec3(0.0f, 0.25f, 0.0f);
+      key.scale = glm::vec3(1.0f);
+    }
+  }
+  return clip;
+}
+
+template <typename Clip>
+double time_sampling(const Clip &clip, const std::vector<float> &times)
+{
+  std::vector<Transform> pose(JOINTS);
+  float sink = 0.0f;
+  const auto start = std::chrono::steady_clock::now();
+  for (const float t : times)
+  {
+    sample_clip(clip, t, pose.data());
+    sink += pose[JOINTS - 1].rotation.w;
+  }
+  const auto end = std::chrono::steady_clock::now();
+  // keep the loop from being optimised away
+  if (sink == 12345.0f)
+    std::puts("");
+  return std::chrono::duration<double>(end - start).count();
+}
+
+}  // unnamed namespace
+
+int main()
+{
+  const AnimationClip raw = make_clip();
+  const CompressedClip compressed = compress_clip(raw);
+
+  const size_t raw_bytes = sizeof(raw) + raw.keys.size() * sizeof(Transform);
+  const size_t packed_bytes = compressed.size_bytes();
+  std::printf("clip: %u joints x %u frames\n", JOINTS, FRAMES);
+  std::printf("raw        %8zu bytes\n", raw_bytes);
+  std::printf("compressed %8zu bytes (%.1fx smaller, %zu segments)\n",
+              packed_bytes, double(raw_bytes) / double(packed_bytes),
+              compressed.segment_offsets.size());
+
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> dist(0.0f, raw.duration());
+  std::vector<float> times(SAMPLES);
+  for (auto &t : times)
+    t = dist(rng);
+
+  // worst error over random times, against the raw clip
+  std::vector<Transform> a(JOINTS), b(JOINTS);
+  float rot_err = 0.0f, trans_err = 0.0f;
+  for (const float t : times)
+  {
+    sample_clip(raw, t, a.data());
+    sample_clip(compressed, t, b.data());
+    for (uint32_t j = 0; j < JOINTS; ++j)
+    {
+      const float d = std::fmin(std::fabs(glm::dot(a[j].rotation,
+                                                   b[j].rotation)), 1.0f);
+      rot_err = std::fmax(rot_err, 2.0f * std::acos(d));
+      trans_err = std::fmax(trans_err, glm::length(a[j].translation -
+                                                   b[j].translation));
+    }
+  }
+  std::printf("max error: rotation %.5f rad, translation %.5f\n",
+              double(rot_err), double(trans_err));
+
+  const double raw_s = time_sampling(raw, times);
+  const double packed_s = time_sampling(compressed, times);
+  std::printf("sampling raw        %10.0f poses/s  %6.1f ns/joint\n",
+              double(SAMPLES) / raw_s, raw_s * 1e9 / double(SAMPLES * JOINTS));
+  std::printf("sampling compressed %10.0f poses/s  %6.1f ns/joint\n",
+              double(SAMPLES) / packed_s,
+              packed_s * 1e9 / double(SAMPLES * JOINTS));
+}
@@ -0,0 +1,406 @@
+// Compares two proto3d-bench result files, scene by scene: every sampled
+// metric gets a one-sided Mann-Whitney U test of "the new run is slower",
+// and counts the runs report once (memory peaks) are compared directly.
+// Prints a table and exits 1 when anything regressed significantly, 2 when
+// the files can't be read.
+//
+//   proto3d-compare BASE.json NEW.json [--confidence 0.99] [--threshold 0.02]
+//
+// A change is a regression only when it is significant at the confidence
+// level and the median moved by more than the threshold, relative; the
+// latter keeps large sample counts from flagging differences too small to
+// matter.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Just enough JSON for bench results: no escapes beyond \" and \\, numbers
+// as doubles.
+struct Json
+{
+  enum Type
+  {
+    NUL,
+    BOOL,
+    NUMBER,
+    STRING,
+    ARRAY,
+    OBJECT
+  };
+
+  Type type = NUL;
+  double number = 0.0;
+  std::string string;
+  std::vector<Json> items;
+  std::vector<std::pair<std::string, Json>> members;
+
+  const Json* find(const char *key) const
+  {
+    for (const auto &m : members)
+      if (m.first == key)
+        return &m.second;
+    return nullptr;
+  }
+};
+
+class JsonParser
+{
+public:
+  explicit JsonParser(const std::string &text) : p_(text.c_str()) { }
+
+  bool parse(Json *out)
+  {
+    if (!value(out))
+      return false;
+    skip_space();
+    return !*p_;
+  }
+
+  const char* position() const { return p_; }
+
+private:
+  void skip_space()
+  {
+    while ((*p_ == ' ') || (*p_ == '\n') || (*p_ == '\r') || (*p_ == '\t'))
+      ++p_;
+  }
+
+  bool literal(const char *word)
+  {
+    const size_t n = std::strlen(word);
+    if (std::strncmp(p_, word, n))
+      return false;
+    p_ += n;
+    return true;
+  }
+
+  bool string(std::string *out)
+  {
+    if (*p_++ != '"')
+      return false;
+    for (; *p_ && (*p_ != '"'); ++p_)
+    {
+      if ((*p_ == '\\') && p_[1])
+        ++p_;
+      out->push_back(*p_);
+    }
+    return *p_++ == '"';
+  }
+
+  bool value(Json *out)
+  {
+    skip_space();
+    switch (*p_)
+    {
+    case '{':
+      out->type = Json::OBJECT;
+      ++p_;
+      skip_space();
+      if (*p_ == '}')
+        return ++p_, true;
+      for (;;)
+      {
+        std::pair<std::string, Json> member;
+        skip_space();
+        if (!string(&member.first))
+          return false;
+        skip_space();
+        if (*p_++ != ':')
+          return false;
+        if (!value(&member.second))
+          return false;
+        out->members.push_back(std::move(member));
+        skip_space();
+        if (*p_ == '}')
+          return ++p_, true;
+        if (*p_++ != ',')
+          return false;
+      }
+    case '[':
+      out->type = Json::ARRAY;
+      ++p_;
+      skip_space();
+      if (*p_ == ']')
+        return ++p_, true;
+      for (;;)
+      {
+        out->items.emplace_back();
+        if (!value(&out->items.back()))
+          return false;
+        skip_space();
+        if (*p_ == ']')
+          return ++p_, true;
+        if (*p_++ != ',')
+          return false;
+      }
+    case '"':
+      out->type = Json::STRING;
+      return string(&out->string);
+    case 't':
+      out->type = Json::BOOL;
+      out->number = 1.0;
+      return literal("true");
+    case 'f':
+      out->type = Json::BOOL;
+      return literal("false");
+    case 'n':
+      return literal("null");
+    default:
+    {
+      char *end = nullptr;
+      out->type = Json::NUMBER;
+      out->number = std::strtod(p_, &end);
+      if (end == p_)
+        return false;
+      p_ = end;
+      return true;
+    }
+    }
+  }
+
+  const char *p_;
+};
+
+bool load_json(const char *file, Json *out)
+{
+  FILE *f = std::fopen(file, "rb");
+  if (!f)
+  {
+    std::fprintf(stderr, "Unable to open %s\n", file);
+    return false;
+  }
+  std::string text;
+  char buffer[1 << 16];
+  size_t n = 0;
+  while ((n = std::fread(buffer, 1, sizeof(buffer), f)) > 0)
+    text.append(buffer, n);
+  std::fclose(f);
+
+  JsonParser parser(text);
+  if (!parser.parse(out) || (out->type != Json::OBJECT))
+  {
+    std::fprintf(stderr, "%s: malformed JSON at byte %ld\n", file,
+                 static_cast<long>(parser.position() - text.c_str()));
+    return false;
+  }
+  return true;
+}
+
+std::vector<double> numbers(const Json *array)
+{
+  std::vector<double> out;
+  if (array && (array->type == Json::ARRAY))
+    for (const auto &item : array->items)
+      out.push_back(item.number);
+  return out;
+}
+
+double median(std::vector<double> v)
+{
+  if (v.empty())
+    return 0.0;
+  const auto mid = v.begin() + static_cast<long>(v.size() / 2);
+  std::nth_element(v.begin(), mid, v.end());
+  if (v.size() & 1)
+    return *mid;
+  return 0.5 * (*mid + *std::max_element(v.begin(), mid));
+}
+
+// One-sided p-value of the Mann-Whitney U test that b tends to exceed a,
+// by the normal approximation with tie and continuity corrections; fine for
+// the hundreds of samples a bench run has.
+double mann_whitney_greater(const std::vector<double> &a,
+                            const std::vector<double> &b)
+{
+  const size_t n1 = a.size(), n2 = b.size(), n = n1 + n2;
+  if (!n1 || !n2)
+    return 1.0;
+  std::vector<std::pair<double, bool>> all;
+  all.reserve(n);
+  for (const double v : a)
+    all.emplace_back(v, false);
+  for (const double v : b)
+    all.emplace_back(v, true);
+  std::sort(all.begin(), all.end(),
+            [](const std::pair<double, bool> &x,
+               const std::pair<double, bool> &y) { return x.first < y.first; });
+
+  // mid-ranks for ties
+  double rank_sum_b = 0.0, tie_term = 0.0;
+  for (size_t i = 0; i < n; )
+  {
+    size_t j = i + 1;
+    while ((j < n) && (all[j].first == all[i].first))
+      ++j;
+    const double rank = 0.5 * static_cast<double>(i + 1 + j);
+    const auto t = static_cast<double>(j - i);
+    tie_term += t * t * t - t;
+    for (size_t k = i; k < j; ++k)
+      if (all[k].second)
+        rank_sum_b += rank;
+    i = j;
+  }
+  const auto dn1 = static_cast<double>(n1), dn2 = static_cast<double>(n2);
+  const auto dn = static_cast<double>(n);
+  const double u = rank_sum_b - dn2 * (dn2 + 1.0) / 2.0;
+  const double mean = dn1 * dn2 / 2.0;
+  const double variance = dn1 * dn2 / 12.0 *
+                          ((dn + 1.0) - tie_term / (dn * (dn - 1.0)));
+  if (variance <= 0.0)
+    return (u > mean) ? 0.0 : 1.0;  // every sample equal within each run
+  const double z = (u - mean - 0.5) / std::sqrt(variance);
+  return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+struct Row
+{
+  std::string scene, metric;
+  double base, current, p;
+  bool regressed, improved;
+};
+
+const Json* scene_named(const Json &results, const std::string &name)
+{
+  const Json *scenes = results.find("scenes");
+  if (!scenes)
+    return nullptr;
+  for (const auto &scene : scenes->items)
+  {
+    const Json *n = scene.find("name");
+    if (n && (n->string == name))
+      return &scene;
+  }
+  return nullptr;
+}
+
+double relative_change(double base, double current)
+{
+  if (base == 0.0)
+    return (current == 0.0) ? 0.0 : 1.0;
+  return (current - base) / base;
+}
+
+}  // unnamed namespace
+
+int main(int argc, char **argv)
+{
+  double confidence = 0.99;
+  double threshold = 0.02;
+  std::vector<const char*> files;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (!std::strcmp(argv[i], "--confidence") && (i + 1 < argc))
+      confidence = std::atof(argv[++i]);
+    else if (!std::strcmp(argv[i], "--threshold") && (i + 1 < argc))
+      threshold = std::atof(argv[++i]);
+    else
+      files.push_back(argv[i]);
+  }
+  if ((files.size() != 2) || (confidence <= 0.0) || (confidence >= 1.0))
+  {
+    std::fprintf(stderr, "usage: %s BASE.json NEW.json [--confidence 0.99] "
+                 "[--threshold 0.02]\n", argv[0]);
+    return 2;
+  }
+  Json base, current;
+  if (!load_json(files[0], &base) || !load_json(files[1], &current))
+    return 2;
+  const Json *base_renderer = base.find("renderer");
+  const Json *current_renderer = current.find("renderer");
+  if (base_renderer && current_renderer &&
+      (base_renderer->string != current_renderer->string))
+    std::fprintf(stderr, "warning: renderers differ (%s vs %s)\n",
+                 base_renderer->string.c_str(),
+                 current_renderer->string.c_str());
+
+  const double alpha = 1.0 - confidence;
+  static const char *const SAMPLED[] = { "cpu_ms", "gpu_ms", "draw_calls",
+                                         "triangles", "texture_binds" };
+  std::vector<Row> rows;
+  const Json *scenes = current.find("scenes");
+  if (!scenes || !base.find("scenes"))
+  {
+    std::fprintf(stderr, "no scenes to compare\n");
+    return 2;
+  }
+  for (const auto &scene : scenes->items)
+  {
+    const Json *name = scene.find("name");
+    if (!name)
+      continue;
+    const Json *old = scene_named(base, name->string);
+    if (!old)
+    {
+      std::fprintf(stderr, "scene %s is new; nothing to compare\n",
+                   name->string.c_str());
+      continue;
+    }
+    const Json *old_samples = old->find("samples");
+    const Json *new_samples = scene.find("samples");
+    for (const char *metric : SAMPLED)
+    {
+      const std::vector<double> a = numbers(old_samples ?
+                                            old_samples->find(metric) :
+                                            nullptr);
+      const std::vector<double> b = numbers(new_samples ?
+                                            new_samples->find(metric) :
+                                            nullptr);
+      if (a.empty() || b.empty())
+        continue;
+      Row row;
+      row.scene = name->string;
+      row.metric = metric;
+      row.base = median(a);
+      row.current = median(b);
+      const double change = relative_change(row.base, row.current);
+      const double p_slower = mann_whitney_greater(a, b);
+      const double p_faster = mann_whitney_greater(b, a);
+      row.p = std::min(p_slower, p_faster);
+      row.regressed = (p_slower < alpha) && (change > threshold);
+      row.improved = (p_faster < alpha) && (change < -threshold);
+      rows.push_back(row);
+    }
+    const Json *old_memory = old->find("memory_peak_bytes");
+    const Json *new_memory = scene.find("memory_peak_bytes");
+    if (old_memory && new_memory)
+    {
+      Row row;
+      row.scene = name->string;
+      row.metric = "memory_mb";
+      row.base = old_memory->number / (1024.0 * 1024.0);
+      row.current = new_memory->number / (1024.0 * 1024.0);
+      const double change = relative_change(row.base, row.current);
+      row.p = -1.0;
+      row.regressed = change > threshold;
+      row.improved = change < -threshold;
+      rows.push_back(row);
+    }
+  }
+
+  std::printf("%-12s %-11s %12s %12s %9s %9s  %s\n", "scene", "metric",
+              "base p50", "new p50", "change", "p", "");
+  int regressions = 0;
+  for (const auto &row : rows)
+  {
+    char p[16] = "-";
+    if (row.p >= 0.0)
+      std::snprintf(p, sizeof(p), "%.4f", row.p);
+    std::printf("%-12s %-11s %12.3f %12.3f %+8.1f%% %9s  %s\n",
+                row.scene.c_str(), row.metric.c_str(), row.base, row.current,
+                100.0 * relative_change(row.base, row.current), p,
+                row.regressed ? "REGRESSION" : row.improved ? "improved" : "");
+    regressions += row.regressed ? 1 : 0;
+  }
+  if (regressions)
+    std::printf("\n%d regression%s at %.1f%% confidence\n", regressions,
+                (regressions > 1) ? "s" : "", 100.0 * confidence);
+  return regressions ? 1 : 0;
+}
@@ -0,0 +1,187 @@
+// Frames a second the capture codec (see frame_codec.h) encodes and decodes at
+// 1080p and 4K, on one thread and on the job pool, against the PNG and QOI
+// encoders capture otherwise uses.  Frames pan across a procedural landscape
+// under a fixed sky and HUD, so both predictors get exercised; the ratio is
+// the encoded size over the raw RGBA.
+
+#include "frame_codec.h"
+#include "image_write.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+constexpr int FRAMES = 60;
+constexpr int PAN = 3;  // pixels a frame
+
+uint32_t hash(uint32_t x, uint32_t y)
+{
+  uint32_t h = x * 0x27d4eb2du ^ y * 0x165667b1u;
+  h ^= h >> 15;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  return h;
+}
+
+// bilinear value noise at cell size, 0..1
+float value(int x, int y, int cell)
+{
+  const int cx = x / cell, cy = y / cell;
+  const float fx = static_cast<float>(x % cell) / static_cast<float>(cell);
+  const float fy = static_cast<float>(y % cell) / static_cast<float>(cell);
+  auto v = [](int i, int j) {
+    return static_cast<float>(hash(static_cast<uint32_t>(i),
+                                   static_cast<uint32_t>(j)) & 0xffff) /
+           65535.0f;
+  };
+  const float top = v(cx, cy) + (v(cx + 1, cy) - v(cx, cy)) * fx;
+  const float bottom = v(cx, cy + 1) + (v(cx + 1, cy + 1) - v(cx, cy + 1)) * fx;
+  return top + (bottom - top) * fy;
+}
+
+uint8_t to_byte(float v)
+{
+  return static_cast<uint8_t>(std::min(255.0f, std::max(0.0f, v * 255.0f)));
+}
+
+// width + PAN * FRAMES wide; frames are windows into it
+std::vector<uint8_t> landscape(int width, int height)
+{
+  const int wide = width + PAN * FRAMES;
+  std::vector<uint8_t> pixels(static_cast<size_t>(wide) * 4 *
+                              static_cast<size_t>(height));
+  for (int y = 0; y < height; ++y)
+    for (int x = 0; x < wide; ++x)
+    {
+      uint8_t *p = &pixels[(static_cast<size_t>(y) * wide + x) * 4];
+      const float t = static_cast<float>(y) / static_cast<float>(height);
+      const float horizon = 0.4f + 0.15f * value(x, 0, height / 4);
+      if (t < horizon)
+      {
+        // smooth sky
+        p[0] = to_byte(0.2f + 0.3f * t);
+        p[1] = to_byte(0.35f + 0.3f * t);
+        p[2] = to_byte(0.5f + 0.4f * t);
+      }
+      else
+      {
+        const float shade = 0.5f * value(x, y, 64) + 0.3f * value(x, y, 8) +
+                            0.2f * value(x, y, 2);
+        p[0] = to_byte(0.3f * shade);
+        p[1] = to_byte(0.6f * shade);
+        p[2] = to_byte(0.2f * shade);
+      }
+      p[3] = 255;
+    }
+  return pixels;
+}
+
+// the frame-th window, with a HUD panel that doesn't move
+void frame_at(const std::vector<uint8_t> &land, int width, int height,
+              int frame, std::vector<uint8_t> *out)
+{
+  const size_t row = static_cast<size_t>(width) * 4;
+  const size_t wide = row + static_cast<size_t>(PAN * FRAMES) * 4;
+  out->resize(row * static_cast<size_t>(height));
+  for (int y = 0; y < height; ++y)
+    std::copy_n(&land[wide * static_cast<size_t>(y) +
+                      static_cast<size_t>(frame * PAN) * 4], row,
+                &(*out)[row * static_cast<size_t>(y)]);
+  for (int y = 16; y < height / 4; ++y)
+    std::fill_n(&(*out)[row * static_cast<size_t>(y) + 64], row / 5,
+                static_cast<uint8_t>(40));
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start).count();
+}
+
+void report(const char *name, int frames, double s, size_t bytes, size_t raw)
+{
+  std::printf("  %-18s %8.1f frames/s  %6.2f ms/frame  ratio %.3f\n", name,
+              frames / s, 1000.0 * s / frames,
+              static_cast<double>(bytes) / static_cast<double>(raw * frames));
+}
+
+void run(JobSystem &jobs, int width, int height)
+{
+  const std::vector<uint8_t> land = landscape(width, height);
+  std::vector<std::vector<uint8_t>> frames(FRAMES);
+  for (int f = 0; f < FRAMES; ++f)
+    frame_at(land, width, height, f, &frames[f]);
+  const size_t raw = frames[0].size();
+  const ptrdiff_t stride = static_cast<ptrdiff_t>(width) * 4;
+  std::printf("%dx%d, %d frames\n", width, height, FRAMES);
+
+  std::vector<uint8_t> archive;
+  for (JobSystem *pool : { static_cast<JobSystem*>(nullptr), &jobs })
+  {
+    FrameEncoder encoder(pool);
+    // untimed, so the scratch and the archive are allocated already
+    for (int f = 0; f < FRAMES; ++f)
+      encoder.encode(static_cast<uint32_t>(f), frames[f].data(), width,
+                     height, stride, &archive);
+    encoder.reset();
+    archive.clear();
+    const auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < FRAMES; ++f)
+      encoder.encode(static_cast<uint32_t>(f), frames[f].data(), width,
+                     height, stride, &archive);
+    report(pool ? "encode, pool" : "encode", FRAMES, seconds_since(start),
+           archive.size(), raw);
+  }
+
+  FrameDecoder decoder;
+  bool exact = true;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t at = 0, f = 0; at < archive.size(); ++f)
+  {
+    FrameInfo info;
+    const size_t n = decoder.decode(&archive[at], archive.size() - at, &info);
+    if (!n)
+    {
+      exact = false;
+      break;
+    }
+    exact = exact && (decoder.frame() == frames[f]);
+    at += n;
+  }
+  report("decode", FRAMES, seconds_since(start), archive.size(), raw);
+  if (!exact)
+    std::printf("  decoded frames differ!\n");
+
+  // a few frames are enough for these
+  constexpr int IMAGES = 8;
+  for (const ImageFormat format : { ImageFormat::QOI, ImageFormat::PNG })
+  {
+    std::vector<uint8_t> encoded;
+    size_t bytes = 0;
+    start = std::chrono::steady_clock::now();
+    for (int f = 0; f < IMAGES; ++f)
+    {
+      encoded.clear();
+      encode_image(format, frames[f].data(), width, height, stride, 4,
+                   &encoded);
+      bytes += encoded.size();
+    }
+    report(format == ImageFormat::QOI ? "qoi" : "png", IMAGES,
+           seconds_since(start), bytes, raw);
+  }
+}
+
+}  // unnamed namespace
+
+int main()
+{
+  JobSystem jobs;
+  std::printf("%u threads in the pool\n", jobs.thread_count());
+  run(jobs, 1920, 1080);
+  run(jobs, 3840, 2160);
+}
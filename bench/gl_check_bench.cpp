@@ -0,0 +1,76 @@
+// Cost of GL_CHECK over a bare GL call, through a fake entry point so only
+// the wrapper is measured: Release's GL_CHECK must cost nothing, and debug
+// builds' check costs a glGetError a call (here a fake one; a real one waits
+// on the driver).
+
+// GL_CHECK as Release builds it, whatever this is built as
+#define PROTO3D_GL_CHECK 0
+
+#include "util.h"
+
+#include "glad/glad.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+namespace {
+
+constexpr int CALLS = 20000000;
+constexpr int RUNS = 5;
+
+volatile GLuint bound = 0;
+
+extern "C" void APIENTRY fake_bind_buffer(GLenum, GLuint buffer)
+{
+  bound = buffer;
+}
+
+extern "C" GLenum APIENTRY fake_get_error()
+{
+  return GL_NO_ERROR;
+}
+
+// fastest of RUNS, in ns a call
+template <typename Loop>
+double time_calls(Loop loop)
+{
+  double best = 1e30;
+  for (int r = 0; r < RUNS; ++r)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    loop();
+    const auto end = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double, std::nano>(
+                            end - start).count() / CALLS);
+  }
+  return best;
+}
+
+}  // unnamed namespace
+
+int main()
+{
+  glad_glBindBuffer = fake_bind_buffer;
+  glad_glGetError = fake_get_error;
+
+  const double bare = time_calls([] {
+    for (int i = 0; i < CALLS; ++i)
+      glBindBuffer(GL_ARRAY_BUFFER, static_cast<GLuint>(i));
+  });
+  const double release = time_calls([] {
+    for (int i = 0; i < CALLS; ++i)
+      GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, static_cast<GLuint>(i)));
+  });
+  const double debug = time_calls([] {
+    for (int i = 0; i < CALLS; ++i)
+      gl_checked([i] { glBindBuffer(GL_ARRAY_BUFFER, static_cast<GLuint>(i)); },
+                 "glBindBuffer", __FILE__, __LINE__);
+  });
+
+  std::printf("%d calls, best of %d\n", CALLS, RUNS);
+  std::printf("bare call:        %6.2f ns\n", bare);
+  std::printf("GL_CHECK release: %6.2f ns (%+.1f%%)\n", release,
+              100.0 * (release - bare) / bare);
+  std::printf("GL_CHECK debug:   %6.2f ns, fake glGetError\n", debug);
+}
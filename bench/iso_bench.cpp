@@ -0,0 +1,125 @@
+// Checks that marching cubes output is a closed two-manifold inside the
+// volume, for a sphere and for fractal noise fields full of ambiguous cells,
+// then times extraction of a 256^3 noise field; exits non-zero on any
+// defect.  Every directed edge must be used once, by one triangle, and its
+// reverse by another, unless both ends lie on the volume's boundary.
+
+#include "isosurface.h"
+#include "jobs.h"
+#include "noise.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+constexpr int CHECK_GRID = 96;
+constexpr int TIME_GRID = 256;
+
+bool on_boundary(const VolumeInfo &volume, const glm::vec3 &p)
+{
+  const glm::vec3 q = (p - volume.origin) / volume.spacing;
+  for (int a = 0; a < 3; ++a)
+  {
+    const float last = static_cast<float>(volume.dims[a] - 1);
+    if ((q[a] <= 0.0f) || (q[a] >= last))
+      return true;
+  }
+  return false;
+}
+
+// prints what's wrong; true when nothing is
+bool check_manifold(const char *name, const VolumeInfo &volume,
+                    const IsoMesh &mesh)
+{
+  auto key = [](uint32_t a, uint32_t b) {
+    return (static_cast<uint64_t>(a) << 32) | b;
+  };
+  std::unordered_map<uint64_t, uint32_t> uses;
+  size_t degenerate = 0;
+  for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+  {
+    const uint32_t *t = &mesh.indices[i];
+    if ((t[0] == t[1]) || (t[1] == t[2]) || (t[2] == t[0]))
+      ++degenerate;
+    for (int k = 0; k < 3; ++k)
+      ++uses[key(t[k], t[(k + 1) % 3])];
+  }
+  size_t repeated = 0, open = 0;
+  for (const auto &use : uses)
+  {
+    const auto a = static_cast<uint32_t>(use.first >> 32);
+    const auto b = static_cast<uint32_t>(use.first);
+    if (use.second > 1)
+      ++repeated;
+    if (!uses.count(key(b, a)) &&
+        !(on_boundary(volume, mesh.positions[a]) &&
+          on_boundary(volume, mesh.positions[b])))
+      ++open;
+  }
+  std::printf("%-10s %8zu vertices %8zu triangles: %zu repeated edges, "
+              "%zu open edges, %zu degenerate triangles\n", name,
+              mesh.positions.size(), mesh.indices.size() / 3, repeated, open,
+              degenerate);
+  return !repeated && !open && !degenerate;
+}
+
+}  // unnamed namespace
+
+int main()
+{
+  JobSystem jobs;
+  VolumeInfo volume;
+  volume.dims = glm::ivec3(CHECK_GRID);
+  const size_t points = static_cast<size_t>(CHECK_GRID) * CHECK_GRID *
+                        CHECK_GRID;
+  std::vector<float> values(points);
+  IsoMesh mesh;
+  bool ok = true;
+
+  const float centre = 0.5f * static_cast<float>(CHECK_GRID - 1);
+  for (int z = 0, i = 0; z < CHECK_GRID; ++z)
+    for (int y = 0; y < CHECK_GRID; ++y)
+      for (int x = 0; x < CHECK_GRID; ++x, ++i)
+        values[static_cast<size_t>(i)] = glm::length(
+          glm::vec3(static_cast<float>(x), static_cast<float>(y),
+                    static_cast<float>(z)) - glm::vec3(centre)) - 30.0f;
+  extract_isosurface(jobs, volume, values.data(), 0.0f, &mesh);
+  ok &= check_manifold("sphere", volume, mesh);
+
+  // high frequencies leave many cells with ambiguous faces
+  const float frequencies[] = { 0.05f, 0.2f, 0.45f };
+  for (const float frequency : frequencies)
+  {
+    NoiseSettings settings;
+    settings.frequency = frequency;
+    fill_noise_grid(jobs, settings, volume.dims, glm::vec3(0.0f), 1.0f,
+                    values.data());
+    extract_isosurface(jobs, volume, values.data(), 0.0f, &mesh);
+    char name[32];
+    std::snprintf(name, sizeof(name), "noise %.2f",
+                  static_cast<double>(frequency));
+    ok &= check_manifold(name, volume, mesh);
+  }
+
+  volume.dims = glm::ivec3(TIME_GRID);
+  values.resize(static_cast<size_t>(TIME_GRID) * TIME_GRID * TIME_GRID);
+  NoiseSettings settings;
+  settings.frequency = 0.02f;
+  fill_noise_grid(jobs, settings, volume.dims, glm::vec3(0.0f), 1.0f,
+                  values.data());
+  const auto start = std::chrono::steady_clock::now();
+  extract_isosurface(jobs, volume, values.data(), 0.0f, &mesh);
+  const double s = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start).count();
+  std::printf("%d^3 noise: %zu triangles in %.1f ms on %u threads\n",
+              TIME_GRID, mesh.indices.size() / 3, s * 1e3,
+              jobs.thread_count());
+  if (!ok)
+    std::printf("isosurface is not a closed manifold\n");
+  return ok ? 0 : 1;
+}
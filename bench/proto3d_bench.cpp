@@ -0,0 +1,1396 @@
+// Replays canned scenes along scripted camera and input paths for a fixed
+// number of frames, offscreen in a hidden window, and writes CPU and GPU
+// frame times, draw calls, triangles, texture binds and memory peaks as JSON,
+// with every frame's samples so runs can be compared statistically.
+//
+// Runs are deterministic: time advances a fixed step a frame and all
+// streaming jobs a frame starts are finished before the next, so every run
+// draws the same frames.  For comparable numbers across machines use a
+// software rasteriser, e.g. LIBGL_ALWAYS_SOFTWARE=1 for Mesa's llvmpipe.
+//
+//   proto3d-bench [--frames N] [--warmup N] [--threads N] [--size WxH]
+//                 [--scene NAME]... [--path NAME=FILE]... [--out FILE]
+//                 [--capture DIR] [--capture-format png|qoi|p3df]
+//                 [--golden DIR] [--update-golden DIR] [--min-ssim X]
+//                 [--max-error X] [--farm N] [--uploads sync|thread]
+//                 [--debug-lines on|off]
+//
+// Path files hold one keyframe or input event a line, times in seconds:
+//
+//   cam  T  X Y Z  YAW PITCH     camera position, yaw and pitch in degrees
+//   act  T  NAME                 scene action, e.g. dig or burst
+//
+// Positions are Catmull-Rom interpolated between keyframes; paths loop.
+//
+// --capture writes every measured frame to DIR/SCENE_NNNNN.png (or .qoi), an
+// existing directory, through the capture ring the app uses; captures are
+// issued outside the timed part of a frame.  p3df writes each scene to one
+// frame archive, DIR/SCENE.p3df, instead.
+//
+// --golden compares each scene's last frame with DIR/SCENE.png and exits 1 if
+// any strays past the tolerances (see image_compare.h): SSIM below
+// --min-ssim, or a mean colour error above --max-error.  A failing scene gets
+// DIR/SCENE.actual.png and a heatmap of the error, DIR/SCENE.diff.png.
+// Comparisons run on the job pool while the next scene renders; a short run,
+// e.g. --frames 30 --warmup 0, is enough; its timings are skewed by the
+// comparisons.  --update-golden writes the frames as the new golden images
+// instead.
+//
+// --farm renders the measured frames of each --scene offline into --capture,
+// on N worker processes, each a copy of this one with its own context (see
+// render_farm.h); nothing is timed.  Workers encode their frames themselves;
+// an archive's are put in order at the end.  A worker handed frames from the
+// middle of a path first draws the ones before, without reading them back,
+// so scenes that stream or simulate reach the same state as in one run.
+//
+// --uploads thread uploads voxel meshes on a GlUploader's thread instead of
+// through the staging ring (see gl_uploader.h).  Frames still settle with
+// every upload published, so they draw the same as sync's.
+//
+// --debug-lines on outlines every voxel chunk drawn through debug_draw.h, in
+// debug builds; it changes both the timings and the frames.
+
+#include "debug_draw.h"
+#include "frame_capture.h"
+#include "frame_codec.h"
+#include "gl_uploader.h"
+#include "image_compare.h"
+#include "image_write.h"
+#include "jobs.h"
+#include "noise.h"
+#include "particles.h"
+#include "perf.h"
+#include "render_farm.h"
+#include "shader.h"
+#include "terrain.h"
+#include "text.h"
+#include "texture_atlas.h"
+#include "voxel.h"
+
+#include "glad/glad.h"
+#include <GLFW/glfw3.h>
+#include "stb_image.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+constexpr float DT = 1.0f / 60.0f;
+constexpr int GPU_QUERIES = 4;
+
+struct CameraKey
+{
+  float t;
+  glm::vec3 position;
+  float yaw, pitch;
+};
+
+struct Action
+{
+  float t;
+  std::string name;
+};
+
+struct Path
+{
+  std::vector<CameraKey> keys;
+  std::vector<Action> actions;
+};
+
+struct Camera
+{
+  glm::vec3 position;
+  glm::vec3 forward;
+};
+
+// A canned scene; update gets the frame's camera and is followed by draw,
+// both timed.  settle then waits for the streaming jobs the frame started,
+// untimed, so they are in by the next frame however long they took.
+struct Scene
+{
+  std::string name;
+  const char *path;
+  std::function<bool()> init_gl;
+  std::function<void(const Camera&)> update;
+  std::function<void(const glm::mat4 &view, const glm::mat4 &proj)> draw;
+  std::function<void()> settle;
+  std::function<void(const std::string &action, const Camera&)> act;
+  std::function<size_t()> memory_bytes;
+};
+
+struct Options
+{
+  int frames = 600;
+  int warmup = 60;
+  unsigned threads = 0;
+  int width = 1280;
+  int height = 720;
+  std::vector<std::string> scenes;
+  std::vector<std::pair<std::string, std::string>> paths;
+  const char *out = nullptr;
+  const char *capture = nullptr;
+  ImageFormat capture_format = ImageFormat::PNG;
+  bool capture_archive = false;
+  const char *golden = nullptr;
+  bool update_golden = false;
+  ImageTolerance tolerance;
+  unsigned farm = 0;
+  int farm_socket = -1;  // set in the farm's workers
+  bool upload_thread = false;
+  bool debug_lines = false;
+};
+
+struct Samples
+{
+  std::vector<double> cpu_ms;
+  std::vector<double> gpu_ms;
+  std::vector<uint64_t> draw_calls;
+  std::vector<uint64_t> triangles;
+  std::vector<uint64_t> texture_binds;
+  size_t memory_peak = 0;
+};
+
+const char VOXEL_PATH[] = R"(
+cam  0    0 40   0    0 -25
+cam  4   60 36  40   60 -20
+cam  8  120 44  10  120 -30
+cam 12   60 40 -50  220 -20
+cam 16    0 40   0  360 -25
+act  5 dig
+act 11 build
+)";
+
+const char TERRAIN_PATH[] = R"(
+cam  0     0 120    0    0 -15
+cam  5   600 150  300   45 -10
+cam 10  1400 300  200   90 -25
+cam 15  2000 120 -400  160 -10
+cam 20     0 120    0  360 -15
+)";
+
+const char PARTICLE_PATH[] = R"(
+cam 0   0 3 12    0 -10
+cam 4  10 5  8   50 -15
+cam 8   0 3 12    0 -10
+act 1 burst
+act 3 burst
+act 5 burst
+)";
+
+const char TEXT_PATH[] = R"(
+cam 0  0 0 0  0 0
+cam 1  0 0 0  0 0
+)";
+
+bool parse_path(const char *text, Path *path)
+{
+  path->keys.clear();
+  path->actions.clear();
+  int line_number = 0;
+  while (*text)
+  {
+    const char *end = std::strchr(text, '\n');
+    const size_t length = end ? static_cast<size_t>(end - text)
+                              : std::strlen(text);
+    const std::string line(text, length);
+    text += length + (end ? 1 : 0);
+    ++line_number;
+
+    char kind[8] = {}, name[64] = {};
+    CameraKey key;
+    Action action;
+    if ((std::sscanf(line.c_str(), " %7s", kind) != 1) || (kind[0] == '#'))
+      continue;
+    if (!std::strcmp(kind, "cam") &&
+        (std::sscanf(line.c_str(), " cam %f %f %f %f %f %f", &key.t,
+                     &key.position.x, &key.position.y, &key.position.z,
+                     &key.yaw, &key.pitch) == 6))
+    {
+      if (!path->keys.empty() && (key.t <= path->keys.back().t))
+      {
+        std::fprintf(stderr, "line %d: keyframe times must increase\n",
+                     line_number);
+        return false;
+      }
+      path->keys.push_back(key);
+    }
+    else if (!std::strcmp(kind, "act") &&
+             (std::sscanf(line.c_str(), " act %f %63s", &action.t,
+                          name) == 2))
+    {
+      action.name = name;
+      path->actions.push_back(action);
+    }
+    else
+    {
+      std::fprintf(stderr, "line %d: can't parse '%s'\n", line_number,
+                   line.c_str());
+      return false;
+    }
+  }
+  if (path->keys.size() < 2)
+  {
+    std::fprintf(stderr, "a path needs at least two keyframes\n");
+    return false;
+  }
+  std::stable_sort(path->actions.begin(), path->actions.end(),
+                   [](const Action &a, const Action &b) { return a.t < b.t; });
+  return true;
+}
+
+bool load_path(const std::string &file, Path *path)
+{
+  FILE *f = std::fopen(file.c_str(), "rb");
+  if (!f)
+  {
+    std::fprintf(stderr, "Unable to open %s\n", file.c_str());
+    return false;
+  }
+  std::string text;
+  char buffer[4096];
+  size_t n = 0;
+  while ((n = std::fread(buffer, 1, sizeof(buffer), f)) > 0)
+    text.append(buffer, n);
+  std::fclose(f);
+  return parse_path(text.c_str(), path);
+}
+
+glm::vec3 catmull_rom(const glm::vec3 &p0, const glm::vec3 &p1,
+                      const glm::vec3 &p2, const glm::vec3 &p3, float t)
+{
+  const float t2 = t * t, t3 = t2 * t;
+  return 0.5f * ((2.0f * p1) + (p2 - p0) * t +
+                 (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 +
+                 (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+}
+
+Camera sample_path(const Path &path, float t)
+{
+  const auto &keys = path.keys;
+  const float duration = keys.back().t - keys.front().t;
+  t = keys.front().t + std::fmod(t, duration);
+  size_t i = 0;
+  while ((i + 2 < keys.size()) && (keys[i + 1].t <= t))
+    ++i;
+  const CameraKey &a = keys[i], &b = keys[i + 1];
+  const float u = std::min((t - a.t) / (b.t - a.t), 1.0f);
+  const glm::vec3 &before = keys[i ? i - 1 : i].position;
+  const glm::vec3 &after = keys[std::min(i + 2, keys.size() - 1)].position;
+
+  const float yaw = glm::radians(a.yaw + (b.yaw - a.yaw) * u);
+  const float pitch = glm::radians(a.pitch + (b.pitch - a.pitch) * u);
+  Camera camera;
+  camera.position = catmull_rom(before, a.position, b.position, after, u);
+  camera.forward = glm::vec3(std::cos(pitch) * std::sin(yaw), std::sin(pitch),
+                             -std::cos(pitch) * std::cos(yaw));
+  return camera;
+}
+
+// uploader, when running, takes the meshes
+Scene voxel_scene(JobSystem &jobs, GlUploader *uploader, bool debug_lines)
+{
+  auto world = std::make_shared<VoxelWorld>(jobs, generate_hills, 4);
+  world->set_uploader(uploader);
+  world->draw_bounds = debug_lines;
+  Scene scene;
+  scene.name = "voxels";
+  scene.path = VOXEL_PATH;
+  scene.init_gl = [world]() { return world->init_gl(); };
+  scene.update = [world, uploader](const Camera &camera) {
+    uploader->publish();
+    world->update(camera.position);
+  };
+  scene.draw = [world](const glm::mat4 &view, const glm::mat4 &proj) {
+    world->draw(proj * view);
+  };
+  scene.settle = [world, uploader]() {
+    world->wait_idle();
+    while (uploader->in_flight())
+      if (!uploader->publish())
+        std::this_thread::yield();
+  };
+  // a 5x5x5 crater or block under the camera
+  scene.act = [world](const std::string &action, const Camera &camera) {
+    const BlockId id = (action == "build") ? 1 : 0;
+    const glm::ivec3 below(static_cast<int>(std::floor(camera.position.x)),
+                           16,
+                           static_cast<int>(std::floor(camera.position.z)));
+    for (int z = -2; z <= 2; ++z)
+      for (int y = -2; y <= 2; ++y)
+        for (int x = -2; x <= 2; ++x)
+          world->set_block(below + glm::ivec3(x, y, z), id);
+  };
+  scene.memory_bytes = [world]() { return world->mesh_bytes(); };
+  return scene;
+}
+
+Scene terrain_scene(JobSystem &jobs)
+{
+  NoiseSettings settings;
+  settings.octaves = 6;
+  settings.frequency = 0.002f;
+  TileLoader loader = [&jobs, settings](int level, const glm::ivec2 &tile,
+                                        float *heights) {
+    const float step = static_cast<float>(1 << level);
+    const glm::vec3 origin(glm::vec2(tile * TILE_SIZE) * step, 0.0f);
+    fill_noise_grid(jobs, settings, glm::ivec3(TILE_SIZE, TILE_SIZE, 1),
+                    origin, step, heights);
+    for (int i = 0; i < TILE_SIZE * TILE_SIZE; ++i)
+      heights[i] = 60.0f + 60.0f * heights[i];
+    return true;
+  };
+  auto terrain = std::make_shared<ClipmapTerrain>(jobs, loader, 6, 1.0f);
+  Scene scene;
+  scene.name = "terrain";
+  scene.path = TERRAIN_PATH;
+  scene.init_gl = [terrain]() { return terrain->init_gl(); };
+  scene.update = [terrain](const Camera &camera) {
+    terrain->update(camera.position);
+  };
+  scene.draw = [terrain](const glm::mat4 &view, const glm::mat4 &proj) {
+    terrain->draw(proj * view);
+  };
+  scene.settle = [terrain]() { terrain->wait_idle(); };
+  scene.act = [](const std::string&, const Camera&) { };
+  scene.memory_bytes = [terrain]() { return terrain->memory_bytes(); };
+  return scene;
+}
+
+Scene particle_scene(JobSystem &jobs)
+{
+  constexpr size_t CAPACITY = 1 << 18;
+  struct State
+  {
+    ParticleSystem particles{CAPACITY};
+    ParticleRenderer renderer;
+    ParticleEmitter emitter;
+    ~State() { renderer.destroy(); }
+  };
+  auto state = std::make_shared<State>();
+  state->particles.add_plane(ParticlePlane{});
+  state->emitter.position = glm::vec3(0.0f, 0.5f, 0.0f);
+  state->emitter.speed_min = 4.0f;
+  state->emitter.speed_max = 8.0f;
+  state->emitter.size = 0.05f;
+
+  Scene scene;
+  scene.name = "particles";
+  scene.path = PARTICLE_PATH;
+  scene.init_gl = [state]() { return state->renderer.init(CAPACITY); };
+  scene.update = [state, &jobs](const Camera&) {
+    state->particles.emit(state->emitter, 2000);
+    state->particles.update(jobs, DT);
+  };
+  scene.draw = [state, &jobs](const glm::mat4 &view, const glm::mat4 &proj) {
+    state->renderer.draw(jobs, state->particles, view, proj);
+  };
+  scene.settle = []() { };
+  scene.act = [state](const std::string &action, const Camera&) {
+    if (action == "burst")
+      state->particles.emit(state->emitter, 50000);
+  };
+  scene.memory_bytes = [state]() {
+    return state->particles.capacity() * 9 * sizeof(float);
+  };
+  return scene;
+}
+
+// A HUD's worth of screen text, a tenth of it changing every frame.
+Scene text_scene(const Options &options)
+{
+  struct State
+  {
+    TextBatch batch;
+    TextRenderer renderer;
+    int frame = 0;
+  };
+  auto state = std::make_shared<State>();
+  const int width = options.width, height = options.height;
+
+  Scene scene;
+  scene.name = "text";
+  scene.path = TEXT_PATH;
+  scene.init_gl = [state]() { return state->renderer.init_gl(); };
+  scene.update = [state](const Camera&) {
+    char line[64];
+    for (int i = 0; i < 200; ++i)
+    {
+      const int n = std::snprintf(line, sizeof(line),
+                                  "%-12s %8d draws %10.3f ms  %8x", "pass",
+                                  (i < 20) ? state->frame : i * 37, i * 0.125,
+                                  i * 2654435761u);
+      state->batch.add(line, static_cast<size_t>(n),
+                       glm::vec2(8.0f, 3.5f * static_cast<float>(i)),
+                       0xffffffffu, 12);
+    }
+    ++state->frame;
+  };
+  scene.draw = [state, width, height](const glm::mat4&, const glm::mat4&) {
+    state->renderer.draw(state->batch, width, height);
+  };
+  scene.settle = []() { };
+  scene.act = [](const std::string&, const Camera&) { };
+  scene.memory_bytes = []() {
+    return size_t(GlyphAtlas::SIZE) * GlyphAtlas::SIZE;
+  };
+  return scene;
+}
+
+// Many small textured quads over the screen, in an order that keeps changing
+// texture: with its own texture each, a bind and a draw a change; packed into
+// one array atlas, one of each for them all.
+Scene sprite_scene(const Options &options, bool atlas)
+{
+  constexpr int TEXTURES = 256;
+  constexpr size_t SPRITES = 8192;
+  constexpr GLuint UNSET = ~0u;
+  struct Sprite
+  {
+    float rect[4];  // x, y, width, height in pixels
+    float uv[4];    // uv * xy + zw
+    float layer;
+  };
+  struct State
+  {
+    std::vector<AtlasImage> images;
+    std::vector<GLuint> textures;
+    TextureAtlas atlas;
+    std::vector<Sprite> sprites;
+    std::vector<GLuint> sprite_textures;
+    GLuint program = 0, vao = 0, vbo = 0;
+    GLint viewport = -1;
+    size_t texture_bytes = 0;
+    ~State()
+    {
+      glDeleteTextures(static_cast<GLsizei>(textures.size()),
+                       textures.data());
+      glDeleteBuffers(1, &vbo);
+      glDeleteVertexArrays(1, &vao);
+      glDeleteProgram(program);
+    }
+  };
+  auto state = std::make_shared<State>();
+  const int width = options.width, height = options.height;
+
+  // 8 to 64 texels a side, each a two-colour checker of its own
+  for (int i = 0; i < TEXTURES; ++i)
+  {
+    AtlasImage image;
+    image.name = std::to_string(i);
+    image.width = 8 * (1 + i % 8);
+    image.height = 8 * (1 + (i / 8) % 8);
+    const uint32_t colour = static_cast<uint32_t>(i) * 2654435761u;
+    for (int y = 0; y < image.height; ++y)
+      for (int x = 0; x < image.width; ++x)
+      {
+        const int shift = ((x / 4 + y / 4) % 2) ? 0 : 8;
+        image.rgba.push_back(static_cast<uint8_t>(colour >> shift));
+        image.rgba.push_back(static_cast<uint8_t>(colour >> (shift + 8)));
+        image.rgba.push_back(static_cast<uint8_t>(colour >> (shift + 16)));
+        image.rgba.push_back(255);
+      }
+    state->texture_bytes += image.rgba.size();
+    state->images.push_back(std::move(image));
+  }
+
+  static const char VERTEX[] = R"(#version 330 core
+layout(location = 0) in vec4 a_rect;
+layout(location = 1) in vec4 a_uv;
+layout(location = 2) in float a_layer;
+uniform vec2 u_viewport;
+out vec3 v_uv;
+void main()
+{
+  vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+  vec2 p = a_rect.xy + corner * a_rect.zw;
+  gl_Position = vec4(p / u_viewport * 2.0 - 1.0, 0.0, 1.0);
+  v_uv = vec3(corner * a_uv.xy + a_uv.zw, a_layer);
+}
+)";
+  static const char FRAGMENT[] = R"(
+in vec3 v_uv;
+out vec4 frag_color;
+void main()
+{
+#ifdef ATLAS
+  frag_color = texture(u_texture, v_uv);
+#else
+  frag_color = texture(u_texture, v_uv.xy);
+#endif
+}
+)";
+
+  Scene scene;
+  scene.name = atlas ? "sprites-atlas" : "sprites";
+  scene.path = TEXT_PATH;
+  scene.init_gl = [state, atlas, width, height]() {
+    std::string fs = "#version 330 core\n";
+    fs += atlas ? "#define ATLAS\nuniform sampler2DArray u_texture;\n"
+                : "uniform sampler2D u_texture;\n";
+    fs += FRAGMENT;
+    state->program = compile_program("sprites", VERTEX, fs.c_str());
+    if (!state->program)
+      return false;
+    state->viewport = glGetUniformLocation(state->program, "u_viewport");
+
+    std::vector<GLuint> by_image;
+    std::vector<glm::vec4> uv(TEXTURES, glm::vec4(1.0f, 1.0f, 0.0f, 0.0f));
+    std::vector<float> layer(TEXTURES, 0.0f);
+    if (atlas)
+    {
+      AtlasLayout layout;
+      if (!pack_atlas(AtlasSettings{}, state->images, &layout) ||
+          !state->atlas.load(std::move(layout), GL_TEXTURE_2D_ARRAY))
+        return false;
+      for (int i = 0; i < TEXTURES; ++i)
+      {
+        const AtlasEntry *entry = state->atlas.find(std::to_string(i));
+        uv[static_cast<size_t>(i)] = state->atlas.uv_transform(*entry);
+        layer[static_cast<size_t>(i)] = static_cast<float>(entry->page);
+      }
+      by_image.assign(TEXTURES, state->atlas.texture(0));
+    }
+    else
+    {
+      state->textures.resize(TEXTURES);
+      glGenTextures(TEXTURES, state->textures.data());
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+      for (int i = 0; i < TEXTURES; ++i)
+      {
+        const AtlasImage &image = state->images[static_cast<size_t>(i)];
+        glBindTexture(GL_TEXTURE_2D, state->textures[static_cast<size_t>(i)]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image.width, image.height, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, image.rgba.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                        GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glGenerateMipmap(GL_TEXTURE_2D);
+      }
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+      glBindTexture(GL_TEXTURE_2D, 0);
+      by_image = state->textures;
+    }
+    state->images.clear();
+
+    // the same layout both ways
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::uniform_int_distribution<int> image(0, TEXTURES - 1);
+    for (size_t s = 0; s < SPRITES; ++s)
+    {
+      const auto i = static_cast<size_t>(image(rng));
+      const float size = 16.0f + 32.0f * unit(rng);
+      Sprite sprite;
+      sprite.rect[0] = unit(rng) * (static_cast<float>(width) - size);
+      sprite.rect[1] = unit(rng) * (static_cast<float>(height) - size);
+      sprite.rect[2] = sprite.rect[3] = size;
+      for (int c = 0; c < 4; ++c)
+        sprite.uv[c] = uv[i][c];
+      sprite.layer = layer[i];
+      state->sprites.push_back(sprite);
+      state->sprite_textures.push_back(by_image[i]);
+    }
+
+    glGenVertexArrays(1, &state->vao);
+    glGenBuffers(1, &state->vbo);
+    glBindVertexArray(state->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, state->vbo);
+    glBufferData(GL_ARRAY_BUFFER,
+                 static_cast<GLsizeiptr>(SPRITES * sizeof(Sprite)),
+                 state->sprites.data(), GL_STATIC_DRAW);
+    for (GLuint a = 0; a < 3; ++a)
+    {
+      glEnableVertexAttribArray(a);
+      glVertexAttribDivisor(a, 1);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return true;
+  };
+  scene.update = [](const Camera&) { };
+  scene.draw = [state, width, height](const glm::mat4&, const glm::mat4&) {
+    glUseProgram(state->program);
+    glUniform2f(state->viewport, static_cast<float>(width),
+                static_cast<float>(height));
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(state->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, state->vbo);
+    const GLenum target = state->textures.empty() ? GL_TEXTURE_2D_ARRAY
+                                                  : GL_TEXTURE_2D;
+    GLuint bound = UNSET;
+    // a draw for each run of sprites sharing a texture; without base
+    // instances in GL 3.3 the attributes move to the run's first sprite
+    for (size_t first = 0; first < SPRITES;)
+    {
+      const GLuint texture = state->sprite_textures[first];
+      size_t end = first + 1;
+      while ((end < SPRITES) && (state->sprite_textures[end] == texture))
+        ++end;
+      if (texture != bound)
+      {
+        glBindTexture(target, texture);
+        perf_count(PerfCounter::TEXTURE_BINDS);
+        bound = texture;
+      }
+      constexpr auto stride = static_cast<GLsizei>(sizeof(Sprite));
+      const size_t base = first * sizeof(Sprite);
+      glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride,
+                            reinterpret_cast<const void*>(
+                              base + offsetof(Sprite, rect)));
+      glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride,
+                            reinterpret_cast<const void*>(
+                              base + offsetof(Sprite, uv)));
+      glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, stride,
+                            reinterpret_cast<const void*>(
+                              base + offsetof(Sprite, layer)));
+      glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4,
+                            static_cast<GLsizei>(end - first));
+      perf_count(PerfCounter::DRAW_CALLS);
+      perf_count(PerfCounter::TRIANGLES,
+                 2 * static_cast<uint64_t>(end - first));
+      first = end;
+    }
+    glBindTexture(target, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+  };
+  scene.settle = []() { };
+  scene.act = [](const std::string&, const Camera&) { };
+  scene.memory_bytes = [state]() { return state->texture_bytes; };
+  return scene;
+}
+
+size_t peak_rss_bytes()
+{
+#if defined(__unix__) || defined(__APPLE__)
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#  ifdef __APPLE__
+  return static_cast<size_t>(usage.ru_maxrss);
+#  else
+  return static_cast<size_t>(usage.ru_maxrss) * 1024u;
+#  endif
+#else
+  return 0;
+#endif
+}
+
+// Time elapsed queries in a ring; a result is read, waiting if need be, when
+// its query comes round again or at the end of the run.
+class GpuTimer
+{
+public:
+  GpuTimer() { glGenQueries(GPU_QUERIES, queries_); }
+  ~GpuTimer() { glDeleteQueries(GPU_QUERIES, queries_); }
+
+  void begin(std::vector<double> *out)
+  {
+    if (pending_[next_])
+      read(next_, out);
+    glBeginQuery(GL_TIME_ELAPSED, queries_[next_]);
+  }
+
+  void end(bool record)
+  {
+    glEndQuery(GL_TIME_ELAPSED);
+    pending_[next_] = true;
+    record_[next_] = record;
+    next_ = (next_ + 1) % GPU_QUERIES;
+  }
+
+  void finish(std::vector<double> *out)
+  {
+    for (int i = 0; i < GPU_QUERIES; ++i)
+    {
+      const int q = (next_ + i) % GPU_QUERIES;
+      if (pending_[q])
+        read(q, out);
+    }
+  }
+
+private:
+  void read(int q, std::vector<double> *out)
+  {
+    GLuint64 ns = 0;
+    glGetQueryObjectui64v(queries_[q], GL_QUERY_RESULT, &ns);
+    if (record_[q])
+      out->push_back(static_cast<double>(ns) * 1e-6);
+    pending_[q] = false;
+  }
+
+  GLuint queries_[GPU_QUERIES] = {};
+  bool pending_[GPU_QUERIES] = {};
+  bool record_[GPU_QUERIES] = {};
+  int next_ = 0;
+};
+
+glm::mat4 projection(const Options &options)
+{
+  return glm::perspective(
+    glm::radians(60.0f),
+    static_cast<float>(options.width) / static_cast<float>(options.height),
+    0.1f, 4000.0f);
+}
+
+// Frame f of a scene: its actions, update and draw; next_action carries
+// over from frame to frame.
+void draw_frame(Scene &scene, const Path &path, const glm::mat4 &proj, int f,
+                size_t *next_action)
+{
+  const float t = static_cast<float>(f) * DT;
+  const Camera camera = sample_path(path, t);
+  const glm::mat4 view = glm::lookAt(camera.position,
+                                     camera.position + camera.forward,
+                                     glm::vec3(0.0f, 1.0f, 0.0f));
+  // actions fire once each time round the loop
+  const float loop_t = std::fmod(t, path.keys.back().t - path.keys.front().t);
+  if (loop_t < DT)
+    *next_action = 0;
+  while ((*next_action < path.actions.size()) &&
+         (path.actions[*next_action].t <= loop_t))
+    scene.act(path.actions[(*next_action)++].name, camera);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  scene.update(camera);
+  scene.draw(view, proj);
+  debug_draw_flush(proj * view);
+}
+
+bool run_scene(Scene &scene, const Path &path, const Options &options,
+               FrameCapture *capture, Samples *samples)
+{
+  if (!scene.init_gl())
+  {
+    std::fprintf(stderr, "Unable to set up scene %s\n", scene.name.c_str());
+    return false;
+  }
+  const glm::mat4 proj = projection(options);
+
+  GpuTimer timer;
+  size_t next_action = 0;
+  const int total = options.warmup + options.frames;
+  for (int f = 0; f < total; ++f)
+  {
+    const bool record = (f >= options.warmup);
+    timer.begin(&samples->gpu_ms);
+    const auto start = std::chrono::steady_clock::now();
+    draw_frame(scene, path, proj, f, &next_action);
+    const auto end = std::chrono::steady_clock::now();
+    timer.end(record);
+    scene.settle();
+    if (record && capture)
+      capture->capture(options.width, options.height);
+    glFlush();
+
+    const uint64_t draws = perf_take(PerfCounter::DRAW_CALLS);
+    const uint64_t triangles = perf_take(PerfCounter::TRIANGLES);
+    const uint64_t binds = perf_take(PerfCounter::TEXTURE_BINDS);
+    if (!record)
+      continue;
+    samples->cpu_ms.push_back(
+      std::chrono::duration<double, std::milli>(end - start).count());
+    samples->draw_calls.push_back(draws);
+    samples->triangles.push_back(triangles);
+    samples->texture_binds.push_back(binds);
+    samples->memory_peak = std::max(samples->memory_peak,
+                                    scene.memory_bytes());
+  }
+  timer.finish(&samples->gpu_ms);
+  glFinish();
+  return true;
+}
+
+// of values sorted ascending; 0 for none
+template <typename T>
+double percentile(const std::vector<T> &sorted, size_t percent)
+{
+  return sorted.empty() ? 0.0 : static_cast<double>(
+    sorted[(sorted.size() - 1) * percent / 100]);
+}
+
+template <typename T>
+void write_summary(FILE *out, const char *name, std::vector<T> values)
+{
+  std::sort(values.begin(), values.end());
+  double sum = 0.0;
+  for (const T v : values)
+    sum += static_cast<double>(v);
+  const size_t n = values.size();
+  auto at = [&values](size_t percent) { return percentile(values, percent); };
+  std::fprintf(out, "      \"%s\": { \"mean\": %.4f, \"p50\": %.4f, "
+               "\"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n", name,
+               n ? sum / static_cast<double>(n) : 0.0, at(50), at(90), at(99),
+               n ? static_cast<double>(values.back()) : 0.0);
+}
+
+void write_samples(FILE *out, const char *name, const std::vector<double> &v,
+                   bool last)
+{
+  std::fprintf(out, "        \"%s\": [", name);
+  for (size_t i = 0; i < v.size(); ++i)
+    std::fprintf(out, "%s%.4f", i ? ", " : "", v[i]);
+  std::fprintf(out, "]%s\n", last ? "" : ",");
+}
+
+void write_samples(FILE *out, const char *name, const std::vector<uint64_t> &v,
+                   bool last)
+{
+  std::fprintf(out, "        \"%s\": [", name);
+  for (size_t i = 0; i < v.size(); ++i)
+    std::fprintf(out, "%s%llu", i ? ", " : "",
+                 static_cast<unsigned long long>(v[i]));
+  std::fprintf(out, "]%s\n", last ? "" : ",");
+}
+
+bool parse_options(int argc, char **argv, Options *options)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    const char *arg = argv[i];
+    const char *value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+    if (!value)
+    {
+      std::fprintf(stderr, "%s needs a value\n", arg);
+      return false;
+    }
+    ++i;
+    if (!std::strcmp(arg, "--frames"))
+      options->frames = std::max(1, std::atoi(value));
+    else if (!std::strcmp(arg, "--warmup"))
+      options->warmup = std::max(0, std::atoi(value));
+    else if (!std::strcmp(arg, "--threads"))
+      options->threads = static_cast<unsigned>(std::max(0, std::atoi(value)));
+    else if (!std::strcmp(arg, "--size"))
+    {
+      if ((std::sscanf(value, "%dx%d", &options->width,
+                       &options->height) != 2) ||
+          (options->width <= 0) || (options->height <= 0))
+      {
+        std::fprintf(stderr, "--size wants WxH\n");
+        return false;
+      }
+    }
+    else if (!std::strcmp(arg, "--scene"))
+      options->scenes.push_back(value);
+    else if (!std::strcmp(arg, "--path"))
+    {
+      const char *eq = std::strchr(value, '=');
+      if (!eq)
+      {
+        std::fprintf(stderr, "--path wants NAME=FILE\n");
+        return false;
+      }
+      options->paths.emplace_back(std::string(value, eq), eq + 1);
+    }
+    else if (!std::strcmp(arg, "--out"))
+      options->out = value;
+    else if (!std::strcmp(arg, "--capture"))
+      options->capture = value;
+    else if (!std::strcmp(arg, "--golden") ||
+             !std::strcmp(arg, "--update-golden"))
+    {
+      options->golden = value;
+      options->update_golden = !std::strcmp(arg, "--update-golden");
+    }
+    else if (!std::strcmp(arg, "--farm"))
+      options->farm = static_cast<unsigned>(std::max(0, std::atoi(value)));
+    else if (!std::strcmp(arg, "--farm-worker"))
+      options->farm_socket = std::atoi(value);
+    else if (!std::strcmp(arg, "--min-ssim"))
+      options->tolerance.min_ssim = std::atof(value);
+    else if (!std::strcmp(arg, "--max-error"))
+      options->tolerance.max_mean_error = std::atof(value);
+    else if (!std::strcmp(arg, "--debug-lines"))
+    {
+      options->debug_lines = !std::strcmp(value, "on");
+      if (!options->debug_lines && std::strcmp(value, "off"))
+      {
+        std::fprintf(stderr, "--debug-lines wants on or off\n");
+        return false;
+      }
+    }
+    else if (!std::strcmp(arg, "--uploads"))
+    {
+      options->upload_thread = !std::strcmp(value, "thread");
+      if (!options->upload_thread && std::strcmp(value, "sync"))
+      {
+        std::fprintf(stderr, "--uploads wants sync or thread\n");
+        return false;
+      }
+    }
+    else if (!std::strcmp(arg, "--capture-format"))
+    {
+      options->capture_archive = false;
+      if (!std::strcmp(value, "qoi"))
+        options->capture_format = ImageFormat::QOI;
+      else if (!std::strcmp(value, "png"))
+        options->capture_format = ImageFormat::PNG;
+      else if (!std::strcmp(value, FRAME_ARCHIVE_EXTENSION + 1))
+        options->capture_archive = true;
+      else
+      {
+        std::fprintf(stderr, "--capture-format wants png, qoi or p3df\n");
+        return false;
+      }
+    }
+    else
+    {
+      std::fprintf(stderr, "Unknown option %s\n", arg);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Colour and depth target of a fixed size, so the window's size (or lack of
+// one) never changes the work.
+struct Target
+{
+  GLuint fbo = 0, color = 0, depth = 0;
+
+  bool init(int width, int height)
+  {
+    glGenFramebuffers(1, &fbo);
+    glGenRenderbuffers(1, &color);
+    glGenRenderbuffers(1, &depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width,
+                          height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_RENDERBUFFER, color);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              GL_RENDERBUFFER, depth);
+    glViewport(0, 0, width, height);
+    return glCheckFramebufferStatus(GL_FRAMEBUFFER) ==
+           GL_FRAMEBUFFER_COMPLETE;
+  }
+
+  ~Target()
+  {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &color);
+    glDeleteRenderbuffers(1, &depth);
+  }
+};
+
+struct GoldenResult
+{
+  std::string scene;
+  ImageDiff diff;
+  const char *problem;  // why the frame couldn't be compared, if it couldn't
+  bool passed;
+};
+
+// The bound framebuffer's colour, rows top-down.
+std::vector<uint8_t> read_frame(int width, int height)
+{
+  const size_t row = static_cast<size_t>(width) * 4;
+  std::vector<uint8_t> bottom_up(row * static_cast<size_t>(height));
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE,
+               bottom_up.data());
+  std::vector<uint8_t> pixels(bottom_up.size());
+  for (int y = 0; y < height; ++y)
+    std::memcpy(&pixels[row * static_cast<size_t>(y)],
+                &bottom_up[row * static_cast<size_t>(height - 1 - y)], row);
+  return pixels;
+}
+
+bool write_png(const std::string &path, const std::vector<uint8_t> &rgba,
+               int width, int height)
+{
+  std::vector<uint8_t> png;
+  encode_png(rgba.data(), width, height, static_cast<ptrdiff_t>(width) * 4, 3,
+             &png);
+  return write_file(path.c_str(), png);
+}
+
+// Compares a scene's frame with its golden image, or replaces the image.
+void check_golden(const Options &options, std::vector<uint8_t> frame,
+                  JobSystem &jobs, GoldenResult *result)
+{
+  const std::string base = std::string(options.golden) + "/" + result->scene;
+  const int width = options.width, height = options.height;
+  result->passed = false;
+  if (options.update_golden)
+  {
+    result->problem = write_png(base + ".png", frame, width, height) ?
+                        nullptr : "unable to write the golden image";
+    result->passed = !result->problem;
+    return;
+  }
+
+  int w = 0, h = 0, channels = 0;
+  stbi_uc *golden = stbi_load((base + ".png").c_str(), &w, &h, &channels, 4);
+  if (!golden || (w != width) || (h != height))
+    result->problem = golden ? "golden image is a different size" :
+                               "no golden image";
+  else
+  {
+    std::vector<uint8_t> heatmap;
+    result->diff = compare_images(golden, frame.data(), width, height,
+                                  options.tolerance, &jobs, &heatmap);
+    result->problem = nullptr;
+    result->passed = within(result->diff, options.tolerance);
+    if (!result->passed)
+    {
+      write_png(base + ".diff.png", heatmap, width, height);
+      write_png(base + ".actual.png", frame, width, height);
+    }
+  }
+  stbi_image_free(golden);
+}
+
+// the scene's own path unless --path replaced it
+bool scene_path(const Scene &scene, const Options &options, Path *path)
+{
+  bool parsed = parse_path(scene.path, path);
+  for (const auto &p : options.paths)
+    if (p.first == scene.name)
+      parsed = load_path(p.second, path);
+  return parsed;
+}
+
+// by scene name, so picking one builds no others
+using SceneFactories =
+  std::vector<std::pair<std::string, std::function<Scene()>>>;
+
+// A farm worker: renders measured frames of the last --scene as the
+// coordinator hands them out, writing images or sending archive records.
+bool farm_worker(const Options &options, const SceneFactories &factories,
+                 JobSystem &jobs)
+{
+  const std::string &name = options.scenes.back();
+  const std::function<Scene()> *factory = nullptr;
+  for (const auto &f : factories)
+    if (f.first == name)
+      factory = &f.second;
+  if (!factory)
+  {
+    std::fprintf(stderr, "No scene %s\n", name.c_str());
+    return false;
+  }
+
+  const glm::mat4 proj = projection(options);
+  const std::string base = std::string(options.capture) + "/" + name;
+  std::unique_ptr<Scene> scene;
+  Path path;
+  int next = 0;
+  size_t next_action = 0;
+  FrameEncoder encoder(&jobs);
+  return serve_farm(options.farm_socket, [&](uint32_t frame, bool first,
+                                             std::vector<uint8_t> *data) {
+    const int f = options.warmup + static_cast<int>(frame);
+    if (!scene || (f < next))
+    {
+      // only a fresh scene can go back in time
+      scene.reset();
+      scene = std::make_unique<Scene>((*factory)());
+      next = 0;
+      next_action = 0;
+      if (!scene_path(*scene, options, &path) || !scene->init_gl())
+        return false;
+    }
+    for (; next <= f; ++next)
+    {
+      draw_frame(*scene, path, proj, next, &next_action);
+      scene->settle();
+    }
+
+    const std::vector<uint8_t> pixels = read_frame(options.width,
+                                                   options.height);
+    const ptrdiff_t stride = static_cast<ptrdiff_t>(options.width) * 4;
+    if (options.capture_archive)
+    {
+      // spans are stored apart, so each starts from a keyframe
+      if (first)
+        encoder.reset();
+      encoder.encode(frame, pixels.data(), options.width, options.height,
+                     stride, data);
+      return true;
+    }
+    std::vector<uint8_t> image;
+    encode_image(options.capture_format, pixels.data(), options.width,
+                 options.height, stride, 3, &image);
+    std::vector<char> file(base.size() + 32);
+    std::snprintf(file.data(), file.size(), "%s_%05u.%s", base.c_str(),
+                  frame, image_extension(options.capture_format));
+    return write_file(file.data(), image);
+  });
+}
+
+// Runs --farm's coordinator over each --scene in turn; needs no context.
+int farm_coordinator(const Options &options, int argc, char **argv)
+{
+  if (!options.capture || options.scenes.empty())
+  {
+    std::fprintf(stderr, "--farm needs --capture and --scene\n");
+    return 2;
+  }
+  int status = 0;
+  for (const auto &name : options.scenes)
+  {
+    std::vector<std::string> args(argv, argv + argc);
+    args.insert(args.end(), { "--farm-worker", "%d", "--scene", name });
+    const std::string base = std::string(options.capture) + "/" + name;
+    FarmSpool spool;
+    if (options.capture_archive)
+      spool.open(base + FRAME_ARCHIVE_EXTENSION);
+
+    FarmStats stats;
+    bool ok = run_farm(
+      0, static_cast<uint32_t>(options.frames), options.farm, 2,
+      [&args](int socket) { return farm_exec(args, socket); },
+      [&](uint32_t frame, std::vector<uint8_t> data) {
+        if (options.capture_archive)
+          spool.add(frame, data);
+      }, &stats);
+    if (options.capture_archive)
+    {
+      std::vector<uint8_t> header;
+      frame_archive_header(&header);
+      ok = spool.finish(header) && ok;
+    }
+    std::fprintf(stderr, "%-10s %llu frames on %u workers in %.2f s, %.1f "
+                 "frames/s; %u spans stolen, %u workers restarted\n",
+                 name.c_str(), static_cast<unsigned long long>(stats.frames),
+                 options.farm, stats.seconds,
+                 stats.seconds > 0.0 ?
+                   static_cast<double>(stats.frames) / stats.seconds : 0.0,
+                 stats.steals, stats.retries);
+    if (!ok)
+    {
+      std::fprintf(stderr, "%-10s FAIL  not every frame was written\n",
+                   name.c_str());
+      status = 1;
+    }
+  }
+  return status;
+}
+
+}  // unnamed namespace
+
+int main(int argc, char **argv)
+{
+  Options options;
+  if (!parse_options(argc, argv, &options))
+    return 2;
+  if (options.farm && (options.farm_socket < 0))
+    return farm_coordinator(options, argc, argv);
+  // the farm's processes share the cores
+  if ((options.farm_socket >= 0) && !options.threads)
+    options.threads = 1;
+
+  glfwInit();
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  GLFWwindow *window = glfwCreateWindow(64, 64, "proto3d-bench", nullptr,
+                                        nullptr);
+  if (!window)
+  {
+    std::fprintf(stderr, "Failed to create GLFW window\n");
+    glfwTerminate();
+    return 1;
+  }
+  glfwMakeContextCurrent(window);
+  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+  {
+    std::fprintf(stderr, "Failed to initialize GLAD\n");
+    return 1;
+  }
+
+  int status = 0;
+  {
+    Target target;
+    if (!target.init(options.width, options.height))
+    {
+      std::fprintf(stderr, "Unable to create the offscreen target\n");
+      return 1;
+    }
+    glClearColor(0.188f, 0.349f, 0.506f, 1.0f);
+    glEnable(GL_DEPTH_TEST);
+    if (!debug_draw_init())
+    {
+      std::fprintf(stderr, "Unable to set up debug drawing\n");
+      return 1;
+    }
+
+    JobSystem jobs(options.threads);
+    FrameCapture capture(jobs);
+    if (options.capture && !capture.init_gl())
+    {
+      std::fprintf(stderr, "Unable to set up frame capture\n");
+      return 1;
+    }
+    GlUploader uploader;
+    if (options.upload_thread && !uploader.start(window))
+    {
+      std::fprintf(stderr, "Unable to start the upload thread\n");
+      return 1;
+    }
+    perf_set_enabled(true);
+    JobCounter comparing;
+    std::vector<GoldenResult> goldens;
+    SceneFactories factories = {
+      { "voxels", [&jobs, &uploader, &options]() {
+        return voxel_scene(jobs, &uploader, options.debug_lines);
+      } },
+      { "terrain", [&jobs]() { return terrain_scene(jobs); } },
+      { "particles", [&jobs]() { return particle_scene(jobs); } },
+      { "text", [&options]() { return text_scene(options); } },
+      { "sprites", [&options]() { return sprite_scene(options, false); } },
+      { "sprites-atlas", [&options]() { return sprite_scene(options, true); } },
+    };
+    if (options.farm_socket >= 0)
+      return farm_worker(options, factories, jobs) ? 0 : 1;
+
+    FILE *out = options.out ? std::fopen(options.out, "wb") : stdout;
+    if (!out)
+    {
+      std::fprintf(stderr, "Unable to write %s\n", options.out);
+      return 1;
+    }
+    const char *renderer = reinterpret_cast<const char*>(
+      glGetString(GL_RENDERER));
+    std::fprintf(out, "{\n  \"renderer\": \"%s\",\n", renderer ? renderer : "");
+    std::fprintf(out, "  \"threads\": %u,\n  \"frames\": %d,\n"
+                 "  \"warmup\": %d,\n  \"dt\": %.6f,\n"
+                 "  \"size\": [%d, %d],\n  \"scenes\": [\n", jobs.thread_count(),
+                 options.frames, options.warmup, static_cast<double>(DT),
+                 options.width, options.height);
+    bool first = true;
+    // stable, as the comparing jobs write into them
+    goldens.reserve(factories.size());
+    for (auto &factory : factories)
+    {
+      if (!options.scenes.empty() &&
+          (std::find(options.scenes.begin(), options.scenes.end(),
+                     factory.first) == options.scenes.end()))
+        continue;
+      Scene scene = factory.second();
+      Path path;
+      const bool parsed = scene_path(scene, options, &path);
+      Samples samples;
+      if (options.capture)
+      {
+        // every frame, however long encoding takes
+        const std::string path = std::string(options.capture) + "/" +
+                                 scene.name;
+        capture.start(options.capture_archive ?
+                        path + FRAME_ARCHIVE_EXTENSION :
+                        path + "_%05d." +
+                          image_extension(options.capture_format),
+                      false);
+      }
+      const bool ran = parsed &&
+                       run_scene(scene, path, options,
+                                 options.capture ? &capture : nullptr,
+                                 &samples);
+      if (options.capture)
+      {
+        capture.stop();
+        const CaptureStats stats = capture.stats();
+        std::fprintf(stderr, "%-10s captured %llu frames, %llu failed; "
+                     "%.3f ms a frame, %.3f ms at most\n", scene.name.c_str(),
+                     static_cast<unsigned long long>(stats.written),
+                     static_cast<unsigned long long>(stats.failed),
+                     stats.render_ms_mean, stats.render_ms_max);
+      }
+      if (!ran)
+      {
+        status = 1;
+        continue;
+      }
+      if (options.golden)
+      {
+        goldens.push_back(GoldenResult{ scene.name, {}, nullptr, false });
+        GoldenResult *result = &goldens.back();
+        jobs.submit([&options, &jobs, result,
+                     frame = read_frame(options.width, options.height)]() {
+          check_golden(options, std::move(frame), jobs, result);
+        }, &comparing);
+      }
+      std::vector<double> cpu_sorted = samples.cpu_ms;
+      std::sort(cpu_sorted.begin(), cpu_sorted.end());
+      std::fprintf(stderr, "%-10s cpu p50 %.3f ms\n", scene.name.c_str(),
+                   percentile(cpu_sorted, 50));
+
+      std::fprintf(out, "%s    {\n      \"name\": \"%s\",\n",
+                   first ? "" : ",\n", scene.name.c_str());
+      first = false;
+      write_summary(out, "cpu_ms", samples.cpu_ms);
+      write_summary(out, "gpu_ms", samples.gpu_ms);
+      write_summary(out, "draw_calls", samples.draw_calls);
+      write_summary(out, "triangles", samples.triangles);
+      write_summary(out, "texture_binds", samples.texture_binds);
+      std::fprintf(out, "      \"memory_peak_bytes\": %zu,\n"
+                   "      \"rss_peak_bytes\": %zu,\n",
+                   samples.memory_peak, peak_rss_bytes());
+      std::fprintf(out, "      \"samples\": {\n");
+      write_samples(out, "cpu_ms", samples.cpu_ms, false);
+      write_samples(out, "gpu_ms", samples.gpu_ms, false);
+      write_samples(out, "draw_calls", samples.draw_calls, false);
+      write_samples(out, "triangles", samples.triangles, false);
+      write_samples(out, "texture_binds", samples.texture_binds, true);
+      std::fprintf(out, "      }\n    }");
+    }
+    std::fprintf(out, "\n  ]\n}\n");
+    if (out != stdout)
+      std::fclose(out);
+
+    jobs.wait(comparing);
+    for (const GoldenResult &result : goldens)
+    {
+      if (result.problem)
+        std::fprintf(stderr, "%-10s FAIL  %s\n", result.scene.c_str(),
+                     result.problem);
+      else if (options.update_golden)
+        std::fprintf(stderr, "%-10s updated\n", result.scene.c_str());
+      else
+        std::fprintf(stderr, "%-10s %s  ssim %.4f, mean error %.4f, max "
+                     "%.3f, %.3f%% of pixels past %.2f\n",
+                     result.scene.c_str(), result.passed ? "ok  " : "FAIL",
+                     result.diff.ssim, result.diff.mean_error,
+                     static_cast<double>(result.diff.max_error),
+                     100.0 * result.diff.bad_fraction,
+                     static_cast<double>(options.tolerance.pixel_error));
+      if (!result.passed)
+        status = 1;
+    }
+    debug_draw_shutdown();
+  }
+
+  glfwDestroyWindow(window);
+  glfwTerminate();
+  return status;
+}
@@ -0,0 +1,330 @@
+// GPU skinning (skinning.vert through GpuBonePalette) against skin_vertices()
+// on the job pool, for a crowd animated by animate_characters().  The
+// shader's output is captured by transform feedback and must match the CPU's
+// within TOLERANCE, through both palette storages; exits non-zero if not.
+// Times are the best of RUNS frames; the GPU's excludes the readback.
+
+#include "anim_compression.h"
+#include "animation.h"
+#include "jobs.h"
+#include "skinning.h"
+
+#include "glad/glad.h"
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t JOINTS = 64;
+constexpr uint32_t FRAMES = 30 * 4;
+constexpr size_t CHARACTERS = 64;
+constexpr size_t VERTICES = 8192;
+constexpr int RUNS = 20;
+constexpr float TOLERANCE = 1e-3f;
+
+// what the shader writes a vertex: gl_Position, then v_normal
+struct Captured
+{
+  float position[4];
+  float normal[3];
+};
+
+struct GpuVertex
+{
+  float position[3];
+  float normal[3];
+  int32_t joints[MAX_INFLUENCES];
+  float weights[MAX_INFLUENCES];
+};
+
+// a chain of joints a quarter unit apart, bending back and forth
+Skeleton make_skeleton()
+{
+  Skeleton skeleton;
+  for (uint32_t j = 0; j < JOINTS; ++j)
+  {
+    skeleton.parents.push_back(static_cast<int16_t>(static_cast<int>(j) - 1));
+    skeleton.inverse_bind.push_back(glm::translate(
+      glm::mat4(1.0f), glm::vec3(0.0f, -0.25f * static_cast<float>(j), 0.0f)));
+  }
+  return skeleton;
+}
+
+AnimationClip make_clip()
+{
+  AnimationClip clip;
+  clip.frame_count = FRAMES;
+  clip.joint_count = JOINTS;
+  clip.keys.resize(size_t(FRAMES) * JOINTS);
+  for (uint32_t f = 0; f < FRAMES; ++f)
+    for (uint32_t j = 0; j < JOINTS; ++j)
+    {
+      const float t = float(f) / clip.sample_rate;
+      Transform &key = clip.keys[f * JOINTS + j];
+      const glm::vec3 axis = glm::normalize(glm::vec3(float(j % 3), 1.0f,
+                                                      float(j % 2)));
+      key.rotation = glm::angleAxis(0.3f * std::sin(t * float(j % 5 + 1)),
+                                    axis);
+      key.translation = glm::vec3(0.0f, (j == 0) ? 0.0f : 0.25f, 0.0f);
+    }
+  return clip;
+}
+
+// a column of vertices along the chain, each pulled by the joints nearest
+SkinnedMesh make_mesh()
+{
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  SkinnedMesh mesh;
+  mesh.resize(VERTICES);
+  for (size_t v = 0; v < VERTICES; ++v)
+  {
+    const float height = 0.25f * float(JOINTS - 1) *
+                         (0.5f + 0.5f * unit(rng));
+    const glm::vec3 n = glm::normalize(glm::vec3(unit(rng), unit(rng),
+                                                 unit(rng)) +
+                                       glm::vec3(0.0f, 0.0f, 2.0f));
+    const glm::vec3 p = glm::vec3(0.0f, height, 0.0f) + 0.3f * n;
+    const int nearest = static_cast<int>(height / 0.25f);
+    float total = 0.0f;
+    for (size_t k = 0; k < MAX_INFLUENCES; ++k)
+    {
+      const int joint = std::clamp(nearest + static_cast<int>(k) - 1, 0,
+                                   static_cast<int>(JOINTS) - 1);
+      mesh.joints[k][v] = joint;
+      mesh.weights[k][v] = 0.5f + 0.5f * unit(rng);
+      total += mesh.weights[k][v];
+    }
+    for (size_t k = 0; k < MAX_INFLUENCES; ++k)
+      mesh.weights[k][v] /= total;
+    for (int a = 0; a < 3; ++a)
+    {
+      mesh.position[a][v] = p[a];
+      mesh.normal[a][v] = n[a];
+    }
+  }
+  return mesh;
+}
+
+GLuint upload_mesh(const SkinnedMesh &mesh, GLuint *vbo)
+{
+  std::vector<GpuVertex> vertices(mesh.vertex_count);
+  for (size_t v = 0; v < mesh.vertex_count; ++v)
+  {
+    for (int a = 0; a < 3; ++a)
+    {
+      vertices[v].position[a] = mesh.position[a][v];
+      vertices[v].normal[a] = mesh.normal[a][v];
+    }
+    for (size_t k = 0; k < MAX_INFLUENCES; ++k)
+    {
+      vertices[v].joints[k] = mesh.joints[k][v];
+      vertices[v].weights[k] = mesh.weights[k][v];
+    }
+  }
+
+  GLuint vao = 0;
+  glGenVertexArrays(1, &vao);
+  glGenBuffers(1, vbo);
+  glBindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, *vbo);
+  glBufferData(GL_ARRAY_BUFFER,
+               static_cast<GLsizeiptr>(vertices.size() * sizeof(GpuVertex)),
+               vertices.data(), GL_STATIC_DRAW);
+  const auto stride = static_cast<GLsizei>(sizeof(GpuVertex));
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride,
+                        (void*)offsetof(GpuVertex, position));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride,
+                        (void*)offsetof(GpuVertex, normal));
+  glEnableVertexAttribArray(2);
+  glVertexAttribIPointer(2, 4, GL_INT, stride,
+                         (void*)offsetof(GpuVertex, joints));
+  glEnableVertexAttribArray(3);
+  glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, stride,
+                        (void*)offsetof(GpuVertex, weights));
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  return vao;
+}
+
+// Skins every character with the shader, points straight into the feedback
+// buffer; returns the frame's GPU time in ms.
+double skin_gpu(const GpuBonePalette &bones,
+                const GpuBonePalette::Program &program, GLuint vao,
+                GLuint feedback, GLuint query)
+{
+  constexpr auto BYTES = static_cast<GLsizeiptr>(VERTICES * sizeof(Captured));
+  glBeginQuery(GL_TIME_ELAPSED, query);
+  glEnable(GL_RASTERIZER_DISCARD);
+  glUseProgram(program.id);
+  const glm::mat4 identity(1.0f);
+  glUniformMatrix4fv(program.view_proj, 1, GL_FALSE, &identity[0][0]);
+  glBindVertexArray(vao);
+  for (size_t c = 0; c < CHARACTERS; ++c)
+  {
+    bones.bind(program, c * JOINTS);
+    glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, feedback,
+                      static_cast<GLintptr>(c) * BYTES, BYTES);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(VERTICES));
+    glEndTransformFeedback();
+  }
+  glBindVertexArray(0);
+  glUseProgram(0);
+  glDisable(GL_RASTERIZER_DISCARD);
+  glEndQuery(GL_TIME_ELAPSED);
+
+  GLuint64 ns = 0;
+  glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+  return static_cast<double>(ns) * 1e-6;
+}
+
+// worst distance between the shader's vertices and the CPU's
+float compare(const std::vector<Captured> &gpu,
+              const std::vector<SkinnedVertices> &cpu)
+{
+  float worst = 0.0f;
+  for (size_t c = 0; c < CHARACTERS; ++c)
+    for (size_t v = 0; v < VERTICES; ++v)
+    {
+      const Captured &g = gpu[c * VERTICES + v];
+      const glm::vec3 p(cpu[c].position[0][v], cpu[c].position[1][v],
+                        cpu[c].position[2][v]);
+      const glm::vec3 n(cpu[c].normal[0][v], cpu[c].normal[1][v],
+                        cpu[c].normal[2][v]);
+      const glm::vec3 gn(g.normal[0], g.normal[1], g.normal[2]);
+      worst = std::max(worst, glm::length(
+        glm::vec3(g.position[0], g.position[1], g.position[2]) - p));
+      if (glm::length(gn) > 0.0f)
+        worst = std::max(worst, glm::length(glm::normalize(gn) - n));
+    }
+  return worst;
+}
+
+}  // unnamed namespace
+
+int main()
+{
+  glfwInit();
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  GLFWwindow *window = glfwCreateWindow(64, 64, "skin_bench", nullptr,
+                                        nullptr);
+  if (!window)
+  {
+    std::fprintf(stderr, "Failed to create GLFW window\n");
+    glfwTerminate();
+    return 1;
+  }
+  glfwMakeContextCurrent(window);
+  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+  {
+    std::fprintf(stderr, "Failed to initialize GLAD\n");
+    return 1;
+  }
+
+  JobSystem jobs;
+  const Skeleton skeleton = make_skeleton();
+  const CompressedClip clip = compress_clip(make_clip());
+  const SkinnedMesh mesh = make_mesh();
+  std::vector<Character> characters(CHARACTERS);
+  for (size_t c = 0; c < CHARACTERS; ++c)
+    characters[c] = Character{ &skeleton, &clip, 0.1f * float(c),
+                               0.8f + 0.01f * float(c), c * JOINTS };
+  std::vector<BoneMatrix> palettes(CHARACTERS * JOINTS);
+  animate_characters(jobs, characters.data(), CHARACTERS, 0.0f,
+                     palettes.data());
+
+  std::vector<SkinnedVertices> cpu(CHARACTERS);
+  double cpu_ms = 1e30;
+  for (int r = 0; r < RUNS; ++r)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t c = 0; c < CHARACTERS; ++c)
+      skin_vertices(jobs, mesh, palettes.data() + c * JOINTS, &cpu[c]);
+    cpu_ms = std::min(cpu_ms, std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() -
+                                start).count());
+  }
+  std::printf("%zu characters x %u joints x %zu vertices\n", CHARACTERS,
+              JOINTS, VERTICES);
+  std::printf("cpu            %8.3f ms on %u threads\n", cpu_ms,
+              jobs.thread_count());
+
+  GLuint vbo = 0, feedback = 0, query = 0;
+  const GLuint vao = upload_mesh(mesh, &vbo);
+  glGenBuffers(1, &feedback);
+  glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, feedback);
+  glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER,
+               static_cast<GLsizeiptr>(CHARACTERS * VERTICES *
+                                       sizeof(Captured)),
+               nullptr, GL_STREAM_READ);
+  glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
+  glGenQueries(1, &query);
+
+  // a character's palette fits a uniform block; claiming more than any block
+  // holds forces the buffer texture
+  const size_t per_character[] = { JOINTS, size_t(1) << 20 };
+  bool ok = true;
+  for (const size_t bones_per_character : per_character)
+  {
+    GpuBonePalette bones;
+    GpuBonePalette::Program program;
+    if (bones.init(palettes.size(), bones_per_character))
+      program = bones.create_program(true);
+    if (!program.id)
+    {
+      std::fprintf(stderr, "Unable to set up GPU skinning\n");
+      return 1;
+    }
+    const bool texture = (bones.storage() ==
+                          GpuBonePalette::Storage::TextureBuffer);
+    double gpu_ms = 1e30;
+    for (int r = 0; r < RUNS; ++r)
+    {
+      bones.upload(palettes.data(), palettes.size());
+      gpu_ms = std::min(gpu_ms, skin_gpu(bones, program, vao, feedback,
+                                         query));
+    }
+
+    std::vector<Captured> gpu(CHARACTERS * VERTICES);
+    glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, feedback);
+    glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0,
+                       static_cast<GLsizeiptr>(gpu.size() * sizeof(Captured)),
+                       gpu.data());
+    glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
+    const float error = compare(gpu, cpu);
+    std::printf("gpu, %-8s %8.3f ms, max error %.6f\n",
+                texture ? "texture" : "uniform", gpu_ms,
+                static_cast<double>(error));
+    ok &= (error <= TOLERANCE);
+    glDeleteProgram(program.id);
+    bones.destroy();
+  }
+
+  glDeleteQueries(1, &query);
+  glDeleteBuffers(1, &feedback);
+  glDeleteVertexArrays(1, &vao);
+  glDeleteBuffers(1, &vbo);
+  glfwDestroyWindow(window);
+  glfwTerminate();
+  if (!ok)
+    std::printf("GPU skinning differs from skin_vertices\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,36 @@
+# Writes OUTPUT, a C++ fragment defining EMBEDDED_ASSETS: each of ASSETS (a
+# ;-separated list of paths under ROOT) as a constexpr byte array, with a NUL
+# appended so text can be used in place.
+# Run in script mode by src/CMakeLists.txt:
+#   cmake -DROOT=... -DASSETS=... -DOUTPUT=... -P EmbedAssets.cmake
+
+list(SORT ASSETS)  # find_embedded_asset does a binary search
+
+# 12 bytes to a line; CMake's regexes have no {n}
+set(line "")
+foreach (i RANGE 11)
+  string(APPEND line "0x..,")
+endforeach ()
+set(line "(${line})")
+
+set(arrays "")
+set(table "")
+foreach (asset ${ASSETS})
+  string(MAKE_C_IDENTIFIER "${asset}" symbol)
+  file(READ "${ROOT}/${asset}" hex HEX)
+  string(LENGTH "${hex}" digits)
+  math(EXPR size "${digits} / 2")
+
+  string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${hex}")
+  string(REGEX REPLACE "${line}" "\\1\n  " bytes "${bytes}")
+  string(APPEND arrays
+    "constexpr uint8_t ${symbol}[] = {\n  ${bytes}0x00\n};\n\n")
+  string(APPEND table
+    "  { \"${asset}\", ${symbol}, ${size} },\n")
+endforeach ()
+
+set(content "// Generated by cmake/EmbedAssets.cmake; do not edit.\n\n")
+string(APPEND content "${arrays}"
+  "constexpr EmbeddedAsset EMBEDDED_ASSETS[] = {\n${table}};\n")
+
+file(WRITE "${OUTPUT}" "${content}")
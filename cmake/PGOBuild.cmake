@@ -0,0 +1,102 @@
+# Builds ReleasePGO (see ReleasePGO.cmake) from the top: an instrumented
+# build, a training run of every proto3d-bench scene, then the optimised build
+# in the same directory.  Run from the source tree:
+#
+#   cmake [-DBUILD_DIR=build-pgo] [-DFRAMES=600] [-DBOLT=ON] [-DBASELINE=ON]
+#         -P cmake/PGOBuild.cmake
+#
+# BOLT lays proto3d-bench out again with llvm-bolt from a second, instrumented
+# training run; the app gets only the compiler's optimisations, as it has no
+# headless mode to train with.  BASELINE also builds Release in
+# BUILD_DIR-release and compares the two with proto3d-compare, writing both
+# runs' results to BUILD_DIR.  Training and comparisons run offscreen; set
+# LIBGL_ALWAYS_SOFTWARE=1 where there's no GPU, or for numbers that don't
+# depend on its driver.
+
+if (NOT BUILD_DIR)
+  set(BUILD_DIR "build-pgo")
+endif ()
+if (NOT FRAMES)
+  set(FRAMES 600)
+endif ()
+get_filename_component(SOURCE_DIR "${CMAKE_CURRENT_LIST_DIR}/.." ABSOLUTE)
+get_filename_component(BUILD_DIR "${BUILD_DIR}" ABSOLUTE)
+set(PROFILE_DIR "${BUILD_DIR}/pgo")
+set(BENCH "${BUILD_DIR}/bench/proto3d-bench")
+
+function(run)
+  execute_process(COMMAND ${ARGN} RESULT_VARIABLE result)
+  if (NOT result EQUAL 0)
+    string(REPLACE ";" " " command "${ARGN}")
+    message(FATAL_ERROR "${command} failed: ${result}")
+  endif ()
+endfunction()
+
+function(build dir type)
+  run(${CMAKE_COMMAND} -S "${SOURCE_DIR}" -B "${dir}"
+    -DCMAKE_BUILD_TYPE=${type} -DPROTO3D_BUILD_BENCH=ON ${ARGN})
+  run(${CMAKE_COMMAND} --build "${dir}" --parallel)
+endfunction()
+
+# scenes measured every frame from the start, so every path gets trained
+function(bench exe out)
+  run("${exe}" --frames ${FRAMES} --warmup 0 --out "${out}")
+endfunction()
+
+if (BASELINE)
+  message(STATUS "Building Release for comparison")
+  build("${BUILD_DIR}-release" Release)
+endif ()
+
+if (BOLT)
+  set(BOLT ON)
+else ()
+  set(BOLT OFF)
+endif ()
+
+message(STATUS "Building instrumented")
+file(REMOVE_RECURSE "${PROFILE_DIR}")
+build("${BUILD_DIR}" ReleasePGO -DPROTO3D_PGO=GENERATE
+  "-DPROTO3D_PGO_DIR=${PROFILE_DIR}" -DPROTO3D_BOLT=${BOLT})
+message(STATUS "Training")
+bench("${BENCH}" "${BUILD_DIR}/training.json")
+
+# Clang writes raw profiles to be merged; GCC's are used as they are
+file(GLOB raw_profiles "${PROFILE_DIR}/*.profraw")
+if (raw_profiles)
+  find_program(LLVM_PROFDATA NAMES llvm-profdata)
+  if (NOT LLVM_PROFDATA)
+    message(FATAL_ERROR "llvm-profdata is needed to merge Clang's profiles")
+  endif ()
+  run("${LLVM_PROFDATA}" merge "-output=${PROFILE_DIR}/default.profdata"
+    ${raw_profiles})
+endif ()
+
+message(STATUS "Building with the profiles")
+build("${BUILD_DIR}" ReleasePGO -DPROTO3D_PGO=USE)
+
+if (BOLT)
+  find_program(LLVM_BOLT NAMES llvm-bolt)
+  if (NOT LLVM_BOLT)
+    message(FATAL_ERROR "BOLT needs llvm-bolt")
+  endif ()
+  message(STATUS "Laying out proto3d-bench with BOLT")
+  set(fdata "${BUILD_DIR}/bolt.fdata")
+  file(REMOVE "${fdata}")
+  run("${LLVM_BOLT}" "${BENCH}" -instrument
+    "--instrumentation-file=${fdata}" -o "${BENCH}.instrumented")
+  bench("${BENCH}.instrumented" "${BUILD_DIR}/bolt-training.json")
+  file(RENAME "${BENCH}" "${BENCH}.pre-bolt")
+  run("${LLVM_BOLT}" "${BENCH}.pre-bolt" "-data=${fdata}" -o "${BENCH}"
+    -reorder-blocks=ext-tsp -reorder-functions=hfsort -split-functions
+    -split-all-cold -icf=1 -dyno-stats)
+endif ()
+
+if (BASELINE)
+  message(STATUS "Comparing with Release")
+  bench("${BUILD_DIR}-release/bench/proto3d-bench" "${BUILD_DIR}/release.json")
+  bench("${BENCH}" "${BUILD_DIR}/release-pgo.json")
+  # exits non-zero only if ReleasePGO is slower; the table shows the gains
+  execute_process(COMMAND "${BUILD_DIR}-release/bench/proto3d-compare"
+    "${BUILD_DIR}/release.json" "${BUILD_DIR}/release-pgo.json")
+endif ()
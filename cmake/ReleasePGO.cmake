@@ -0,0 +1,67 @@
+# The ReleasePGO build type: Release optimised with profiles of a training
+# run, in one of two phases picked with PROTO3D_PGO:
+#   GENERATE  instrumented; running it writes profiles to PROTO3D_PGO_DIR
+#   USE       built with those profiles, link-time optimisation and -fno-plt;
+#             with PROTO3D_BOLT the link keeps relocations for llvm-bolt
+# cmake/PGOBuild.cmake runs both phases with proto3d-bench as the training.
+# GCC and Clang only.
+
+set(PROTO3D_PGO "USE" CACHE STRING "ReleasePGO phase: GENERATE or USE")
+set_property(CACHE PROTO3D_PGO PROPERTY STRINGS "GENERATE" "USE")
+set(PROTO3D_PGO_DIR "${CMAKE_BINARY_DIR}/pgo" CACHE PATH
+  "Where ReleasePGO builds write and read profiles")
+option(PROTO3D_BOLT "Link ReleasePGO binaries so llvm-bolt can lay them out"
+  OFF)
+
+if (NOT (CMAKE_COMPILER_IS_GNUCXX OR (CMAKE_CXX_COMPILER_ID MATCHES "Clang")))
+  if (CMAKE_BUILD_TYPE STREQUAL "ReleasePGO")
+    message(WARNING "ReleasePGO needs GCC or Clang; building plain Release")
+  endif ()
+  set(CMAKE_CXX_FLAGS_RELEASEPGO "${CMAKE_CXX_FLAGS_RELEASE}")
+  set(CMAKE_C_FLAGS_RELEASEPGO "${CMAKE_C_FLAGS_RELEASE}")
+  return ()
+endif ()
+
+set(pgo_flags "-O3 -DNDEBUG")
+set(pgo_link_flags "")
+if (PROTO3D_PGO STREQUAL "GENERATE")
+  string(APPEND pgo_flags " -fprofile-generate=${PROTO3D_PGO_DIR}")
+  # the job pool's threads run the same code; racing counters lose counts
+  if (CMAKE_COMPILER_IS_GNUCXX)
+    string(APPEND pgo_flags " -fprofile-update=prefer-atomic")
+  endif ()
+elseif (PROTO3D_PGO STREQUAL "USE")
+  if (CMAKE_COMPILER_IS_GNUCXX)
+    # GCC finds each object's profile by its path: USE must build in the
+    # directory GENERATE did.  Code training never ran, e.g. the app's own
+    # loop, is optimised as in Release rather than for size; sources edited
+    # since training get a warning rather than an error.
+    string(APPEND pgo_flags " -fprofile-use=${PROTO3D_PGO_DIR}"
+      " -fprofile-partial-training -Wno-missing-profile"
+      " -Wno-error=coverage-mismatch -flto=auto")
+  else ()
+    # merged from the raw profiles with llvm-profdata
+    string(APPEND pgo_flags
+      " -fprofile-use=${PROTO3D_PGO_DIR}/default.profdata"
+      " -Wno-profile-instr-unprofiled -flto=thin")
+    set(pgo_link_flags "-fuse-ld=lld")
+  endif ()
+  string(APPEND pgo_flags " -fno-plt")
+  if (PROTO3D_BOLT)
+    set(pgo_link_flags "${pgo_link_flags} -Wl,--emit-relocs")
+  endif ()
+else ()
+  message(FATAL_ERROR "PROTO3D_PGO must be GENERATE or USE")
+endif ()
+
+set(CMAKE_CXX_FLAGS_RELEASEPGO "${pgo_flags}")
+set(CMAKE_C_FLAGS_RELEASEPGO "${pgo_flags}")
+# links get the compile flags too
+set(CMAKE_EXE_LINKER_FLAGS_RELEASEPGO "${pgo_link_flags}")
+
+# the core is a static library; its LTO objects need the compiler's archiver
+if ((CMAKE_BUILD_TYPE STREQUAL "ReleasePGO") AND
+    (PROTO3D_PGO STREQUAL "USE") AND CMAKE_CXX_COMPILER_AR)
+  set(CMAKE_AR "${CMAKE_CXX_COMPILER_AR}")
+  set(CMAKE_RANLIB "${CMAKE_CXX_COMPILER_RANLIB}")
+endif ()
@@ -0,0 +1,11 @@
+#version 330 core
+in vec2 v_corner;
+in float v_age;
+out vec4 frag_color;
+
+void main()
+{
+  float falloff = max(1.0 - dot(v_corner, v_corner), 0.0);
+  vec3 color = mix(vec3(1.0, 0.8, 0.4), vec3(0.3, 0.4, 1.0), v_age);
+  frag_color = vec4(color * falloff * (1.0 - v_age), 1.0);
+}
@@ -0,0 +1,20 @@
+#version 330 core
+layout(location = 0) in vec4 a_center_size;
+layout(location = 1) in float a_age;
+
+uniform mat4 u_view_proj;
+uniform vec3 u_right;
+uniform vec3 u_up;
+
+out vec2 v_corner;
+out float v_age;
+
+void main()
+{
+  // triangle strip quad from the vertex id; no vertex buffer needed
+  v_corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+  v_age = a_age;
+  vec3 pos = a_center_size.xyz +
+             (u_right * v_corner.x + u_up * v_corner.y) * a_center_size.w;
+  gl_Position = u_view_proj * vec4(pos, 1.0);
+}
@@ -0,0 +1,10 @@
+#version 330 core
+in vec3 v_normal;
+out vec4 frag_color;
+
+void main()
+{
+  const vec3 light = normalize(vec3(0.3, 1.0, 0.5));
+  float lambert = max(dot(normalize(v_normal), light), 0.0);
+  frag_color = vec4(vec3(0.2 + 0.8 * lambert), 1.0);
+}
@@ -0,0 +1,34 @@
+layout(location = 0) in vec3 a_position;
+layout(location = 1) in vec3 a_normal;
+layout(location = 2) in ivec4 a_joints;
+layout(location = 3) in vec4 a_weights;
+
+uniform mat4 u_view_proj;
+uniform int u_bone_base;  // in vec4 rows
+
+#ifdef BONES_IN_TEXTURE
+uniform samplerBuffer u_bones;
+vec4 bone_row(int i) { return texelFetch(u_bones, i); }
+#else
+layout(std140) uniform Bones { vec4 u_rows[BONE_ROWS]; };
+vec4 bone_row(int i) { return u_rows[i]; }
+#endif
+
+out vec3 v_normal;
+
+void main()
+{
+  vec4 r0 = vec4(0.0), r1 = vec4(0.0), r2 = vec4(0.0);
+  for (int i = 0; i < 4; ++i)
+  {
+    int row = u_bone_base + 3 * a_joints[i];
+    r0 += a_weights[i] * bone_row(row);
+    r1 += a_weights[i] * bone_row(row + 1);
+    r2 += a_weights[i] * bone_row(row + 2);
+  }
+  vec4 p = vec4(a_position, 1.0);
+  vec3 pos = vec3(dot(r0, p), dot(r1, p), dot(r2, p));
+  v_normal = vec3(dot(r0.xyz, a_normal), dot(r1.xyz, a_normal),
+                  dot(r2.xyz, a_normal));
+  gl_Position = u_view_proj * vec4(pos, 1.0);
+}
@@ -0,0 +1,14 @@
+#version 330 core
+in vec3 v_normal;
+in float v_height;
+out vec4 frag_color;
+
+void main()
+{
+  vec3 n = normalize(v_normal);
+  float light = 0.3 + 0.7 * max(dot(n, normalize(vec3(0.4, 1.0, 0.3))), 0.0);
+  vec3 grass = vec3(0.32, 0.45, 0.2), rock = vec3(0.45, 0.42, 0.4);
+  vec3 albedo = mix(rock, grass, smoothstep(0.7, 0.85, n.y));
+  albedo = mix(albedo, vec3(0.95), smoothstep(180.0, 220.0, v_height));
+  frag_color = vec4(albedo * light, 1.0);
+}
@@ -0,0 +1,43 @@
+#version 330 core
+layout(location = 0) in vec2 a_grid;
+
+uniform mat4 u_view_proj;
+uniform sampler2DArray u_heights;
+uniform vec2 u_origin;
+uniform float u_spacing;
+uniform int u_level;
+uniform float u_morph;
+
+out vec3 v_normal;
+out float v_height;
+
+const float TEXELS = 256.0;        // CLIPMAP_TEXELS
+const float HALF_GRID = 64.0;      // CLIPMAP_GRID / 2
+const float MORPH_CELLS = 16.0;
+
+float height_at(vec2 world, float spacing, int level)
+{
+  vec2 uv = (world / spacing + 0.5) / TEXELS;
+  return textureLod(u_heights, vec3(uv, float(level)), 0.0).r;
+}
+
+void main()
+{
+  vec2 world = u_origin + a_grid * u_spacing;
+  // blend into the next coarser level over the outer cells, so the edge
+  // lies exactly on its triangles: no cracks, no popping as levels move
+  vec2 d = abs(a_grid - HALF_GRID);
+  float t = u_morph * clamp((max(d.x, d.y) - (HALF_GRID - MORPH_CELLS)) /
+                            MORPH_CELLS, 0.0, 1.0);
+  float h = mix(height_at(world, u_spacing, u_level),
+                height_at(world, 2.0 * u_spacing, u_level + 1), t);
+
+  vec2 dx = vec2(u_spacing, 0.0), dz = vec2(0.0, u_spacing);
+  float sx = height_at(world + dx, u_spacing, u_level) -
+             height_at(world - dx, u_spacing, u_level);
+  float sz = height_at(world + dz, u_spacing, u_level) -
+             height_at(world - dz, u_spacing, u_level);
+  v_normal = normalize(vec3(-sx, 2.0 * u_spacing, -sz));
+  v_height = h;
+  gl_Position = u_view_proj * vec4(world.x, h, world.y, 1.0);
+}
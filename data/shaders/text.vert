@@ -0,0 +1,19 @@
+#version 330 core
+layout(location = 0) in vec4 a_rect;
+layout(location = 1) in vec4 a_uv;
+layout(location = 2) in vec4 a_color;
+
+uniform vec2 u_viewport;
+
+out vec2 v_uv;
+out vec4 v_color;
+
+void main()
+{
+  vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+  vec2 pos = a_rect.xy + corner * a_rect.zw;
+  v_uv = mix(a_uv.xy, a_uv.zw, corner);
+  v_color = a_color;
+  gl_Position = vec4(pos / u_viewport * vec2(2.0, -2.0) + vec2(-1.0, 1.0),
+                     0.0, 1.0);
+}
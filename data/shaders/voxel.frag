@@ -0,0 +1,14 @@
+#version 330 core
+flat in uint v_face;
+flat in uint v_block;
+out vec4 frag_color;
+
+void main()
+{
+  // cheap per-face lighting; +y brightest, -y darkest
+  const float SHADE[6] = float[6](0.8, 0.7, 1.0, 0.5, 0.9, 0.6);
+  uint h = v_block * 2654435761u;
+  vec3 albedo = vec3((h >> 8) & 255u, (h >> 16) & 255u, (h >> 24) & 255u) /
+                255.0;
+  frag_color = vec4(mix(vec3(0.4), albedo, 0.6) * SHADE[v_face], 1.0);
+}
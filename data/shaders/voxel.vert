@@ -0,0 +1,16 @@
+#version 330 core
+layout(location = 0) in uvec4 a_position_face;
+layout(location = 1) in uint a_block;
+
+uniform mat4 u_view_proj;
+uniform vec3 u_origin;
+
+flat out uint v_face;
+flat out uint v_block;
+
+void main()
+{
+  v_face = a_position_face.w;
+  v_block = a_block;
+  gl_Position = u_view_proj * vec4(u_origin + vec3(a_position_face.xyz), 1.0);
+}
@@ -0,0 +1,392 @@
+#include "anim_compression.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// translation and scale: min xyz, extent xyz each
+constexpr size_t RANGE_FLOATS = 12;
+constexpr size_t TRACKS_PER_JOINT = 3;
+constexpr size_t KEY_BYTES = 3 * sizeof(uint16_t);
+// bound on the three smallest components of a unit quaternion
+constexpr float QUAT_RANGE = 0.70710678f;
+constexpr float QUAT_STEPS = 32767.0f;
+constexpr float VEC_STEPS = 65535.0f;
+
+enum Track
+{
+  ROTATION,
+  TRANSLATION,
+  SCALE
+};
+
+template <typename T>
+T load(const uint8_t *p)
+{
+  T v;
+  std::memcpy(&v, p, sizeof(T));
+  return v;
+}
+
+template <typename T>
+void append(std::vector<uint8_t> &out, const T *src, size_t count)
+{
+  const auto *bytes = reinterpret_cast<const uint8_t*>(src);
+  out.insert(out.end(), bytes, bytes + count * sizeof(T));
+}
+
+void pack_rotation(const glm::quat &q, uint16_t out[3])
+{
+  const float c[4] = { q.x, q.y, q.z, q.w };
+  unsigned largest = 0;
+  for (unsigned i = 1; i < 4; ++i)
+  {
+    if (std::fabs(c[i]) > std::fabs(c[largest]))
+      largest = i;
+  }
+  // q and -q are the same rotation; flip so the dropped component is positive
+  const float sign = (c[largest] < 0.0f) ? -1.0f : 1.0f;
+  uint64_t bits = largest;
+  for (unsigned i = 0; i < 4; ++i)
+  {
+    if (i == largest)
+      continue;
+    const float v = std::min(std::max(sign * c[i] / QUAT_RANGE, -1.0f), 1.0f);
+    bits = (bits << 15) |
+           static_cast<uint64_t>(std::lround((v * 0.5f + 0.5f) * QUAT_STEPS));
+  }
+  out[0] = static_cast<uint16_t>(bits);
+  out[1] = static_cast<uint16_t>(bits >> 16);
+  out[2] = static_cast<uint16_t>(bits >> 32);
+}
+
+glm::quat unpack_rotation(const uint16_t in[3])
+{
+  uint64_t bits = uint64_t(in[0]) | (uint64_t(in[1]) << 16) |
+                  (uint64_t(in[2]) << 32);
+  const auto largest = static_cast<unsigned>(bits >> 45);
+  float c[4];
+  float sum = 0.0f;
+  for (unsigned i = 4; i-- > 0; )
+  {
+    if (i == largest)
+      continue;
+    const float v = float(bits & 0x7fff) / QUAT_STEPS * 2.0f - 1.0f;
+    c[i] = v * QUAT_RANGE;
+    sum += c[i] * c[i];
+    bits >>= 15;
+  }
+  c[largest] = std::sqrt(std::max(1.0f - sum, 0.0f));
+  return glm::quat(c[3], c[0], c[1], c[2]);
+}
+
+void pack_vec(const glm::vec3 &v, const float *range, uint16_t out[3])
+{
+  for (int i = 0; i < 3; ++i)
+  {
+    const float extent = range[3 + i];
+    const float f = (extent > 0.0f) ? (v[i] - range[i]) / extent : 0.0f;
+    out[i] = static_cast<uint16_t>(
+      std::lround(std::min(std::max(f, 0.0f), 1.0f) * VEC_STEPS));
+  }
+}
+
+glm::vec3 unpack_vec(const uint16_t in[3], const float *range)
+{
+  return glm::vec3(range[0] + float(in[0]) / VEC_STEPS * range[3],
+                   range[1] + float(in[1]) / VEC_STEPS * range[4],
+                   range[2] + float(in[2]) / VEC_STEPS * range[5]);
+}
+
+float rotation_error(const glm::quat &a, const glm::quat &b)
+{
+  const float d = std::min(std::fabs(glm::dot(a, b)), 1.0f);
+  return 2.0f * std::acos(d);
+}
+
+float vec_error(const glm::vec3 &a, const glm::vec3 &b)
+{
+  return glm::length(a - b);
+}
+
+struct Key
+{
+  uint16_t value[3];
+};
+
+// Keys of one track over one segment.  Quantised keys are decoded before
+// measuring so the bound covers quantisation too.
+template <typename T, typename Decode, typename Lerp, typename Error>
+std::vector<uint8_t> reduce_keys(const std::vector<T> &raw,
+                                 const std::vector<Key> &keys,
+                                 float tolerance,
+                                 Decode decode,
+                                 Lerp lerp,
+                                 Error error)
+{
+  const size_t n = raw.size();
+  std::vector<T> decoded(n);
+  for (size_t i = 0; i < n; ++i)
+    decoded[i] = decode(keys[i]);
+
+  bool constant = true;
+  for (size_t i = 1; (i < n) && constant; ++i)
+    constant = error(decoded[0], raw[i]) <= tolerance;
+  if (constant)
+    return { 0 };
+
+  // Ramer–Douglas–Peucker over time: split at the worst frame until every
+  // frame in between is within tolerance
+  std::vector<bool> keep(n, false);
+  keep[0] = keep[n - 1] = true;
+  std::vector<std::pair<size_t, size_t>> spans = { { 0, n - 1 } };
+  while (!spans.empty())
+  {
+    const auto span = spans.back();
+    spans.pop_back();
+    float worst = tolerance;
+    size_t worst_frame = span.first;
+    for (size_t i = span.first + 1; i < span.second; ++i)
+    {
+      const float t = float(i - span.first) / float(span.second - span.first);
+      const float e = error(lerp(decoded[span.first], decoded[span.second], t),
+                            raw[i]);
+      if (e > worst)
+      {
+        worst = e;
+        worst_frame = i;
+      }
+    }
+    if (worst_frame != span.first)
+    {
+      keep[worst_frame] = true;
+      spans.emplace_back(span.first, worst_frame);
+      spans.emplace_back(worst_frame, span.second);
+    }
+  }
+
+  std::vector<uint8_t> frames;
+  for (size_t i = 0; i < n; ++i)
+  {
+    if (keep[i])
+      frames.push_back(static_cast<uint8_t>(i));
+  }
+  return frames;
+}
+
+glm::vec3 lerp_vec(const glm::vec3 &a, const glm::vec3 &b, float t)
+{
+  return glm::mix(a, b, t);
+}
+
+}  // unnamed namespace
+
+CompressedClip compress_clip(const AnimationClip &clip,
+                             const CompressionSettings &settings)
+{
+  CompressedClip out;
+  out.sample_rate = clip.sample_rate;
+  out.frame_count = clip.frame_count;
+  out.joint_count = clip.joint_count;
+  if (clip.frame_count == 0)
+    return out;
+
+  const uint32_t seg_frames = CompressedClip::SEGMENT_FRAMES;
+  const size_t joints = clip.joint_count;
+  const uint32_t segments = (clip.frame_count > 1) ?
+    (clip.frame_count - 2) / seg_frames + 1 : 1;
+
+  for (uint32_t s = 0; s < segments; ++s)
+  {
+    const uint32_t first = s * seg_frames;
+    const uint32_t last = std::min(first + seg_frames, clip.frame_count - 1);
+    const size_t n = last - first + 1;
+    auto key_at = [&](size_t frame, size_t joint) -> const Transform& {
+      return clip.keys[(first + frame) * joints + joint];
+    };
+
+    std::vector<float> ranges;
+    std::vector<uint8_t> counts;
+    std::vector<uint8_t> frames;
+    std::vector<Key> values;
+    for (size_t j = 0; j < joints; ++j)
+    {
+      float range[RANGE_FLOATS];
+      for (int track = 0; track < 2; ++track)
+      {
+        glm::vec3 lo(INFINITY), hi(-INFINITY);
+        for (size_t f = 0; f < n; ++f)
+        {
+          const glm::vec3 &v = track ? key_at(f, j).scale
+                                     : key_at(f, j).translation;
+          lo = glm::min(lo, v);
+          hi = glm::max(hi, v);
+        }
+        for (int i = 0; i < 3; ++i)
+        {
+          range[track * 6 + i] = lo[i];
+          range[track * 6 + 3 + i] = hi[i] - lo[i];
+        }
+      }
+
+      std::vector<glm::quat> rotations(n);
+      std::vector<glm::vec3> translations(n), scales(n);
+      std::vector<Key> rot_keys(n), trans_keys(n), scale_keys(n);
+      for (size_t f = 0; f < n; ++f)
+      {
+        const Transform &key = key_at(f, j);
+        rotations[f] = key.rotation;
+        translations[f] = key.translation;
+        scales[f] = key.scale;
+        pack_rotation(key.rotation, rot_keys[f].value);
+        pack_vec(key.translation, range, trans_keys[f].value);
+        pack_vec(key.scale, range + 6, scale_keys[f].value);
+      }
+
+      const float *trans_range = range;
+      const float *scale_range = range + 6;
+      const std::vector<uint8_t> kept[TRACKS_PER_JOINT] = {
+        reduce_keys(rotations, rot_keys, settings.rotation_error,
+                    [](const Key &k) { return unpack_rotation(k.value); },
+                    nlerp, rotation_error),
+        reduce_keys(translations, trans_keys, settings.translation_error,
+                    [trans_range](const Key &k) {
+                      return unpack_vec(k.value, trans_range);
+                    },
+                    lerp_vec, vec_error),
+        reduce_keys(scales, scale_keys, settings.scale_error,
+                    [scale_range](const Key &k) {
+                      return unpack_vec(k.value, scale_range);
+                    },
+                    lerp_vec, vec_error)
+      };
+      const std::vector<Key> *track_keys[TRACKS_PER_JOINT] = {
+        &rot_keys, &trans_keys, &scale_keys
+      };
+      const glm::vec3 *track_values[TRACKS_PER_JOINT] = {
+        nullptr, translations.data(), scales.data()
+      };
+      for (size_t t = 0; t < TRACKS_PER_JOINT; ++t)
+      {
+        counts.push_back(static_cast<uint8_t>(kept[t].size()));
+        const bool animated = kept[t].size() > 1;
+        if (t != ROTATION)
+        {
+          // a constant vector is cheaper stored as is than as range + key
+          const float *r = range + (t - 1) * 6;
+          if (animated)
+            ranges.insert(ranges.end(), r, r + 6);
+          else
+            ranges.insert(ranges.end(), &track_values[t][0].x,
+                          &track_values[t][0].x + 3);
+        }
+        if (!animated && (t != ROTATION))
+          continue;
+        for (const uint8_t f : kept[t])
+        {
+          if (animated)
+            frames.push_back(f);
+          values.push_back((*track_keys[t])[f]);
+        }
+      }
+    }
+
+    // offsets up front keep the sampler to a single forward pass
+    const size_t counts_offset = 2 * sizeof(uint32_t) +
+                                 ranges.size() * sizeof(float);
+    const size_t values_offset = round_up(counts_offset + counts.size() +
+                                          frames.size(), 2);
+    const uint32_t header[2] = { static_cast<uint32_t>(counts_offset),
+                                 static_cast<uint32_t>(values_offset) };
+    std::vector<uint8_t> &data = out.data;
+    const size_t block = data.size();
+    out.segment_offsets.push_back(static_cast<uint32_t>(block));
+    append(data, header, 2);
+    append(data, ranges.data(), ranges.size());
+    append(data, counts.data(), counts.size());
+    append(data, frames.data(), frames.size());
+    data.resize(block + values_offset);
+    for (const Key &k : values)
+      append(data, k.value, 3);
+    // next block's floats stay 4-byte aligned
+    data.resize(round_up(data.size(), 4));
+  }
+  return out;
+}
+
+void sample_clip(const CompressedClip &clip, float time, Transform *pose)
+{
+  if (clip.frame_count == 0)
+    return;
+
+  float frame = 0.0f;
+  if (clip.frame_count > 1)
+  {
+    const float duration = clip.duration();
+    time = std::fmod(time, duration);
+    if (time < 0.0f)
+      time += duration;
+    frame = std::min(time * clip.sample_rate, float(clip.frame_count - 1));
+  }
+  const auto segments = static_cast<uint32_t>(clip.segment_offsets.size());
+  const uint32_t segment = std::min(
+    static_cast<uint32_t>(frame) / CompressedClip::SEGMENT_FRAMES,
+    segments - 1);
+  const float local = frame - float(segment * CompressedClip::SEGMENT_FRAMES);
+
+  const size_t joints = clip.joint_count;
+  const uint8_t *block = clip.data.data() + clip.segment_offsets[segment];
+  const uint8_t *ranges = block + 2 * sizeof(uint32_t);
+  const uint8_t *counts = block + load<uint32_t>(block);
+  const uint8_t *frames = counts + joints * TRACKS_PER_JOINT;
+  const uint8_t *values = block + load<uint32_t>(block + sizeof(uint32_t));
+
+  for (size_t j = 0; j < joints; ++j)
+  {
+    for (size_t track = 0; track < TRACKS_PER_JOINT; ++track)
+    {
+      const size_t count = *counts++;
+      glm::vec3 *vec = (track == SCALE) ? &pose[j].scale
+                                        : &pose[j].translation;
+      if ((track != ROTATION) && (count == 1))
+      {
+        std::memcpy(&vec->x, ranges, 3 * sizeof(float));
+        ranges += 3 * sizeof(float);
+        continue;
+      }
+
+      // with more than one key, k and k + 1 bracket the sample
+      size_t k = 0;
+      while ((k + 2 < count) && (float(frames[k + 1]) <= local))
+        ++k;
+      const float t = (count > 1) ? (local - float(frames[k])) /
+                                    float(frames[k + 1] - frames[k])
+                                  : 0.0f;
+      uint16_t a[3], b[3];
+      std::memcpy(a, values + k * KEY_BYTES, KEY_BYTES);
+      if (track == ROTATION)
+      {
+        pose[j].rotation = unpack_rotation(a);
+        if (count > 1)
+        {
+          std::memcpy(b, values + (k + 1) * KEY_BYTES, KEY_BYTES);
+          pose[j].rotation = nlerp(pose[j].rotation, unpack_rotation(b), t);
+        }
+      }
+      else
+      {
+        float range[6];
+        std::memcpy(range, ranges, sizeof(range));
+        ranges += sizeof(range);
+        std::memcpy(b, values + (k + 1) * KEY_BYTES, KEY_BYTES);
+        *vec = glm::mix(unpack_vec(a, range), unpack_vec(b, range), t);
+      }
+      if (count > 1)
+        frames += count;
+      values += count * KEY_BYTES;
+    }
+  }
+}
@@ -0,0 +1,63 @@
+#ifndef __ANIM_COMPRESSION_H__
+#define __ANIM_COMPRESSION_H__
+
+#include "animation.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Per-track error bounds used when dropping keys; quantisation error is
+// included in the bound.
+struct CompressionSettings
+{
+  float rotation_error = 0.0005f;     // radians
+  float translation_error = 0.0005f;  // model units
+  float scale_error = 0.0005f;
+};
+
+// A clip cut into segments of SEGMENT_FRAMES frames.  Each segment is a single
+// contiguous block holding every track's retained keys, so sampling a pose
+// reads one block front to back:
+//
+//   uint32  counts_offset, values_offset
+//   float   vectors[]              per translation/scale track: the value if
+//                                  constant, else min xyz and extent xyz
+//   uint8   key_count[joints * 3]  rotation, translation, scale per joint
+//   uint8   key_frame[]            for tracks with more than one key
+//   uint16  key_value[][3]         rotations, animated translations/scales
+//
+// Rotations are stored smallest-three (2 bit index, 3 x 15 bit components),
+// translation and scale as 16 bit fractions of the segment range.  The last
+// frame of a segment is repeated as the first of the next, so interpolation
+// never straddles two blocks.
+struct CompressedClip
+{
+  static constexpr uint32_t SEGMENT_FRAMES = 16;
+
+  float sample_rate = 30.0f;
+  uint32_t frame_count = 0;
+  uint32_t joint_count = 0;
+  std::vector<uint32_t> segment_offsets;
+  std::vector<uint8_t> data;
+
+  float duration() const
+  {
+    return (frame_count > 1) ? float(frame_count - 1) / sample_rate : 0.0f;
+  }
+
+  size_t size_bytes() const
+  {
+    return sizeof(*this) + segment_offsets.size() * sizeof(uint32_t) +
+           data.size();
+  }
+};
+
+// Cook-time step; an offline cost, not meant for per-frame use.
+CompressedClip compress_clip(const AnimationClip &clip,
+                             const CompressionSettings &settings = {});
+
+// time wraps around the clip's duration
+void sample_clip(const CompressedClip &clip, float time, Transform *pose);
+
+#endif  // __ANIM_COMPRESSION_H__
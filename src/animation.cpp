@@ -0,0 +1,155 @@
+#include "animation.h"
+#include "anim_compression.h"
+#include "jobs.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+glm::mat4 to_matrix(const Transform &xform)
+{
+  glm::mat4 m = glm::mat4_cast(xform.rotation);
+  m[0] *= xform.scale.x;
+  m[1] *= xform.scale.y;
+  m[2] *= xform.scale.z;
+  m[3] = glm::vec4(xform.translation, 1.0f);
+  return m;
+}
+
+#if PROTO3D_HAS_AVX2
+inline
+__m256 dup128(const float *p)
+{
+  const __m128 v = _mm_loadu_ps(p);
+  return _mm256_set_m128(v, v);
+}
+#endif
+
+}  // unnamed namespace
+
+void sample_clip(const AnimationClip &clip, float time, Transform *pose)
+{
+  const size_t joints = clip.joint_count;
+  if (clip.frame_count < 2)
+  {
+    for (size_t j = 0; j < joints; ++j)
+      pose[j] = clip.keys[j];
+    return;
+  }
+
+  const float duration = clip.duration();
+  time = std::fmod(time, duration);
+  if (time < 0.0f)
+    time += duration;
+  const float frame = time * clip.sample_rate;
+  const auto f0 = std::min(static_cast<uint32_t>(frame), clip.frame_count - 2);
+  const float t = frame - float(f0);
+
+  const Transform *k0 = &clip.keys[f0 * joints];
+  const Transform *k1 = k0 + joints;
+  for (size_t j = 0; j < joints; ++j)
+  {
+    pose[j].rotation = nlerp(k0[j].rotation, k1[j].rotation, t);
+    pose[j].translation = glm::mix(k0[j].translation, k1[j].translation, t);
+    pose[j].scale = glm::mix(k0[j].scale, k1[j].scale, t);
+  }
+}
+
+void local_to_model(const Skeleton &skeleton,
+                    const Transform *local,
+                    glm::mat4 *model)
+{
+  const size_t joints = skeleton.joint_count();
+  for (size_t j = 0; j < joints; ++j)
+  {
+    const int16_t parent = skeleton.parents[j];
+    model[j] = (parent < 0) ? to_matrix(local[j])
+                            : model[parent] * to_matrix(local[j]);
+  }
+}
+
+void compute_palette(const glm::mat4 *model,
+                     const glm::mat4 *inverse_bind,
+                     size_t count,
+                     BoneMatrix *palette)
+{
+  for (size_t i = 0; i < count; ++i)
+  {
+    const float *a = &model[i][0][0];
+    const float *b = &inverse_bind[i][0][0];
+#if PROTO3D_HAS_AVX2
+    // column j of C = sum_k A.col[k] * B[j][k]; two columns per register with
+    // A's columns duplicated across both lanes
+    const __m256 a0 = dup128(a + 0);
+    const __m256 a1 = dup128(a + 4);
+    const __m256 a2 = dup128(a + 8);
+    const __m256 a3 = dup128(a + 12);
+    const __m256 b01 = _mm256_loadu_ps(b);
+    const __m256 b23 = _mm256_loadu_ps(b + 8);
+
+    __m256 c01 = _mm256_mul_ps(a0, _mm256_permute_ps(b01, 0x00));
+    c01 = _mm256_fmadd_ps(a1, _mm256_permute_ps(b01, 0x55), c01);
+    c01 = _mm256_fmadd_ps(a2, _mm256_permute_ps(b01, 0xAA), c01);
+    c01 = _mm256_fmadd_ps(a3, _mm256_permute_ps(b01, 0xFF), c01);
+    __m256 c23 = _mm256_mul_ps(a0, _mm256_permute_ps(b23, 0x00));
+    c23 = _mm256_fmadd_ps(a1, _mm256_permute_ps(b23, 0x55), c23);
+    c23 = _mm256_fmadd_ps(a2, _mm256_permute_ps(b23, 0xAA), c23);
+    c23 = _mm256_fmadd_ps(a3, _mm256_permute_ps(b23, 0xFF), c23);
+
+    __m128 r0 = _mm256_castps256_ps128(c01);
+    __m128 r1 = _mm256_extractf128_ps(c01, 1);
+    __m128 r2 = _mm256_castps256_ps128(c23);
+    __m128 r3 = _mm256_extractf128_ps(c23, 1);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_storeu_ps(palette[i].rows[0], r0);
+    _mm_storeu_ps(palette[i].rows[1], r1);
+    _mm_storeu_ps(palette[i].rows[2], r2);
+#else
+    for (size_t r = 0; r < 3; ++r)
+    {
+      for (size_t c = 0; c < 4; ++c)
+      {
+        palette[i].rows[r][c] = a[r] * b[c * 4 + 0] +
+                                a[4 + r] * b[c * 4 + 1] +
+                                a[8 + r] * b[c * 4 + 2] +
+                                a[12 + r] * b[c * 4 + 3];
+      }
+    }
+#endif
+  }
+}
+
+void animate_characters(JobSystem &jobs,
+                        Character *characters,
+                        size_t count,
+                        float dt,
+                        BoneMatrix *palettes)
+{
+  // a character is a few microseconds of work; batch to amortise dispatch
+  constexpr size_t CHARACTERS_PER_JOB = 16;
+  jobs.parallel_for(count, CHARACTERS_PER_JOB,
+                    [=](size_t begin, size_t end) {
+    thread_local std::vector<Transform> pose;
+    thread_local std::vector<glm::mat4> model;
+    for (size_t i = begin; i < end; ++i)
+    {
+      Character &c = characters[i];
+      const Skeleton &skeleton = *c.skeleton;
+      const size_t joints = skeleton.joint_count();
+      pose.resize(joints);
+      model.resize(joints);
+
+      // wrap here so long running characters don't lose float precision
+      c.time += dt * c.speed;
+      const float duration = c.clip->duration();
+      if (duration > 0.0f)
+        c.time = std::fmod(c.time, duration);
+      sample_clip(*c.clip, c.time, pose.data());
+      local_to_model(skeleton, pose.data(), model.data());
+      compute_palette(model.data(), skeleton.inverse_bind.data(), joints,
+                      palettes + c.palette_offset);
+    }
+  });
+}
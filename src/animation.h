@@ -0,0 +1,98 @@
+#ifndef __ANIMATION_H__
+#define __ANIMATION_H__
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+struct CompressedClip;
+
+struct Transform
+{
+  glm::quat rotation;
+  glm::vec3 translation{0.0f};
+  glm::vec3 scale{1.0f};
+};
+
+// Joints are sorted such that a parent always precedes its children; parents
+// of roots are -1.
+struct Skeleton
+{
+  std::vector<int16_t> parents;
+  std::vector<glm::mat4> inverse_bind;
+
+  size_t joint_count() const { return parents.size(); }
+};
+
+// Keys sampled at a fixed rate, stored frame-major:
+// keys[frame * joint_count + joint].
+struct AnimationClip
+{
+  float sample_rate = 30.0f;
+  uint32_t frame_count = 0;
+  uint32_t joint_count = 0;
+  std::vector<Transform> keys;
+
+  float duration() const
+  {
+    return (frame_count > 1) ? float(frame_count - 1) / sample_rate : 0.0f;
+  }
+};
+
+// Normalised lerp taking the shorter arc; close enough to slerp for keys a
+// frame apart and far cheaper.
+inline
+glm::quat nlerp(const glm::quat &a, const glm::quat &b, float t)
+{
+  const float sign = (glm::dot(a, b) < 0.0f) ? -1.0f : 1.0f;
+  const glm::quat q(a.w + t * (sign * b.w - a.w),
+                    a.x + t * (sign * b.x - a.x),
+                    a.y + t * (sign * b.y - a.y),
+                    a.z + t * (sign * b.z - a.z));
+  return glm::normalize(q);
+}
+
+// Affine 3x4 row-major joint matrix; the layout both the CPU skinning kernels
+// and the GPU palette (three vec4 rows per joint) read.
+struct BoneMatrix
+{
+  float rows[3][4];
+};
+
+// time wraps around the clip's duration
+void sample_clip(const AnimationClip &clip, float time, Transform *pose);
+
+void local_to_model(const Skeleton &skeleton,
+                    const Transform *local,
+                    glm::mat4 *model);
+
+// palette[i] = model[i] * inverse_bind[i], transposed to rows; batched with
+// AVX2 when available.
+void compute_palette(const glm::mat4 *model,
+                     const glm::mat4 *inverse_bind,
+                     size_t count,
+                     BoneMatrix *palette);
+
+struct Character
+{
+  const Skeleton *skeleton;
+  const CompressedClip *clip;
+  float time;
+  float speed;
+  // first joint of this character in the shared palette array
+  size_t palette_offset;
+};
+
+// Advances every character by dt and writes its joint palette at
+// palettes + palette_offset.  Characters are sampled in parallel.
+void animate_characters(JobSystem &jobs,
+                        Character *characters,
+                        size_t count,
+                        float dt,
+                        BoneMatrix *palettes);
+
+#endif  // __ANIMATION_H__
@@ -0,0 +1,99 @@
+#include "assets.h"
+#include "config.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+
+#include "embedded_assets.inc"
+
+bool read_file(const std::string &path, std::string *out)
+{
+  FILE *f = std::fopen(path.c_str(), "rb");
+  if (!f)
+    return false;
+  char buffer[4096];
+  size_t n;
+  while ((n = std::fread(buffer, 1, sizeof(buffer), f)) > 0)
+    out->append(buffer, n);
+  const bool ok = !std::ferror(f);
+  std::fclose(f);
+  return ok;
+}
+
+std::mutex preloaded_mutex;
+std::unordered_map<std::string, std::string> preloaded;
+
+bool take_preloaded(const char *name, std::string *out)
+{
+  std::lock_guard<std::mutex> lock(preloaded_mutex);
+  const auto it = preloaded.find(name);
+  if (it == preloaded.end())
+    return false;
+  *out = std::move(it->second);
+  preloaded.erase(it);
+  return true;
+}
+
+}  // unnamed namespace
+
+const EmbeddedAsset* find_embedded_asset(const char *name)
+{
+  const auto end = std::end(EMBEDDED_ASSETS);
+  const auto it = std::lower_bound(std::begin(EMBEDDED_ASSETS), end, name,
+                                   [](const EmbeddedAsset &a, const char *n) {
+                                     return std::strcmp(a.name, n) < 0;
+                                   });
+  return (it != end && !std::strcmp(it->name, name)) ? it : nullptr;
+}
+
+const char* asset_directory()
+{
+  if (const char *dir = std::getenv("PROTO3D_DATA_DIR"))
+    return dir;
+  return PROTO3D_LIVE_ASSETS ? PROTO3D_DATA_DIR : nullptr;
+}
+
+std::string asset_text(const char *name)
+{
+  std::string text;
+  if (const char *dir = asset_directory())
+  {
+    if (take_preloaded(name, &text) ||
+        read_file(std::string(dir) + '/' + name, &text))
+      return text;
+    text.clear();
+  }
+  if (const EmbeddedAsset *asset = find_embedded_asset(name))
+    return std::string(reinterpret_cast<const char*>(asset->data),
+                       asset->size);
+  std::cerr << "Asset " << name << " is missing\n";
+  return text;
+}
+
+void preload_assets(JobSystem &jobs, JobCounter *counter)
+{
+  const char *dir = asset_directory();
+  if (!dir)
+    return;
+  for (const EmbeddedAsset &asset : EMBEDDED_ASSETS)
+  {
+    const std::string path = std::string(dir) + '/' + asset.name;
+    const char *name = asset.name;
+    jobs.submit([path, name]() {
+      std::string text;
+      if (!read_file(path, &text))
+        return;
+      std::lock_guard<std::mutex> lock(preloaded_mutex);
+      preloaded[name] = std::move(text);
+    }, counter);
+  }
+}
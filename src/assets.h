@@ -0,0 +1,43 @@
+#ifndef __ASSETS_H__
+#define __ASSETS_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class JobSystem;
+struct JobCounter;
+
+// Small assets startup can't do without, e.g. the core shaders, are compiled
+// into the binary from /data by cmake/EmbedAssets.cmake, so nothing is read
+// from disk before the first frame.  While developing, point the environment
+// variable PROTO3D_DATA_DIR at a data directory, or configure with
+// PROTO3D_LIVE_ASSETS to use the source tree's, and they're read from there
+// instead, falling back to the embedded copy for any that are missing.
+
+struct EmbeddedAsset
+{
+  const char *name;  // path under /data, e.g. "shaders/voxel.vert"
+  const uint8_t *data;  // size bytes and then a NUL
+  size_t size;
+};
+
+// nullptr if name wasn't embedded
+const EmbeddedAsset* find_embedded_asset(const char *name);
+
+// Where assets are read from at run time; nullptr if only the embedded ones
+// are used.
+const char* asset_directory();
+
+// The asset's contents, from asset_directory() if it's there, else embedded;
+// empty, with a message on stderr, if neither has it.
+std::string asset_text(const char *name);
+
+// Reads every embedded asset's copy in asset_directory() on the pool, e.g.
+// while the window is being created, so asset_text needn't wait on the disk;
+// nothing to do without a directory.  Each copy read is handed out once, by
+// the first asset_text after counter drains; later calls read the file again,
+// so edits still show.
+void preload_assets(JobSystem &jobs, JobCounter *counter);
+
+#endif  // __ASSETS_H__
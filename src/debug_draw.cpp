@@ -0,0 +1,315 @@
+#include "debug_draw.h"
+
+#if PROTO3D_DEBUG_DRAW
+
+#include "assets.h"
+#include "perf.h"
+#include "shader.h"
+#include "stream_buffer.h"
+#include "util.h"
+
+#include "glad/glad.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct DebugVertex
+{
+  float x, y, z;
+  uint32_t color;
+};
+
+enum Layer
+{
+  DEPTH_TESTED,
+  ON_TOP,
+  LAYER_COUNT
+};
+
+constexpr int CIRCLE_SEGMENTS = 32;
+constexpr GLsizeiptr RING_BYTES = 8 << 20;
+
+struct ThreadBuffer
+{
+  std::mutex mutex;
+  std::vector<DebugVertex> lines[LAYER_COUNT];
+};
+
+// Buffers of every thread that ever drew; they outlive their threads so no
+// line is lost, and are only touched by flush otherwise.
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<ThreadBuffer>> registry;
+// between init and shutdown; lines drawn otherwise would never be flushed
+std::atomic<bool> accepting{ false };
+
+struct Renderer
+{
+  StreamBuffer ring;
+  GLuint vao = 0;
+  GLuint program = 0;
+  GLint u_view_proj = -1;
+  std::vector<DebugVertex> merged[LAYER_COUNT];
+};
+Renderer renderer;
+
+ThreadBuffer& local_buffer()
+{
+  thread_local ThreadBuffer *buffer = nullptr;
+  if (!buffer)
+  {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    registry.push_back(std::make_unique<ThreadBuffer>());
+    buffer = registry.back().get();
+  }
+  return *buffer;
+}
+
+DebugVertex vertex(const glm::vec3 &p, uint32_t color)
+{
+  return DebugVertex{ p.x, p.y, p.z, color };
+}
+
+// 12 edges of a box given its corners, bit 0 of the index picking x, bit 1 y
+// and bit 2 z
+void box_edges(const glm::vec3 corners[8], uint32_t color, bool on_top)
+{
+  ThreadBuffer &buffer = local_buffer();
+  std::lock_guard<std::mutex> lock(buffer.mutex);
+  auto &lines = buffer.lines[on_top ? ON_TOP : DEPTH_TESTED];
+  const size_t first = lines.size();
+  lines.resize(first + 24);
+  DebugVertex *out = lines.data() + first;
+  for (int c = 0; c < 8; ++c)
+  {
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      if (c & (1 << axis))
+        continue;
+      *out++ = vertex(corners[c], color);
+      *out++ = vertex(corners[c | (1 << axis)], color);
+    }
+  }
+}
+
+}  // unnamed namespace
+
+void debug_line(const glm::vec3 &a, const glm::vec3 &b, uint32_t color,
+                bool on_top)
+{
+  if (!accepting.load(std::memory_order_relaxed))
+    return;
+  ThreadBuffer &buffer = local_buffer();
+  std::lock_guard<std::mutex> lock(buffer.mutex);
+  auto &lines = buffer.lines[on_top ? ON_TOP : DEPTH_TESTED];
+  lines.push_back(vertex(a, color));
+  lines.push_back(vertex(b, color));
+}
+
+void debug_aabb(const glm::vec3 &min, const glm::vec3 &max, uint32_t color,
+                bool on_top)
+{
+  if (!accepting.load(std::memory_order_relaxed))
+    return;
+  glm::vec3 corners[8];
+  for (int c = 0; c < 8; ++c)
+    corners[c] = glm::vec3((c & 1) ? max.x : min.x, (c & 2) ? max.y : min.y,
+                           (c & 4) ? max.z : min.z);
+  box_edges(corners, color, on_top);
+}
+
+void debug_frustum(const glm::mat4 &inverse_view_proj, uint32_t color,
+                   bool on_top)
+{
+  if (!accepting.load(std::memory_order_relaxed))
+    return;
+  glm::vec3 corners[8];
+  for (int c = 0; c < 8; ++c)
+  {
+    const glm::vec4 p = inverse_view_proj *
+                        glm::vec4((c & 1) ? 1.0f : -1.0f,
+                                  (c & 2) ? 1.0f : -1.0f,
+                                  (c & 4) ? 1.0f : -1.0f, 1.0f);
+    corners[c] = glm::vec3(p.x, p.y, p.z) / p.w;
+  }
+  box_edges(corners, color, on_top);
+}
+
+void debug_sphere(const glm::vec3 &center, float radius, uint32_t color,
+                  bool on_top)
+{
+  if (!accepting.load(std::memory_order_relaxed))
+    return;
+  // unit circle once; every sphere only scales it
+  static const struct Circle
+  {
+    float c[CIRCLE_SEGMENTS + 1];
+    float s[CIRCLE_SEGMENTS + 1];
+    Circle()
+    {
+      for (int i = 0; i <= CIRCLE_SEGMENTS; ++i)
+      {
+        const float a = 6.2831853f * static_cast<float>(i) / CIRCLE_SEGMENTS;
+        c[i] = std::cos(a);
+        s[i] = std::sin(a);
+      }
+    }
+  } circle;
+
+  ThreadBuffer &buffer = local_buffer();
+  std::lock_guard<std::mutex> lock(buffer.mutex);
+  auto &lines = buffer.lines[on_top ? ON_TOP : DEPTH_TESTED];
+  const size_t first = lines.size();
+  lines.resize(first + 3 * CIRCLE_SEGMENTS * 2);
+  DebugVertex *out = lines.data() + first;
+  for (int plane = 0; plane < 3; ++plane)
+  {
+    const int u = plane, v = (plane + 1) % 3;
+    for (int i = 0; i < CIRCLE_SEGMENTS; ++i)
+    {
+      glm::vec3 a = center, b = center;
+      a[u] += circle.c[i] * radius;
+      a[v] += circle.s[i] * radius;
+      b[u] += circle.c[i + 1] * radius;
+      b[v] += circle.s[i + 1] * radius;
+      *out++ = vertex(a, color);
+      *out++ = vertex(b, color);
+    }
+  }
+}
+
+void debug_axes(const glm::mat4 &transform, float size, bool on_top)
+{
+  if (!accepting.load(std::memory_order_relaxed))
+    return;
+  const glm::vec3 origin(transform[3].x, transform[3].y, transform[3].z);
+  const uint32_t colors[3] = { DEBUG_RED, DEBUG_GREEN, DEBUG_BLUE };
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    const glm::vec4 &dir = transform[axis];
+    debug_line(origin, origin + glm::vec3(dir.x, dir.y, dir.z) * size,
+               colors[axis], on_top);
+  }
+}
+
+bool debug_draw_init()
+{
+  renderer.program =
+    compile_program("debug_draw", asset_text("shaders/debug_draw.vert").c_str(),
+                    asset_text("shaders/debug_draw.frag").c_str());
+  if (!renderer.program)
+    return false;
+  renderer.u_view_proj = glGetUniformLocation(renderer.program,
+                                              "u_view_proj");
+  glGenVertexArrays(1, &renderer.vao);
+  glBindVertexArray(renderer.vao);
+  gl_label(GL_VERTEX_ARRAY_KHR, renderer.vao, "debug draw");
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+  glBindVertexArray(0);
+  if (!renderer.ring.init(GL_ARRAY_BUFFER, RING_BYTES, "debug draw ring"))
+    return false;
+  accepting.store(true, std::memory_order_relaxed);
+  return true;
+}
+
+void debug_draw_shutdown()
+{
+  accepting.store(false, std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> registry_lock(registry_mutex);
+    for (auto &buffer : registry)
+    {
+      std::lock_guard<std::mutex> lock(buffer->mutex);
+      for (auto &lines : buffer->lines)
+        lines = std::vector<DebugVertex>();
+    }
+  }
+  renderer.ring.destroy();
+  glDeleteVertexArrays(1, &renderer.vao);
+  glDeleteProgram(renderer.program);
+  renderer.vao = renderer.program = 0;
+}
+
+void debug_draw_flush(const glm::mat4 &view_proj)
+{
+  GL_ZONE("debug draw");
+  {
+    std::lock_guard<std::mutex> registry_lock(registry_mutex);
+    for (auto &buffer : registry)
+    {
+      std::lock_guard<std::mutex> lock(buffer->mutex);
+      for (int layer = 0; layer < LAYER_COUNT; ++layer)
+      {
+        auto &src = buffer->lines[layer];
+        renderer.merged[layer].insert(renderer.merged[layer].end(),
+                                      src.begin(), src.end());
+        src.clear();
+      }
+    }
+  }
+
+  const size_t total = renderer.merged[DEPTH_TESTED].size() +
+                       renderer.merged[ON_TOP].size();
+  // a frame's lines must fit a third of the ring; drop the rest
+  const size_t capacity = static_cast<size_t>(RING_BYTES) / 3 /
+                          sizeof(DebugVertex);
+  if (total && renderer.program)
+  {
+    const size_t count = std::min(total, capacity) & ~size_t(1);
+    GLintptr offset = 0;
+    auto *dst = static_cast<DebugVertex*>(renderer.ring.map(
+      static_cast<GLsizeiptr>(count * sizeof(DebugVertex)),
+      sizeof(DebugVertex), &offset));
+    if (dst)
+    {
+      const size_t tested = std::min(count,
+                                     renderer.merged[DEPTH_TESTED].size());
+      std::memcpy(dst, renderer.merged[DEPTH_TESTED].data(),
+                  tested * sizeof(DebugVertex));
+      std::memcpy(dst + tested, renderer.merged[ON_TOP].data(),
+                  (count - tested) * sizeof(DebugVertex));
+      renderer.ring.unmap();
+
+      constexpr auto stride = static_cast<GLsizei>(sizeof(DebugVertex));
+      glBindVertexArray(renderer.vao);
+      glBindBuffer(GL_ARRAY_BUFFER, renderer.ring.id());
+      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride,
+                            reinterpret_cast<const void*>(offset));
+      glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+                            reinterpret_cast<const void*>(
+                              offset + offsetof(DebugVertex, color)));
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+      glUseProgram(renderer.program);
+      glUniformMatrix4fv(renderer.u_view_proj, 1, GL_FALSE, &view_proj[0][0]);
+      if (tested)
+      {
+        glEnable(GL_DEPTH_TEST);
+        glDrawArrays(GL_LINES, 0, static_cast<GLsizei>(tested));
+        perf_count(PerfCounter::DRAW_CALLS);
+      }
+      if (count > tested)
+      {
+        glDisable(GL_DEPTH_TEST);
+        glDrawArrays(GL_LINES, static_cast<GLint>(tested),
+                     static_cast<GLsizei>(count - tested));
+        perf_count(PerfCounter::DRAW_CALLS);
+        glEnable(GL_DEPTH_TEST);
+      }
+      glBindVertexArray(0);
+      renderer.ring.end_frame();
+    }
+  }
+  for (auto &merged : renderer.merged)
+    merged.clear();
+}
+
+#endif  // PROTO3D_DEBUG_DRAW
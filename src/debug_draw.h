@@ -0,0 +1,70 @@
+#ifndef __DEBUG_DRAW_H__
+#define __DEBUG_DRAW_H__
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+// Immediate-mode debug lines.  Compiled in for debug builds only; define
+// PROTO3D_DEBUG_DRAW to 0 or 1 to override.  In Release every call below is
+// an empty inline function, and code that only exists to feed it (walking a
+// BVH, say) should sit under `if (DEBUG_DRAW)` so it vanishes too.
+#ifndef PROTO3D_DEBUG_DRAW
+#  ifdef NDEBUG
+#    define PROTO3D_DEBUG_DRAW 0
+#  else
+#    define PROTO3D_DEBUG_DRAW 1
+#  endif
+#endif
+
+constexpr bool DEBUG_DRAW = PROTO3D_DEBUG_DRAW;
+
+// RGBA8, red in the low byte
+constexpr uint32_t DEBUG_RED = 0xff0000ffu;
+constexpr uint32_t DEBUG_GREEN = 0xff00ff00u;
+constexpr uint32_t DEBUG_BLUE = 0xffff0000u;
+constexpr uint32_t DEBUG_YELLOW = 0xff00ffffu;
+constexpr uint32_t DEBUG_WHITE = 0xffffffffu;
+
+#if PROTO3D_DEBUG_DRAW
+
+// Callable from any thread at any time: each thread appends to its own
+// buffer, taking only its own, uncontended lock.  on_top lines skip the depth
+// test.  Lines are dropped unless debug_draw_init succeeded.
+void debug_line(const glm::vec3 &a, const glm::vec3 &b, uint32_t color,
+                bool on_top = false);
+void debug_aabb(const glm::vec3 &min, const glm::vec3 &max, uint32_t color,
+                bool on_top = false);
+// edges of the frustum whose clip space inverse_view_proj maps back
+void debug_frustum(const glm::mat4 &inverse_view_proj, uint32_t color,
+                   bool on_top = false);
+// three great circles
+void debug_sphere(const glm::vec3 &center, float radius, uint32_t color,
+                  bool on_top = false);
+// x, y and z of transform in red, green and blue, size long
+void debug_axes(const glm::mat4 &transform, float size, bool on_top = false);
+
+// Main thread, with a GL context; shutdown drops lines not yet flushed.
+bool debug_draw_init();
+void debug_draw_shutdown();
+// Merges every thread's lines and draws them, depth tested ones first, in at
+// most two calls; lines appended meanwhile wait for the next frame.
+void debug_draw_flush(const glm::mat4 &view_proj);
+
+#else
+
+inline void debug_line(const glm::vec3&, const glm::vec3&, uint32_t,
+                       bool = false) { }
+inline void debug_aabb(const glm::vec3&, const glm::vec3&, uint32_t,
+                       bool = false) { }
+inline void debug_frustum(const glm::mat4&, uint32_t, bool = false) { }
+inline void debug_sphere(const glm::vec3&, float, uint32_t, bool = false) { }
+inline void debug_axes(const glm::mat4&, float, bool = false) { }
+
+inline bool debug_draw_init() { return true; }
+inline void debug_draw_shutdown() { }
+inline void debug_draw_flush(const glm::mat4&) { }
+
+#endif  // PROTO3D_DEBUG_DRAW
+
+#endif  // __DEBUG_DRAW_H__
@@ -0,0 +1,273 @@
+#include "frame_capture.h"
+#include "util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+FrameCapture::FrameCapture(JobSystem &jobs)
+  : jobs_(jobs)
+  , archive_(&jobs)
+  , max_encoding_(jobs.thread_count() + 1)
+{
+}
+
+FrameCapture::~FrameCapture()
+{
+  stop();
+  for (auto &slot : slots_)
+    glDeleteBuffers(1, &slot.pbo);
+}
+
+bool FrameCapture::init_gl()
+{
+  for (auto &slot : slots_)
+  {
+    glGenBuffers(1, &slot.pbo);
+    if (!slot.pbo)
+      return false;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    gl_label(GL_BUFFER_KHR, slot.pbo, "capture readback");
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  return true;
+}
+
+void FrameCapture::start(const std::string &pattern, bool drop_when_busy)
+{
+  stop();
+  pattern_ = pattern;
+  format_ = image_format_for(pattern.c_str());
+  const size_t ext = sizeof(FRAME_ARCHIVE_EXTENSION) - 1;
+  archiving_ = (pattern.size() >= ext) &&
+               !pattern.compare(pattern.size() - ext, ext,
+                                FRAME_ARCHIVE_EXTENSION);
+  if (archiving_ && !archive_.open(pattern.c_str()))
+  {
+    std::fprintf(stderr, "Unable to write %s\n", pattern.c_str());
+    return;
+  }
+  drop_ = drop_when_busy;
+  paused_ = false;
+  frame_ = 0;
+  sequence_ = 0;
+  captured_ = dropped_ = render_calls_ = 0;
+  written_.store(0, std::memory_order_relaxed);
+  failed_.store(0, std::memory_order_relaxed);
+  render_ms_max_ = render_ms_total_ = 0.0;
+  active_ = true;
+}
+
+void FrameCapture::stop()
+{
+  // oldest first, so each wait finds the ones before it done
+  for (int i = 0; i < RING; ++i)
+    retire(slots_[(next_ + i) % RING], true);
+  jobs_.wait(encoding_);
+  if (archiving_)
+  {
+    // written frames count as they land; a failed write may lose the ones
+    // after it too
+    written_.store(archive_.written(), std::memory_order_relaxed);
+    if (!archive_.close())
+    {
+      std::fprintf(stderr, "Unable to write %s\n", pattern_.c_str());
+      failed_.store(captured_ - written_.load(std::memory_order_relaxed),
+                    std::memory_order_relaxed);
+    }
+    archiving_ = false;
+  }
+  active_ = false;
+}
+
+void FrameCapture::retire(Slot &slot, bool wait)
+{
+  if (slot.state == SlotState::READING)
+  {
+    constexpr GLuint64 ONE_SECOND = 1000000000;
+    GLenum status = glClientWaitSync(slot.fence,
+                                     wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                     wait ? ONE_SECOND : 0);
+    while (wait && (status == GL_TIMEOUT_EXPIRED))
+      status = glClientWaitSync(slot.fence, 0, ONE_SECOND);
+    if ((status != GL_ALREADY_SIGNALED) &&
+        (status != GL_CONDITION_SATISFIED))
+      return;
+    map(slot);
+  }
+  if (slot.state == SlotState::MAPPED)
+  {
+    if (slot.copying.load(std::memory_order_acquire))
+    {
+      if (!wait)
+        return;
+      jobs_.wait(encoding_);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.state = SlotState::FREE;
+  }
+}
+
+void FrameCapture::read(Slot &slot, int width, int height)
+{
+  const GLsizeiptr bytes = static_cast<GLsizeiptr>(width) * height * 4;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+  if (slot.size != bytes)
+  {
+    glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+    slot.size = bytes;
+  }
+  // into the buffer: returns once the copy is queued
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  slot.width = width;
+  slot.height = height;
+  slot.frame = frame_;
+  slot.sequence = sequence_++;
+  slot.state = SlotState::READING;
+}
+
+void FrameCapture::map(Slot &slot)
+{
+  glDeleteSync(slot.fence);
+  slot.fence = nullptr;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+  const void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.size,
+                                      GL_MAP_READ_BIT);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  if (!data)
+  {
+    std::fprintf(stderr, "Unable to map captured frame %d\n", slot.frame);
+    failed_.fetch_add(1, std::memory_order_relaxed);
+    if (archiving_)
+      archive_.skip(slot.sequence);
+    slot.state = SlotState::FREE;
+    return;
+  }
+
+  slot.state = SlotState::MAPPED;
+  slot.copying.store(true, std::memory_order_relaxed);
+  const int width = slot.width, height = slot.height;
+  Slot *s = &slot;
+  if (archiving_)
+  {
+    // the archive encodes in sequence on whichever job hands in the frame
+    // next due, spreading its strips over the pool
+    jobs_.submit([this, s, data, width, height, sequence = slot.sequence,
+                  frame = static_cast<uint32_t>(slot.frame)]() {
+      std::vector<uint8_t> pixels = archive_.take_buffer(
+        static_cast<size_t>(width) * 4 * static_cast<size_t>(height));
+      std::memcpy(pixels.data(), data, pixels.size());
+      s->copying.store(false, std::memory_order_release);
+      archive_.add(sequence, frame, width, height, true, std::move(pixels));
+    }, &encoding_);
+    return;
+  }
+
+  std::vector<char> path(pattern_.size() + 32);
+  std::snprintf(path.data(), path.size(), pattern_.c_str(), slot.frame);
+  const ImageFormat format = format_;
+  // copying out first frees the buffer for unmapping before encoding starts;
+  // mapped memory may be uncached, so it's read once, in order
+  jobs_.submit([this, s, data, width, height, format,
+                file = std::string(path.data())]() {
+    const size_t row = static_cast<size_t>(width) * 4;
+    std::vector<uint8_t> pixels = take_buffer(row *
+                                              static_cast<size_t>(height));
+    std::memcpy(pixels.data(), data, pixels.size());
+    s->copying.store(false, std::memory_order_release);
+
+    std::vector<uint8_t> encoded;
+    // bottom-up rows, written top-down; the default framebuffer's alpha is
+    // meaningless, so it's dropped
+    encode_image(format, pixels.data() + row * static_cast<size_t>(height - 1),
+                 width, height, -static_cast<ptrdiff_t>(row), 3, &encoded);
+    give_buffer(std::move(pixels));
+    if (write_file(file.c_str(), encoded))
+      written_.fetch_add(1, std::memory_order_relaxed);
+    else
+    {
+      std::fprintf(stderr, "Unable to write %s\n", file.c_str());
+      failed_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }, &encoding_);
+}
+
+void FrameCapture::capture(int width, int height)
+{
+  if (!active_ || (width <= 0) || (height <= 0))
+    return;
+  GL_ZONE("capture");
+  const auto start = std::chrono::steady_clock::now();
+
+  for (int i = 0; i < RING; ++i)
+    retire(slots_[(next_ + i) % RING], false);
+  // with no workers jobs only run when waited for
+  if (!jobs_.worker_count())
+    jobs_.wait(encoding_);
+  if (paused_)
+    return;
+
+  Slot &slot = slots_[next_];
+  // frames queued in the archive behind the one being encoded are done with
+  // their jobs, but still hold memory
+  const bool busy = (slot.state != SlotState::FREE) ||
+                    (encoding_.pending.load(std::memory_order_acquire) >=
+                     max_encoding_) ||
+                    (archiving_ && (archive_.pending() >= max_encoding_));
+  if (busy && drop_)
+    ++dropped_;
+  else
+  {
+    if (busy)
+    {
+      retire(slot, true);
+      if (encoding_.pending.load(std::memory_order_acquire) >= max_encoding_)
+        jobs_.wait(encoding_);
+    }
+    read(slot, width, height);
+    next_ = (next_ + 1) % RING;
+    ++captured_;
+  }
+  ++frame_;
+
+  const double ms = std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - start).count();
+  render_ms_max_ = std::max(render_ms_max_, ms);
+  render_ms_total_ += ms;
+  ++render_calls_;
+}
+
+CaptureStats FrameCapture::stats() const
+{
+  return CaptureStats{
+    captured_, dropped_, written_.load(std::memory_order_relaxed),
+    failed_.load(std::memory_order_relaxed), render_ms_max_,
+    render_calls_ ? render_ms_total_ / static_cast<double>(render_calls_) :
+                    0.0 };
+}
+
+std::vector<uint8_t> FrameCapture::take_buffer(size_t bytes)
+{
+  std::vector<uint8_t> buffer;
+  {
+    std::lock_guard<std::mutex> lock(spare_mutex_);
+    if (!spare_.empty())
+    {
+      buffer = std::move(spare_.back());
+      spare_.pop_back();
+    }
+  }
+  buffer.resize(bytes);
+  return buffer;
+}
+
+void FrameCapture::give_buffer(std::vector<uint8_t> buffer)
+{
+  std::lock_guard<std::mutex> lock(spare_mutex_);
+  spare_.push_back(std::move(buffer));
+}
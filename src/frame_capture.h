@@ -0,0 +1,124 @@
+#ifndef __FRAME_CAPTURE_H__
+#define __FRAME_CAPTURE_H__
+
+#include "frame_codec.h"
+#include "image_write.h"
+#include "jobs.h"
+
+#include "glad/glad.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct CaptureStats
+{
+  uint64_t captured;  // frames read back
+  uint64_t dropped;   // skipped as the ring or the encoders were still busy
+  uint64_t written;
+  uint64_t failed;    // read back but not written
+  double render_ms_max;   // longest capture() took on the render thread
+  double render_ms_mean;
+};
+
+// Captures frames to image files without stalling the render thread.  Each
+// frame is read into the next of RING pixel pack buffers; its fence is polled
+// on later frames and, once signalled, the buffer is mapped and a job copies
+// it out, encodes it and writes the file, so the render thread only ever
+// issues the read, the map and the unmap.  Work still in flight when a slot
+// comes round again makes the frame a drop, or a wait if drops are off.
+// Without JobSystem workers the jobs run on the render thread, which stalls.
+// A pattern ending in FRAME_ARCHIVE_EXTENSION appends every frame to one
+// archive instead (see frame_codec.h), which encodes many times quicker.
+class FrameCapture
+{
+public:
+  static constexpr int RING = 3;
+
+  explicit FrameCapture(JobSystem &jobs);
+  // stops; needs the context current
+  ~FrameCapture();
+
+  FrameCapture(const FrameCapture&) = delete;
+  FrameCapture& operator=(const FrameCapture&) = delete;
+
+  bool init_gl();
+
+  // pattern is a printf format taking the frame number as an int, e.g.
+  // "capture/frame_%05d.qoi"; its extension picks the format (see
+  // image_format_for), or an archive path, e.g. "capture/run.p3df"; frame
+  // numbers and stats() restart.  Without drops
+  // every frame is written, waiting when the encoders fall behind; headless
+  // runs want that.
+  void start(const std::string &pattern, bool drop_when_busy = true);
+  // Finishes every capture in flight.
+  void stop();
+  bool active() const { return active_; }
+  // While paused, capture() only finishes the frames in flight; resuming
+  // carries on the numbering, the archive and stats().
+  void set_paused(bool paused) { paused_ = paused; }
+  bool paused() const { return paused_; }
+
+  // Reads the bound read framebuffer's colour; call after drawing a frame,
+  // before swapping.
+  void capture(int width, int height);
+
+  CaptureStats stats() const;
+
+private:
+  enum class SlotState
+  {
+    FREE,
+    READING,  // glReadPixels issued, fenced
+    MAPPED,   // a job is copying the pixels out
+  };
+
+  struct Slot
+  {
+    GLuint pbo = 0;
+    GLsizeiptr size = 0;
+    GLsync fence = nullptr;
+    SlotState state = SlotState::FREE;
+    std::atomic<bool> copying{ false };
+    int width = 0, height = 0;
+    int frame = 0;
+    uint64_t sequence = 0;  // in the archive
+  };
+
+  void read(Slot &slot, int width, int height);
+  // Maps a slot whose fence is signalled and unmaps one copied out; wait
+  // blocks until both happened.
+  void retire(Slot &slot, bool wait);
+  void map(Slot &slot);
+  std::vector<uint8_t> take_buffer(size_t bytes);
+  void give_buffer(std::vector<uint8_t> buffer);
+
+  JobSystem &jobs_;
+  Slot slots_[RING];
+  int next_ = 0;
+  int frame_ = 0;
+  bool active_ = false;
+  bool paused_ = false;
+  bool drop_ = true;
+  std::string pattern_;
+  ImageFormat format_ = ImageFormat::PNG;
+  FrameArchive archive_;
+  bool archiving_ = false;
+  uint64_t sequence_ = 0;
+
+  // frames copied out but not yet written; bounded so slow encoders can't
+  // queue up unbounded memory
+  JobCounter encoding_;
+  size_t max_encoding_ = 0;
+  std::mutex spare_mutex_;
+  std::vector<std::vector<uint8_t>> spare_;
+
+  uint64_t captured_ = 0, dropped_ = 0;
+  std::atomic<uint64_t> written_{ 0 }, failed_{ 0 };
+  double render_ms_max_ = 0.0, render_ms_total_ = 0.0;
+  uint64_t render_calls_ = 0;
+};
+
+#endif  // __FRAME_CAPTURE_H__
@@ -0,0 +1,472 @@
+#include "frame_codec.h"
+
+#include "simd.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// zero runs shorter than this stay in the literals; a run costs a token
+constexpr size_t MIN_ZERO_RUN = 8;
+constexpr size_t BLOCK = 32;
+
+int count_trailing_zeros(uint64_t v)
+{
+#if defined(__GNUC__)
+  return __builtin_ctzll(v);
+#else
+  int n = 0;
+  for (; !(v & 1); v >>= 1)
+    ++n;
+  return n;
+#endif
+}
+
+#if PROTO3D_HAS_AVX2
+int pop_count(uint32_t v)
+{
+#if defined(__GNUC__)
+  return __builtin_popcount(v);
+#else
+  int n = 0;
+  for (; v; v &= v - 1)
+    ++n;
+  return n;
+#endif
+}
+#endif
+
+// bit i set if p[i] is zero, for 32 bytes
+uint32_t zero_mask(const uint8_t *p)
+{
+#if PROTO3D_HAS_AVX2
+  const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+  return static_cast<uint32_t>(_mm256_movemask_epi8(
+    _mm256_cmpeq_epi8(v, _mm256_setzero_si256())));
+#else
+  uint32_t m = 0;
+  for (size_t i = 0; i < BLOCK; ++i)
+    m |= static_cast<uint32_t>(!p[i]) << i;
+  return m;
+#endif
+}
+
+// Residuals of a row against the pixel to the left (left) and the previous
+// frame's row (previous), which then becomes this row; returns the zero
+// bytes in each.
+void predict_row(const uint8_t *src, uint8_t *previous, size_t n, uint8_t *left,
+                 uint8_t *temporal, size_t *left_zeros, size_t *temporal_zeros)
+{
+  size_t lz = 0, tz = 0;
+  size_t i = 0;
+  for (; (i < 4) && (i < n); ++i)
+  {
+    left[i] = src[i];
+    temporal[i] = static_cast<uint8_t>(src[i] - previous[i]);
+    previous[i] = src[i];
+    lz += !left[i];
+    tz += !temporal[i];
+  }
+#if PROTO3D_HAS_AVX2
+  const __m256i zero = _mm256_setzero_si256();
+  for (; i + BLOCK <= n; i += BLOCK)
+  {
+    const __m256i c = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(src + i));
+    const __m256i l = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(src + i - 4));
+    const __m256i p = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(previous + i));
+    const __m256i dl = _mm256_sub_epi8(c, l);
+    const __m256i dp = _mm256_sub_epi8(c, p);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(left + i), dl);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(temporal + i), dp);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(previous + i), c);
+    lz += static_cast<size_t>(pop_count(static_cast<uint32_t>(
+      _mm256_movemask_epi8(_mm256_cmpeq_epi8(dl, zero)))));
+    tz += static_cast<size_t>(pop_count(static_cast<uint32_t>(
+      _mm256_movemask_epi8(_mm256_cmpeq_epi8(dp, zero)))));
+  }
+#endif
+  for (; i < n; ++i)
+  {
+    left[i] = static_cast<uint8_t>(src[i] - src[i - 4]);
+    temporal[i] = static_cast<uint8_t>(src[i] - previous[i]);
+    previous[i] = src[i];
+    lz += !left[i];
+    tz += !temporal[i];
+  }
+  *left_zeros += lz;
+  *temporal_zeros += tz;
+}
+
+// where the next run of at least MIN_ZERO_RUN zeros starts; n if none
+size_t next_zero_run(const uint8_t *r, size_t i, size_t n)
+{
+  if (i + 2 * BLOCK <= n)
+  {
+    uint64_t next = zero_mask(r + i);
+    for (; i + 2 * BLOCK <= n; i += BLOCK)
+    {
+      const uint64_t m = next | (uint64_t(zero_mask(r + i + BLOCK)) << 32);
+      next = m >> 32;
+      // bit k survives if bytes k to k + 7 are all zero
+      uint64_t run = m & (m >> 1);
+      run &= run >> 2;
+      run &= run >> 4;
+      run &= 0xFFFFFFFFu;
+      if (run)
+        return i + static_cast<size_t>(count_trailing_zeros(run));
+    }
+  }
+  size_t zeros = 0;
+  for (; i < n; ++i)
+  {
+    zeros = r[i] ? 0 : zeros + 1;
+    if (zeros == MIN_ZERO_RUN)
+      return i + 1 - MIN_ZERO_RUN;
+  }
+  return n;
+}
+
+size_t zero_run_length(const uint8_t *r, size_t i, size_t n)
+{
+  const size_t start = i;
+  for (; i + BLOCK <= n; i += BLOCK)
+  {
+    const uint32_t m = zero_mask(r + i);
+    if (m != 0xFFFFFFFFu)
+      return i + static_cast<size_t>(count_trailing_zeros(~m)) - start;
+  }
+  while ((i < n) && !r[i])
+    ++i;
+  return i - start;
+}
+
+void put_varint(std::vector<uint8_t> *out, size_t v)
+{
+  while (v >= 0x80)
+  {
+    out->push_back(static_cast<uint8_t>(v | 0x80));
+    v >>= 7;
+  }
+  out->push_back(static_cast<uint8_t>(v));
+}
+
+bool get_varint(const uint8_t *&p, const uint8_t *end, size_t *v)
+{
+  *v = 0;
+  for (int shift = 0; (p < end) && (shift < 64); shift += 7)
+  {
+    const uint8_t b = *p++;
+    *v |= static_cast<size_t>(b & 0x7F) << shift;
+    if (!(b & 0x80))
+      return true;
+  }
+  return false;
+}
+
+void put_u32(std::vector<uint8_t> *out, uint32_t v)
+{
+  for (int i = 0; i < 4; ++i)
+    out->push_back(static_cast<uint8_t>(v >> (8 * i)));
+}
+
+void set_u32(uint8_t *p, uint32_t v)
+{
+  for (int i = 0; i < 4; ++i)
+    p[i] = static_cast<uint8_t>(v >> (8 * i));
+}
+
+uint32_t get_u32(const uint8_t *p)
+{
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+void encode_runs(const uint8_t *r, size_t n, std::vector<uint8_t> *out)
+{
+  size_t i = 0;
+  while (i < n)
+  {
+    const size_t zeros_at = next_zero_run(r, i, n);
+    const size_t zeros = (zeros_at < n) ? zero_run_length(r, zeros_at, n) : 0;
+    put_varint(out, zeros_at - i);
+    out->insert(out->end(), r + i, r + zeros_at);
+    put_varint(out, zeros);
+    i = zeros_at + zeros;
+  }
+}
+
+bool decode_runs(const uint8_t *p, const uint8_t *end, uint8_t *r, size_t n)
+{
+  size_t i = 0;
+  while (i < n)
+  {
+    size_t literals = 0, zeros = 0;
+    if (!get_varint(p, end, &literals) ||
+        (literals > static_cast<size_t>(end - p)) || (literals > n - i))
+      return false;
+    std::memcpy(r + i, p, literals);
+    p += literals;
+    i += literals;
+    if (!get_varint(p, end, &zeros) || (zeros > n - i))
+      return false;
+    std::memset(r + i, 0, zeros);
+    i += zeros;
+  }
+  return p == end;
+}
+
+// one strip: the record's predictor byte, size and runs
+void encode_strip(const uint8_t *rgba, ptrdiff_t stride, size_t row, int y0,
+                  int y1, uint8_t *previous, bool key, std::vector<uint8_t> *out)
+{
+  thread_local std::vector<uint8_t> left, temporal;
+  const size_t bytes = row * static_cast<size_t>(y1 - y0);
+  left.resize(bytes);
+  temporal.resize(bytes);
+  size_t left_zeros = 0, temporal_zeros = 0;
+  for (int y = y0; y < y1; ++y)
+  {
+    const size_t at = row * static_cast<size_t>(y - y0);
+    predict_row(rgba + stride * y, previous + row * static_cast<size_t>(y),
+                row, &left[at], &temporal[at], &left_zeros, &temporal_zeros);
+  }
+  const bool use_previous = !key && (temporal_zeros > left_zeros);
+
+  out->clear();
+  out->push_back(static_cast<uint8_t>(use_previous ? StripPredictor::PREVIOUS :
+                                                     StripPredictor::LEFT));
+  put_u32(out, 0);
+  encode_runs(use_previous ? temporal.data() : left.data(), bytes, out);
+  set_u32(out->data() + 1, static_cast<uint32_t>(out->size() - 5));
+}
+
+}  // unnamed namespace
+
+void frame_archive_header(std::vector<uint8_t> *out)
+{
+  out->insert(out->end(), FRAME_ARCHIVE_MAGIC, FRAME_ARCHIVE_MAGIC + 8);
+  put_u32(out, FRAME_ARCHIVE_VERSION);
+}
+
+void FrameEncoder::encode(uint32_t frame, const uint8_t *rgba, int width,
+                          int height, ptrdiff_t stride,
+                          std::vector<uint8_t> *out)
+{
+  const size_t row = static_cast<size_t>(width) * 4;
+  bool key = (count_ % KEYFRAME_INTERVAL) == 0;
+  if ((width != width_) || (height != height_))
+  {
+    width_ = width;
+    height_ = height;
+    previous_.assign(row * static_cast<size_t>(height), 0);
+    key = true;
+  }
+  count_ = key ? 1 : count_ + 1;
+
+  const size_t strip_count = static_cast<size_t>(
+    (height + STRIP_ROWS - 1) / STRIP_ROWS);
+  strips_.resize(strip_count);
+  auto code = [&](size_t begin, size_t end) {
+    for (size_t s = begin; s < end; ++s)
+    {
+      const int y0 = static_cast<int>(s) * STRIP_ROWS;
+      encode_strip(rgba, stride, row, y0, std::min(height, y0 + STRIP_ROWS),
+                   previous_.data(), key, &strips_[s]);
+    }
+  };
+  if (jobs_)
+    jobs_->parallel_for(strip_count, 1, code);
+  else
+    code(0, strip_count);
+
+  const size_t start = out->size();
+  put_u32(out, 0);
+  put_u32(out, frame);
+  put_u32(out, static_cast<uint32_t>(width));
+  put_u32(out, static_cast<uint32_t>(height));
+  out->push_back(key ? FRAME_KEY : 0);
+  for (const auto &s : strips_)
+    out->insert(out->end(), s.begin(), s.end());
+  set_u32(out->data() + start, static_cast<uint32_t>(out->size() - start - 4));
+}
+
+size_t FrameDecoder::decode(const uint8_t *data, size_t size, FrameInfo *info)
+{
+  constexpr size_t HEADER = 17;
+  if (size < HEADER)
+    return 0;
+  const size_t record = get_u32(data);
+  if ((record < HEADER - 4) || (record > size - 4))
+    return 0;
+  const uint8_t *p = data + HEADER;
+  const uint8_t *end = data + 4 + record;
+  info->frame = get_u32(data + 4);
+  const uint32_t width = get_u32(data + 8), height = get_u32(data + 12);
+  info->key = (data[16] & FRAME_KEY) != 0;
+  // 16k a side is past anything GL renders to
+  if ((width > 16384) || (height > 16384))
+    return 0;
+  info->width = static_cast<int>(width);
+  info->height = static_cast<int>(height);
+  if ((info->width != width_) || (info->height != height_))
+  {
+    if (!info->key)
+      return 0;
+    width_ = info->width;
+    height_ = info->height;
+    frame_.assign(size_t(width) * height * 4, 0);
+  }
+
+  const size_t row = size_t(width) * 4;
+  for (int y0 = 0; y0 < height_; y0 += STRIP_ROWS)
+  {
+    const int y1 = std::min(height_, y0 + STRIP_ROWS);
+    const size_t bytes = row * static_cast<size_t>(y1 - y0);
+    if (end - p < 5)
+      return 0;
+    const uint8_t predictor = p[0];
+    const size_t strip = get_u32(p + 1);
+    p += 5;
+    if ((strip > static_cast<size_t>(end - p)) ||
+        (predictor > static_cast<uint8_t>(StripPredictor::PREVIOUS)) ||
+        (info->key && predictor))
+      return 0;
+    residual_.resize(bytes);
+    if (!decode_runs(p, p + strip, residual_.data(), bytes))
+      return 0;
+    p += strip;
+
+    uint8_t *out = &frame_[row * static_cast<size_t>(y0)];
+    const uint8_t *r = residual_.data();
+    if (predictor == static_cast<uint8_t>(StripPredictor::PREVIOUS))
+    {
+      for (size_t i = 0; i < bytes; ++i)
+        out[i] = static_cast<uint8_t>(out[i] + r[i]);
+      continue;
+    }
+    for (size_t y = 0; y < static_cast<size_t>(y1 - y0); ++y)
+    {
+      uint8_t *o = out + y * row;
+      const uint8_t *d = r + y * row;
+      std::memcpy(o, d, std::min<size_t>(4, row));
+      for (size_t i = 4; i < row; ++i)
+        o[i] = static_cast<uint8_t>(o[i - 4] + d[i]);
+    }
+  }
+  return (p == end) ? 4 + record : 0;
+}
+
+bool FrameArchive::open(const char *path)
+{
+  close();
+  file_ = std::fopen(path, "wb");
+  if (!file_)
+    return false;
+  std::vector<uint8_t> header;
+  frame_archive_header(&header);
+  failed_ = std::fwrite(header.data(), 1, header.size(), file_) !=
+            header.size();
+  next_ = written_ = 0;
+  encoder_.reset();
+  return !failed_;
+}
+
+bool FrameArchive::close()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!file_)
+    return true;
+  // whatever is still out of order stays unwritten; the gap before it never
+  // came
+  if (!pending_.empty() && (pending_.begin()->first != next_))
+    failed_ = true;
+  drain(lock);
+  const bool ok = !failed_ && (std::fclose(file_) == 0);
+  file_ = nullptr;
+  pending_.clear();
+  return ok;
+}
+
+void FrameArchive::add(uint64_t sequence, uint32_t frame, int width, int height,
+                       bool bottom_up, std::vector<uint8_t> rgba)
+{
+  put(sequence, Frame{ frame, width, height, bottom_up, false,
+                       std::move(rgba) });
+}
+
+void FrameArchive::skip(uint64_t sequence)
+{
+  put(sequence, Frame{ 0, 0, 0, false, true, {} });
+}
+
+void FrameArchive::put(uint64_t sequence, Frame frame)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  pending_.emplace(sequence, std::move(frame));
+  if (!draining_)
+    drain(lock);
+}
+
+void FrameArchive::drain(std::unique_lock<std::mutex> &lock)
+{
+  draining_ = true;
+  while (file_ && !pending_.empty() && (pending_.begin()->first == next_))
+  {
+    Frame f = std::move(pending_.begin()->second);
+    pending_.erase(pending_.begin());
+    lock.unlock();
+    bool ok = true;
+    if (!f.skipped)
+    {
+      const size_t row = static_cast<size_t>(f.width) * 4;
+      const uint8_t *first = f.bottom_up ?
+        f.rgba.data() + row * static_cast<size_t>(f.height - 1) :
+        f.rgba.data();
+      const ptrdiff_t stride = f.bottom_up ? -static_cast<ptrdiff_t>(row) :
+                                             static_cast<ptrdiff_t>(row);
+      record_.clear();
+      encoder_.encode(f.frame, first, f.width, f.height, stride, &record_);
+      ok = std::fwrite(record_.data(), 1, record_.size(), file_) ==
+           record_.size();
+    }
+    lock.lock();
+    if (!f.skipped)
+      spare_.push_back(std::move(f.rgba));
+    failed_ = failed_ || !ok;
+    written_ += (ok && !f.skipped) ? 1 : 0;
+    ++next_;
+  }
+  draining_ = false;
+}
+
+std::vector<uint8_t> FrameArchive::take_buffer(size_t bytes)
+{
+  std::vector<uint8_t> buffer;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!spare_.empty())
+    {
+      buffer = std::move(spare_.back());
+      spare_.pop_back();
+    }
+  }
+  buffer.resize(bytes);
+  return buffer;
+}
+
+size_t FrameArchive::pending()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return pending_.size() + (draining_ ? 1 : 0);
+}
+
+uint64_t FrameArchive::written()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return written_;
+}
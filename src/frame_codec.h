@@ -0,0 +1,147 @@
+#ifndef __FRAME_CODEC_H__
+#define __FRAME_CODEC_H__
+
+#include "jobs.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// Lossless codec for sequences of captured RGBA8 frames, made to keep up with
+// capturing every frame.  Each strip of STRIP_ROWS rows is predicted either
+// from the pixel to its left or from the same strip of the previous frame,
+// whichever leaves more zero bytes, and the residuals are stored as literal
+// runs between runs of zeros.  Strips are coded independently, in parallel
+// when given a JobSystem.  Every KEYFRAME_INTERVAL-th frame, and any frame
+// that changes size, predicts spatially only, so an archive can be read from
+// any keyframe.  No entropy coding: archives are meant to be converted to PNG
+// offline (see tools/frame_unpack.cpp).
+//
+// An archive is FRAME_ARCHIVE_MAGIC, the version as a little-endian uint32,
+// then one record a frame:
+//
+//   uint32 size       bytes of the record after this field
+//   uint32 frame      the app's frame number
+//   uint32 width, height
+//   uint8  flags      FRAME_KEY
+//   per strip: uint8 predictor, uint32 size, then size bytes of
+//              varint literal count, literals, varint zero count, ...
+//
+// Integers are little-endian; varints are LEB128.
+constexpr char FRAME_ARCHIVE_MAGIC[8] = { 'P', '3', 'D', 'F', 'R', 'A', 'M',
+                                          'E' };
+constexpr uint32_t FRAME_ARCHIVE_VERSION = 1;
+constexpr char FRAME_ARCHIVE_EXTENSION[] = ".p3df";
+constexpr int STRIP_ROWS = 16;
+constexpr uint32_t KEYFRAME_INTERVAL = 120;
+
+constexpr uint8_t FRAME_KEY = 1;
+
+enum class StripPredictor : uint8_t
+{
+  LEFT = 0,
+  PREVIOUS = 1,
+};
+
+struct FrameInfo
+{
+  uint32_t frame;
+  int width, height;
+  bool key;
+};
+
+// the bytes an archive starts with
+void frame_archive_header(std::vector<uint8_t> *out);
+
+class FrameEncoder
+{
+public:
+  // with jobs, strips are coded on its threads; the caller helps
+  explicit FrameEncoder(JobSystem *jobs = nullptr) : jobs_(jobs) { }
+
+  // Appends a record of the frame to out.  Rows are stride bytes apart, so a
+  // negative stride from the last row stores a bottom-up readback top-down.
+  void encode(uint32_t frame, const uint8_t *rgba, int width, int height,
+              ptrdiff_t stride, std::vector<uint8_t> *out);
+  // the next frame is a keyframe
+  void reset() { count_ = 0; }
+
+private:
+  JobSystem *jobs_;
+  int width_ = 0, height_ = 0;
+  uint32_t count_ = 0;
+  std::vector<uint8_t> previous_;
+  std::vector<std::vector<uint8_t>> strips_;
+};
+
+class FrameDecoder
+{
+public:
+  // Decodes the record at data into the top-down RGBA8 frame(); returns the
+  // bytes it took, or 0 if it is truncated, malformed or predicts from a
+  // frame this decoder didn't see.
+  size_t decode(const uint8_t *data, size_t size, FrameInfo *info);
+  const std::vector<uint8_t>& frame() const { return frame_; }
+
+private:
+  std::vector<uint8_t> frame_;
+  std::vector<uint8_t> residual_;
+  int width_ = 0, height_ = 0;
+};
+
+// Writes an archive from frames handed in by any thread in any order: each
+// is encoded in sequence order by whichever thread hands in the one next due,
+// while the others return at once.  Sequence numbers run from 0 without gaps;
+// skip() stands in for one that won't come.
+class FrameArchive
+{
+public:
+  explicit FrameArchive(JobSystem *jobs = nullptr) : encoder_(jobs) { }
+  ~FrameArchive() { close(); }
+
+  FrameArchive(const FrameArchive&) = delete;
+  FrameArchive& operator=(const FrameArchive&) = delete;
+
+  bool open(const char *path);
+  // Writes what's pending in order; false if anything failed to write.
+  bool close();
+
+  // rgba is width * height * 4 bytes, rows bottom-up if bottom_up
+  void add(uint64_t sequence, uint32_t frame, int width, int height,
+           bool bottom_up, std::vector<uint8_t> rgba);
+  void skip(uint64_t sequence);
+  // a buffer for add(), reusing one a written frame gave back
+  std::vector<uint8_t> take_buffer(size_t bytes);
+  // frames handed in but not yet written
+  size_t pending();
+  uint64_t written();
+
+private:
+  struct Frame
+  {
+    uint32_t frame;
+    int width, height;
+    bool bottom_up;
+    bool skipped;
+    std::vector<uint8_t> rgba;
+  };
+
+  void put(uint64_t sequence, Frame frame);
+  void drain(std::unique_lock<std::mutex> &lock);
+
+  std::mutex mutex_;
+  std::map<uint64_t, Frame> pending_;
+  std::vector<std::vector<uint8_t>> spare_;
+  uint64_t next_ = 0;
+  uint64_t written_ = 0;
+  bool draining_ = false;
+  bool failed_ = false;
+  FILE *file_ = nullptr;
+  FrameEncoder encoder_;
+  std::vector<uint8_t> record_;
+};
+
+#endif  // __FRAME_CODEC_H__
@@ -0,0 +1,71 @@
+#include "gl_lazy.h"
+#include "gl_trace.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+GLADloadproc loader = nullptr;
+
+void* resolve(uint32_t call);
+
+#define GL_TRACE_LAZY
+#include "gl_trace.inc"
+
+constexpr size_t CALL_COUNT = GL_TRACE_CALL_END - GL_TRACE_FIRST_CALL;
+
+// looked up once each; threads racing on one store the same pointer
+std::atomic<void*> resolved[CALL_COUNT];
+
+void* resolve(uint32_t call)
+{
+  const size_t i = call - GL_TRACE_FIRST_CALL;
+  void *real = resolved[i].load(std::memory_order_acquire);
+  if (real)
+    return real;
+  real = loader(GL_TRACE_CALL_NAMES[i]);
+  if (!real)
+  {
+    std::fprintf(stderr, "GL entry point %s is missing\n",
+                 GL_TRACE_CALL_NAMES[i]);
+    std::abort();
+  }
+  resolved[i].store(real, std::memory_order_release);
+  return real;
+}
+
+// what GLAD gets instead of loader: the stub for name
+void* stub_for(const char *name)
+{
+  static const auto by_name = []() {
+    std::array<uint32_t, CALL_COUNT> order;
+    for (uint32_t i = 0; i < CALL_COUNT; ++i)
+      order[i] = i;
+    std::sort(order.begin(), order.end(), [](uint32_t a, uint32_t b) {
+      return std::strcmp(GL_TRACE_CALL_NAMES[a], GL_TRACE_CALL_NAMES[b]) < 0;
+    });
+    return order;
+  }();
+  const auto it = std::lower_bound(by_name.begin(), by_name.end(), name,
+                                   [](uint32_t i, const char *n) {
+    return std::strcmp(GL_TRACE_CALL_NAMES[i], n) < 0;
+  });
+  if ((it == by_name.end()) || std::strcmp(GL_TRACE_CALL_NAMES[*it], name))
+    return nullptr;
+  return LAZY_STUBS[*it];
+}
+
+}  // unnamed namespace
+
+bool gl_load_lazy(GLADloadproc load)
+{
+  loader = load;
+  for (auto &r : resolved)
+    r.store(nullptr, std::memory_order_relaxed);
+  return gladLoadGLLoader(stub_for) != 0;
+}
@@ -0,0 +1,15 @@
+#ifndef __GL_LAZY_H__
+#define __GL_LAZY_H__
+
+#include "glad/glad.h"
+
+// gladLoadGLLoader, but every glad_gl* pointer starts as a stub that looks
+// its entry point up through loader on the first call and then puts it in
+// the pointer, so startup resolves only the few dozen entry points it uses
+// instead of all of them.  GLAD's version and extension flags are set as
+// usual.  Calling an entry point the driver lacks prints its name and aborts,
+// where an eager load would have left a null pointer; check the flags.
+// Stubs may resolve on any thread with a context current.
+bool gl_load_lazy(GLADloadproc loader);
+
+#endif  // __GL_LAZY_H__
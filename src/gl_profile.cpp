@@ -0,0 +1,110 @@
+#include "gl_profile.h"
+
+#if PROTO3D_GL_PROFILE
+
+#include "gl_trace.h"
+
+#include "glad/glad.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+// around every call the wrappers below forward; start is what pre_call
+// returned
+uint64_t pre_call(uint32_t call);
+void post_call(uint32_t call, uint64_t start);
+
+#define GL_TRACE_HOOKS
+#include "gl_trace.inc"
+
+constexpr size_t CALL_COUNT = GL_TRACE_CALL_END - GL_TRACE_FIRST_CALL;
+
+struct Counter
+{
+  std::atomic<uint32_t> calls{ 0 };
+  std::atomic<uint64_t> ns{ 0 };
+};
+
+Counter counters[CALL_COUNT];
+bool sync_call[CALL_COUNT];
+bool reported[CALL_COUNT];
+std::vector<GlCallStats> last_frame;
+uint64_t frame = 0;
+
+uint64_t now_ns()
+{
+  return static_cast<uint64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+uint64_t pre_call(uint32_t)
+{
+  return now_ns();
+}
+
+void post_call(uint32_t call, uint64_t start)
+{
+  Counter &c = counters[call - GL_TRACE_FIRST_CALL];
+  c.calls.fetch_add(1, std::memory_order_relaxed);
+  c.ns.fetch_add(now_ns() - start, std::memory_order_relaxed);
+}
+
+}  // unnamed namespace
+
+void gl_profile_start()
+{
+  for (size_t i = 0; i < CALL_COUNT; ++i)
+  {
+    const char *name = GL_TRACE_CALL_NAMES[i];
+    sync_call[i] = !std::strncmp(name, "glGet", 5) ||
+                   !std::strcmp(name, "glReadPixels") ||
+                   !std::strcmp(name, "glFinish");
+  }
+  install_wrappers();
+}
+
+void gl_profile_stop()
+{
+  uninstall_wrappers();
+}
+
+void gl_profile_frame()
+{
+  last_frame.clear();
+  for (size_t i = 0; i < CALL_COUNT; ++i)
+  {
+    const uint32_t calls = counters[i].calls.exchange(0,
+                                                      std::memory_order_relaxed);
+    const uint64_t ns = counters[i].ns.exchange(0, std::memory_order_relaxed);
+    if (!calls)
+      continue;
+    const float ms = static_cast<float>(static_cast<double>(ns) * 1e-6);
+    last_frame.push_back(GlCallStats{ GL_TRACE_CALL_NAMES[i], calls, ms,
+                                      sync_call[i] });
+    if (sync_call[i] && !reported[i])
+    {
+      std::fprintf(stderr, "GL sync point: %s, %u call%s taking %.3f ms in "
+                   "frame %llu\n", GL_TRACE_CALL_NAMES[i], calls,
+                   (calls > 1) ? "s" : "", static_cast<double>(ms),
+                   static_cast<unsigned long long>(frame));
+      reported[i] = true;
+    }
+  }
+  std::sort(last_frame.begin(), last_frame.end(),
+            [](const GlCallStats &a, const GlCallStats &b) {
+              return a.ms > b.ms; });
+  ++frame;
+}
+
+const std::vector<GlCallStats>& gl_profile_last_frame()
+{
+  return last_frame;
+}
+
+#endif  // PROTO3D_GL_PROFILE
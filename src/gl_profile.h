@@ -0,0 +1,55 @@
+#ifndef __GL_PROFILE_H__
+#define __GL_PROFILE_H__
+
+#include <cstdint>
+#include <vector>
+
+// Counts and times every GL call by entry point, a frame at a time, flagging
+// those that can make the driver wait on the GPU: glGet*, glReadPixels and
+// glFinish.  Compiled in for debug builds only; define PROTO3D_GL_PROFILE to 0
+// or 1 to override.  Each call costs two clock reads while it's running.
+#ifndef PROTO3D_GL_PROFILE
+#  ifdef NDEBUG
+#    define PROTO3D_GL_PROFILE 0
+#  else
+#    define PROTO3D_GL_PROFILE 1
+#  endif
+#endif
+
+constexpr bool GL_PROFILE = PROTO3D_GL_PROFILE;
+
+struct GlCallStats
+{
+  const char *name;
+  uint32_t calls;
+  float ms;   // CPU time spent in the driver
+  bool sync;  // can stall on the GPU
+};
+
+#if PROTO3D_GL_PROFILE
+
+// After loading GL.  Start before gl_trace_start() and stop after
+// gl_trace_stop(), so recording isn't timed as driver work.  Calls from every
+// thread are counted.
+void gl_profile_start();
+void gl_profile_stop();
+// Ends a frame: its calls become gl_profile_last_frame(), and a syncing entry
+// point seen for the first time is reported on stderr.
+void gl_profile_frame();
+// entry points the last frame called, costliest first
+const std::vector<GlCallStats>& gl_profile_last_frame();
+
+#else
+
+inline void gl_profile_start() { }
+inline void gl_profile_stop() { }
+inline void gl_profile_frame() { }
+inline const std::vector<GlCallStats>& gl_profile_last_frame()
+{
+  static const std::vector<GlCallStats> none;
+  return none;
+}
+
+#endif  // PROTO3D_GL_PROFILE
+
+#endif  // __GL_PROFILE_H__
@@ -0,0 +1,395 @@
+#include "gl_trace.h"
+
+#if PROTO3D_GL_TRACE
+
+#include "glad/glad.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// records reach the file in writes of about this size
+constexpr size_t FLUSH_BYTES = 4u << 20;
+
+// glPixelStore state one direction of transfers lays texels out by
+struct PixelStore
+{
+  GLint alignment = 4;
+  GLint row_length = 0;
+  GLint image_height = 0;
+  GLint skip_pixels = 0;
+  GLint skip_rows = 0;
+  GLint skip_images = 0;
+};
+
+// a writable mapping; its bytes are recorded as it's flushed or unmapped
+struct Mapping
+{
+  const uint8_t *data;
+  GLsizeiptr length;
+  bool explicit_flush;
+};
+
+struct Trace
+{
+  std::mutex mutex;
+  FILE *file = nullptr;
+  std::vector<uint8_t> out;
+
+  PixelStore unpack, pack;
+  GLuint unpack_buffer = 0;
+  GLuint pack_buffer = 0;
+  std::unordered_map<GLenum, Mapping> mappings;
+  // fences by address; ids are what the trace holds
+  std::unordered_map<const void*, uint64_t> syncs;
+  uint64_t next_sync = 1;
+  PFNGLGETBUFFERPARAMETERIVPROC get_buffer_parameteriv = nullptr;
+};
+
+Trace trace;
+
+void flush()
+{
+  if (!trace.out.empty() &&
+      (std::fwrite(trace.out.data(), 1, trace.out.size(), trace.file) !=
+       trace.out.size()))
+    std::fprintf(stderr, "Unable to write the GL trace\n");
+  trace.out.clear();
+}
+
+void put_varint(uint64_t v)
+{
+  while (v >= 0x80)
+  {
+    trace.out.push_back(static_cast<uint8_t>(v | 0x80));
+    v >>= 7;
+  }
+  trace.out.push_back(static_cast<uint8_t>(v));
+}
+
+// zigzag, so small negatives stay short too
+template <typename T>
+void put_int(T v)
+{
+  const auto s = static_cast<int64_t>(v);
+  put_varint((static_cast<uint64_t>(s) << 1) ^ static_cast<uint64_t>(s >> 63));
+}
+
+void put_raw(const void *p, size_t bytes)
+{
+  const auto *b = static_cast<const uint8_t*>(p);
+  trace.out.insert(trace.out.end(), b, b + bytes);
+}
+
+void put_float(float v)
+{
+  put_raw(&v, sizeof(v));
+}
+
+void put_double(double v)
+{
+  put_raw(&v, sizeof(v));
+}
+
+void put_call(uint32_t call)
+{
+  if (trace.out.size() >= FLUSH_BYTES)
+    flush();
+  put_varint(call);
+}
+
+// count elements of element_size bytes; a negative count, which GL rejects,
+// records none
+void put_bytes(const void *p, int64_t count, size_t element_size)
+{
+  if (!p)
+  {
+    put_varint(GL_TRACE_NULL);
+    return;
+  }
+  const size_t bytes = (count > 0) ? static_cast<size_t>(count) * element_size :
+                                     0;
+  put_varint(GL_TRACE_BYTES);
+  put_varint(bytes);
+  put_raw(p, bytes);
+}
+
+void put_offset(const void *p)
+{
+  put_varint(GL_TRACE_OFFSET);
+  put_varint(reinterpret_cast<uintptr_t>(p));
+}
+
+void put_offsets(const void *const *p, GLsizei count)
+{
+  put_varint((p && (count > 0)) ? static_cast<uint64_t>(count) : 0);
+  for (GLsizei i = 0; p && (i < count); ++i)
+    put_varint(reinterpret_cast<uintptr_t>(p[i]));
+}
+
+void put_out(int64_t bytes)
+{
+  put_varint(GL_TRACE_OUT);
+  put_varint((bytes > 0) ? static_cast<uint64_t>(bytes) : 0);
+}
+
+void put_pack_out(const void *p, int64_t bytes)
+{
+  if (trace.pack_buffer)
+    put_offset(p);
+  else
+    put_out(bytes);
+}
+
+// length < 0 for NUL terminated, which keeps the NUL
+void put_string(const GLchar *s, GLsizei length)
+{
+  put_bytes(s, (length < 0) && s ? static_cast<int64_t>(std::strlen(s)) + 1 :
+                                   length, 1);
+}
+
+void put_strings(GLsizei count, const GLchar *const *strings,
+                 const GLint *lengths)
+{
+  put_varint((strings && (count > 0)) ? static_cast<uint64_t>(count) : 0);
+  for (GLsizei i = 0; strings && (i < count); ++i)
+    put_string(strings[i], lengths ? lengths[i] : -1);
+}
+
+void put_names(GLsizei count, const GLuint *names)
+{
+  for (GLsizei i = 0; i < count; ++i)
+    put_int(names[i]);
+}
+
+void put_sync(const void *sync)
+{
+  const auto it = trace.syncs.find(sync);
+  put_int((it == trace.syncs.end()) ? 0 : it->second);
+}
+
+void put_new_sync(GLsync sync)
+{
+  const uint64_t id = sync ? trace.next_sync++ : 0;
+  if (sync)
+    trace.syncs[sync] = id;
+  put_int(id);
+}
+
+void forget_sync(GLsync sync)
+{
+  trace.syncs.erase(sync);
+}
+
+// bytes a transfer of a w x h x d image touches, from the start of the
+// pointer GL gets, skips included
+int64_t image_bytes(const PixelStore &store, GLenum format, GLenum type,
+                    GLsizei w, GLsizei h, GLsizei d)
+{
+  if ((w <= 0) || (h <= 0) || (d <= 0))
+    return 0;
+  int64_t components = 4;
+  switch (format)
+  {
+  case GL_RED: case GL_GREEN: case GL_BLUE: case GL_RED_INTEGER:
+  case GL_GREEN_INTEGER: case GL_BLUE_INTEGER: case GL_DEPTH_COMPONENT:
+  case GL_STENCIL_INDEX:
+    components = 1;
+    break;
+  case GL_RG: case GL_RG_INTEGER: case GL_DEPTH_STENCIL:
+    components = 2;
+    break;
+  case GL_RGB: case GL_BGR: case GL_RGB_INTEGER: case GL_BGR_INTEGER:
+    components = 3;
+    break;
+  default:
+    break;
+  }
+  int64_t pixel = 0;
+  switch (type)
+  {
+  case GL_UNSIGNED_BYTE: case GL_BYTE:
+    pixel = components;
+    break;
+  case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT:
+    pixel = 2 * components;
+    break;
+  case GL_UNSIGNED_INT: case GL_INT: case GL_FLOAT:
+    pixel = 4 * components;
+    break;
+  case GL_UNSIGNED_BYTE_3_3_2: case GL_UNSIGNED_BYTE_2_3_3_REV:
+    pixel = 1;
+    break;
+  case GL_UNSIGNED_SHORT_5_6_5: case GL_UNSIGNED_SHORT_5_6_5_REV:
+  case GL_UNSIGNED_SHORT_4_4_4_4: case GL_UNSIGNED_SHORT_4_4_4_4_REV:
+  case GL_UNSIGNED_SHORT_5_5_5_1: case GL_UNSIGNED_SHORT_1_5_5_5_REV:
+    pixel = 2;
+    break;
+  case GL_FLOAT_32_UNSIGNED_INT_24_8_REV:
+    pixel = 8;
+    break;
+  default:  // the remaining packed types are 32 bits a pixel
+    pixel = 4;
+    break;
+  }
+  const int64_t row_pixels = store.row_length ? store.row_length : w;
+  const int64_t align = std::max(store.alignment, 1);
+  const int64_t row = (row_pixels * pixel + align - 1) / align * align;
+  const int64_t rows = store.image_height ? store.image_height : h;
+  return ((store.skip_images + d - 1) * rows + store.skip_rows + h - 1) * row +
+         (store.skip_pixels + w) * pixel;
+}
+
+void put_image(const void *pixels, GLenum format, GLenum type, GLsizei w,
+               GLsizei h, GLsizei d)
+{
+  if (trace.unpack_buffer)
+    put_offset(pixels);
+  else
+    put_bytes(pixels, image_bytes(trace.unpack, format, type, w, h, d), 1);
+}
+
+void put_compressed(const void *data, GLsizei image_size)
+{
+  if (trace.unpack_buffer)
+    put_offset(data);
+  else
+    put_bytes(data, image_size, 1);
+}
+
+void note_bind_buffer(GLenum target, GLuint buffer)
+{
+  if (target == GL_PIXEL_UNPACK_BUFFER)
+    trace.unpack_buffer = buffer;
+  else if (target == GL_PIXEL_PACK_BUFFER)
+    trace.pack_buffer = buffer;
+}
+
+void note_pixel_store(GLenum pname, GLint param)
+{
+  switch (pname)
+  {
+  case GL_UNPACK_ALIGNMENT: trace.unpack.alignment = param; break;
+  case GL_UNPACK_ROW_LENGTH: trace.unpack.row_length = param; break;
+  case GL_UNPACK_IMAGE_HEIGHT: trace.unpack.image_height = param; break;
+  case GL_UNPACK_SKIP_PIXELS: trace.unpack.skip_pixels = param; break;
+  case GL_UNPACK_SKIP_ROWS: trace.unpack.skip_rows = param; break;
+  case GL_UNPACK_SKIP_IMAGES: trace.unpack.skip_images = param; break;
+  case GL_PACK_ALIGNMENT: trace.pack.alignment = param; break;
+  case GL_PACK_ROW_LENGTH: trace.pack.row_length = param; break;
+  case GL_PACK_IMAGE_HEIGHT: trace.pack.image_height = param; break;
+  case GL_PACK_SKIP_PIXELS: trace.pack.skip_pixels = param; break;
+  case GL_PACK_SKIP_ROWS: trace.pack.skip_rows = param; break;
+  case GL_PACK_SKIP_IMAGES: trace.pack.skip_images = param; break;
+  default: break;
+  }
+}
+
+void note_map(GLenum target, GLsizeiptr length, GLbitfield access,
+              const void *data)
+{
+  if (data && (access & GL_MAP_WRITE_BIT))
+    trace.mappings[target] = Mapping{ static_cast<const uint8_t*>(data),
+                                      length,
+                                      (access & GL_MAP_FLUSH_EXPLICIT_BIT) !=
+                                      0 };
+}
+
+void note_map_buffer(GLenum target, GLenum access, const void *data)
+{
+  if (access == GL_READ_ONLY)
+    return;
+  GLint size = 0;
+  trace.get_buffer_parameteriv(target, GL_BUFFER_SIZE, &size);
+  note_map(target, size, GL_MAP_WRITE_BIT, data);
+}
+
+void write_map_data(GLenum target, const Mapping &mapping, GLintptr offset,
+                    GLsizeiptr length)
+{
+  if ((offset < 0) || (length <= 0) || (offset + length > mapping.length))
+    return;
+  put_call(GL_TRACE_MAP_DATA);
+  put_int(target);
+  put_int(offset);
+  put_bytes(mapping.data + offset, length, 1);
+}
+
+// what the app wrote, before GL owns the memory again
+void write_mapped(GLenum target)
+{
+  const auto it = trace.mappings.find(target);
+  if (it == trace.mappings.end())
+    return;
+  if (!it->second.explicit_flush)
+    write_map_data(target, it->second, 0, it->second.length);
+  trace.mappings.erase(it);
+}
+
+void write_mapped_range(GLenum target, GLintptr offset, GLsizeiptr length)
+{
+  const auto it = trace.mappings.find(target);
+  if (it != trace.mappings.end())
+    write_map_data(target, it->second, offset, length);
+}
+
+#define GL_TRACE_RECORD
+#include "gl_trace.inc"
+
+}  // unnamed namespace
+
+bool gl_trace_start(const char *path, int width, int height)
+{
+  const std::lock_guard<std::mutex> lock(trace.mutex);
+  if (trace.file)
+  {
+    std::fprintf(stderr, "GL trace already running\n");
+    return false;
+  }
+  trace.file = std::fopen(path, "wb");
+  if (!trace.file)
+  {
+    std::fprintf(stderr, "Unable to open GL trace %s\n", path);
+    return false;
+  }
+  trace.out.assign(GL_TRACE_MAGIC, GL_TRACE_MAGIC + sizeof(GL_TRACE_MAGIC));
+  put_varint(GL_TRACE_VERSION);
+  put_varint(GL_TRACE_CALL_END - GL_TRACE_FIRST_CALL);
+  put_varint(GL_TRACE_API_HASH);
+  put_varint(static_cast<uint64_t>(width));
+  put_varint(static_cast<uint64_t>(height));
+
+  trace.unpack = trace.pack = PixelStore();
+  trace.unpack_buffer = trace.pack_buffer = 0;
+  trace.mappings.clear();
+  trace.syncs.clear();
+  trace.next_sync = 1;
+  trace.get_buffer_parameteriv = glad_glGetBufferParameteriv;
+  install_wrappers();
+  return true;
+}
+
+void gl_trace_frame()
+{
+  const std::lock_guard<std::mutex> lock(trace.mutex);
+  if (trace.file)
+    put_call(GL_TRACE_FRAME);
+}
+
+void gl_trace_stop()
+{
+  const std::lock_guard<std::mutex> lock(trace.mutex);
+  if (!trace.file)
+    return;
+  uninstall_wrappers();
+  flush();
+  std::fclose(trace.file);
+  trace.file = nullptr;
+}
+
+#endif  // PROTO3D_GL_TRACE
@@ -0,0 +1,56 @@
+#ifndef __GL_TRACE_H__
+#define __GL_TRACE_H__
+
+#include <cstdint>
+
+// Records every GL call made through glad, with whatever data its pointers
+// reach, for proto3d-replay (tools/gl_replay.cpp) to re-issue without the
+// app.  Built only with -DPROTO3D_GL_TRACE=ON; otherwise the calls below are
+// empty inline functions and glad is left alone.
+#ifndef PROTO3D_GL_TRACE
+#  define PROTO3D_GL_TRACE 0
+#endif
+
+constexpr bool GL_TRACE = PROTO3D_GL_TRACE;
+
+// A trace is the magic, then as varints the version, the number of entry
+// points, GL_TRACE_API_HASH and the default framebuffer's size; then records,
+// each a varint record or call id followed by its arguments.  Integers are
+// zigzag varints, floats raw, pointers a GlTracePointer tag and its payload.
+constexpr char GL_TRACE_MAGIC[8] = { 'P', '3', 'D', 'G', 'L', 'T', 'R', 'C' };
+constexpr uint32_t GL_TRACE_VERSION = 1;
+
+enum GlTraceRecord : uint32_t
+{
+  GL_TRACE_FRAME = 0,       // gl_trace_frame()
+  GL_TRACE_MAP_DATA = 1,    // target, offset and bytes written to a mapping
+  GL_TRACE_FIRST_CALL = 16  // entry points, in gl_trace.inc's order
+};
+
+enum GlTracePointer : uint32_t
+{
+  GL_TRACE_NULL = 0,
+  GL_TRACE_OFFSET = 1,  // into a bound buffer
+  GL_TRACE_BYTES = 2,   // size, then the bytes
+  GL_TRACE_OUT = 3      // size of client memory GL writes to
+};
+
+#if PROTO3D_GL_TRACE
+
+// Start right after loading GL, before any object exists: replay only knows
+// objects the trace saw created.  width and height are the default
+// framebuffer's.  Calls from every thread are recorded, one at a time.
+bool gl_trace_start(const char *path, int width, int height);
+// ends a frame; call right before swapping buffers
+void gl_trace_frame();
+void gl_trace_stop();
+
+#else
+
+inline bool gl_trace_start(const char*, int, int) { return false; }
+inline void gl_trace_frame() { }
+inline void gl_trace_stop() { }
+
+#endif  // PROTO3D_GL_TRACE
+
+#endif  // __GL_TRACE_H__
@@ -0,0 +1,160 @@
+#include "gl_uploader.h"
+#include "util.h"
+
+#include <GLFW/glfw3.h>
+
+#include <iterator>
+#include <memory>
+#include <utility>
+
+bool GlUploader::start(GLFWwindow *share)
+{
+  stop();
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR,
+                 glfwGetWindowAttrib(share, GLFW_CONTEXT_VERSION_MAJOR));
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR,
+                 glfwGetWindowAttrib(share, GLFW_CONTEXT_VERSION_MINOR));
+  glfwWindowHint(GLFW_OPENGL_PROFILE,
+                 glfwGetWindowAttrib(share, GLFW_OPENGL_PROFILE));
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT,
+                 glfwGetWindowAttrib(share, GLFW_OPENGL_FORWARD_COMPAT));
+  glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT,
+                 glfwGetWindowAttrib(share, GLFW_OPENGL_DEBUG_CONTEXT));
+  window_ = glfwCreateWindow(1, 1, "uploads", nullptr, share);
+  glfwDefaultWindowHints();
+  if (!window_)
+    return false;
+  quit_ = false;
+  thread_ = std::thread(&GlUploader::thread_main, this);
+  return true;
+}
+
+void GlUploader::stop()
+{
+  if (thread_.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      quit_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+  }
+  if (window_)
+  {
+    glfwDestroyWindow(window_);
+    window_ = nullptr;
+  }
+}
+
+void GlUploader::submit(Work work, Ready ready)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(Request{ std::move(work), std::move(ready) });
+    ++in_flight_;
+  }
+  cv_.notify_one();
+}
+
+void GlUploader::upload_buffer(GLuint buffer, GLintptr offset,
+                               std::vector<uint8_t> data, Ready ready)
+{
+  auto bytes = std::make_shared<std::vector<uint8_t>>(std::move(data));
+  submit([buffer, offset, bytes]() {
+    // the upload context's binding points are its own
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, offset,
+                    static_cast<GLsizeiptr>(bytes->size()), bytes->data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }, std::move(ready));
+}
+
+void GlUploader::upload_texture(GLuint texture, GLint level, GLint x, GLint y,
+                                GLsizei width, GLsizei height, GLenum format,
+                                GLenum type, std::vector<uint8_t> data,
+                                Ready ready)
+{
+  auto texels = std::make_shared<std::vector<uint8_t>>(std::move(data));
+  submit([=]() {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, level, x, y, width, height, format, type,
+                    texels->data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+  }, std::move(ready));
+}
+
+size_t GlUploader::publish()
+{
+  std::vector<Ready> done;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    done.swap(done_);
+    in_flight_ -= done.size();
+  }
+  for (auto &ready : done)
+    if (ready)
+      ready();
+  return done.size();
+}
+
+size_t GlUploader::in_flight() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return in_flight_;
+}
+
+// Runs what's queued as one batch, a fence after each upload, then waits on
+// the fences in order, handing each upload over as its fence signals.
+void GlUploader::thread_main()
+{
+  glfwMakeContextCurrent(window_);
+  struct Pending
+  {
+    GLsync fence;
+    Ready ready;
+  };
+  std::vector<Request> batch;
+  std::vector<Pending> pending;
+  for (;;)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]() { return quit_ || !queue_.empty(); });
+      if (queue_.empty())
+        break;
+      batch.assign(std::make_move_iterator(queue_.begin()),
+                   std::make_move_iterator(queue_.end()));
+      queue_.clear();
+    }
+
+    {
+      GL_ZONE("uploads");
+      for (auto &request : batch)
+      {
+        request.work();
+        pending.push_back(Pending{
+          glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0),
+          std::move(request.ready) });
+      }
+      batch.clear();
+      glFlush();
+    }
+
+    for (auto &p : pending)
+    {
+      constexpr GLuint64 ONE_SECOND = 1000000000;
+      GLenum status;
+      do
+        status = glClientWaitSync(p.fence, 0, ONE_SECOND);
+      while (status == GL_TIMEOUT_EXPIRED);
+      glDeleteSync(p.fence);
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_.push_back(std::move(p.ready));
+    }
+    pending.clear();
+  }
+  glfwMakeContextCurrent(nullptr);
+}
@@ -0,0 +1,80 @@
+#ifndef __GL_UPLOADER_H__
+#define __GL_UPLOADER_H__
+
+#include "glad/glad.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct GLFWwindow;
+
+// Texture and buffer uploads off the render thread.  A hidden window's
+// context, sharing objects with the render context, is current on a thread
+// of its own that runs each upload, fences it and waits for the fence; only
+// then is the upload's ready callback queued, for the render thread to run
+// from publish().  Textures and buffers are shared between the contexts,
+// vertex arrays and framebuffers aren't: make those on the render thread,
+// from ready.  A context sees another's changes to an object once it binds
+// the object again, so ready should (re)bind what it hands out.
+class GlUploader
+{
+public:
+  // on the upload thread, its context current
+  using Work = std::function<void()>;
+  // on the render thread, from publish()
+  using Ready = std::function<void()>;
+
+  GlUploader() = default;
+  ~GlUploader() { stop(); }
+
+  GlUploader(const GlUploader&) = delete;
+  GlUploader& operator=(const GlUploader&) = delete;
+
+  // Main thread, after loading GL: makes the hidden window, with the hints
+  // share was made with, and starts the thread.
+  bool start(GLFWwindow *share);
+  // Finishes every upload submitted; their ready callbacks are left for
+  // publish().
+  void stop();
+  bool running() const { return thread_.joinable(); }
+
+  void submit(Work work, Ready ready);
+  // glBufferSubData of data into buffer at offset
+  void upload_buffer(GLuint buffer, GLintptr offset, std::vector<uint8_t> data,
+                     Ready ready);
+  // glTexSubImage2D of tightly packed rows into a GL_TEXTURE_2D
+  void upload_texture(GLuint texture, GLint level, GLint x, GLint y,
+                      GLsizei width, GLsizei height, GLenum format,
+                      GLenum type, std::vector<uint8_t> data, Ready ready);
+
+  // Render thread, once a frame: runs the ready callbacks of uploads whose
+  // fences signalled, in submission order; returns how many.
+  size_t publish();
+  // submitted and not yet published
+  size_t in_flight() const;
+
+private:
+  struct Request
+  {
+    Work work;
+    Ready ready;
+  };
+
+  void thread_main();
+
+  GLFWwindow *window_ = nullptr;
+  std::thread thread_;
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Request> queue_;
+  std::vector<Ready> done_;
+  size_t in_flight_ = 0;
+  bool quit_ = false;
+};
+
+#endif  // __GL_UPLOADER_H__
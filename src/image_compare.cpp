@@ -0,0 +1,359 @@
+#include "image_compare.h"
+#include "jobs.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr int WINDOW = 8;
+// SSIM's stabilisers for a dynamic range of 1
+constexpr float C1 = 0.01f * 0.01f;
+constexpr float C2 = 0.03f * 0.03f;
+// where CIELAB's f(t) turns from linear to cube root
+constexpr float LAB_EPSILON = 216.0f / 24389.0f;
+constexpr float LAB_SLOPE = 24389.0f / 27.0f / 116.0f;
+constexpr float LAB_OFFSET = 16.0f / 116.0f;
+// errors of 0.25 and above are white in heatmaps
+constexpr float HEAT_SCALE = 4.0f;
+
+// linear sRGB to XYZ over the D65 white point
+constexpr float XYZ[3][3] = {
+  { 0.4124f / 0.95047f, 0.3576f / 0.95047f, 0.1805f / 0.95047f },
+  { 0.2126f, 0.7152f, 0.0722f },
+  { 0.0193f / 1.08883f, 0.1192f / 1.08883f, 0.9505f / 1.08883f },
+};
+
+struct LinearTable
+{
+  float v[256];
+
+  LinearTable()
+  {
+    for (int i = 0; i < 256; ++i)
+    {
+      const float c = static_cast<float>(i) / 255.0f;
+      v[i] = (c <= 0.04045f) ? c / 12.92f :
+                               std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+  }
+};
+
+const LinearTable& srgb_to_linear()
+{
+  static const LinearTable table;
+  return table;
+}
+
+float lab_f(float t)
+{
+  return (t > LAB_EPSILON) ? std::cbrt(t) : LAB_SLOPE * t + LAB_OFFSET;
+}
+
+// one row's pixels in CIELAB, L over 100 so SSIM sees a range of 1
+struct LabRow
+{
+  std::vector<float> l, a, b;
+
+  void resize(size_t n)
+  {
+    l.resize(n);
+    a.resize(n);
+    b.resize(n);
+  }
+};
+
+#if PROTO3D_HAS_AVX2
+// a cube root a few ulps out: a guess from halving the exponent bits, then
+// three Newton steps
+__m256 cbrt_ps(__m256 x)
+{
+  const __m256i bits = _mm256_castps_si256(x);
+  const __m256 third = _mm256_set1_ps(1.0f / 3.0f);
+  __m256 y = _mm256_castsi256_ps(_mm256_add_epi32(
+    _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(bits), third)),
+    _mm256_set1_epi32(709921077)));
+  for (int i = 0; i < 3; ++i)
+    y = _mm256_mul_ps(third, _mm256_add_ps(
+      _mm256_add_ps(y, y), _mm256_div_ps(x, _mm256_mul_ps(y, y))));
+  return y;
+}
+
+__m256 lab_f_ps(__m256 t)
+{
+  const __m256 linear = _mm256_fmadd_ps(t, _mm256_set1_ps(LAB_SLOPE),
+                                        _mm256_set1_ps(LAB_OFFSET));
+  const __m256 cube = _mm256_cmp_ps(t, _mm256_set1_ps(LAB_EPSILON),
+                                    _CMP_GT_OQ);
+  // cube roots of lanes below epsilon are thrown away; keep them positive
+  const __m256 root = cbrt_ps(_mm256_max_ps(t, _mm256_set1_ps(LAB_EPSILON)));
+  return _mm256_blendv_ps(linear, root, cube);
+}
+
+__m256 dot_ps(const float (&m)[3], __m256 r, __m256 g, __m256 b)
+{
+  return _mm256_fmadd_ps(_mm256_set1_ps(m[0]), r, _mm256_fmadd_ps(
+    _mm256_set1_ps(m[1]), g, _mm256_mul_ps(_mm256_set1_ps(m[2]), b)));
+}
+
+float hsum_ps(__m256 v)
+{
+  const __m128 h = _mm_add_ps(_mm256_castps256_ps128(v),
+                              _mm256_extractf128_ps(v, 1));
+  const __m128 q = _mm_add_ps(h, _mm_movehl_ps(h, h));
+  return _mm_cvtss_f32(_mm_add_ss(q, _mm_shuffle_ps(q, q, 1)));
+}
+#endif
+
+void to_lab(const uint8_t *rgba, int width, LabRow *out)
+{
+  const float *linear = srgb_to_linear().v;
+  int x = 0;
+#if PROTO3D_HAS_AVX2
+  const __m256i byte = _mm256_set1_epi32(0xFF);
+  for (; x + 8 <= width; x += 8)
+  {
+    const __m256i p = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(rgba + 4 * x));
+    const __m256 r = _mm256_i32gather_ps(linear, _mm256_and_si256(p, byte),
+                                         4);
+    const __m256 g = _mm256_i32gather_ps(
+      linear, _mm256_and_si256(_mm256_srli_epi32(p, 8), byte), 4);
+    const __m256 b = _mm256_i32gather_ps(
+      linear, _mm256_and_si256(_mm256_srli_epi32(p, 16), byte), 4);
+    const __m256 fx = lab_f_ps(dot_ps(XYZ[0], r, g, b));
+    const __m256 fy = lab_f_ps(dot_ps(XYZ[1], r, g, b));
+    const __m256 fz = lab_f_ps(dot_ps(XYZ[2], r, g, b));
+    _mm256_storeu_ps(&out->l[x], _mm256_fmsub_ps(
+      fy, _mm256_set1_ps(1.16f), _mm256_set1_ps(0.16f)));
+    _mm256_storeu_ps(&out->a[x], _mm256_mul_ps(_mm256_sub_ps(fx, fy),
+                                               _mm256_set1_ps(500.0f)));
+    _mm256_storeu_ps(&out->b[x], _mm256_mul_ps(_mm256_sub_ps(fy, fz),
+                                               _mm256_set1_ps(200.0f)));
+  }
+#endif
+  for (; x < width; ++x)
+  {
+    const uint8_t *p = rgba + 4 * x;
+    const float r = linear[p[0]], g = linear[p[1]], b = linear[p[2]];
+    float f[3];
+    for (int i = 0; i < 3; ++i)
+      f[i] = lab_f(XYZ[i][0] * r + XYZ[i][1] * g + XYZ[i][2] * b);
+    out->l[static_cast<size_t>(x)] = 1.16f * f[1] - 0.16f;
+    out->a[static_cast<size_t>(x)] = 500.0f * (f[0] - f[1]);
+    out->b[static_cast<size_t>(x)] = 200.0f * (f[1] - f[2]);
+  }
+}
+
+uint8_t heat_channel(float v)
+{
+  return static_cast<uint8_t>(std::min(1.0f, std::max(0.0f, v)) * 255.0f +
+                              0.5f);
+}
+
+struct Band
+{
+  double error = 0.0;
+  float max_error = 0.0f;
+  size_t bad = 0;
+  double ssim = 0.0;
+  size_t windows = 0;
+};
+
+// Errors of a row of pixels; adds them up in band and writes heat.
+void row_error(const LabRow &p, const LabRow &q, int width, float bad_error,
+               Band *band, uint8_t *heat)
+{
+  thread_local std::vector<float> error;
+  error.resize(static_cast<size_t>(width));
+  int x = 0;
+#if PROTO3D_HAS_AVX2
+  const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+  for (; x + 8 <= width; x += 8)
+  {
+    const __m256 dl = _mm256_sub_ps(_mm256_loadu_ps(&p.l[x]),
+                                    _mm256_loadu_ps(&q.l[x]));
+    const __m256 da = _mm256_sub_ps(_mm256_loadu_ps(&p.a[x]),
+                                    _mm256_loadu_ps(&q.a[x]));
+    const __m256 db = _mm256_sub_ps(_mm256_loadu_ps(&p.b[x]),
+                                    _mm256_loadu_ps(&q.b[x]));
+    // L is over 100 already
+    const __m256 e = _mm256_min_ps(_mm256_set1_ps(1.0f), _mm256_fmadd_ps(
+      _mm256_sqrt_ps(_mm256_fmadd_ps(da, da, _mm256_mul_ps(db, db))),
+      _mm256_set1_ps(0.01f), _mm256_and_ps(dl, abs_mask)));
+    _mm256_storeu_ps(&error[static_cast<size_t>(x)], e);
+  }
+#endif
+  for (; x < width; ++x)
+  {
+    const size_t i = static_cast<size_t>(x);
+    const float da = p.a[i] - q.a[i], db = p.b[i] - q.b[i];
+    error[i] = std::min(1.0f, std::fabs(p.l[i] - q.l[i]) +
+                              0.01f * std::sqrt(da * da + db * db));
+  }
+
+  float sum = 0.0f;
+  for (const float e : error)
+  {
+    sum += e;
+    band->max_error = std::max(band->max_error, e);
+    band->bad += (e > bad_error) ? 1 : 0;
+  }
+  band->error += static_cast<double>(sum);
+  if (!heat)
+    return;
+  for (const float e : error)
+  {
+    // black, red, yellow, white
+    const float t = e * HEAT_SCALE;
+    heat[0] = heat_channel(3.0f * t);
+    heat[1] = heat_channel(3.0f * t - 1.0f);
+    heat[2] = heat_channel(3.0f * t - 2.0f);
+    heat[3] = 255;
+    heat += 4;
+  }
+}
+
+// Sums of a window's lightness, its squares and products for SSIM, each in
+// eight lanes added up at the end.
+enum WindowSum
+{
+  SUM_P,
+  SUM_Q,
+  SUM_PP,
+  SUM_QQ,
+  SUM_PQ,
+  WINDOW_SUMS
+};
+
+void add_windows(const float *p, const float *q, int width, float *sums)
+{
+  int x = 0;
+#if PROTO3D_HAS_AVX2
+  for (; x + WINDOW <= width; x += WINDOW)
+  {
+    float *s = sums + (x / WINDOW) * WINDOW_SUMS * WINDOW;
+    const __m256 vp = _mm256_loadu_ps(p + x), vq = _mm256_loadu_ps(q + x);
+    auto add = [s](int k, __m256 v) {
+      float *at = s + k * WINDOW;
+      _mm256_storeu_ps(at, _mm256_add_ps(_mm256_loadu_ps(at), v));
+    };
+    add(SUM_P, vp);
+    add(SUM_Q, vq);
+    add(SUM_PP, _mm256_mul_ps(vp, vp));
+    add(SUM_QQ, _mm256_mul_ps(vq, vq));
+    add(SUM_PQ, _mm256_mul_ps(vp, vq));
+  }
+#endif
+  for (; x < width; ++x)
+  {
+    float *s = sums + (x / WINDOW) * WINDOW_SUMS * WINDOW + x % WINDOW;
+    s[SUM_P * WINDOW] += p[x];
+    s[SUM_Q * WINDOW] += q[x];
+    s[SUM_PP * WINDOW] += p[x] * p[x];
+    s[SUM_QQ * WINDOW] += q[x] * q[x];
+    s[SUM_PQ * WINDOW] += p[x] * q[x];
+  }
+}
+
+float lanes(const float *s)
+{
+#if PROTO3D_HAS_AVX2
+  return hsum_ps(_mm256_loadu_ps(s));
+#else
+  float sum = 0.0f;
+  for (int i = 0; i < WINDOW; ++i)
+    sum += s[i];
+  return sum;
+#endif
+}
+
+void band_ssim(const float *sums, int width, int rows, Band *band)
+{
+  for (int x = 0; x < width; x += WINDOW)
+  {
+    const float *s = sums + (x / WINDOW) * WINDOW_SUMS * WINDOW;
+    const float n = static_cast<float>(std::min(WINDOW, width - x) * rows);
+    const float mp = lanes(s + SUM_P * WINDOW) / n;
+    const float mq = lanes(s + SUM_Q * WINDOW) / n;
+    const float vp = lanes(s + SUM_PP * WINDOW) / n - mp * mp;
+    const float vq = lanes(s + SUM_QQ * WINDOW) / n - mq * mq;
+    const float cov = lanes(s + SUM_PQ * WINDOW) / n - mp * mq;
+    band->ssim += static_cast<double>(
+      ((2.0f * mp * mq + C1) * (2.0f * cov + C2)) /
+      ((mp * mp + mq * mq + C1) * (vp + vq + C2)));
+    ++band->windows;
+  }
+}
+
+void compare_band(const uint8_t *a, const uint8_t *b, int width, int y0,
+                  int y1, float bad_error, Band *band, uint8_t *heatmap)
+{
+  thread_local LabRow p, q;
+  thread_local std::vector<float> sums;
+  const size_t w = static_cast<size_t>(width);
+  p.resize(w);
+  q.resize(w);
+  sums.assign(static_cast<size_t>((width + WINDOW - 1) / WINDOW) *
+              WINDOW_SUMS * WINDOW, 0.0f);
+  const size_t row = w * 4;
+  for (int y = y0; y < y1; ++y)
+  {
+    const size_t at = row * static_cast<size_t>(y);
+    to_lab(a + at, width, &p);
+    to_lab(b + at, width, &q);
+    row_error(p, q, width, bad_error, band, heatmap ? heatmap + at : nullptr);
+    add_windows(p.l.data(), q.l.data(), width, sums.data());
+  }
+  band_ssim(sums.data(), width, y1 - y0, band);
+}
+
+}  // unnamed namespace
+
+ImageDiff compare_images(const uint8_t *a, const uint8_t *b, int width,
+                         int height, const ImageTolerance &tolerance,
+                         JobSystem *jobs, std::vector<uint8_t> *heatmap)
+{
+  if ((width <= 0) || (height <= 0))
+    return ImageDiff{ 1.0, 0.0, 0.0f, 0.0 };
+  if (heatmap)
+    heatmap->resize(static_cast<size_t>(width) * 4 *
+                    static_cast<size_t>(height));
+  std::vector<Band> bands(static_cast<size_t>((height + WINDOW - 1) /
+                                              WINDOW));
+  auto compare = [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i)
+    {
+      const int y0 = static_cast<int>(i) * WINDOW;
+      compare_band(a, b, width, y0, std::min(height, y0 + WINDOW),
+                   tolerance.pixel_error, &bands[i],
+                   heatmap ? heatmap->data() : nullptr);
+    }
+  };
+  if (jobs)
+    jobs->parallel_for(bands.size(), 4, compare);
+  else
+    compare(0, bands.size());
+
+  Band total;
+  for (const Band &band : bands)
+  {
+    total.error += band.error;
+    total.max_error = std::max(total.max_error, band.max_error);
+    total.bad += band.bad;
+    total.ssim += band.ssim;
+    total.windows += band.windows;
+  }
+  const double pixels = static_cast<double>(width) * height;
+  return ImageDiff{ total.ssim / static_cast<double>(total.windows),
+                    total.error / pixels, total.max_error,
+                    static_cast<double>(total.bad) / pixels };
+}
+
+bool within(const ImageDiff &diff, const ImageTolerance &tolerance)
+{
+  return (diff.ssim >= tolerance.min_ssim) &&
+         (diff.mean_error <= tolerance.max_mean_error) &&
+         (diff.bad_fraction <= tolerance.max_bad_fraction);
+}
@@ -0,0 +1,41 @@
+#ifndef __IMAGE_COMPARE_H__
+#define __IMAGE_COMPARE_H__
+
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+// How far an image may stray from its golden one.
+struct ImageTolerance
+{
+  double min_ssim = 0.98;
+  double max_mean_error = 0.01;
+  // pixels erring more than this are bad; max_bad_fraction of them pass
+  float pixel_error = 0.1f;
+  double max_bad_fraction = 0.002;
+};
+
+struct ImageDiff
+{
+  double ssim;        // mean over 8x8 windows of lightness; 1 if identical
+  double mean_error;  // per-pixel colour error, 0 to 1
+  float max_error;
+  double bad_fraction;
+};
+
+// Perceptual difference of two RGBA8 images of the same size, rows top-down.
+// A pixel's colour error is the HyAB distance of the two in CIELAB, as FLIP's
+// colour pipeline measures it but without its spatial filters, over 100 and
+// clamped to 1; alpha is ignored.  SSIM is over lightness, in 8x8 windows
+// that don't overlap.  Bands of rows are compared on jobs' threads when given
+// one; heatmap, if given, gets each pixel's error as RGBA8, black through red
+// and yellow to white at 0.25.
+ImageDiff compare_images(const uint8_t *a, const uint8_t *b, int width,
+                         int height, const ImageTolerance &tolerance,
+                         JobSystem *jobs = nullptr,
+                         std::vector<uint8_t> *heatmap = nullptr);
+
+bool within(const ImageDiff &diff, const ImageTolerance &tolerance);
+
+#endif  // __IMAGE_COMPARE_H__
@@ -0,0 +1,452 @@
+#include "image_write.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// ---- PNG --------------------------------------------------------------------
+
+uint32_t crc_table[256];
+
+struct CrcInit
+{
+  CrcInit()
+  {
+    for (uint32_t n = 0; n < 256; ++n)
+    {
+      uint32_t c = n;
+      for (int k = 0; k < 8; ++k)
+        c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+      crc_table[n] = c;
+    }
+  }
+} crc_init;
+
+uint32_t crc32(uint32_t crc, const uint8_t *p, size_t n)
+{
+  crc = ~crc;
+  for (size_t i = 0; i < n; ++i)
+    crc = crc_table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+uint32_t adler32(const uint8_t *p, size_t n)
+{
+  // largest block whose sums can't overflow 32 bits
+  constexpr size_t NMAX = 5552;
+  uint32_t a = 1, b = 0;
+  while (n)
+  {
+    const size_t block = (n < NMAX) ? n : NMAX;
+    for (size_t i = 0; i < block; ++i)
+    {
+      a += p[i];
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+    p += block;
+    n -= block;
+  }
+  return (b << 16) | a;
+}
+
+void put_be32(std::vector<uint8_t> *out, uint32_t v)
+{
+  out->push_back(static_cast<uint8_t>(v >> 24));
+  out->push_back(static_cast<uint8_t>(v >> 16));
+  out->push_back(static_cast<uint8_t>(v >> 8));
+  out->push_back(static_cast<uint8_t>(v));
+}
+
+// LSB-first bit packer deflate streams are made of
+class BitWriter
+{
+public:
+  explicit BitWriter(std::vector<uint8_t> *out) : out_(out) { }
+
+  void put(uint32_t bits, int count)
+  {
+    bits_ |= static_cast<uint64_t>(bits) << count_;
+    count_ += count;
+    while (count_ >= 8)
+    {
+      out_->push_back(static_cast<uint8_t>(bits_));
+      bits_ >>= 8;
+      count_ -= 8;
+    }
+  }
+
+  void flush()
+  {
+    if (count_ > 0)
+      out_->push_back(static_cast<uint8_t>(bits_));
+    bits_ = 0;
+    count_ = 0;
+  }
+
+private:
+  std::vector<uint8_t> *out_;
+  uint64_t bits_ = 0;
+  int count_ = 0;
+};
+
+uint32_t reverse_bits(uint32_t code, int count)
+{
+  uint32_t r = 0;
+  for (int i = 0; i < count; ++i, code >>= 1)
+    r = (r << 1) | (code & 1);
+  return r;
+}
+
+// Fixed Huffman codes (RFC 1951 3.2.6), pre-reversed for the LSB-first packer
+struct FixedCodes
+{
+  uint16_t lit[288];
+  uint8_t lit_bits[288];
+  uint8_t dist[30];
+
+  FixedCodes()
+  {
+    for (uint32_t v = 0; v < 288; ++v)
+    {
+      uint32_t code;
+      int bits;
+      if (v < 144)      { code = 0x30 + v;          bits = 8; }
+      else if (v < 256) { code = 0x190 + (v - 144); bits = 9; }
+      else if (v < 280) { code = v - 256;           bits = 7; }
+      else              { code = 0xC0 + (v - 280);  bits = 8; }
+      lit[v] = static_cast<uint16_t>(reverse_bits(code, bits));
+      lit_bits[v] = static_cast<uint8_t>(bits);
+    }
+    for (uint32_t d = 0; d < 30; ++d)
+      dist[d] = static_cast<uint8_t>(reverse_bits(d, 5));
+  }
+} const fixed;
+
+int floor_log2(uint32_t v)
+{
+  int n = 0;
+  while (v >>= 1)
+    ++n;
+  return n;
+}
+
+void put_literal(BitWriter &bits, uint32_t v)
+{
+  bits.put(fixed.lit[v], fixed.lit_bits[v]);
+}
+
+void put_match(BitWriter &bits, uint32_t length, uint32_t distance)
+{
+  // lengths 3..258 and distances 1..32768 as a symbol plus extra bits
+  if (length == 258)
+    put_literal(bits, 285);
+  else
+  {
+    const uint32_t l = length - 3;
+    if (l < 8)
+      put_literal(bits, 257 + l);
+    else
+    {
+      const int n = floor_log2(l);
+      const uint32_t top = (l >> (n - 2)) & 3;
+      put_literal(bits, 257 + 4 * static_cast<uint32_t>(n - 1) + top);
+      bits.put(l - ((4 + top) << (n - 2)), n - 2);
+    }
+  }
+
+  const uint32_t d = distance - 1;
+  if (d < 4)
+    bits.put(fixed.dist[d], 5);
+  else
+  {
+    const int n = floor_log2(d);
+    const uint32_t top = (d >> (n - 1)) & 1;
+    bits.put(fixed.dist[2 * static_cast<uint32_t>(n) + top], 5);
+    bits.put(d - ((2 + top) << (n - 1)), n - 1);
+  }
+}
+
+// zlib stream of one fixed-Huffman block; each position probes only the last
+// one with the same 3-byte hash
+void deflate(const std::vector<uint8_t> &in, std::vector<uint8_t> *out)
+{
+  constexpr int HASH_BITS = 15;
+  constexpr size_t WINDOW = 32768;
+  constexpr size_t MIN_MATCH = 3, MAX_MATCH = 258;
+
+  out->push_back(0x78);
+  out->push_back(0x01);
+  BitWriter bits(out);
+  bits.put(1, 1);  // BFINAL
+  bits.put(1, 2);  // fixed Huffman
+
+  std::vector<uint32_t> head(size_t(1) << HASH_BITS, UINT32_MAX);
+  auto hash = [&in](size_t i) {
+    const uint32_t v = static_cast<uint32_t>(in[i]) |
+                       (static_cast<uint32_t>(in[i + 1]) << 8) |
+                       (static_cast<uint32_t>(in[i + 2]) << 16);
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+  };
+
+  const size_t n = in.size();
+  size_t i = 0;
+  while (i + MIN_MATCH <= n)
+  {
+    const uint32_t h = hash(i);
+    const uint32_t candidate = head[h];
+    head[h] = static_cast<uint32_t>(i);
+    size_t length = 0;
+    if ((candidate != UINT32_MAX) && (i - candidate <= WINDOW))
+    {
+      const size_t limit = std::min(MAX_MATCH, n - i);
+      while ((length < limit) && (in[candidate + length] == in[i + length]))
+        ++length;
+    }
+    if (length < MIN_MATCH)
+    {
+      put_literal(bits, in[i++]);
+      continue;
+    }
+    put_match(bits, static_cast<uint32_t>(length),
+              static_cast<uint32_t>(i - candidate));
+    const size_t end = i + length;
+    for (++i; (i < end) && (i + MIN_MATCH <= n); ++i)
+      head[hash(i)] = static_cast<uint32_t>(i);
+    i = end;
+  }
+  for (; i < n; ++i)
+    put_literal(bits, in[i]);
+  put_literal(bits, 256);
+  bits.flush();
+  put_be32(out, adler32(in.data(), in.size()));
+}
+
+void put_chunk(std::vector<uint8_t> *out, const char *type,
+               const uint8_t *data, size_t size)
+{
+  put_be32(out, static_cast<uint32_t>(size));
+  const size_t start = out->size();
+  out->insert(out->end(), type, type + 4);
+  out->insert(out->end(), data, data + size);
+  put_be32(out, crc32(0, out->data() + start, size + 4));
+}
+
+uint8_t paeth(int a, int b, int c)
+{
+  const int p = a + b - c;
+  const int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+  if ((pa <= pb) && (pa <= pc))
+    return static_cast<uint8_t>(a);
+  return static_cast<uint8_t>((pb <= pc) ? b : c);
+}
+
+// ---- QOI --------------------------------------------------------------------
+
+constexpr uint8_t QOI_OP_INDEX = 0x00;
+constexpr uint8_t QOI_OP_DIFF = 0x40;
+constexpr uint8_t QOI_OP_LUMA = 0x80;
+constexpr uint8_t QOI_OP_RUN = 0xC0;
+constexpr uint8_t QOI_OP_RGB = 0xFE;
+constexpr uint8_t QOI_OP_RGBA = 0xFF;
+
+struct Pixel
+{
+  uint8_t r, g, b, a;
+
+  bool operator==(const Pixel &o) const
+  {
+    return (r == o.r) && (g == o.g) && (b == o.b) && (a == o.a);
+  }
+};
+
+}  // unnamed namespace
+
+void encode_png(const uint8_t *rgba, int width, int height, ptrdiff_t stride,
+                int channels, std::vector<uint8_t> *out)
+{
+  const size_t w = static_cast<size_t>(width);
+  const size_t h = static_cast<size_t>(height);
+  const size_t row = w * static_cast<size_t>(channels);
+
+  // filter each row with whichever of Sub, Up and Paeth leaves the smallest
+  // sum of signed residuals, the usual estimate of what compresses best
+  std::vector<uint8_t> raw(h * (row + 1));
+  std::vector<uint8_t> prev(row, 0), cur(row), trial[3];
+  for (auto &t : trial)
+    t.resize(row);
+  for (size_t y = 0; y < h; ++y)
+  {
+    const uint8_t *src = rgba + static_cast<ptrdiff_t>(y) * stride;
+    for (size_t x = 0; x < w; ++x)
+      std::memcpy(&cur[x * static_cast<size_t>(channels)], src + x * 4,
+                  static_cast<size_t>(channels));
+
+    uint32_t best_cost = UINT32_MAX;
+    int best = 0;
+    for (int f = 0; f < 3; ++f)
+    {
+      uint32_t cost = 0;
+      for (size_t i = 0; i < row; ++i)
+      {
+        const int a = (i >= static_cast<size_t>(channels)) ?
+                      cur[i - static_cast<size_t>(channels)] : 0;
+        const int b = prev[i];
+        const int c = (i >= static_cast<size_t>(channels)) ?
+                      prev[i - static_cast<size_t>(channels)] : 0;
+        const int predict = (f == 0) ? a : (f == 1) ? b : paeth(a, b, c);
+        const uint8_t r = static_cast<uint8_t>(cur[i] - predict);
+        trial[f][i] = r;
+        cost += static_cast<uint32_t>(std::abs(static_cast<int8_t>(r)));
+      }
+      if (cost < best_cost)
+      {
+        best_cost = cost;
+        best = f;
+      }
+    }
+    uint8_t *dst = &raw[y * (row + 1)];
+    static const uint8_t FILTER_TYPE[3] = { 1, 2, 4 };  // Sub, Up, Paeth
+    dst[0] = FILTER_TYPE[best];
+    std::memcpy(dst + 1, trial[best].data(), row);
+    prev.swap(cur);
+  }
+
+  std::vector<uint8_t> idat;
+  idat.reserve(raw.size() / 2);
+  deflate(raw, &idat);
+
+  static const uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A,
+                                        0x1A, 0x0A };
+  out->clear();
+  out->reserve(idat.size() + 64);
+  out->insert(out->end(), SIGNATURE, SIGNATURE + 8);
+  std::vector<uint8_t> ihdr;
+  put_be32(&ihdr, static_cast<uint32_t>(width));
+  put_be32(&ihdr, static_cast<uint32_t>(height));
+  // 8 bits, RGB(A), deflate, adaptive filtering, not interlaced
+  const uint8_t rest[5] = { 8, static_cast<uint8_t>((channels == 4) ? 6 : 2),
+                            0, 0, 0 };
+  ihdr.insert(ihdr.end(), rest, rest + 5);
+  put_chunk(out, "IHDR", ihdr.data(), ihdr.size());
+  put_chunk(out, "IDAT", idat.data(), idat.size());
+  put_chunk(out, "IEND", nullptr, 0);
+}
+
+void encode_qoi(const uint8_t *rgba, int width, int height, ptrdiff_t stride,
+                int channels, std::vector<uint8_t> *out)
+{
+  out->clear();
+  const size_t w = static_cast<size_t>(width);
+  const size_t h = static_cast<size_t>(height);
+  // worst case is a tag byte more than every pixel
+  out->reserve(14 + w * h * static_cast<size_t>(channels + 1) + 8);
+  const uint8_t magic[4] = { 'q', 'o', 'i', 'f' };
+  out->insert(out->end(), magic, magic + 4);
+  put_be32(out, static_cast<uint32_t>(width));
+  put_be32(out, static_cast<uint32_t>(height));
+  out->push_back(static_cast<uint8_t>(channels));
+  out->push_back(0);  // sRGB with linear alpha
+
+  Pixel index[64] = {};
+  Pixel prev{ 0, 0, 0, 255 };
+  int run = 0;
+  for (size_t y = 0; y < h; ++y)
+  {
+    const uint8_t *src = rgba + static_cast<ptrdiff_t>(y) * stride;
+    for (size_t x = 0; x < w; ++x, src += 4)
+    {
+      const Pixel px{ src[0], src[1], src[2],
+                      (channels == 4) ? src[3] : uint8_t(255) };
+      if (px == prev)
+      {
+        if (++run == 62)
+        {
+          out->push_back(static_cast<uint8_t>(QOI_OP_RUN | (run - 1)));
+          run = 0;
+        }
+        continue;
+      }
+      if (run)
+      {
+        out->push_back(static_cast<uint8_t>(QOI_OP_RUN | (run - 1)));
+        run = 0;
+      }
+
+      const int slot = (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+      if (index[slot] == px)
+        out->push_back(static_cast<uint8_t>(QOI_OP_INDEX | slot));
+      else if (px.a != prev.a)
+      {
+        index[slot] = px;
+        const uint8_t op[5] = { QOI_OP_RGBA, px.r, px.g, px.b, px.a };
+        out->insert(out->end(), op, op + 5);
+      }
+      else
+      {
+        index[slot] = px;
+        const int dr = static_cast<int8_t>(px.r - prev.r);
+        const int dg = static_cast<int8_t>(px.g - prev.g);
+        const int db = static_cast<int8_t>(px.b - prev.b);
+        const int dr_dg = dr - dg, db_dg = db - dg;
+        if ((dr >= -2) && (dr <= 1) && (dg >= -2) && (dg <= 1) &&
+            (db >= -2) && (db <= 1))
+          out->push_back(static_cast<uint8_t>(
+            QOI_OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));
+        else if ((dg >= -32) && (dg <= 31) && (dr_dg >= -8) && (dr_dg <= 7) &&
+                 (db_dg >= -8) && (db_dg <= 7))
+        {
+          out->push_back(static_cast<uint8_t>(QOI_OP_LUMA | (dg + 32)));
+          out->push_back(static_cast<uint8_t>(((dr_dg + 8) << 4) |
+                                              (db_dg + 8)));
+        }
+        else
+        {
+          const uint8_t op[4] = { QOI_OP_RGB, px.r, px.g, px.b };
+          out->insert(out->end(), op, op + 4);
+        }
+      }
+      prev = px;
+    }
+  }
+  if (run)
+    out->push_back(static_cast<uint8_t>(QOI_OP_RUN | (run - 1)));
+  const uint8_t end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+  out->insert(out->end(), end, end + 8);
+}
+
+void encode_image(ImageFormat format, const uint8_t *rgba, int width,
+                  int height, ptrdiff_t stride, int channels,
+                  std::vector<uint8_t> *out)
+{
+  if (format == ImageFormat::QOI)
+    encode_qoi(rgba, width, height, stride, channels, out);
+  else
+    encode_png(rgba, width, height, stride, channels, out);
+}
+
+ImageFormat image_format_for(const char *path)
+{
+  const char *dot = std::strrchr(path, '.');
+  return (dot && !std::strcmp(dot, ".qoi")) ? ImageFormat::QOI :
+                                               ImageFormat::PNG;
+}
+
+const char* image_extension(ImageFormat format)
+{
+  return (format == ImageFormat::QOI) ? "qoi" : "png";
+}
+
+bool write_file(const char *path, const std::vector<uint8_t> &bytes)
+{
+  FILE *f = std::fopen(path, "wb");
+  if (!f)
+    return false;
+  const bool ok = std::fwrite(bytes.data(), 1, bytes.size(), f) ==
+                  bytes.size();
+  return (std::fclose(f) == 0) && ok;
+}
@@ -0,0 +1,34 @@
+#ifndef __IMAGE_WRITE_H__
+#define __IMAGE_WRITE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class ImageFormat
+{
+  PNG,
+  QOI,
+};
+
+// Encoders for 8-bit RGBA pixels; channels picks 3 (alpha dropped) or 4 in the
+// file.  Rows are stride bytes apart, so a negative stride starting at the last
+// row writes GL's bottom-up readbacks top-down.  Both are lossless.  PNG
+// compresses with a single-probe LZ77 under fixed Huffman codes: larger files
+// than zlib's best, made many times quicker.  QOI is several times
+// quicker again, for somewhat larger files.
+void encode_png(const uint8_t *rgba, int width, int height, ptrdiff_t stride,
+                int channels, std::vector<uint8_t> *out);
+void encode_qoi(const uint8_t *rgba, int width, int height, ptrdiff_t stride,
+                int channels, std::vector<uint8_t> *out);
+
+void encode_image(ImageFormat format, const uint8_t *rgba, int width,
+                  int height, ptrdiff_t stride, int channels,
+                  std::vector<uint8_t> *out);
+// by extension, .qoi or else PNG
+ImageFormat image_format_for(const char *path);
+const char* image_extension(ImageFormat format);
+
+bool write_file(const char *path, const std::vector<uint8_t> &bytes);
+
+#endif  // __IMAGE_WRITE_H__
@@ -0,0 +1,565 @@
+#include "isosurface.h"
+#include "jobs.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// rows of a slab handed to one job
+constexpr size_t ROWS_PER_BLOCK = 16;
+// at most 12 crossed edges in loops of 3 or more: 10 triangles
+constexpr int MAX_CASE_INDICES = 30;
+
+// Corner c of a cell sits at (c & 1, (c >> 1) & 1, (c >> 2) & 1); edge e runs
+// from CORNER[e] along AXIS[e].
+struct CaseTables
+{
+  uint8_t edge_corner[12];
+  uint8_t edge_axis[12];
+  uint8_t count[256];
+  uint8_t indices[256][MAX_CASE_INDICES];
+};
+
+glm::vec3 corner_pos(int c)
+{
+  return glm::vec3(float(c & 1), float((c >> 1) & 1), float((c >> 2) & 1));
+}
+
+// whether edges e and f lie on a common face of the cell
+bool share_face(const CaseTables &t, int e, int f)
+{
+  for (int b = 0; b < 3; ++b)
+  {
+    if ((b != t.edge_axis[e]) && (b != t.edge_axis[f]) &&
+        (((t.edge_corner[e] ^ t.edge_corner[f]) >> b & 1) == 0))
+      return true;
+  }
+  return false;
+}
+
+// Triangles of the loop between i and j, split at split[i][j].
+void emit_loop(const int *loop, int split[12][12], int i, int j,
+               uint8_t *indices, int *n)
+{
+  if (j - i < 2)
+    return;
+  const int k = split[i][j];
+  indices[(*n)++] = static_cast<uint8_t>(loop[i]);
+  indices[(*n)++] = static_cast<uint8_t>(loop[k]);
+  indices[(*n)++] = static_cast<uint8_t>(loop[j]);
+  emit_loop(loop, split, i, k, indices, n);
+  emit_loop(loop, split, k, j, indices, n);
+}
+
+// Builds the triangle table instead of carrying the classic 256 x 16 one: per
+// case, every cell face contributes segments between its crossed edges, which
+// chain into loops around the inside corners.  Ambiguous faces always
+// separate their inside corners; the choice depends only on the face, so
+// neighbouring cells agree and the surface stays watertight.  Loops are
+// triangulated with diagonals through the cell only: one along a face would
+// be a triangle edge the neighbour across it doesn't know about, or a
+// triangle in the face the neighbour emits too.  Every loop of the 256 cases
+// has such a triangulation.
+CaseTables build_tables()
+{
+  CaseTables t{};
+  int edge_of[8][8];
+  int e = 0;
+  for (int c = 0; c < 8; ++c)
+  {
+    for (int a = 0; a < 3; ++a)
+    {
+      if (c & (1 << a))
+        continue;
+      const int d = c | (1 << a);
+      t.edge_corner[e] = static_cast<uint8_t>(c);
+      t.edge_axis[e] = static_cast<uint8_t>(a);
+      edge_of[c][d] = edge_of[d][c] = e;
+      ++e;
+    }
+  }
+
+  for (int cube = 0; cube < 256; ++cube)
+  {
+    int next[12];
+    std::fill(next, next + 12, -1);
+    for (int face = 0; face < 6; ++face)
+    {
+      const int a = face / 2, side = face % 2;
+      const int u = (a + 1) % 3, v = (a + 2) % 3;
+      // counter-clockwise seen from outside the cell
+      int q[4] = { 0, 1 << u, (1 << u) | (1 << v), 1 << v };
+      if (!side)
+        std::swap(q[1], q[3]);
+      bool in[4];
+      for (int k = 0; k < 4; ++k)
+      {
+        q[k] |= side << a;
+        in[k] = (cube >> q[k]) & 1;
+      }
+      // pair each exit crossing with the entry before it, so the segment
+      // cuts off the inside corners in between
+      for (int k = 0; k < 4; ++k)
+      {
+        if (!in[k] || in[(k + 1) % 4])
+          continue;
+        int j = k;
+        while (in[j])
+          j = (j + 3) % 4;
+        next[edge_of[q[k]][q[(k + 1) % 4]]] = edge_of[q[j]][q[(j + 1) % 4]];
+      }
+    }
+
+    bool visited[12] = {};
+    int n = 0;
+    for (int start = 0; start < 12; ++start)
+    {
+      if (next[start] < 0 || visited[start])
+        continue;
+      int loop[12], len = 0;
+      for (int i = start; !visited[i]; i = next[i])
+      {
+        visited[i] = true;
+        loop[len++] = i;
+      }
+      // can[i][j]: loop[i..j] triangulates with inner diagonals only, given
+      // the chord i-j; the closing chord 0-(len - 1) is a loop segment
+      bool can[12][12] = {};
+      int split[12][12] = {};
+      for (int span = 1; span < len; ++span)
+      {
+        for (int i = 0; i + span < len; ++i)
+        {
+          const int j = i + span;
+          const bool chord_ok = (span == 1) || (span == len - 1) ||
+                                !share_face(t, loop[i], loop[j]);
+          if (span == 1)
+            can[i][j] = true;
+          for (int k = i + 1; chord_ok && !can[i][j] && (k < j); ++k)
+          {
+            if (can[i][k] && can[k][j])
+            {
+              can[i][j] = true;
+              split[i][j] = k;
+            }
+          }
+        }
+      }
+      emit_loop(loop, split, 0, len - 1, t.indices[cube], &n);
+    }
+    t.count[cube] = static_cast<uint8_t>(n);
+  }
+
+  // wind triangles to face away from the inside; corner 0 alone is inside
+  // for case 1, so its triangle must face (1, 1, 1)
+  glm::vec3 p[3];
+  for (int k = 0; k < 3; ++k)
+  {
+    const int edge = t.indices[1][k];
+    p[k] = corner_pos(t.edge_corner[edge]);
+    p[k][t.edge_axis[edge]] += 0.5f;
+  }
+  if (glm::dot(glm::cross(p[1] - p[0], p[2] - p[0]), glm::vec3(1.0f)) < 0.0f)
+  {
+    for (int cube = 0; cube < 256; ++cube)
+      for (int i = 0; i < t.count[cube]; i += 3)
+        std::swap(t.indices[cube][i + 1], t.indices[cube][i + 2]);
+  }
+  return t;
+}
+
+const CaseTables& tables()
+{
+  static const CaseTables t = build_tables();
+  return t;
+}
+
+// Inside bits of a row of samples, 64 to a word.
+void classify_row(const float *row, int nx, float iso, uint64_t *bits)
+{
+  std::fill(bits, bits + (nx + 63) / 64, 0);
+  int x = 0;
+#if PROTO3D_HAS_AVX2
+  const __m256 level = _mm256_set1_ps(iso);
+  // 8 divides 64, so a movemask never straddles words
+  for (; x + 8 <= nx; x += 8)
+  {
+    const __m256 in = _mm256_cmp_ps(_mm256_loadu_ps(row + x), level,
+                                    _CMP_LT_OQ);
+    bits[x >> 6] |= uint64_t(unsigned(_mm256_movemask_ps(in))) << (x & 63);
+  }
+#endif
+  for (; x < nx; ++x)
+  {
+    if (row[x] < iso)
+      bits[x >> 6] |= uint64_t(1) << (x & 63);
+  }
+}
+
+// word w of a row shifted down a bit: bit x holds sample x + 1
+uint64_t shifted(const uint64_t *row, size_t w, size_t words)
+{
+  return (row[w] >> 1) | ((w + 1 < words) ? (row[w + 1] << 63) : 0);
+}
+
+// mask of the first n bits of word w
+uint64_t valid_bits(int n, size_t w)
+{
+  const int rest = n - static_cast<int>(w * 64);
+  return (rest >= 64) ? ~uint64_t(0)
+                      : (rest <= 0) ? 0 : ((uint64_t(1) << rest) - 1);
+}
+
+int count_trailing_zeros(uint64_t v)
+{
+#if defined(__GNUC__)
+  return __builtin_ctzll(v);
+#else
+  int n = 0;
+  for (; !(v & 1); v >>= 1)
+    ++n;
+  return n;
+#endif
+}
+
+int pop_count(uint64_t v)
+{
+#if defined(__GNUC__)
+  return __builtin_popcountll(v);
+#else
+  int n = 0;
+  for (; v; v &= v - 1)
+    ++n;
+  return n;
+#endif
+}
+
+// All state of one slab: samples with a halo slice on either side, inside
+// bits and the vertex id of every crossed edge.  Sized once for slab_depth
+// and reused, so memory stays bounded by the slab, not the volume.
+class Slab
+{
+public:
+  Slab(const VolumeInfo &volume, float iso, int slab_depth)
+    : info_(volume), iso_(iso), nx_(volume.dims.x), ny_(volume.dims.y),
+      words_(static_cast<size_t>((nx_ + 63) / 64))
+  {
+    const size_t slice = static_cast<size_t>(nx_) * static_cast<size_t>(ny_);
+    const size_t planes = static_cast<size_t>(slab_depth) + 1;
+    values_.resize(slice * (planes + 2));
+    bits_.resize(words_ * static_cast<size_t>(ny_) * planes);
+    for (auto &ids : ids_)
+      ids.resize(slice * planes);
+    row_vertices_.resize(static_cast<size_t>(ny_) * planes);
+  }
+
+  bool run(JobSystem &jobs, int z0, int depth, uint32_t vertex_base,
+           const SlabSource &source, IsoMesh *out);
+
+private:
+  size_t point(int x, int y, int lz) const
+  {
+    return (static_cast<size_t>(lz) * static_cast<size_t>(ny_) +
+            static_cast<size_t>(y)) * static_cast<size_t>(nx_) +
+           static_cast<size_t>(x);
+  }
+  const uint64_t* row_bits(int y, int lz) const
+  {
+    return &bits_[(static_cast<size_t>(lz) * static_cast<size_t>(ny_) +
+                   static_cast<size_t>(y)) * words_];
+  }
+  float value(int x, int y, int z) const
+  {
+    return values_[(static_cast<size_t>(z - load_begin_) *
+                    static_cast<size_t>(ny_) + static_cast<size_t>(y)) *
+                   static_cast<size_t>(nx_) + static_cast<size_t>(x)];
+  }
+  glm::vec3 gradient(int x, int y, int z) const;
+  // crossed edges along axis of point row (y, lz), one bit per x
+  uint64_t crossings(int axis, int y, int lz, size_t w) const;
+  bool owns_edges(int axis, int y, int lz) const;
+  void count_row(int y, int lz);
+  void emit_row(int y, int lz, IsoMesh *out);
+  void triangulate_row(int y, int lz, std::vector<uint32_t> *indices) const;
+
+  VolumeInfo info_;
+  float iso_;
+  int nx_, ny_;
+  size_t words_;
+  int z0_ = 0, depth_ = 0, load_begin_ = 0, load_end_ = 0;
+  uint32_t vertex_base_ = 0;
+
+  std::vector<float> values_;
+  std::vector<uint64_t> bits_;
+  std::vector<uint32_t> ids_[3];
+  // vertices a row of points creates; turned into first ids by a prefix sum
+  std::vector<uint32_t> row_vertices_;
+  std::vector<std::vector<uint32_t>> block_indices_;
+};
+
+glm::vec3 Slab::gradient(int x, int y, int z) const
+{
+  const int x0 = std::max(x - 1, 0), x1 = std::min(x + 1, nx_ - 1);
+  const int y0 = std::max(y - 1, 0), y1 = std::min(y + 1, ny_ - 1);
+  const int z0 = std::max(z - 1, load_begin_);
+  const int z1 = std::min(z + 1, load_end_ - 1);
+  glm::vec3 g(0.0f);
+  if (x1 > x0)
+    g.x = (value(x1, y, z) - value(x0, y, z)) / float(x1 - x0);
+  if (y1 > y0)
+    g.y = (value(x, y1, z) - value(x, y0, z)) / float(y1 - y0);
+  if (z1 > z0)
+    g.z = (value(x, y, z1) - value(x, y, z0)) / float(z1 - z0);
+  return g;
+}
+
+uint64_t Slab::crossings(int axis, int y, int lz, size_t w) const
+{
+  const uint64_t *row = row_bits(y, lz);
+  switch (axis)
+  {
+  case 0:
+    return (row[w] ^ shifted(row, w, words_)) & valid_bits(nx_ - 1, w);
+  case 1:
+    return (row[w] ^ row_bits(y + 1, lz)[w]) & valid_bits(nx_, w);
+  default:
+    return (row[w] ^ row_bits(y, lz + 1)[w]) & valid_bits(nx_, w);
+  }
+}
+
+// x and y edges on the first plane came from the previous slab; z edges end
+// one plane short of the last
+bool Slab::owns_edges(int axis, int y, int lz) const
+{
+  switch (axis)
+  {
+  case 0:
+    return lz > 0 || z0_ == 0;
+  case 1:
+    return (lz > 0 || z0_ == 0) && y + 1 < ny_;
+  default:
+    return lz < depth_;
+  }
+}
+
+void Slab::count_row(int y, int lz)
+{
+  uint32_t n = 0;
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    if (!owns_edges(axis, y, lz))
+      continue;
+    for (size_t w = 0; w < words_; ++w)
+      n += static_cast<uint32_t>(pop_count(crossings(axis, y, lz, w)));
+  }
+  row_vertices_[static_cast<size_t>(lz * ny_ + y)] = n;
+}
+
+void Slab::emit_row(int y, int lz, IsoMesh *out)
+{
+  uint32_t local = row_vertices_[static_cast<size_t>(lz * ny_ + y)];
+  const int z = z0_ + lz;
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    if (!owns_edges(axis, y, lz))
+      continue;
+    for (size_t w = 0; w < words_; ++w)
+    {
+      for (uint64_t m = crossings(axis, y, lz, w); m; m &= m - 1)
+      {
+        const int x = static_cast<int>(w * 64) + count_trailing_zeros(m);
+        glm::ivec3 q(x, y, z);
+        q[axis] += 1;
+        const float v0 = value(x, y, z);
+        const float v1 = value(q.x, q.y, q.z);
+        const float t = (iso_ - v0) / (v1 - v0);
+
+        glm::vec3 p(static_cast<float>(x), static_cast<float>(y),
+                    static_cast<float>(z));
+        p[axis] += t;
+        glm::vec3 n = glm::mix(gradient(x, y, z), gradient(q.x, q.y, q.z), t);
+        const float len = glm::length(n);
+        n = (len > 0.0f) ? n / len : glm::vec3(0.0f);
+
+        out->positions[local] = info_.origin + p * info_.spacing;
+        out->normals[local] = n;
+        ids_[axis][point(x, y, lz)] = vertex_base_ + local;
+        ++local;
+      }
+    }
+  }
+}
+
+void Slab::triangulate_row(int y, int lz, std::vector<uint32_t> *indices) const
+{
+  const CaseTables &t = tables();
+  const uint64_t *a = row_bits(y, lz), *b = row_bits(y + 1, lz);
+  const uint64_t *c = row_bits(y, lz + 1), *d = row_bits(y + 1, lz + 1);
+  for (size_t w = 0; w < words_; ++w)
+  {
+    // corner bits of 64 cells at once; corner k of cell x is bit x of r[k]
+    const uint64_t r[8] = {
+      a[w], shifted(a, w, words_), b[w], shifted(b, w, words_),
+      c[w], shifted(c, w, words_), d[w], shifted(d, w, words_)
+    };
+    uint64_t mixed = 0;
+    for (int k = 1; k < 8; ++k)
+      mixed |= r[0] ^ r[k];
+    mixed &= valid_bits(nx_ - 1, w);
+
+    for (; mixed; mixed &= mixed - 1)
+    {
+      const int bit = count_trailing_zeros(mixed);
+      unsigned cube = 0;
+      for (int k = 0; k < 8; ++k)
+        cube |= static_cast<unsigned>((r[k] >> bit) & 1) << k;
+
+      const int x = static_cast<int>(w * 64) + bit;
+      for (int i = 0; i < t.count[cube]; ++i)
+      {
+        const int e = t.indices[cube][i];
+        const int corner = t.edge_corner[e];
+        indices->push_back(ids_[t.edge_axis[e]][point(
+          x + (corner & 1), y + ((corner >> 1) & 1), lz + ((corner >> 2) & 1))]);
+      }
+    }
+  }
+}
+
+bool Slab::run(JobSystem &jobs, int z0, int depth, uint32_t vertex_base,
+               const SlabSource &source, IsoMesh *out)
+{
+  if (z0 > 0)
+  {
+    // the last plane's x and y edges become this slab's first
+    const size_t slice = static_cast<size_t>(nx_) * static_cast<size_t>(ny_);
+    for (int axis = 0; axis < 2; ++axis)
+      std::memmove(ids_[axis].data(), ids_[axis].data() + slice *
+                   static_cast<size_t>(depth_), slice * sizeof(uint32_t));
+  }
+  z0_ = z0;
+  depth_ = depth;
+  vertex_base_ = vertex_base;
+  load_begin_ = std::max(z0 - 1, 0);
+  load_end_ = std::min(z0 + depth + 2, info_.dims.z);
+  if (!source(load_begin_, load_end_ - load_begin_, values_.data()))
+    return false;
+
+  const size_t planes = static_cast<size_t>(depth) + 1;
+  const size_t rows = planes * static_cast<size_t>(ny_);
+  auto for_rows = [&](size_t count, const std::function<void(int, int)> &fn) {
+    jobs.parallel_for(count, ROWS_PER_BLOCK, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i)
+        fn(static_cast<int>(i % static_cast<size_t>(ny_)),
+           static_cast<int>(i / static_cast<size_t>(ny_)));
+    });
+  };
+
+  for_rows(rows, [&](int y, int lz) {
+    const float *row = &values_[(static_cast<size_t>(z0 + lz - load_begin_) *
+                                 static_cast<size_t>(ny_) +
+                                 static_cast<size_t>(y)) *
+                                static_cast<size_t>(nx_)];
+    classify_row(row, nx_, iso_, &bits_[(static_cast<size_t>(lz) *
+                                         static_cast<size_t>(ny_) +
+                                         static_cast<size_t>(y)) * words_]);
+  });
+
+  for_rows(rows, [&](int y, int lz) { count_row(y, lz); });
+  uint32_t total = 0;
+  for (size_t i = 0; i < rows; ++i)
+  {
+    const uint32_t n = row_vertices_[i];
+    row_vertices_[i] = total;
+    total += n;
+  }
+  out->positions.resize(total);
+  out->normals.resize(total);
+  for_rows(rows, [&](int y, int lz) { emit_row(y, lz, out); });
+
+  // cells: one plane and one row fewer than points; a block a job
+  const size_t cell_rows = static_cast<size_t>(depth) *
+                           static_cast<size_t>(ny_ - 1);
+  const size_t blocks = (cell_rows + ROWS_PER_BLOCK - 1) / ROWS_PER_BLOCK;
+  if (block_indices_.size() < blocks)
+    block_indices_.resize(blocks);
+  jobs.parallel_for(blocks, 1, [&](size_t begin, size_t end) {
+    for (size_t block = begin; block < end; ++block)
+    {
+      std::vector<uint32_t> &indices = block_indices_[block];
+      indices.clear();
+      const size_t last = std::min((block + 1) * ROWS_PER_BLOCK, cell_rows);
+      for (size_t i = block * ROWS_PER_BLOCK; i < last; ++i)
+        triangulate_row(static_cast<int>(i % static_cast<size_t>(ny_ - 1)),
+                        static_cast<int>(i / static_cast<size_t>(ny_ - 1)),
+                        &indices);
+    }
+  });
+
+  out->indices.clear();
+  for (size_t block = 0; block < blocks; ++block)
+    out->indices.insert(out->indices.end(), block_indices_[block].begin(),
+                        block_indices_[block].end());
+  return true;
+}
+
+}  // unnamed namespace
+
+bool extract_isosurface(JobSystem &jobs,
+                        const VolumeInfo &volume,
+                        float iso,
+                        int slab_depth,
+                        const SlabSource &source,
+                        const MeshSink &sink)
+{
+  const glm::ivec3 &dims = volume.dims;
+  if (slab_depth < 1)
+    return false;
+  // no cells, no surface
+  if (dims.x < 2 || dims.y < 2 || dims.z < 2)
+    return true;
+
+  Slab slab(volume, iso, slab_depth);
+  IsoMesh mesh;
+  uint32_t vertex_base = 0;
+  for (int z0 = 0; z0 + 1 < dims.z; z0 += slab_depth)
+  {
+    const int depth = std::min(slab_depth, dims.z - 1 - z0);
+    if (!slab.run(jobs, z0, depth, vertex_base, source, &mesh))
+      return false;
+    vertex_base += static_cast<uint32_t>(mesh.positions.size());
+    sink(mesh);
+  }
+  return true;
+}
+
+void extract_isosurface(JobSystem &jobs,
+                        const VolumeInfo &volume,
+                        const float *values,
+                        float iso,
+                        IsoMesh *out)
+{
+  constexpr int SLAB_DEPTH = 32;
+  const size_t slice = static_cast<size_t>(volume.dims.x) *
+                       static_cast<size_t>(volume.dims.y);
+  out->positions.clear();
+  out->normals.clear();
+  out->indices.clear();
+  extract_isosurface(
+    jobs, volume, iso, SLAB_DEPTH,
+    [&](int z_begin, int count, float *dst) {
+      std::memcpy(dst, values + slice * static_cast<size_t>(z_begin),
+                  slice * static_cast<size_t>(count) * sizeof(float));
+      return true;
+    },
+    [&](const IsoMesh &slab) {
+      out->positions.insert(out->positions.end(), slab.positions.begin(),
+                            slab.positions.end());
+      out->normals.insert(out->normals.end(), slab.normals.begin(),
+                          slab.normals.end());
+      out->indices.insert(out->indices.end(), slab.indices.begin(),
+                          slab.indices.end());
+    });
+}
@@ -0,0 +1,57 @@
+#ifndef __ISOSURFACE_H__
+#define __ISOSURFACE_H__
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class JobSystem;
+
+// Indexed triangle mesh; vertices are shared between all triangles using the
+// same grid edge, so the surface is welded and watertight inside the volume.
+struct IsoMesh
+{
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> normals;
+  std::vector<uint32_t> indices;
+};
+
+// Samples on a regular grid, x fastest then y then z.  Points with values
+// below the iso level are inside; normals point towards increasing values,
+// i.e. outwards for signed distance fields.
+struct VolumeInfo
+{
+  glm::ivec3 dims{0};
+  glm::vec3 origin{0.0f};
+  float spacing = 1.0f;
+};
+
+// Fills slices [z_begin, z_begin + count) into out, dims.x * dims.y floats
+// per slice; false aborts the extraction.
+using SlabSource = std::function<bool(int z_begin, int count, float *out)>;
+
+// Receives each slab's new vertices and triangles; indices are global, i.e.
+// they count every vertex passed to earlier calls.
+using MeshSink = std::function<void(const IsoMesh &slab)>;
+
+// Marching cubes over the volume slab_depth slices at a time, so only a slab
+// (plus a one slice halo for gradients) is ever in memory.  Within a slab,
+// rows of cells are split into blocks processed as parallel jobs.
+bool extract_isosurface(JobSystem &jobs,
+                        const VolumeInfo &volume,
+                        float iso,
+                        int slab_depth,
+                        const SlabSource &source,
+                        const MeshSink &sink);
+
+// Convenience wrapper for volumes that fit in memory.
+void extract_isosurface(JobSystem &jobs,
+                        const VolumeInfo &volume,
+                        const float *values,
+                        float iso,
+                        IsoMesh *out);
+
+#endif  // __ISOSURFACE_H__
@@ -0,0 +1,124 @@
+#include "jobs.h"
+
+#include <algorithm>
+#include <utility>
+
+JobSystem::JobSystem(unsigned worker_count)
+{
+  if (worker_count == 0)
+  {
+    const unsigned hw = std::thread::hardware_concurrency();
+    worker_count = (hw > 1) ? (hw - 1) : 0;
+  }
+  workers_.reserve(worker_count);
+  for (unsigned i = 0; i < worker_count; ++i)
+    workers_.emplace_back(&JobSystem::worker_main, this);
+}
+
+JobSystem::~JobSystem()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  cv_.notify_all();
+  for (auto &w : workers_)
+    w.join();
+}
+
+void JobSystem::submit(Job job, JobCounter *counter)
+{
+  if (counter)
+    counter->pending.fetch_add(1, std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(Task{std::move(job), counter});
+  }
+  cv_.notify_one();
+  // it may be a waiter's to run
+  wait_cv_.notify_all();
+}
+
+void JobSystem::run(Task &task)
+{
+  task.job();
+  if (task.counter &&
+      (task.counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1))
+  {
+    // under the lock, so a waiter can't miss it between check and sleep;
+    // the counter itself may be gone once a waiter sees it drained
+    std::lock_guard<std::mutex> lock(mutex_);
+    wait_cv_.notify_all();
+  }
+}
+
+bool JobSystem::take(const JobCounter *counter, Task *task)
+{
+  const auto it = std::find_if(queue_.begin(), queue_.end(),
+                               [counter](const Task &t) {
+    return !counter || (t.counter == counter);
+  });
+  if (it == queue_.end())
+    return false;
+  *task = std::move(*it);
+  queue_.erase(it);
+  return true;
+}
+
+void JobSystem::wait(JobCounter &counter)
+{
+  // without workers nothing else would run the rest of the queue
+  const JobCounter *only = workers_.empty() ? nullptr : &counter;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!counter.done())
+  {
+    Task task;
+    if (take(only, &task))
+    {
+      lock.unlock();
+      run(task);
+      lock.lock();
+    }
+    else
+      wait_cv_.wait(lock);
+  }
+}
+
+void JobSystem::parallel_for(size_t count, size_t grain, const RangeJob &fn)
+{
+  if (count == 0)
+    return;
+  grain = std::max<size_t>(grain, 1);
+  if ((count <= grain) || workers_.empty())
+  {
+    fn(0, count);
+    return;
+  }
+
+  JobCounter counter;
+  // keep the first batch for this thread; it'd otherwise idle in wait()
+  for (size_t begin = grain; begin < count; begin += grain)
+  {
+    const size_t end = std::min(begin + grain, count);
+    submit([&fn, begin, end]() { fn(begin, end); }, &counter);
+  }
+  fn(0, grain);
+  wait(counter);
+}
+
+void JobSystem::worker_main()
+{
+  for (;;)
+  {
+    Task task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]() { return quit_ || !queue_.empty(); });
+      if (quit_ && queue_.empty())
+        return;
+      task = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    run(task);
+  }
+}
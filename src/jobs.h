@@ -0,0 +1,78 @@
+#ifndef __JOBS_H__
+#define __JOBS_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Outstanding job count of a batch; JobSystem::wait returns once it drains.
+struct JobCounter
+{
+  std::atomic<size_t> pending{0};
+
+  bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+// Fixed pool of worker threads pulling closures off a shared queue.  Waiting
+// threads help run the queued jobs of the counter they wait on, so waits may
+// nest inside jobs without starving the pool, and a wait on the render thread
+// never picks up someone else's long job; with none of its jobs queued a
+// waiting thread sleeps until the counter drains.  With zero workers
+// everything runs on the waiting thread.
+class JobSystem
+{
+public:
+  using Job = std::function<void()>;
+  using RangeJob = std::function<void(size_t begin, size_t end)>;
+
+  // worker_count of 0 picks hardware_concurrency - 1 (the caller is a worker
+  // too while it waits)
+  explicit JobSystem(unsigned worker_count = 0);
+  ~JobSystem();
+
+  JobSystem(const JobSystem&) = delete;
+  JobSystem& operator=(const JobSystem&) = delete;
+
+  void submit(Job job, JobCounter *counter = nullptr);
+  void wait(JobCounter &counter);
+
+  // Splits [0, count) into batches of at most grain items and blocks until
+  // all of them ran.
+  void parallel_for(size_t count, size_t grain, const RangeJob &fn);
+
+  unsigned worker_count() const
+  {
+    return static_cast<unsigned>(workers_.size());
+  }
+
+  // Workers plus the calling thread; use it to size per-thread scratch.
+  unsigned thread_count() const { return worker_count() + 1; }
+
+private:
+  struct Task
+  {
+    Job job;
+    JobCounter *counter;
+  };
+
+  // pops the first queued job of counter, or of any when it's null; mutex_
+  // must be held
+  bool take(const JobCounter *counter, Task *task);
+  void run(Task &task);
+  void worker_main();
+
+  std::vector<std::thread> workers_;
+  std::deque<Task> queue_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  // waiters: a counter drained or a job was queued
+  std::condition_variable wait_cv_;
+  bool quit_ = false;
+};
+
+#endif  // __JOBS_H__
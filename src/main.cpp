@@ -1,15 +1,42 @@
+#include "assets.h"
+#include "debug_draw.h"
+#include "frame_capture.h"
+#include "gl_lazy.h"
+#include "gl_profile.h"
+#include "gl_trace.h"
+#include "perf_hud.h"
+#include "startup.h"
 #include "util.h"
 
 #include "glad/glad.h"
 #include <GLFW/glfw3.h>
 
+#include <cstdlib>
 #include <iostream>
 
+// what the key callback acts on
+struct Controls
+{
+  PerfHud *hud;
+  FrameCapture *capture;
+};
+
 void framebuffer_size_callback(GLFWwindow*, int width, int height)
 {
   glViewport(0, 0, width, height);
 }
 
+void key_callback(GLFWwindow *window, int key, int, int action, int)
+{
+  auto *controls = static_cast<Controls*>(glfwGetWindowUserPointer(window));
+  if ((action != GLFW_PRESS) || !controls)
+    return;
+  if (key == GLFW_KEY_F1)
+    controls->hud->toggle();
+  else if ((key == GLFW_KEY_F12) && controls->capture->active())
+    controls->capture->set_paused(!controls->capture->paused());
+}
+
 void process_input(GLFWwindow *window)
 {
   if(glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
@@ -19,13 +46,69 @@ void process_input(GLFWwindow *window)
 void setup_debug(bool enable)
 {
   glDebugMessageCallbackKHR(enable ? gl_debug_logger : nullptr, stderr);
-  glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS_KHR);
-  if (GL_NO_ERROR != glGetError())
-    std::cerr << "Unable to set synchronous debug output\n";
+  GL_CHECK(glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS_KHR));
+}
+
+// what init_gl hands back
+struct GlInit
+{
+  bool loaded = false;
+  bool capture_ready = false;
+};
+
+// Loads GL and makes the GL objects the first frame needs; capture is set up
+// only when it's wanted.  The window's context must be current.
+GlInit init_gl(int width, int height, JobSystem &jobs,
+               JobCounter &assets_loaded, PerfHud &hud, FrameCapture *capture)
+{
+  GlInit result;
+  // entry points are looked up on first call, so only the ones used cost
+  result.loaded = gl_load_lazy((GLADloadproc)glfwGetProcAddress);
+  if (!result.loaded)
+    return result;
+  startup_mark("GL stubbed");
+  gl_profile_start();
+  // before any GL object exists, so the trace can be replayed
+  if (GL_TRACE)
+  {
+    if (const char *trace = std::getenv("PROTO3D_GL_TRACE_FILE"))
+      gl_trace_start(trace, width, height);
+  }
+#ifndef NDEBUG
+  if (GLAD_GL_KHR_debug)
+  {
+    setup_debug(true);
+  }
+#endif
+  glViewport(0, 0, width, height);
+  glClearColor(0.188f, 0.349f, 0.506f, 1.0f);
+
+  // shaders are assets
+  jobs.wait(assets_loaded);
+  if (!hud.init_gl())
+    std::cerr << "Unable to initialise the performance HUD\n";
+  if (!debug_draw_init())
+    std::cerr << "Unable to initialise debug drawing\n";
+  if (capture)
+  {
+    result.capture_ready = capture->init_gl();
+    if (!result.capture_ready)
+      std::cerr << "Unable to set up frame capture\n";
+  }
+  startup_mark("GL objects made");
+  return result;
 }
 
 int main() {
+  startup_mark("main");
+  // assets still read from disk (see assets.h) load on the pool while the
+  // window and context are created
+  JobSystem jobs;
+  JobCounter assets_loaded;
+  preload_assets(jobs, &assets_loaded);
+
   glfwInit();
+  startup_mark("GLFW initialised");
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
@@ -48,31 +131,68 @@ int main() {
     glfwTerminate();
     return -1;
   }
-  glfwMakeContextCurrent(window);
-  glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+  startup_mark("window created");
 
-  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-  {
-    std::cout << "Failed to initialize GLAD\n";
-    return -1;
-  }
-#ifndef NDEBUG
-  if (GLAD_GL_KHR_debug)
   {
-    setup_debug(true);
-  }
-#endif
-  glViewport(0, 0, INIT_WIDTH, INIT_HEIGHT);
-  glClearColor(0.188f, 0.349f, 0.506f, 1.0f);
+    // F1 shows frame times and counters
+    PerfHud hud;
+    // with PROTO3D_CAPTURE set, every frame is written to the files its
+    // pattern names; F12 pauses and resumes
+    FrameCapture capture(jobs);
+    const char *pattern = std::getenv("PROTO3D_CAPTURE");
+    glfwMakeContextCurrent(window);
+    const GlInit gl = init_gl(INIT_WIDTH, INIT_HEIGHT, jobs, assets_loaded,
+                              hud, pattern ? &capture : nullptr);
+    if (!gl.loaded)
+    {
+      // exits without the HUD's and capture's destructors, which call GL
+      std::cout << "Failed to initialize GLAD\n";
+      std::exit(-1);
+    }
 
-  while (!glfwWindowShouldClose(window))
-  {
-    glClear(GL_COLOR_BUFFER_BIT);
-    process_input(window);
+    Controls controls{ &hud, &capture };
+    glfwSetWindowUserPointer(window, &controls);
+    glfwSetKeyCallback(window, key_callback);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    if (gl.capture_ready)
+      capture.start(pattern);
+
+    bool first_frame = true;
+    while (!glfwWindowShouldClose(window))
+    {
+      hud.begin_frame();
+      glClear(GL_COLOR_BUFFER_BIT);
+      process_input(window);
+      // nothing 3D yet: lines are drawn in clip space
+      debug_draw_flush(glm::mat4(1.0f));
+      hud.end_frame();
+
+      int width = 0, height = 0;
+      glfwGetFramebufferSize(window, &width, &height);
+      hud.draw(width, height);
+      capture.capture(width, height);
 
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+      gl_trace_frame();
+      gl_profile_frame();
+      glfwSwapBuffers(window);
+      // PROTO3D_STARTUP_TRACE=1 prints how long it took to get here
+      if (first_frame && std::getenv("PROTO3D_STARTUP_TRACE"))
+        startup_report();
+      first_frame = false;
+      glfwPollEvents();
+    }
+    glfwSetWindowUserPointer(window, nullptr);
+    debug_draw_shutdown();
+    capture.stop();
+    const CaptureStats stats = capture.stats();
+    if (stats.captured || stats.dropped)
+      std::cerr << "Captured " << stats.written << " frames, dropped "
+                << stats.dropped << ", failed " << stats.failed
+                << "; capture took " << stats.render_ms_mean << " ms a frame, "
+                << stats.render_ms_max << " ms at most\n";
   }
+  gl_trace_stop();
+  gl_profile_stop();
 
   glfwDestroyWindow(window);
   glfwTerminate();
@@ -0,0 +1,408 @@
+#include "noise.h"
+#include "jobs.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+// Every kernel below is written once, as a template over a lane type: one
+// float for the reference path, eight for AVX2.  Both instantiations run the
+// same IEEE operations in the same order, and this file is built with
+// floating-point contraction off (see CMakeLists.txt) so neither gets fused
+// multiply-adds the other lacks; that is what makes them match exactly.
+
+namespace {
+
+struct Scalar
+{
+  using F = float;
+  using I = uint32_t;
+  using M = bool;
+
+  static F splat(float f) { return f; }
+  static I splat_int(uint32_t i) { return i; }
+  static F load(const float *p) { return *p; }
+  static void store(float *p, F f) { *p = f; }
+};
+
+inline float neg(float a) { return -a; }
+inline float abs_f(float a) { return std::fabs(a); }
+inline float sqrt_f(float a) { return std::sqrt(a); }
+inline float floor_f(float a) { return std::floor(a); }
+// both operands compared the way minps does: the second wins unless a < b
+inline float min_f(float a, float b) { return (a < b) ? a : b; }
+inline float select(bool m, float a, float b) { return m ? a : b; }
+inline bool lt(float a, float b) { return a < b; }
+inline bool ge(float a, float b) { return a >= b; }
+inline bool gt(float a, float b) { return a > b; }
+inline bool both(bool a, bool b) { return a && b; }
+inline bool either(bool a, bool b) { return a || b; }
+inline bool inverse(bool a) { return !a; }
+// floored floats to lattice coordinates and back; two's complement wrap
+inline uint32_t to_int(float a)
+{
+  return static_cast<uint32_t>(static_cast<int32_t>(a));
+}
+inline float to_float(uint32_t a)
+{
+  return static_cast<float>(static_cast<int32_t>(a));
+}
+template <int N> inline uint32_t shr(uint32_t a) { return a >> N; }
+inline bool ilt(uint32_t a, uint32_t b) { return a < b; }
+inline bool ieq(uint32_t a, uint32_t b) { return a == b; }
+
+#if PROTO3D_HAS_AVX2
+struct VF { __m256 v; };
+struct VI { __m256i v; };
+struct VM { __m256 v; };
+
+struct Avx
+{
+  using F = VF;
+  using I = VI;
+  using M = VM;
+
+  static F splat(float f) { return { _mm256_set1_ps(f) }; }
+  static I splat_int(uint32_t i)
+  {
+    return { _mm256_set1_epi32(static_cast<int>(i)) };
+  }
+  static F load(const float *p) { return { _mm256_loadu_ps(p) }; }
+  static void store(float *p, F f) { _mm256_storeu_ps(p, f.v); }
+};
+
+inline VF operator+(VF a, VF b) { return { _mm256_add_ps(a.v, b.v) }; }
+inline VF operator-(VF a, VF b) { return { _mm256_sub_ps(a.v, b.v) }; }
+inline VF operator*(VF a, VF b) { return { _mm256_mul_ps(a.v, b.v) }; }
+inline VF neg(VF a)
+{
+  return { _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)) };
+}
+inline VF abs_f(VF a)
+{
+  return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v) };
+}
+inline VF sqrt_f(VF a) { return { _mm256_sqrt_ps(a.v) }; }
+inline VF floor_f(VF a) { return { _mm256_floor_ps(a.v) }; }
+inline VF min_f(VF a, VF b) { return { _mm256_min_ps(a.v, b.v) }; }
+inline VF select(VM m, VF a, VF b)
+{
+  return { _mm256_blendv_ps(b.v, a.v, m.v) };
+}
+inline VM lt(VF a, VF b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+inline VM ge(VF a, VF b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+inline VM gt(VF a, VF b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+inline VM both(VM a, VM b) { return { _mm256_and_ps(a.v, b.v) }; }
+inline VM either(VM a, VM b) { return { _mm256_or_ps(a.v, b.v) }; }
+inline VM inverse(VM a)
+{
+  return { _mm256_xor_ps(a.v, _mm256_castsi256_ps(_mm256_set1_epi32(-1))) };
+}
+inline VI to_int(VF a) { return { _mm256_cvttps_epi32(a.v) }; }
+inline VF to_float(VI a) { return { _mm256_cvtepi32_ps(a.v) }; }
+
+inline VI operator+(VI a, VI b) { return { _mm256_add_epi32(a.v, b.v) }; }
+inline VI operator*(VI a, VI b) { return { _mm256_mullo_epi32(a.v, b.v) }; }
+inline VI operator^(VI a, VI b) { return { _mm256_xor_si256(a.v, b.v) }; }
+inline VI operator&(VI a, VI b) { return { _mm256_and_si256(a.v, b.v) }; }
+template <int N> inline VI shr(VI a) { return { _mm256_srli_epi32(a.v, N) }; }
+// only used on small non-negative values, where signed compares agree
+inline VM ilt(VI a, VI b)
+{
+  return { _mm256_castsi256_ps(_mm256_cmpgt_epi32(b.v, a.v)) };
+}
+inline VM ieq(VI a, VI b)
+{
+  return { _mm256_castsi256_ps(_mm256_cmpeq_epi32(a.v, b.v)) };
+}
+#endif
+
+template <typename L>
+typename L::I hash(typename L::I x, typename L::I y, typename L::I z,
+                   typename L::I seed)
+{
+  using I = typename L::I;
+  I h = seed ^ (x * L::splat_int(0x8da6b343u)) ^
+        (y * L::splat_int(0xd8163841u)) ^ (z * L::splat_int(0xcb1ab31fu));
+  h = h ^ shr<15>(h);
+  h = h * L::splat_int(0x2c1b3c6du);
+  h = h ^ shr<12>(h);
+  h = h * L::splat_int(0x297a2d39u);
+  return h ^ shr<15>(h);
+}
+
+template <typename L>
+typename L::F fade(typename L::F t)
+{
+  return t * t * t * (t * (t * L::splat(6.0f) - L::splat(15.0f)) +
+                      L::splat(10.0f));
+}
+
+template <typename L>
+typename L::F lerp(typename L::F a, typename L::F b, typename L::F t)
+{
+  return a + t * (b - a);
+}
+
+// dot with one of the 12 cube edge directions (4 repeated to fill 16)
+template <typename L>
+typename L::F grad(typename L::I hash, typename L::F x, typename L::F y,
+                   typename L::F z)
+{
+  using I = typename L::I;
+  const I h = hash & L::splat_int(15);
+  const auto u = select(ilt(h, L::splat_int(8)), x, y);
+  const auto v = select(ilt(h, L::splat_int(4)), y,
+                        select(either(ieq(h, L::splat_int(12)),
+                                      ieq(h, L::splat_int(14))), x, z));
+  const I zero = L::splat_int(0);
+  return select(ieq(h & L::splat_int(1), zero), u, neg(u)) +
+         select(ieq(h & L::splat_int(2), zero), v, neg(v));
+}
+
+template <typename L>
+typename L::F lattice_value(typename L::I hash)
+{
+  return to_float(shr<8>(hash)) * L::splat(2.0f / 16777215.0f) -
+         L::splat(1.0f);
+}
+
+template <typename L>
+typename L::F value_noise(typename L::F x, typename L::F y, typename L::F z,
+                          typename L::I seed)
+{
+  using F = typename L::F;
+  using I = typename L::I;
+  const F fx = floor_f(x), fy = floor_f(y), fz = floor_f(z);
+  const I x0 = to_int(fx), y0 = to_int(fy), z0 = to_int(fz);
+  const I one = L::splat_int(1);
+  const I x1 = x0 + one, y1 = y0 + one, z1 = z0 + one;
+  const F u = fade<L>(x - fx), v = fade<L>(y - fy), w = fade<L>(z - fz);
+  return lerp<L>(
+    lerp<L>(lerp<L>(lattice_value<L>(hash<L>(x0, y0, z0, seed)),
+                    lattice_value<L>(hash<L>(x1, y0, z0, seed)), u),
+            lerp<L>(lattice_value<L>(hash<L>(x0, y1, z0, seed)),
+                    lattice_value<L>(hash<L>(x1, y1, z0, seed)), u), v),
+    lerp<L>(lerp<L>(lattice_value<L>(hash<L>(x0, y0, z1, seed)),
+                    lattice_value<L>(hash<L>(x1, y0, z1, seed)), u),
+            lerp<L>(lattice_value<L>(hash<L>(x0, y1, z1, seed)),
+                    lattice_value<L>(hash<L>(x1, y1, z1, seed)), u), v),
+    w);
+}
+
+template <typename L>
+typename L::F perlin_noise(typename L::F x, typename L::F y, typename L::F z,
+                           typename L::I seed)
+{
+  using F = typename L::F;
+  using I = typename L::I;
+  const F fx = floor_f(x), fy = floor_f(y), fz = floor_f(z);
+  const I x0 = to_int(fx), y0 = to_int(fy), z0 = to_int(fz);
+  const I one = L::splat_int(1);
+  const I x1 = x0 + one, y1 = y0 + one, z1 = z0 + one;
+  const F dx0 = x - fx, dy0 = y - fy, dz0 = z - fz;
+  const F dx1 = dx0 - L::splat(1.0f), dy1 = dy0 - L::splat(1.0f),
+          dz1 = dz0 - L::splat(1.0f);
+  const F u = fade<L>(dx0), v = fade<L>(dy0), w = fade<L>(dz0);
+  return lerp<L>(
+    lerp<L>(lerp<L>(grad<L>(hash<L>(x0, y0, z0, seed), dx0, dy0, dz0),
+                    grad<L>(hash<L>(x1, y0, z0, seed), dx1, dy0, dz0), u),
+            lerp<L>(grad<L>(hash<L>(x0, y1, z0, seed), dx0, dy1, dz0),
+                    grad<L>(hash<L>(x1, y1, z0, seed), dx1, dy1, dz0), u), v),
+    lerp<L>(lerp<L>(grad<L>(hash<L>(x0, y0, z1, seed), dx0, dy0, dz1),
+                    grad<L>(hash<L>(x1, y0, z1, seed), dx1, dy0, dz1), u),
+            lerp<L>(grad<L>(hash<L>(x0, y1, z1, seed), dx0, dy1, dz1),
+                    grad<L>(hash<L>(x1, y1, z1, seed), dx1, dy1, dz1), u), v),
+    w);
+}
+
+template <typename L>
+typename L::F simplex_corner(typename L::I hash, typename L::F x,
+                             typename L::F y, typename L::F z)
+{
+  using F = typename L::F;
+  const F t = L::splat(0.6f) - x * x - y * y - z * z;
+  const F t2 = t * t;
+  return select(lt(t, L::splat(0.0f)), L::splat(0.0f),
+                t2 * t2 * grad<L>(hash, x, y, z));
+}
+
+// Gustavson's simplex noise with branch-free corner ordering.
+template <typename L>
+typename L::F simplex_noise(typename L::F x, typename L::F y, typename L::F z,
+                            typename L::I seed)
+{
+  using F = typename L::F;
+  using I = typename L::I;
+  const F F3 = L::splat(1.0f / 3.0f), G3 = L::splat(1.0f / 6.0f);
+  const F s = (x + y + z) * F3;
+  const F fi = floor_f(x + s), fj = floor_f(y + s), fk = floor_f(z + s);
+  const F t = (fi + fj + fk) * G3;
+  const F x0 = x - (fi - t), y0 = y - (fj - t), z0 = z - (fk - t);
+
+  const auto x_ge_y = ge(x0, y0), x_ge_z = ge(x0, z0), y_ge_z = ge(y0, z0);
+  const F one = L::splat(1.0f), zero = L::splat(0.0f);
+  const F i1 = select(both(x_ge_y, x_ge_z), one, zero);
+  const F j1 = select(both(inverse(x_ge_y), y_ge_z), one, zero);
+  const F k1 = select(both(gt(z0, x0), gt(z0, y0)), one, zero);
+  const F i2 = select(either(x_ge_y, x_ge_z), one, zero);
+  const F j2 = select(either(inverse(x_ge_y), y_ge_z), one, zero);
+  const F k2 = select(inverse(both(x_ge_z, y_ge_z)), one, zero);
+
+  const F x1 = x0 - i1 + G3, y1 = y0 - j1 + G3, z1 = z0 - k1 + G3;
+  const F G3x2 = L::splat(2.0f / 6.0f), G3x3 = L::splat(3.0f / 6.0f);
+  const F x2 = x0 - i2 + G3x2, y2 = y0 - j2 + G3x2, z2 = z0 - k2 + G3x2;
+  const F x3 = x0 - one + G3x3, y3 = y0 - one + G3x3, z3 = z0 - one + G3x3;
+
+  const I i = to_int(fi), j = to_int(fj), k = to_int(fk);
+  const I e = L::splat_int(1);
+  const F n = simplex_corner<L>(hash<L>(i, j, k, seed), x0, y0, z0) +
+              simplex_corner<L>(hash<L>(i + to_int(i1), j + to_int(j1),
+                                        k + to_int(k1), seed), x1, y1, z1) +
+              simplex_corner<L>(hash<L>(i + to_int(i2), j + to_int(j2),
+                                        k + to_int(k2), seed), x2, y2, z2) +
+              simplex_corner<L>(hash<L>(i + e, j + e, k + e, seed),
+                                x3, y3, z3);
+  return n * L::splat(32.0f);
+}
+
+template <typename L>
+typename L::F cellular_noise(typename L::F x, typename L::F y,
+                             typename L::F z, typename L::I seed)
+{
+  using F = typename L::F;
+  using I = typename L::I;
+  const F fx = floor_f(x), fy = floor_f(y), fz = floor_f(z);
+  const I cx = to_int(fx), cy = to_int(fy), cz = to_int(fz);
+  const F px = x - fx, py = y - fy, pz = z - fz;
+  const I bits = L::splat_int(1023);
+  const F scale = L::splat(1.0f / 1023.0f);
+  F best = L::splat(16.0f);
+  for (int dz = -1; dz <= 1; ++dz)
+  {
+    for (int dy = -1; dy <= 1; ++dy)
+    {
+      for (int dx = -1; dx <= 1; ++dx)
+      {
+        // a feature point per cell, jittered by three 10-bit hash fields
+        const I h = hash<L>(cx + L::splat_int(static_cast<uint32_t>(dx)),
+                            cy + L::splat_int(static_cast<uint32_t>(dy)),
+                            cz + L::splat_int(static_cast<uint32_t>(dz)),
+                            seed);
+        const F ox = L::splat(float(dx)) + to_float(h & bits) * scale - px;
+        const F oy = L::splat(float(dy)) +
+                     to_float(shr<10>(h) & bits) * scale - py;
+        const F oz = L::splat(float(dz)) +
+                     to_float(shr<20>(h) & bits) * scale - pz;
+        best = min_f(best, ox * ox + oy * oy + oz * oz);
+      }
+    }
+  }
+  return sqrt_f(best);
+}
+
+template <typename L>
+typename L::F sample(NoiseType type, typename L::F x, typename L::F y,
+                     typename L::F z, typename L::I seed)
+{
+  switch (type)
+  {
+  case NoiseType::VALUE:
+    return value_noise<L>(x, y, z, seed);
+  case NoiseType::PERLIN:
+    return perlin_noise<L>(x, y, z, seed);
+  case NoiseType::SIMPLEX:
+    return simplex_noise<L>(x, y, z, seed);
+  case NoiseType::CELLULAR:
+  default:
+    return cellular_noise<L>(x, y, z, seed);
+  }
+}
+
+template <typename L>
+typename L::F fractal(const NoiseSettings &s, typename L::F x,
+                      typename L::F y, typename L::F z)
+{
+  using F = typename L::F;
+  const F frequency = L::splat(s.frequency);
+  x = x * frequency;
+  y = y * frequency;
+  z = z * frequency;
+  if ((s.fractal == FractalType::NONE) || (s.octaves < 1))
+    return sample<L>(s.type, x, y, z, L::splat_int(s.seed));
+
+  const F lacunarity = L::splat(s.lacunarity);
+  F sum = L::splat(0.0f);
+  float amplitude = 1.0f, total = 0.0f;
+  for (int o = 0; o < s.octaves; ++o)
+  {
+    // a seed an octave, so octaves don't line up at the origin
+    F n = sample<L>(s.type, x, y, z,
+                    L::splat_int(s.seed + static_cast<uint32_t>(o)));
+    if (s.fractal == FractalType::RIDGED)
+      n = L::splat(1.0f) - abs_f(n);
+    sum = sum + n * L::splat(amplitude);
+    total += amplitude;
+    amplitude *= s.gain;
+    x = x * lacunarity;
+    y = y * lacunarity;
+    z = z * lacunarity;
+  }
+  return sum * L::splat(1.0f / total);
+}
+
+}  // unnamed namespace
+
+float noise(const NoiseSettings &settings, float x, float y, float z)
+{
+  return fractal<Scalar>(settings, x, y, z);
+}
+
+void noise(const NoiseSettings &settings, const float *x, const float *y,
+           const float *z, float *out, size_t n)
+{
+  size_t i = 0;
+#if PROTO3D_HAS_AVX2
+  for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH)
+    Avx::store(out + i, fractal<Avx>(settings, Avx::load(x + i),
+                                     Avx::load(y + i), Avx::load(z + i)));
+#endif
+  for (; i < n; ++i)
+    out[i] = fractal<Scalar>(settings, x[i], y[i], z[i]);
+}
+
+void fill_noise_grid(JobSystem &jobs,
+                     const NoiseSettings &settings,
+                     const glm::ivec3 &dims,
+                     const glm::vec3 &origin,
+                     float step,
+                     float *out)
+{
+  const auto nx = static_cast<size_t>(dims.x);
+  const auto ny = static_cast<size_t>(dims.y);
+  const auto nz = static_cast<size_t>(dims.z);
+  if (!nx || !ny || !nz)
+    return;
+
+  // x is the same for every row; y and z are constant along one
+  AlignedVector<float> xs(nx);
+  for (size_t i = 0; i < nx; ++i)
+    xs[i] = origin.x + static_cast<float>(i) * step;
+
+  // rows a job; enough that short rows don't drown in scheduling
+  const size_t grain = std::max<size_t>(1, 4096 / nx);
+  jobs.parallel_for(ny * nz, grain, [&](size_t begin, size_t end) {
+    thread_local AlignedVector<float> ys, zs;
+    ys.resize(nx);
+    zs.resize(nx);
+    for (size_t row = begin; row < end; ++row)
+    {
+      const float y = origin.y + static_cast<float>(row % ny) * step;
+      const float z = origin.z + static_cast<float>(row / ny) * step;
+      std::fill(ys.begin(), ys.end(), y);
+      std::fill(zs.begin(), zs.end(), z);
+      noise(settings, xs.data(), ys.data(), zs.data(), out + row * nx, nx);
+    }
+  });
+}
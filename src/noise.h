@@ -0,0 +1,57 @@
+#ifndef __NOISE_H__
+#define __NOISE_H__
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+class JobSystem;
+
+enum class NoiseType
+{
+  VALUE,     // trilinear blend of random lattice values
+  PERLIN,    // improved gradient noise
+  SIMPLEX,   // gradient noise on a tetrahedral lattice; cheaper, no grid bias
+  CELLULAR   // distance to the nearest jittered feature point (Worley F1)
+};
+
+enum class FractalType
+{
+  NONE,
+  FBM,       // sum of octaves
+  RIDGED     // sum of 1 - |octave|; sharp crests
+};
+
+// Value, Perlin and simplex noise and their sums are roughly -1..1; ridged
+// sums are 0..1, cellular is 0 at feature points and about 1 at most.
+struct NoiseSettings
+{
+  NoiseType type = NoiseType::PERLIN;
+  FractalType fractal = FractalType::FBM;
+  int octaves = 4;
+  float frequency = 0.01f;
+  float lacunarity = 2.0f;
+  float gain = 0.5f;
+  uint32_t seed = 1337;
+};
+
+// Reference implementation, one sample at a time.  The batched and grid
+// versions evaluate the very same operations, eight lanes at a time, and
+// match it bit for bit.
+float noise(const NoiseSettings &settings, float x, float y, float z);
+
+// Samples n points given as separate coordinate streams.
+void noise(const NoiseSettings &settings, const float *x, const float *y,
+           const float *z, float *out, size_t n);
+
+// Samples dims points starting at origin, step apart, x fastest then y then
+// z; a 2D grid has dims.z == 1.  Rows are spread over the job system.
+void fill_noise_grid(JobSystem &jobs,
+                     const NoiseSettings &settings,
+                     const glm::ivec3 &dims,
+                     const glm::vec3 &origin,
+                     float step,
+                     float *out);
+
+#endif  // __NOISE_H__
@@ -0,0 +1,380 @@
+#include "particles.h"
+#include "assets.h"
+#include "jobs.h"
+#include "perf.h"
+#include "shader.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+namespace {
+
+inline
+uint32_t xorshift(uint32_t &x)
+{
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x;
+}
+
+// [0, 1) from the top 23 bits: the mantissa of a float in [1, 2)
+inline
+float to_unit(uint32_t x)
+{
+  const uint32_t bits = (x >> 9) | 0x3f800000u;
+  float f;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f - 1.0f;
+}
+
+#if PROTO3D_HAS_AVX2
+inline
+__m256 next_unit(__m256i &x)
+{
+  x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 13));
+  x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 17));
+  x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 5));
+  const __m256i bits = _mm256_or_si256(_mm256_srli_epi32(x, 9),
+                                       _mm256_set1_epi32(0x3f800000));
+  return _mm256_sub_ps(_mm256_castsi256_ps(bits), _mm256_set1_ps(1.0f));
+}
+
+// For each 8-bit keep mask, the lane permutation moving kept lanes to the
+// front in order; indexes _mm256_permutevar8x32_ps.
+struct CompactTable
+{
+  alignas(32) int32_t lanes[256][8];
+
+  CompactTable()
+  {
+    for (int mask = 0; mask < 256; ++mask)
+    {
+      int n = 0;
+      for (int lane = 0; lane < 8; ++lane)
+      {
+        if (mask & (1 << lane))
+          lanes[mask][n++] = lane;
+      }
+      for (; n < 8; ++n)
+        lanes[mask][n] = 0;
+    }
+  }
+};
+
+const CompactTable compact_table;
+#endif
+
+}  // unnamed namespace
+
+ParticleSystem::ParticleSystem(size_t capacity, uint32_t seed)
+{
+  const size_t blocks = std::max<size_t>(1, (capacity + BLOCK_SIZE - 1) /
+                                            BLOCK_SIZE);
+  block_count_.assign(blocks, 0);
+  for (auto &s : streams_)
+    s.resize(blocks * BLOCK_SIZE);
+  // xorshift state must be non-zero; decorrelate lanes with a hash
+  for (size_t i = 0; i < SIMD_WIDTH; ++i)
+    rng_[i] = (seed + static_cast<uint32_t>(i) * 0x9e3779b9u) | 1u;
+}
+
+bool ParticleSystem::add_plane(const ParticlePlane &plane)
+{
+  if (planes_.size() == MAX_PLANES)
+    return false;
+  planes_.push_back(plane);
+  return true;
+}
+
+size_t ParticleSystem::alive() const
+{
+  size_t n = 0;
+  for (const auto c : block_count_)
+    n += c;
+  return n;
+}
+
+size_t ParticleSystem::emit(const ParticleEmitter &e, size_t count)
+{
+  const float speed_range = e.speed_max - e.speed_min;
+  const float life_range = e.life_max - e.life_min;
+  size_t emitted = 0;
+  for (size_t b = 0; (b < block_count_.size()) && (emitted < count); ++b)
+  {
+    const size_t n = std::min(BLOCK_SIZE - block_count_[b], count - emitted);
+    size_t i = b * BLOCK_SIZE + block_count_[b];
+    const size_t end = i + n;
+    block_count_[b] += static_cast<uint32_t>(n);
+    emitted += n;
+
+#if PROTO3D_HAS_AVX2
+    __m256i rng = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rng_));
+    for (; i + SIMD_WIDTH <= end; i += SIMD_WIDTH)
+    {
+      const __m256 speed = _mm256_fmadd_ps(next_unit(rng),
+                                           _mm256_set1_ps(speed_range),
+                                           _mm256_set1_ps(e.speed_min));
+      // jitter = (2u - 1) * spread * speed
+      const __m256 jitter_scale = _mm256_mul_ps(speed,
+                                                _mm256_set1_ps(e.spread));
+      const __m256 two = _mm256_set1_ps(2.0f);
+      const __m256 one = _mm256_set1_ps(1.0f);
+      for (int c = 0; c < 3; ++c)
+      {
+        const __m256 jitter = _mm256_fmsub_ps(next_unit(rng), two, one);
+        const __m256 v = _mm256_fmadd_ps(jitter, jitter_scale,
+          _mm256_mul_ps(speed, _mm256_set1_ps(e.direction[c])));
+        _mm256_storeu_ps(streams_[VX + c].data() + i, v);
+        _mm256_storeu_ps(streams_[PX + c].data() + i,
+                         _mm256_set1_ps(e.position[c]));
+      }
+      _mm256_storeu_ps(streams_[LIFE].data() + i,
+                       _mm256_fmadd_ps(next_unit(rng),
+                                       _mm256_set1_ps(life_range),
+                                       _mm256_set1_ps(e.life_min)));
+      _mm256_storeu_ps(streams_[AGE].data() + i, _mm256_setzero_ps());
+      _mm256_storeu_ps(streams_[SIZE].data() + i, _mm256_set1_ps(e.size));
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(rng_), rng);
+#endif
+    for (; i < end; ++i)
+    {
+      const float speed = e.speed_min + to_unit(xorshift(rng_[0])) * speed_range;
+      for (int c = 0; c < 3; ++c)
+      {
+        const float jitter = to_unit(xorshift(rng_[0])) * 2.0f - 1.0f;
+        streams_[VX + c][i] = speed * e.direction[c] +
+                              jitter * speed * e.spread;
+        streams_[PX + c][i] = e.position[c];
+      }
+      streams_[LIFE][i] = e.life_min + to_unit(xorshift(rng_[0])) * life_range;
+      streams_[AGE][i] = 0.0f;
+      streams_[SIZE][i] = e.size;
+    }
+  }
+  return emitted;
+}
+
+void ParticleSystem::update_block(size_t block, float dt)
+{
+  const size_t base = block * BLOCK_SIZE;
+  const size_t n = block_count_[block];
+  float *s[STREAM_COUNT];
+  for (int i = 0; i < STREAM_COUNT; ++i)
+    s[i] = streams_[i].data() + base;
+
+  size_t i = 0;
+  size_t kept = 0;
+#if PROTO3D_HAS_AVX2
+  const __m256 vdt = _mm256_set1_ps(dt);
+  const __m256 dv[3] = { _mm256_set1_ps(gravity.x * dt),
+                         _mm256_set1_ps(gravity.y * dt),
+                         _mm256_set1_ps(gravity.z * dt) };
+  for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH)
+  {
+    __m256 v[STREAM_COUNT];
+    for (int k = 0; k < STREAM_COUNT; ++k)
+      v[k] = _mm256_loadu_ps(s[k] + i);
+
+    for (int c = 0; c < 3; ++c)
+    {
+      v[VX + c] = _mm256_add_ps(v[VX + c], dv[c]);
+      v[PX + c] = _mm256_fmadd_ps(v[VX + c], vdt, v[PX + c]);
+    }
+    for (const auto &plane : planes_)
+    {
+      const __m256 nx = _mm256_set1_ps(plane.normal.x);
+      const __m256 ny = _mm256_set1_ps(plane.normal.y);
+      const __m256 nz = _mm256_set1_ps(plane.normal.z);
+      const __m256 d = _mm256_sub_ps(
+        _mm256_fmadd_ps(nx, v[PX], _mm256_fmadd_ps(ny, v[PY],
+                                                   _mm256_mul_ps(nz, v[PZ]))),
+        _mm256_set1_ps(plane.distance));
+      const __m256 vn = _mm256_fmadd_ps(nx, v[VX],
+                        _mm256_fmadd_ps(ny, v[VY], _mm256_mul_ps(nz, v[VZ])));
+      // reflect the position back out; bounce velocity only when heading in
+      const __m256 inside = _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_LT_OQ);
+      const __m256 approaching = _mm256_and_ps(inside,
+        _mm256_cmp_ps(vn, _mm256_setzero_ps(), _CMP_LT_OQ));
+      const __m256 push = _mm256_and_ps(inside,
+                                        _mm256_mul_ps(d, _mm256_set1_ps(-2.0f)));
+      const __m256 bounce = _mm256_and_ps(approaching,
+        _mm256_mul_ps(vn, _mm256_set1_ps(-(1.0f + plane.restitution))));
+      const __m256 n3[3] = { nx, ny, nz };
+      for (int c = 0; c < 3; ++c)
+      {
+        v[PX + c] = _mm256_fmadd_ps(push, n3[c], v[PX + c]);
+        v[VX + c] = _mm256_fmadd_ps(bounce, n3[c], v[VX + c]);
+      }
+    }
+    v[AGE] = _mm256_add_ps(v[AGE], vdt);
+
+    // left-pack survivors; stores land at or behind lanes already loaded
+    const int mask = _mm256_movemask_ps(_mm256_cmp_ps(v[AGE], v[LIFE],
+                                                      _CMP_LT_OQ));
+    const __m256i perm = _mm256_load_si256(
+      reinterpret_cast<const __m256i*>(compact_table.lanes[mask]));
+    for (int k = 0; k < STREAM_COUNT; ++k)
+      _mm256_storeu_ps(s[k] + kept, _mm256_permutevar8x32_ps(v[k], perm));
+    kept += static_cast<size_t>(_mm_popcnt_u32(static_cast<unsigned>(mask)));
+  }
+#endif
+  for (; i < n; ++i)
+  {
+    float v[STREAM_COUNT];
+    for (int k = 0; k < STREAM_COUNT; ++k)
+      v[k] = s[k][i];
+    for (int c = 0; c < 3; ++c)
+    {
+      v[VX + c] += gravity[c] * dt;
+      v[PX + c] += v[VX + c] * dt;
+    }
+    for (const auto &plane : planes_)
+    {
+      const float d = plane.normal.x * v[PX] + plane.normal.y * v[PY] +
+                      plane.normal.z * v[PZ] - plane.distance;
+      const float vn = plane.normal.x * v[VX] + plane.normal.y * v[VY] +
+                       plane.normal.z * v[VZ];
+      const float push = (d < 0.0f) ? -2.0f * d : 0.0f;
+      const float bounce = ((d < 0.0f) && (vn < 0.0f)) ?
+        -(1.0f + plane.restitution) * vn : 0.0f;
+      for (int c = 0; c < 3; ++c)
+      {
+        v[PX + c] += push * plane.normal[c];
+        v[VX + c] += bounce * plane.normal[c];
+      }
+    }
+    v[AGE] += dt;
+    for (int k = 0; k < STREAM_COUNT; ++k)
+      s[k][kept] = v[k];
+    kept += (v[AGE] < v[LIFE]) ? 1 : 0;
+  }
+  block_count_[block] = static_cast<uint32_t>(kept);
+}
+
+void ParticleSystem::update(JobSystem &jobs, float dt)
+{
+  jobs.parallel_for(block_count_.size(), 1, [this, dt](size_t begin,
+                                                       size_t end) {
+    for (size_t b = begin; b < end; ++b)
+      update_block(b, dt);
+  });
+}
+
+void ParticleSystem::write_instances(JobSystem &jobs,
+                                     ParticleInstance *out) const
+{
+  std::vector<size_t> first(block_count_.size());
+  size_t total = 0;
+  for (size_t b = 0; b < block_count_.size(); ++b)
+  {
+    first[b] = total;
+    total += block_count_[b];
+  }
+
+  jobs.parallel_for(block_count_.size(), 1, [&](size_t begin, size_t end) {
+    for (size_t b = begin; b < end; ++b)
+    {
+      const size_t base = b * BLOCK_SIZE;
+      ParticleInstance *dst = out + first[b];
+      for (size_t i = 0; i < block_count_[b]; ++i)
+      {
+        const size_t p = base + i;
+        dst[i].position[0] = streams_[PX][p];
+        dst[i].position[1] = streams_[PY][p];
+        dst[i].position[2] = streams_[PZ][p];
+        dst[i].size = streams_[SIZE][p];
+        dst[i].age = streams_[AGE][p] / streams_[LIFE][p];
+      }
+    }
+  });
+}
+
+bool ParticleRenderer::init(size_t max_particles, size_t frames_in_flight)
+{
+  program_ = compile_program("particles",
+                             asset_text("shaders/particles.vert").c_str(),
+                             asset_text("shaders/particles.frag").c_str());
+  if (!program_)
+    return false;
+  u_view_proj_ = glGetUniformLocation(program_, "u_view_proj");
+  u_right_ = glGetUniformLocation(program_, "u_right");
+  u_up_ = glGetUniformLocation(program_, "u_up");
+
+  glGenVertexArrays(1, &vao_);
+  glBindVertexArray(vao_);
+  gl_label(GL_VERTEX_ARRAY_KHR, vao_, "particles");
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+  glVertexAttribDivisor(0, 1);
+  glVertexAttribDivisor(1, 1);
+  glBindVertexArray(0);
+
+  return ring_.init(GL_ARRAY_BUFFER,
+                    static_cast<GLsizeiptr>(max_particles * frames_in_flight *
+                                            sizeof(ParticleInstance)),
+                    "particle ring");
+}
+
+void ParticleRenderer::destroy()
+{
+  ring_.destroy();
+  glDeleteVertexArrays(1, &vao_);
+  glDeleteProgram(program_);
+  vao_ = program_ = 0;
+}
+
+void ParticleRenderer::draw(JobSystem &jobs,
+                            const ParticleSystem &particles,
+                            const glm::mat4 &view,
+                            const glm::mat4 &proj)
+{
+  const size_t count = particles.alive();
+  if (count == 0)
+    return;
+  GL_ZONE("particles");
+
+  GLintptr offset = 0;
+  const auto bytes = static_cast<GLsizeiptr>(count * sizeof(ParticleInstance));
+  auto *instances = static_cast<ParticleInstance*>(
+    ring_.map(bytes, sizeof(float), &offset));
+  if (!instances)
+    return;
+  particles.write_instances(jobs, instances);
+  ring_.unmap();
+
+  // GL 3.3 has no base instance; re-point the attributes at this frame's slice
+  constexpr auto stride = static_cast<GLsizei>(sizeof(ParticleInstance));
+  glBindVertexArray(vao_);
+  glBindBuffer(GL_ARRAY_BUFFER, ring_.id());
+  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride,
+                        reinterpret_cast<const void*>(offset));
+  glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, stride,
+                        reinterpret_cast<const void*>(
+                          offset + offsetof(ParticleInstance, age)));
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  const glm::mat4 view_proj = proj * view;
+  glUseProgram(program_);
+  glUniformMatrix4fv(u_view_proj_, 1, GL_FALSE, &view_proj[0][0]);
+  // camera basis is the first two rows of the view rotation
+  glUniform3f(u_right_, view[0][0], view[1][0], view[2][0]);
+  glUniform3f(u_up_, view[0][1], view[1][1], view[2][1]);
+
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_ONE, GL_ONE);
+  glDepthMask(GL_FALSE);
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4,
+                        static_cast<GLsizei>(count));
+  perf_count(PerfCounter::DRAW_CALLS);
+  perf_count(PerfCounter::TRIANGLES, 2 * static_cast<uint64_t>(count));
+  glDepthMask(GL_TRUE);
+  glDisable(GL_BLEND);
+  glBindVertexArray(0);
+
+  ring_.end_frame();
+}
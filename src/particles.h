@@ -0,0 +1,111 @@
+#ifndef __PARTICLES_H__
+#define __PARTICLES_H__
+
+#include "simd.h"
+#include "stream_buffer.h"
+
+#include "glad/glad.h"
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+struct ParticleEmitter
+{
+  glm::vec3 position{0.0f};
+  glm::vec3 direction{0.0f, 1.0f, 0.0f};
+  float spread = 0.3f;  // random velocity, as a fraction of speed
+  float speed_min = 2.0f;
+  float speed_max = 4.0f;
+  float life_min = 1.0f;
+  float life_max = 2.0f;
+  float size = 0.02f;
+};
+
+// Particles hit the back side of planes where dot(normal, p) < distance and
+// bounce off with velocity along the normal scaled by restitution.
+struct ParticlePlane
+{
+  glm::vec3 normal{0.0f, 1.0f, 0.0f};
+  float distance = 0.0f;
+  float restitution = 0.5f;
+};
+
+// Per-instance billboard data streamed to the GPU.
+struct ParticleInstance
+{
+  float position[3];
+  float size;
+  float age;  // normalised to [0, 1) over the particle's life
+};
+
+// Particles in SoA streams, grouped into fixed blocks that are updated as
+// independent jobs.  Dead particles are squeezed out of their block with
+// branch-free compaction, so live ones are [0, count) of every block and no
+// frame ever moves data across blocks.
+class ParticleSystem
+{
+public:
+  static constexpr size_t BLOCK_SIZE = 16384;
+  static constexpr size_t MAX_PLANES = 4;
+
+  explicit ParticleSystem(size_t capacity, uint32_t seed = 1);
+
+  // Spawns up to count particles; returns how many fit.
+  size_t emit(const ParticleEmitter &emitter, size_t count);
+  void update(JobSystem &jobs, float dt);
+
+  bool add_plane(const ParticlePlane &plane);
+
+  // Interleaves every live particle into out[0, alive()).
+  void write_instances(JobSystem &jobs, ParticleInstance *out) const;
+
+  size_t alive() const;
+  size_t capacity() const { return block_count_.size() * BLOCK_SIZE; }
+
+  glm::vec3 gravity{0.0f, -9.81f, 0.0f};
+
+private:
+  enum Stream
+  {
+    PX, PY, PZ,
+    VX, VY, VZ,
+    AGE, LIFE, SIZE,
+    STREAM_COUNT
+  };
+
+  void update_block(size_t block, float dt);
+
+  AlignedVector<float> streams_[STREAM_COUNT];
+  std::vector<uint32_t> block_count_;
+  std::vector<ParticlePlane> planes_;
+  uint32_t rng_[SIMD_WIDTH];
+};
+
+// Draws a ParticleSystem as camera-facing quads, one instanced draw; the
+// instance data is streamed through a ring buffer.
+class ParticleRenderer
+{
+public:
+  // frames_in_flight frames of max_particles instances fit the ring
+  bool init(size_t max_particles, size_t frames_in_flight = 3);
+  void destroy();
+
+  void draw(JobSystem &jobs,
+            const ParticleSystem &particles,
+            const glm::mat4 &view,
+            const glm::mat4 &proj);
+
+private:
+  StreamBuffer ring_;
+  GLuint vao_ = 0;
+  GLuint program_ = 0;
+  GLint u_view_proj_ = -1;
+  GLint u_right_ = -1;
+  GLint u_up_ = -1;
+};
+
+#endif  // __PARTICLES_H__
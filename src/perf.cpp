@@ -0,0 +1,24 @@
+#include "perf.h"
+
+namespace perf_detail {
+
+std::atomic<bool> enabled{false};
+Slot counters[static_cast<int>(PerfCounter::COUNT)];
+
+}  // namespace perf_detail
+
+void perf_set_enabled(bool enabled)
+{
+  perf_detail::enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool perf_enabled()
+{
+  return perf_detail::enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t perf_take(PerfCounter counter)
+{
+  return perf_detail::counters[static_cast<int>(counter)].value.exchange(
+    0, std::memory_order_relaxed);
+}
@@ -0,0 +1,45 @@
+#ifndef __PERF_H__
+#define __PERF_H__
+
+#include <atomic>
+#include <cstdint>
+
+// Frame counters bumped by subsystems from any thread.  They only count while
+// something reads them (the HUD, say): otherwise perf_count() is a relaxed
+// load and a well-predicted branch.
+enum class PerfCounter
+{
+  DRAW_CALLS,
+  TRIANGLES,
+  STATE_CHANGES_SKIPPED,
+  TEXTURE_BINDS,
+  COUNT
+};
+
+namespace perf_detail {
+
+// a cache line each so threads counting different things don't contend
+struct alignas(64) Slot
+{
+  std::atomic<uint64_t> value{0};
+};
+
+extern std::atomic<bool> enabled;
+extern Slot counters[static_cast<int>(PerfCounter::COUNT)];
+
+}  // namespace perf_detail
+
+inline void perf_count(PerfCounter counter, uint64_t n = 1)
+{
+  if (perf_detail::enabled.load(std::memory_order_relaxed))
+    perf_detail::counters[static_cast<int>(counter)].value.fetch_add(
+      n, std::memory_order_relaxed);
+}
+
+void perf_set_enabled(bool enabled);
+bool perf_enabled();
+
+// Count since the last take, resetting it to zero.
+uint64_t perf_take(PerfCounter counter);
+
+#endif  // __PERF_H__
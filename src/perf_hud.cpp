@@ -0,0 +1,262 @@
+#include "perf_hud.h"
+#include "gl_profile.h"
+#include "perf.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+constexpr float MARGIN = 8.0f;
+constexpr float PADDING = 6.0f;
+constexpr float LINE_HEIGHT = 18.0f;
+constexpr float GRAPH_HEIGHT = 48.0f;
+// frame time at the top of a graph
+constexpr float GRAPH_MS = 33.3f;
+constexpr float TARGET_MS = 16.7f;
+// numbers change this often, so they can be read and their layouts cached
+constexpr uint64_t TEXT_REFRESH = 15;
+// costliest GL entry points listed, with a GL profile
+constexpr size_t GL_CALLS_LISTED = 3;
+
+constexpr uint32_t PANEL_COLOR = 0xb0000000u;
+constexpr uint32_t TEXT_COLOR = 0xffffffffu;
+constexpr uint32_t GOOD_COLOR = 0xff40d040u;
+constexpr uint32_t SLOW_COLOR = 0xff20c0e0u;
+constexpr uint32_t BAD_COLOR = 0xff3030e0u;
+constexpr uint32_t TARGET_COLOR = 0x80ffffffu;
+
+std::string format(const char *fmt, double a, double b, double c,
+                   double d = 0.0)
+{
+  char line[96];
+  std::snprintf(line, sizeof(line), fmt, a, b, c, d);
+  return line;
+}
+
+}  // unnamed namespace
+
+void PerfHud::History::push(float v)
+{
+  ms[head] = v;
+  head = (head + 1) % HISTORY;
+  count = std::min(count + 1, HISTORY);
+}
+
+void PerfHud::History::percentiles(std::vector<float> *scratch, float *p50,
+                                   float *p99) const
+{
+  *p50 = *p99 = 0.0f;
+  if (!count)
+    return;
+  scratch->assign(ms, ms + count);
+  const auto at = [scratch](int percent) {
+    auto nth = scratch->begin() + (static_cast<long>(scratch->size()) - 1) *
+                                  percent / 100;
+    std::nth_element(scratch->begin(), nth, scratch->end());
+    return *nth;
+  };
+  *p50 = at(50);
+  *p99 = at(99);
+}
+
+PerfHud::~PerfHud()
+{
+  if (visible_)
+    perf_set_enabled(false);
+  glDeleteQueries(QUERY_COUNT, queries_);
+}
+
+bool PerfHud::init_gl()
+{
+  glGenQueries(QUERY_COUNT, queries_);
+  return renderer_.init_gl();
+}
+
+void PerfHud::add_memory(const std::string &name,
+                         std::function<size_t()> bytes)
+{
+  memory_.push_back(Memory{ name, std::move(bytes) });
+}
+
+void PerfHud::set_visible(bool visible)
+{
+  if (visible == visible_)
+    return;
+  visible_ = visible;
+  perf_set_enabled(visible);
+  has_last_begin_ = false;
+  frame_ = 0;
+  if (visible)
+  {
+    // counts gathered while hidden, if any, aren't this frame's
+    for (int c = 0; c < static_cast<int>(PerfCounter::COUNT); ++c)
+      perf_take(static_cast<PerfCounter>(c));
+  }
+}
+
+void PerfHud::begin_frame()
+{
+  if (!visible_)
+    return;
+  const auto now = std::chrono::steady_clock::now();
+  if (has_last_begin_)
+    cpu_.push(std::chrono::duration<float, std::milli>(now - last_begin_)
+              .count());
+  last_begin_ = now;
+  has_last_begin_ = true;
+
+  // with every query still in flight this frame goes unmeasured rather than
+  // stalling on an old result
+  query_active_ = !query_pending_[query_next_];
+  if (query_active_)
+    glBeginQuery(GL_TIME_ELAPSED, queries_[query_next_]);
+}
+
+void PerfHud::end_frame()
+{
+  if (!visible_)
+    return;
+  if (query_active_)
+  {
+    glEndQuery(GL_TIME_ELAPSED);
+    query_pending_[query_next_] = true;
+    query_next_ = (query_next_ + 1) % QUERY_COUNT;
+    query_active_ = false;
+  }
+  poll_queries();
+
+  draw_calls_ = perf_take(PerfCounter::DRAW_CALLS);
+  triangles_ = perf_take(PerfCounter::TRIANGLES);
+  skipped_ = perf_take(PerfCounter::STATE_CHANGES_SKIPPED);
+  texture_binds_ = perf_take(PerfCounter::TEXTURE_BINDS);
+}
+
+// oldest first, so the history stays in frame order
+void PerfHud::poll_queries()
+{
+  for (int i = 0; i < QUERY_COUNT; ++i)
+  {
+    const int q = (query_next_ + i) % QUERY_COUNT;
+    if (!query_pending_[q])
+      continue;
+    GLint available = 0;
+    glGetQueryObjectiv(queries_[q], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+      break;
+    GLuint64 ns = 0;
+    glGetQueryObjectui64v(queries_[q], GL_QUERY_RESULT, &ns);
+    gpu_.push(static_cast<float>(static_cast<double>(ns) * 1e-6));
+    query_pending_[q] = false;
+  }
+}
+
+void PerfHud::refresh_text()
+{
+  lines_.clear();
+  float p50 = 0.0f, p99 = 0.0f;
+  cpu_.percentiles(&scratch_, &p50, &p99);
+  lines_.push_back(format("CPU %6.2f ms   p50 %6.2f   p99 %6.2f",
+                          cpu_.count ? cpu_.ms[(cpu_.head + HISTORY - 1) %
+                                               HISTORY] : 0.0f,
+                          p50, p99));
+  gpu_.percentiles(&scratch_, &p50, &p99);
+  lines_.push_back(format("GPU %6.2f ms   p50 %6.2f   p99 %6.2f",
+                          gpu_.count ? gpu_.ms[(gpu_.head + HISTORY - 1) %
+                                               HISTORY] : 0.0f,
+                          p50, p99));
+  lines_.push_back(format("draws %.0f   tris %.1fk   binds %.0f   "
+                          "skipped %.0f",
+                          static_cast<double>(draw_calls_),
+                          static_cast<double>(triangles_) * 1e-3,
+                          static_cast<double>(texture_binds_),
+                          static_cast<double>(skipped_)));
+  if (GL_PROFILE)
+    gl_text();
+  for (const auto &memory : memory_)
+  {
+    char line[96];
+    std::snprintf(line, sizeof(line), "%-12.12s %9.1f MB",
+                  memory.name.c_str(),
+                  static_cast<double>(memory.bytes()) / (1024.0 * 1024.0));
+    lines_.push_back(line);
+  }
+}
+
+// the last frame's GL calls: totals, then the costliest entry points
+void PerfHud::gl_text()
+{
+  const std::vector<GlCallStats> &calls = gl_profile_last_frame();
+  uint32_t count = 0, syncs = 0;
+  float ms = 0.0f;
+  for (const auto &c : calls)
+  {
+    count += c.calls;
+    syncs += c.sync ? c.calls : 0;
+    ms += c.ms;
+  }
+  lines_.push_back(format("gl calls %.0f   %.2f ms   sync %.0f",
+                          static_cast<double>(count), static_cast<double>(ms),
+                          static_cast<double>(syncs)));
+  for (size_t i = 0; i < std::min(calls.size(), GL_CALLS_LISTED); ++i)
+  {
+    char line[96];
+    std::snprintf(line, sizeof(line), "  %-24.24s %5u %6.2f ms%s",
+                  calls[i].name, calls[i].calls,
+                  static_cast<double>(calls[i].ms),
+                  calls[i].sync ? "  sync" : "");
+    lines_.push_back(line);
+  }
+}
+
+// one bar a frame, oldest on the left, with a line at the frame target
+void PerfHud::graph(const History &history, const glm::vec2 &pos)
+{
+  for (int i = 0; i < history.count; ++i)
+  {
+    const float ms = history.ms[(history.head + HISTORY - history.count + i) %
+                                HISTORY];
+    const float h = std::min(ms / GRAPH_MS, 1.0f) * GRAPH_HEIGHT;
+    const uint32_t color = (ms <= TARGET_MS) ? GOOD_COLOR :
+                           (ms <= GRAPH_MS) ? SLOW_COLOR : BAD_COLOR;
+    batch_.add_rect(glm::vec2(pos.x + static_cast<float>(i),
+                              pos.y + GRAPH_HEIGHT - h),
+                    glm::vec2(1.0f, h), color);
+  }
+  batch_.add_rect(glm::vec2(pos.x, pos.y + GRAPH_HEIGHT *
+                            (1.0f - TARGET_MS / GRAPH_MS)),
+                  glm::vec2(static_cast<float>(HISTORY), 1.0f), TARGET_COLOR);
+}
+
+void PerfHud::draw(int viewport_width, int viewport_height)
+{
+  if (!visible_)
+    return;
+  GL_ZONE("perf hud");
+  if (frame_++ % TEXT_REFRESH == 0)
+    refresh_text();
+
+  const float width = static_cast<float>(HISTORY) + 2.0f * PADDING;
+  const float height = 2.0f * PADDING + 2.0f * GRAPH_HEIGHT +
+                       static_cast<float>(lines_.size()) * LINE_HEIGHT;
+  batch_.add_rect(glm::vec2(MARGIN), glm::vec2(width, height), PANEL_COLOR);
+
+  glm::vec2 pos(MARGIN + PADDING);
+  for (size_t i = 0; i < lines_.size(); ++i)
+  {
+    batch_.add(lines_[i], pos, TEXT_COLOR, 14);
+    pos.y += LINE_HEIGHT;
+    if (i < 2)
+    {
+      graph(i ? gpu_ : cpu_, pos);
+      pos.y += GRAPH_HEIGHT;
+    }
+  }
+  renderer_.draw(batch_, viewport_width, viewport_height);
+
+  // the HUD's own draws would otherwise be counted into the next frame
+  perf_take(PerfCounter::DRAW_CALLS);
+  perf_take(PerfCounter::TRIANGLES);
+  perf_take(PerfCounter::TEXTURE_BINDS);
+}
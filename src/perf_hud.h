@@ -0,0 +1,90 @@
+#ifndef __PERF_HUD_H__
+#define __PERF_HUD_H__
+
+#include "text.h"
+
+#include "glad/glad.h"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Overlay of CPU and GPU frame-time graphs with their p50/p99, the frame's
+// perf counters, its costliest GL calls in builds with a GL profile (see
+// gl_profile.h) and memory per subsystem.  Hidden, it measures nothing: no
+// timer queries and perf_count() stays off.
+class PerfHud
+{
+public:
+  // frames in the graphs and percentiles
+  static constexpr int HISTORY = 240;
+
+  ~PerfHud();
+
+  bool init_gl();
+
+  // bytes is only called while the HUD is visible
+  void add_memory(const std::string &name, std::function<size_t()> bytes);
+
+  void set_visible(bool visible);
+  void toggle() { set_visible(!visible_); }
+  bool visible() const { return visible_; }
+
+  // Bracket the frame's rendering; draw after end_frame so the HUD isn't part
+  // of what it measures.
+  void begin_frame();
+  void end_frame();
+  void draw(int viewport_width, int viewport_height);
+
+private:
+  // timer results arrive a few frames late; polled, never waited on
+  static constexpr int QUERY_COUNT = 4;
+
+  struct History
+  {
+    float ms[HISTORY] = {};
+    int head = 0;
+    int count = 0;
+
+    void push(float v);
+    // p50 and p99 of what's recorded
+    void percentiles(std::vector<float> *scratch, float *p50,
+                     float *p99) const;
+  };
+
+  struct Memory
+  {
+    std::string name;
+    std::function<size_t()> bytes;
+  };
+
+  void poll_queries();
+  void refresh_text();
+  void gl_text();
+  void graph(const History &history, const glm::vec2 &pos);
+
+  TextBatch batch_;
+  TextRenderer renderer_;
+  GLuint queries_[QUERY_COUNT] = {};
+  bool query_pending_[QUERY_COUNT] = {};
+  int query_next_ = 0;
+  bool query_active_ = false;
+
+  bool visible_ = false;
+  bool has_last_begin_ = false;
+  std::chrono::steady_clock::time_point last_begin_;
+  History cpu_, gpu_;
+  uint64_t draw_calls_ = 0;
+  uint64_t triangles_ = 0;
+  uint64_t skipped_ = 0;
+  uint64_t texture_binds_ = 0;
+  std::vector<Memory> memory_;
+
+  std::vector<std::string> lines_;
+  std::vector<float> scratch_;
+  uint64_t frame_ = 0;
+};
+
+#endif  // __PERF_HUD_H__
@@ -0,0 +1,497 @@
+#include "render_farm.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define PROTO3D_HAS_FARM 1
+#else
+#define PROTO3D_HAS_FARM 0
+#endif
+
+#if PROTO3D_HAS_FARM
+
+namespace {
+
+// Both ends run the same binary on the same machine, so messages are raw
+// structs.
+enum class Message : uint32_t
+{
+  READY,      // worker is up
+  CHUNK,      // render frames a to b
+  TRUNCATE,   // stop before frame a, or as soon as you can after it
+  TRUNCATED,  // now stopping before frame a
+  FRAME,      // frame a's output, the size bytes following
+  DONE,       // finished the span
+  QUIT,
+};
+
+struct Header
+{
+  Message type;
+  uint32_t a, b;
+  uint64_t size;
+};
+
+bool write_all(int fd, const void *data, size_t size)
+{
+  const char *p = static_cast<const char*>(data);
+  while (size)
+  {
+    const ssize_t n = write(fd, p, size);
+    if ((n < 0) && (errno == EINTR))
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool read_all(int fd, void *data, size_t size)
+{
+  char *p = static_cast<char*>(data);
+  while (size)
+  {
+    const ssize_t n = read(fd, p, size);
+    if ((n < 0) && (errno == EINTR))
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool post(int fd, Message type, uint32_t a = 0, uint32_t b = 0,
+          const std::vector<uint8_t> *payload = nullptr)
+{
+  const Header h{ type, a, b, payload ? payload->size() : 0 };
+  return write_all(fd, &h, sizeof(h)) &&
+         (!payload || write_all(fd, payload->data(), payload->size()));
+}
+
+// Frames [next, end) of a span are this worker's to render.
+struct Worker
+{
+  int pid = -1;
+  int fd = -1;
+  uint32_t next = 0, end = 0;
+  bool ready = false;
+  bool truncating = false;
+  unsigned deaths = 0;
+
+  bool busy() const { return next < end; }
+};
+
+struct Span
+{
+  uint32_t first, end;
+};
+
+class Coordinator
+{
+public:
+  Coordinator(unsigned retries, const FarmSpawn &spawn,
+              const FarmOutput &output, FarmStats *stats)
+    : retries_(retries)
+    , spawn_(spawn)
+    , output_(output)
+    , stats_(stats)
+  {
+  }
+
+  bool run(uint32_t first, uint32_t end, unsigned count);
+
+private:
+  bool start(Worker &w);
+  void stop(Worker &w);
+  // a worker died or broke the protocol; its frames go back in the queue
+  void fail(Worker &w);
+  bool receive(Worker &w);
+  // hands queued spans to idle workers, or has them steal
+  void dispatch();
+
+  unsigned retries_;
+  const FarmSpawn &spawn_;
+  const FarmOutput &output_;
+  FarmStats *stats_;
+  std::vector<Worker> workers_;
+  std::deque<Span> queue_;
+  uint64_t remaining_ = 0;
+};
+
+bool Coordinator::start(Worker &w)
+{
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+    return false;
+  // so later workers don't inherit this one's connection
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  w.pid = spawn_(fds[1]);
+  close(fds[1]);
+  if (w.pid < 0)
+  {
+    close(fds[0]);
+    return false;
+  }
+  w.fd = fds[0];
+  w.ready = w.truncating = false;
+  return true;
+}
+
+void Coordinator::stop(Worker &w)
+{
+  if (w.fd >= 0)
+    close(w.fd);
+  if (w.pid > 0)
+  {
+    kill(w.pid, SIGTERM);
+    waitpid(w.pid, nullptr, 0);
+  }
+  w.fd = w.pid = -1;
+}
+
+void Coordinator::fail(Worker &w)
+{
+  std::fprintf(stderr, "Farm worker %d died with frames %u to %u left\n",
+               w.pid, w.next, w.end);
+  stop(w);
+  if (w.busy())
+    queue_.push_back(Span{ w.next, w.end });
+  w.next = w.end = 0;
+  if (++w.deaths <= retries_)
+  {
+    ++stats_->retries;
+    start(w);
+  }
+}
+
+bool Coordinator::receive(Worker &w)
+{
+  Header h;
+  if (!read_all(w.fd, &h, sizeof(h)))
+    return false;
+  switch (h.type)
+  {
+  case Message::READY:
+    w.ready = true;
+    return true;
+  case Message::TRUNCATED:
+    // frames past the worker's new end are up for grabs
+    if (!w.truncating || (h.a < w.next) || (h.a > w.end))
+      return false;
+    if (h.a < w.end)
+    {
+      queue_.push_back(Span{ h.a, w.end });
+      ++stats_->steals;
+    }
+    w.end = h.a;
+    w.truncating = false;
+    return true;
+  case Message::FRAME:
+  {
+    // a gigabyte is past any frame
+    if ((h.a != w.next) || !w.busy() || (h.size > (uint64_t(1) << 30)))
+      return false;
+    std::vector<uint8_t> data(static_cast<size_t>(h.size));
+    if (!read_all(w.fd, data.data(), data.size()))
+      return false;
+    ++w.next;
+    --remaining_;
+    ++stats_->frames;
+    output_(h.a, std::move(data));
+    return true;
+  }
+  case Message::DONE:
+    // a truncation crossing the end of the span is still answered
+    return !w.busy();
+  default:
+    return false;
+  }
+}
+
+void Coordinator::dispatch()
+{
+  // spans on their way from truncations already asked for
+  size_t stealing = 0;
+  for (const auto &w : workers_)
+    stealing += ((w.fd >= 0) && w.truncating) ? 1 : 0;
+  for (auto &w : workers_)
+  {
+    if ((w.fd < 0) || !w.ready || w.busy() || w.truncating)
+      continue;
+    if (!queue_.empty())
+    {
+      const Span span = queue_.front();
+      queue_.pop_front();
+      w.next = span.first;
+      w.end = span.end;
+      if (!post(w.fd, Message::CHUNK, span.first, span.end))
+        fail(w);
+      continue;
+    }
+    if (stealing)
+    {
+      --stealing;
+      continue;
+    }
+    // the back half of the span with most left, unless it's nearly done
+    Worker *victim = nullptr;
+    for (auto &v : workers_)
+      if ((v.fd >= 0) && !v.truncating && (v.end - v.next >= 4) &&
+          (!victim || (v.end - v.next > victim->end - victim->next)))
+        victim = &v;
+    if (!victim)
+      return;
+    victim->truncating = true;
+    if (!post(victim->fd, Message::TRUNCATE,
+              victim->next + (victim->end - victim->next) / 2))
+      fail(*victim);
+  }
+}
+
+bool Coordinator::run(uint32_t first, uint32_t end, unsigned count)
+{
+  // a worker closing its socket mustn't kill us when we write to it
+  std::signal(SIGPIPE, SIG_IGN);
+  remaining_ = end - first;
+  workers_.resize(count);
+  for (unsigned i = 0; i < count; ++i)
+  {
+    const uint32_t a = first + static_cast<uint32_t>(
+      uint64_t(end - first) * i / count);
+    const uint32_t b = first + static_cast<uint32_t>(
+      uint64_t(end - first) * (i + 1) / count);
+    if (a < b)
+      queue_.push_back(Span{ a, b });
+    if (!start(workers_[i]))
+      std::fprintf(stderr, "Unable to start farm worker %u\n", i);
+  }
+
+  std::vector<pollfd> fds;
+  std::vector<Worker*> polled;
+  while (remaining_)
+  {
+    dispatch();
+    fds.clear();
+    polled.clear();
+    for (auto &w : workers_)
+      if (w.fd >= 0)
+      {
+        fds.push_back(pollfd{ w.fd, POLLIN, 0 });
+        polled.push_back(&w);
+      }
+    if (fds.empty())
+      break;
+    if (poll(fds.data(), static_cast<nfds_t>(fds.size()), -1) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    for (size_t i = 0; i < fds.size(); ++i)
+      if (fds[i].revents && !receive(*polled[i]))
+        fail(*polled[i]);
+  }
+
+  for (auto &w : workers_)
+  {
+    if (w.fd >= 0)
+      post(w.fd, Message::QUIT);
+    if (w.pid > 0)
+      waitpid(w.pid, nullptr, 0);
+    if (w.fd >= 0)
+      close(w.fd);
+  }
+  return !remaining_;
+}
+
+}  // unnamed namespace
+
+bool run_farm(uint32_t first, uint32_t end, unsigned workers, unsigned retries,
+              const FarmSpawn &spawn, const FarmOutput &output,
+              FarmStats *stats)
+{
+  *stats = FarmStats{ 0, 0, 0, 0.0 };
+  const auto start = std::chrono::steady_clock::now();
+  Coordinator coordinator(retries, spawn, output, stats);
+  const bool ok = coordinator.run(first, std::max(first, end),
+                                  std::max(workers, 1u));
+  stats->seconds = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start).count();
+  return ok;
+}
+
+int farm_exec(const std::vector<std::string> &argv, int socket)
+{
+  char fd[16];
+  std::snprintf(fd, sizeof(fd), "%d", socket);
+  std::vector<std::string> args(argv);
+  for (auto &arg : args)
+    if (arg == "%d")
+      arg = fd;
+  std::vector<char*> pointers;
+  for (auto &arg : args)
+    pointers.push_back(&arg[0]);
+  pointers.push_back(nullptr);
+
+  const pid_t pid = fork();
+  if (pid == 0)
+  {
+    execv(pointers[0], pointers.data());
+    std::perror(pointers[0]);
+    _exit(127);
+  }
+  return pid;
+}
+
+bool serve_farm(int socket, const FarmRender &render)
+{
+  if (!post(socket, Message::READY))
+    return false;
+  uint32_t end = 0;
+  std::vector<uint8_t> data;
+  // answers a command; false to stop serving
+  auto handle = [&](const Header &h, uint32_t next, bool *ok) {
+    if (h.type == Message::TRUNCATE)
+    {
+      end = std::min(end, std::max(h.a, next));
+      *ok = post(socket, Message::TRUNCATED, end);
+      return *ok;
+    }
+    *ok = (h.type == Message::QUIT);
+    return false;
+  };
+
+  Header h;
+  bool ok = true;
+  while (read_all(socket, &h, sizeof(h)))
+  {
+    if (h.type != Message::CHUNK)
+    {
+      if (handle(h, end, &ok))
+        continue;
+      return ok;
+    }
+    end = h.b;
+    for (uint32_t frame = h.a; frame < end; ++frame)
+    {
+      // take any truncation before starting a frame
+      pollfd p{ socket, POLLIN, 0 };
+      while ((poll(&p, 1, 0) > 0) && (p.revents & POLLIN))
+      {
+        Header command;
+        if (!read_all(socket, &command, sizeof(command)) ||
+            !handle(command, frame, &ok))
+          return ok;
+      }
+      if (frame >= end)
+        break;
+      data.clear();
+      if (!render(frame, frame == h.a, &data) ||
+          !post(socket, Message::FRAME, frame, 0, &data))
+        return false;
+    }
+    if (!post(socket, Message::DONE))
+      return false;
+  }
+  // the coordinator went away
+  return false;
+}
+
+#else
+
+bool run_farm(uint32_t, uint32_t, unsigned, unsigned, const FarmSpawn&,
+              const FarmOutput&, FarmStats *stats)
+{
+  *stats = FarmStats{ 0, 0, 0, 0.0 };
+  std::fprintf(stderr, "Render farms need POSIX processes and sockets\n");
+  return false;
+}
+
+int farm_exec(const std::vector<std::string>&, int)
+{
+  return -1;
+}
+
+bool serve_farm(int, const FarmRender&)
+{
+  return false;
+}
+
+#endif
+
+void FarmSpool::open(const std::string &path)
+{
+  discard();
+  path_ = path;
+  failed_ = false;
+}
+
+bool FarmSpool::add(uint32_t frame, const std::vector<uint8_t> &data)
+{
+  auto run = runs_.begin();
+  for (; run != runs_.end(); ++run)
+    if (run->second.end == frame)
+      break;
+  if (run == runs_.end())
+  {
+    Run r{ path_ + ".part" + std::to_string(frame), nullptr, frame };
+    r.file = std::fopen(r.path.c_str(), "w+b");
+    if (!r.file)
+    {
+      failed_ = true;
+      return false;
+    }
+    run = runs_.emplace(frame, r).first;
+  }
+  ++run->second.end;
+  if (std::fwrite(data.data(), 1, data.size(), run->second.file) !=
+      data.size())
+    failed_ = true;
+  return !failed_;
+}
+
+bool FarmSpool::finish(const std::vector<uint8_t> &header)
+{
+  FILE *out = failed_ ? nullptr : std::fopen(path_.c_str(), "wb");
+  bool ok = out && (std::fwrite(header.data(), 1, header.size(), out) ==
+                    header.size());
+  uint32_t next = runs_.empty() ? 0 : runs_.begin()->first;
+  std::vector<char> buffer(1 << 20);
+  for (auto &r : runs_)
+  {
+    ok = ok && (r.first == next) && !std::fseek(r.second.file, 0, SEEK_SET);
+    next = r.second.end;
+    for (size_t n; ok && (n = std::fread(buffer.data(), 1, buffer.size(),
+                                         r.second.file)) > 0;)
+      ok = std::fwrite(buffer.data(), 1, n, out) == n;
+  }
+  if (out)
+    ok = (std::fclose(out) == 0) && ok;
+  discard();
+  return ok;
+}
+
+void FarmSpool::discard()
+{
+  for (auto &r : runs_)
+  {
+    std::fclose(r.second.file);
+    std::remove(r.second.path.c_str());
+  }
+  runs_.clear();
+}
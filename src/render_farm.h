@@ -0,0 +1,87 @@
+#ifndef __RENDER_FARM_H__
+#define __RENDER_FARM_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// Renders a range of frames across worker processes on this machine.  The
+// coordinator gives each worker a contiguous span of the range, so it only
+// ever moves forward through the sequence; a worker that runs out of work
+// steals the back half of the busiest span, and the frames of a worker that
+// dies go to the others while it is respawned, up to a retry limit.  Workers
+// send each frame's output, e.g. an encoded image, back over a Unix socket as
+// they finish it, and the coordinator hands it on in whatever order it
+// arrives; FarmSpool puts it back in order.  POSIX only; elsewhere run_farm
+// fails.
+
+struct FarmStats
+{
+  uint64_t frames;
+  unsigned steals;   // spans split for idle workers
+  unsigned retries;  // workers respawned after dying
+  double seconds;
+};
+
+// Starts a worker process given its end of a socket, e.g. with farm_exec;
+// returns its process id, or -1.
+using FarmSpawn = std::function<int(int socket)>;
+using FarmOutput = std::function<void(uint32_t frame,
+                                      std::vector<uint8_t> data)>;
+
+// Renders frames [first, end) on that many worker processes; false if some
+// frames couldn't be rendered, every worker having died retries times.
+bool run_farm(uint32_t first, uint32_t end, unsigned workers, unsigned retries,
+              const FarmSpawn &spawn, const FarmOutput &output,
+              FarmStats *stats);
+
+// Runs argv with the socket left open for it, an argument of "%d" standing
+// for the socket's descriptor.
+int farm_exec(const std::vector<std::string> &argv, int socket);
+
+// Serves a coordinator on socket, which a spawned worker gets, until told to
+// stop.  render draws a frame and fills in its output, which may be empty;
+// frames come in increasing order within a span, and first is set on a
+// span's first frame, which may be anywhere.  Returns false if render or the
+// connection failed.
+using FarmRender = std::function<bool(uint32_t frame, bool first,
+                                      std::vector<uint8_t> *data)>;
+bool serve_farm(int socket, const FarmRender &render);
+
+// Writes frames' data to one file in frame order as they come in out of
+// order, a run of consecutive frames at a time: each run is spooled to a file
+// of its own beside the output, and finish() joins them.
+class FarmSpool
+{
+public:
+  FarmSpool() = default;
+  ~FarmSpool() { discard(); }
+
+  FarmSpool(const FarmSpool&) = delete;
+  FarmSpool& operator=(const FarmSpool&) = delete;
+
+  void open(const std::string &path);
+  bool add(uint32_t frame, const std::vector<uint8_t> &data);
+  // Writes header and then every run in order to the output; false if a
+  // write failed or frames are missing.
+  bool finish(const std::vector<uint8_t> &header);
+
+private:
+  struct Run
+  {
+    std::string path;
+    FILE *file;
+    uint32_t end;
+  };
+
+  void discard();
+
+  std::string path_;
+  std::map<uint32_t, Run> runs_;  // by first frame
+  bool failed_ = false;
+};
+
+#endif  // __RENDER_FARM_H__
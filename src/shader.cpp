@@ -0,0 +1,77 @@
+#include "shader.h"
+#include "util.h"
+
+#include <iostream>
+#include <vector>
+
+namespace {
+
+void print_log(const char *name, const char *stage, const std::vector<char> &log)
+{
+  std::cerr << "Shader " << name << " (" << stage << "): " << log.data() << '\n';
+}
+
+GLuint compile_stage(const char *name, GLenum type, const char *src)
+{
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 1, &src, nullptr);
+  glCompileShader(shader);
+
+  GLint ok = GL_FALSE;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+  if (ok != GL_TRUE)
+  {
+    GLint len = 0;
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &len);
+    std::vector<char> log(static_cast<size_t>(len) + 1, '\0');
+    glGetShaderInfoLog(shader, len, nullptr, log.data());
+    print_log(name, (type == GL_VERTEX_SHADER) ? "vertex" : "fragment", log);
+    glDeleteShader(shader);
+    return 0;
+  }
+  return shader;
+}
+
+}  // unnamed namespace
+
+GLuint compile_program(const char *name,
+                       const char *vertex_src,
+                       const char *fragment_src,
+                       const char *const *feedback,
+                       GLsizei feedback_count)
+{
+  const GLuint vs = compile_stage(name, GL_VERTEX_SHADER, vertex_src);
+  const GLuint fs = compile_stage(name, GL_FRAGMENT_SHADER, fragment_src);
+  if (!vs || !fs)
+  {
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    return 0;
+  }
+
+  GLuint program = glCreateProgram();
+  glAttachShader(program, vs);
+  glAttachShader(program, fs);
+  if (feedback_count)
+    glTransformFeedbackVaryings(program, feedback_count, feedback,
+                                GL_INTERLEAVED_ATTRIBS);
+  glLinkProgram(program);
+  // flagged for deletion; freed along with the program
+  glDeleteShader(vs);
+  glDeleteShader(fs);
+
+  GLint ok = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &ok);
+  if (ok != GL_TRUE)
+  {
+    GLint len = 0;
+    glGetProgramiv(program, GL_INFO_LOG_LENGTH, &len);
+    std::vector<char> log(static_cast<size_t>(len) + 1, '\0');
+    glGetProgramInfoLog(program, len, nullptr, log.data());
+    print_log(name, "link", log);
+    glDeleteProgram(program);
+    return 0;
+  }
+  gl_label(GL_PROGRAM_KHR, program, name);
+  return program;
+}
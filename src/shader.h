@@ -0,0 +1,15 @@
+#ifndef __SHADER_H__
+#define __SHADER_H__
+
+#include "glad/glad.h"
+
+// Compiles and links a vertex + fragment shader pair.  Compile and link logs
+// go to stderr prefixed with name; returns 0 on failure.  Varyings named in
+// feedback are captured, interleaved, by transform feedback.
+GLuint compile_program(const char *name,
+                       const char *vertex_src,
+                       const char *fragment_src,
+                       const char *const *feedback = nullptr,
+                       GLsizei feedback_count = 0);
+
+#endif  // __SHADER_H__
@@ -0,0 +1,66 @@
+#ifndef __SIMD_H__
+#define __SIMD_H__
+
+// SIMD kernels are selected at compile time; configure with PROTO3D_AVX2=OFF
+// to get the scalar paths on machines without AVX2/FMA.
+#if defined(__AVX2__) && defined(__FMA__)
+#  define PROTO3D_HAS_AVX2 1
+#  include <immintrin.h>
+#else
+#  define PROTO3D_HAS_AVX2 0
+#endif
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+constexpr size_t SIMD_ALIGN = 32;
+constexpr size_t SIMD_WIDTH = 8;  // float lanes per AVX2 register
+
+inline
+size_t round_up(size_t val, size_t multiple)
+{
+  return (val + multiple - 1) / multiple * multiple;
+}
+
+// std::allocator with 32-byte aligned storage so SoA streams can use aligned
+// loads; no exceptions are thrown since the project builds without them.
+template <typename T>
+struct AlignedAllocator
+{
+  using value_type = T;
+
+  AlignedAllocator() = default;
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U>&) { }
+
+  T* allocate(size_t n)
+  {
+    const size_t bytes = round_up(n * sizeof(T), SIMD_ALIGN);
+#ifdef _MSC_VER
+    return static_cast<T*>(_aligned_malloc(bytes, SIMD_ALIGN));
+#else
+    return static_cast<T*>(std::aligned_alloc(SIMD_ALIGN, bytes));
+#endif
+  }
+
+  void deallocate(T *p, size_t)
+  {
+#ifdef _MSC_VER
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+  }
+
+  template <typename U>
+  bool operator==(const AlignedAllocator<U>&) const { return true; }
+  template <typename U>
+  bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+#endif  // __SIMD_H__
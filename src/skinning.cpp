@@ -0,0 +1,263 @@
+#include "skinning.h"
+#include "assets.h"
+#include "jobs.h"
+#include "shader.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+namespace {
+
+constexpr GLsizeiptr BONE_BYTES = sizeof(BoneMatrix);
+constexpr GLint ROW_BYTES = 4 * sizeof(float);
+// beyond 64 KiB most drivers silently fall back to slower paths
+constexpr GLint MAX_BLOCK_ROWS = 4096;
+constexpr GLint BONE_TEXTURE_UNIT = 0;
+
+void skin_scalar(const SkinnedMesh &mesh,
+                 const BoneMatrix *palette,
+                 SkinnedVertices *out,
+                 size_t begin,
+                 size_t end)
+{
+  for (size_t v = begin; v < end; ++v)
+  {
+    float m[3][4] = { };
+    for (size_t k = 0; k < MAX_INFLUENCES; ++k)
+    {
+      const float w = mesh.weights[k][v];
+      const BoneMatrix &bone = palette[mesh.joints[k][v]];
+      for (size_t r = 0; r < 3; ++r)
+        for (size_t c = 0; c < 4; ++c)
+          m[r][c] += w * bone.rows[r][c];
+    }
+
+    const float p[3] = { mesh.position[0][v], mesh.position[1][v],
+                         mesh.position[2][v] };
+    const float n[3] = { mesh.normal[0][v], mesh.normal[1][v],
+                         mesh.normal[2][v] };
+    float skinned_n[3];
+    for (size_t r = 0; r < 3; ++r)
+    {
+      out->position[r][v] = m[r][0] * p[0] + m[r][1] * p[1] + m[r][2] * p[2] +
+                            m[r][3];
+      skinned_n[r] = m[r][0] * n[0] + m[r][1] * n[1] + m[r][2] * n[2];
+    }
+    const float len = std::sqrt(skinned_n[0] * skinned_n[0] +
+                                skinned_n[1] * skinned_n[1] +
+                                skinned_n[2] * skinned_n[2]);
+    const float inv_len = (len > 0.0f) ? (1.0f / len) : 0.0f;
+    for (size_t r = 0; r < 3; ++r)
+      out->normal[r][v] = skinned_n[r] * inv_len;
+  }
+}
+
+}  // unnamed namespace
+
+void SkinnedMesh::resize(size_t count)
+{
+  vertex_count = count;
+  for (auto &s : position) s.resize(count);
+  for (auto &s : normal) s.resize(count);
+  for (auto &s : joints) s.resize(count);
+  for (auto &s : weights) s.resize(count);
+}
+
+void SkinnedVertices::resize(size_t count)
+{
+  vertex_count = count;
+  for (auto &s : position) s.resize(count);
+  for (auto &s : normal) s.resize(count);
+}
+
+void skin_vertices(const SkinnedMesh &mesh,
+                   const BoneMatrix *palette,
+                   SkinnedVertices *out,
+                   size_t begin,
+                   size_t end)
+{
+#if PROTO3D_HAS_AVX2
+  const float *base = &palette[0].rows[0][0];
+  const __m256i stride = _mm256_set1_epi32(
+    static_cast<int>(sizeof(BoneMatrix) / sizeof(float)));
+  for (; begin + SIMD_WIDTH <= end; begin += SIMD_WIDTH)
+  {
+    // blend the joint matrices first: 12 gathers per influence, then a single
+    // transform of position and normal
+    __m256 m[12];
+    for (auto &e : m)
+      e = _mm256_setzero_ps();
+    for (size_t k = 0; k < MAX_INFLUENCES; ++k)
+    {
+      const __m256i j = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(mesh.joints[k].data() + begin));
+      const __m256 w = _mm256_loadu_ps(mesh.weights[k].data() + begin);
+      const __m256i idx = _mm256_mullo_epi32(j, stride);
+      for (int e = 0; e < 12; ++e)
+        m[e] = _mm256_fmadd_ps(w, _mm256_i32gather_ps(base + e, idx, 4), m[e]);
+    }
+
+    const __m256 px = _mm256_loadu_ps(mesh.position[0].data() + begin);
+    const __m256 py = _mm256_loadu_ps(mesh.position[1].data() + begin);
+    const __m256 pz = _mm256_loadu_ps(mesh.position[2].data() + begin);
+    const __m256 nx = _mm256_loadu_ps(mesh.normal[0].data() + begin);
+    const __m256 ny = _mm256_loadu_ps(mesh.normal[1].data() + begin);
+    const __m256 nz = _mm256_loadu_ps(mesh.normal[2].data() + begin);
+    __m256 n[3];
+    for (size_t r = 0; r < 3; ++r)
+    {
+      const __m256 *row = m + r * 4;
+      const __m256 p = _mm256_fmadd_ps(row[0], px,
+                       _mm256_fmadd_ps(row[1], py,
+                       _mm256_fmadd_ps(row[2], pz, row[3])));
+      _mm256_storeu_ps(out->position[r].data() + begin, p);
+      n[r] = _mm256_fmadd_ps(row[0], nx,
+             _mm256_fmadd_ps(row[1], ny, _mm256_mul_ps(row[2], nz)));
+    }
+    const __m256 len2 = _mm256_fmadd_ps(n[0], n[0],
+                        _mm256_fmadd_ps(n[1], n[1], _mm256_mul_ps(n[2], n[2])));
+    // zero length normals (all weights 0) stay zero instead of turning NaN
+    const __m256 nonzero = _mm256_cmp_ps(len2, _mm256_setzero_ps(), _CMP_GT_OQ);
+    const __m256 inv_len = _mm256_and_ps(nonzero,
+      _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(len2)));
+    for (size_t r = 0; r < 3; ++r)
+      _mm256_storeu_ps(out->normal[r].data() + begin,
+                       _mm256_mul_ps(n[r], inv_len));
+  }
+#endif
+  skin_scalar(mesh, palette, out, begin, end);
+}
+
+void skin_vertices(JobSystem &jobs,
+                   const SkinnedMesh &mesh,
+                   const BoneMatrix *palette,
+                   SkinnedVertices *out)
+{
+  constexpr size_t VERTICES_PER_JOB = 4096;
+  out->resize(mesh.vertex_count);
+  jobs.parallel_for(mesh.vertex_count, VERTICES_PER_JOB,
+                    [&](size_t begin, size_t end) {
+    skin_vertices(mesh, palette, out, begin, end);
+  });
+}
+
+bool GpuBonePalette::init(size_t max_bones, size_t max_bones_per_character)
+{
+  GLint max_block_size = 0;
+  glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &max_block_size);
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offset_align_);
+  offset_align_ = std::max(offset_align_, ROW_BYTES);
+  block_rows_ = std::min(max_block_size / ROW_BYTES, MAX_BLOCK_ROWS);
+
+  // a misaligned palette start costs up to (align / 16 - 1) leading rows
+  const auto rows_needed = static_cast<GLint>(max_bones_per_character * 3) +
+                           offset_align_ / ROW_BYTES - 1;
+  storage_ = (rows_needed <= block_rows_) ? Storage::UniformBuffer
+                                          : Storage::TextureBuffer;
+  max_bones_ = max_bones;
+  // the uniform block case pads so a full block bound at the last palette
+  // never runs off the end
+  buffer_bytes_ = static_cast<GLsizeiptr>(max_bones) * BONE_BYTES;
+  if (storage_ == Storage::UniformBuffer)
+    buffer_bytes_ += block_rows_ * ROW_BYTES;
+
+  glGenBuffers(1, &buffer_);
+  if (storage_ == Storage::TextureBuffer)
+  {
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer_);
+    glBufferData(GL_TEXTURE_BUFFER, buffer_bytes_, nullptr, GL_STREAM_DRAW);
+    glGenTextures(1, &texture_);
+    glBindTexture(GL_TEXTURE_BUFFER, texture_);
+    gl_label(GL_TEXTURE, texture_, "bone palette");
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer_);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  }
+  else
+  {
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+    glBufferData(GL_UNIFORM_BUFFER, buffer_bytes_, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  }
+  gl_label(GL_BUFFER_KHR, buffer_, "bone palette");
+  return buffer_ != 0;
+}
+
+void GpuBonePalette::destroy()
+{
+  glDeleteTextures(1, &texture_);
+  glDeleteBuffers(1, &buffer_);
+  texture_ = buffer_ = 0;
+  buffer_bytes_ = 0;
+}
+
+void GpuBonePalette::upload(const BoneMatrix *palette, size_t count)
+{
+  GL_ZONE("bone palette upload");
+  const GLenum target = (storage_ == Storage::TextureBuffer) ?
+    GL_TEXTURE_BUFFER : GL_UNIFORM_BUFFER;
+  glBindBuffer(target, buffer_);
+  // orphan so the driver needn't wait on draws still reading last frame's
+  glBufferData(target, buffer_bytes_, nullptr, GL_STREAM_DRAW);
+  glBufferSubData(target, 0,
+                  static_cast<GLsizeiptr>(std::min(count, max_bones_)) *
+                  BONE_BYTES,
+                  palette);
+  glBindBuffer(target, 0);
+}
+
+GpuBonePalette::Program GpuBonePalette::create_program(bool feedback) const
+{
+  static const char *const CAPTURED[] = { "gl_Position", "v_normal" };
+  std::string vs = "#version 330 core\n";
+  if (storage_ == Storage::TextureBuffer)
+    vs += "#define BONES_IN_TEXTURE\n";
+  else
+    vs += "#define BONE_ROWS " + std::to_string(block_rows_) + "\n";
+  vs += asset_text("shaders/skinning.vert");
+
+  Program p;
+  p.id = compile_program("skinning", vs.c_str(),
+                         asset_text("shaders/skinning.frag").c_str(),
+                         feedback ? CAPTURED : nullptr, feedback ? 2 : 0);
+  if (!p.id)
+    return p;
+  p.view_proj = glGetUniformLocation(p.id, "u_view_proj");
+  p.bone_base = glGetUniformLocation(p.id, "u_bone_base");
+  if (storage_ == Storage::TextureBuffer)
+  {
+    p.bones = glGetUniformLocation(p.id, "u_bones");
+    glUseProgram(p.id);
+    glUniform1i(p.bones, BONE_TEXTURE_UNIT);
+    glUseProgram(0);
+  }
+  else
+  {
+    glUniformBlockBinding(p.id, glGetUniformBlockIndex(p.id, "Bones"),
+                          UNIFORM_BINDING);
+  }
+  return p;
+}
+
+void GpuBonePalette::bind(const Program &program, size_t first_bone) const
+{
+  const auto first_row = static_cast<GLint>(first_bone * 3);
+  if (storage_ == Storage::TextureBuffer)
+  {
+    glActiveTexture(GL_TEXTURE0 + BONE_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, texture_);
+    glUniform1i(program.bone_base, first_row);
+    return;
+  }
+
+  // ranges must start on the alignment boundary; the remainder becomes a row
+  // offset inside the block
+  const GLint rows_per_align = offset_align_ / ROW_BYTES;
+  const GLint aligned_row = first_row - first_row % rows_per_align;
+  glBindBufferRange(GL_UNIFORM_BUFFER, UNIFORM_BINDING, buffer_,
+                    static_cast<GLintptr>(aligned_row) * ROW_BYTES,
+                    static_cast<GLsizeiptr>(block_rows_) * ROW_BYTES);
+  glUniform1i(program.bone_base, first_row - aligned_row);
+}
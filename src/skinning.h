@@ -0,0 +1,99 @@
+#ifndef __SKINNING_H__
+#define __SKINNING_H__
+
+#include "animation.h"
+#include "simd.h"
+
+#include "glad/glad.h"
+
+#include <cstddef>
+#include <cstdint>
+
+class JobSystem;
+
+constexpr size_t MAX_INFLUENCES = 4;
+
+// Bind-pose vertex streams, SoA so eight vertices fill one AVX2 register.
+// Unused influences carry weight 0.
+struct SkinnedMesh
+{
+  size_t vertex_count = 0;
+  AlignedVector<float> position[3];
+  AlignedVector<float> normal[3];
+  AlignedVector<int32_t> joints[MAX_INFLUENCES];
+  AlignedVector<float> weights[MAX_INFLUENCES];
+
+  void resize(size_t count);
+};
+
+struct SkinnedVertices
+{
+  size_t vertex_count = 0;
+  AlignedVector<float> position[3];
+  AlignedVector<float> normal[3];
+
+  void resize(size_t count);
+};
+
+// Linear blend skinning of vertices [begin, end) on the CPU, for consumers
+// that need skinned positions on the host (picking, physics, CPU rendering).
+void skin_vertices(const SkinnedMesh &mesh,
+                   const BoneMatrix *palette,
+                   SkinnedVertices *out,
+                   size_t begin,
+                   size_t end);
+
+// Skins the whole mesh, split across the job system.
+void skin_vertices(JobSystem &jobs,
+                   const SkinnedMesh &mesh,
+                   const BoneMatrix *palette,
+                   SkinnedVertices *out);
+
+// Joint palettes of all characters of a frame in one GL buffer.  A uniform
+// block is used when a character's palette fits GL_MAX_UNIFORM_BLOCK_SIZE,
+// else a buffer texture (RGBA32F, three texels per joint).
+class GpuBonePalette
+{
+public:
+  enum class Storage
+  {
+    UniformBuffer,
+    TextureBuffer
+  };
+
+  struct Program
+  {
+    GLuint id = 0;
+    GLint view_proj = -1;
+    GLint bone_base = -1;
+    GLint bones = -1;
+  };
+
+  static constexpr GLuint UNIFORM_BINDING = 0;
+
+  bool init(size_t max_bones, size_t max_bones_per_character);
+  void destroy();
+
+  // Replaces the palette for this frame; count <= max_bones.
+  void upload(const BoneMatrix *palette, size_t count);
+
+  // feedback also captures gl_Position and v_normal, interleaved, by
+  // transform feedback, to check the shader against skin_vertices()
+  Program create_program(bool feedback = false) const;
+  // Sets up bindings for drawing a character whose palette starts at
+  // first_bone; the program must be in use.
+  void bind(const Program &program, size_t first_bone) const;
+
+  Storage storage() const { return storage_; }
+
+private:
+  Storage storage_ = Storage::UniformBuffer;
+  GLuint buffer_ = 0;
+  GLuint texture_ = 0;
+  GLsizeiptr buffer_bytes_ = 0;
+  size_t max_bones_ = 0;
+  GLint block_rows_ = 0;
+  GLint offset_align_ = 0;
+};
+
+#endif  // __SKINNING_H__
@@ -0,0 +1,65 @@
+#include "startup.h"
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Mark
+{
+  const char *phase;
+  double ms;
+  size_t thread;
+};
+
+const Clock::time_point process_start = Clock::now();
+std::mutex marks_mutex;
+std::vector<Mark> marks;
+
+}  // unnamed namespace
+
+double startup_ms()
+{
+  return std::chrono::duration<double, std::milli>(Clock::now() -
+                                                   process_start).count();
+}
+
+void startup_mark(const char *phase)
+{
+  const double ms = startup_ms();
+  const size_t thread =
+    std::hash<std::thread::id>()(std::this_thread::get_id());
+  std::lock_guard<std::mutex> lock(marks_mutex);
+  marks.push_back(Mark{ phase, ms, thread });
+}
+
+void startup_report()
+{
+  startup_mark("first frame");
+  std::lock_guard<std::mutex> lock(marks_mutex);
+  // threads are numbered in the order they first marked
+  std::vector<size_t> threads;
+  double last = 0.0;
+  for (const Mark &m : marks)
+  {
+    size_t t = 0;
+    while ((t < threads.size()) && (threads[t] != m.thread))
+      ++t;
+    if (t == threads.size())
+      threads.push_back(m.thread);
+    std::fprintf(stderr, "startup %8.2f ms  +%7.2f  thread %zu  %s\n", m.ms,
+                 m.ms - last, t, m.phase);
+    last = m.ms;
+  }
+  const double total = marks.back().ms;
+  std::fprintf(stderr, "startup: first frame at %.2f ms, %s the %.0f ms "
+               "target\n", total,
+               (total <= STARTUP_TARGET_MS) ? "within" : "over",
+               STARTUP_TARGET_MS);
+}
@@ -0,0 +1,17 @@
+#ifndef __STARTUP_H__
+#define __STARTUP_H__
+
+// Startup trace: phases marked from any thread with the time since the
+// process started, or as near as static initialisation gets, and the thread
+// that reached them.
+
+constexpr double STARTUP_TARGET_MS = 100.0;
+
+// phase must be a literal or otherwise outlive the trace
+void startup_mark(const char *phase);
+double startup_ms();
+// Call once the first frame is presented: marks it and prints every phase to
+// stderr, with the time to the first frame against STARTUP_TARGET_MS.
+void startup_report();
+
+#endif  // __STARTUP_H__
@@ -0,0 +1,91 @@
+#include "stream_buffer.h"
+#include "util.h"
+
+#include <algorithm>
+
+bool StreamBuffer::init(GLenum target, GLsizeiptr size, const char *label)
+{
+  target_ = target;
+  size_ = size;
+  head_ = frame_begin_ = 0;
+  glGenBuffers(1, &buffer_);
+  glBindBuffer(target_, buffer_);
+  glBufferData(target_, size_, nullptr, GL_STREAM_DRAW);
+  gl_label(GL_BUFFER_KHR, buffer_, label);
+  glBindBuffer(target_, 0);
+  return buffer_ != 0;
+}
+
+void StreamBuffer::destroy()
+{
+  for (auto &f : fences_)
+    glDeleteSync(f.sync);
+  fences_.clear();
+  glDeleteBuffers(1, &buffer_);
+  buffer_ = 0;
+}
+
+void StreamBuffer::fence_range(GLintptr begin, GLintptr end)
+{
+  if (begin < end)
+    fences_.push_back(Fence{glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0),
+                            begin, end});
+}
+
+void StreamBuffer::wait_for(GLintptr begin, GLintptr end)
+{
+  // fences complete in order, so waiting on the newest overlapping one
+  // retires all older ones too
+  auto last = fences_.end();
+  for (auto it = fences_.begin(); it != fences_.end(); ++it)
+  {
+    if ((it->begin < end) && (begin < it->end))
+      last = it;
+  }
+  if (last == fences_.end())
+    return;
+
+  constexpr GLuint64 ONE_SECOND = 1000000000;
+  while (glClientWaitSync(last->sync, GL_SYNC_FLUSH_COMMANDS_BIT, ONE_SECOND) ==
+         GL_TIMEOUT_EXPIRED)
+  {
+  }
+  for (auto it = fences_.begin(); it != std::next(last); ++it)
+    glDeleteSync(it->sync);
+  fences_.erase(fences_.begin(), std::next(last));
+}
+
+void* StreamBuffer::map(GLsizeiptr bytes, GLsizeiptr align, GLintptr *offset)
+{
+  if (bytes > size_)
+    return nullptr;
+
+  GLintptr begin = (head_ + align - 1) / align * align;
+  if (begin + bytes > size_)
+  {
+    // this frame's tail end is in flight as soon as we wrap
+    fence_range(frame_begin_, head_);
+    begin = frame_begin_ = 0;
+  }
+  wait_for(begin, begin + bytes);
+  head_ = begin + bytes;
+  *offset = begin;
+
+  glBindBuffer(target_, buffer_);
+  return glMapBufferRange(target_, begin, bytes,
+                          GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT |
+                          GL_MAP_INVALIDATE_RANGE_BIT);
+}
+
+void StreamBuffer::unmap()
+{
+  glBindBuffer(target_, buffer_);
+  glUnmapBuffer(target_);
+  glBindBuffer(target_, 0);
+}
+
+void StreamBuffer::end_frame()
+{
+  fence_range(frame_begin_, head_);
+  frame_begin_ = head_;
+}
@@ -0,0 +1,52 @@
+#ifndef __STREAM_BUFFER_H__
+#define __STREAM_BUFFER_H__
+
+#include "glad/glad.h"
+
+#include <deque>
+
+// Ring of per-frame CPU-written data (instances, staging for uploads) in one
+// GL buffer.  Space is handed out with unsynchronised maps; ranges still read
+// by in-flight frames are protected with fences, so a write only ever waits
+// when the ring is smaller than the data in flight.  A single frame must not
+// write more than the ring holds.
+class StreamBuffer
+{
+public:
+  // label names the buffer in debug tools; see gl_label
+  bool init(GLenum target, GLsizeiptr size, const char *label);
+  void destroy();
+
+  // Maps bytes at the next offset that is a multiple of align and returns the
+  // pointer; nullptr when bytes exceeds the ring.  The buffer stays bound to
+  // the target until unmap().
+  void* map(GLsizeiptr bytes, GLsizeiptr align, GLintptr *offset);
+  void unmap();
+
+  // Fences everything written since the last call; call once a frame after
+  // issuing the commands that read it.
+  void end_frame();
+
+  GLuint id() const { return buffer_; }
+  GLsizeiptr size() const { return size_; }
+
+private:
+  struct Fence
+  {
+    GLsync sync;
+    GLintptr begin;
+    GLintptr end;
+  };
+
+  void fence_range(GLintptr begin, GLintptr end);
+  void wait_for(GLintptr begin, GLintptr end);
+
+  GLuint buffer_ = 0;
+  GLenum target_ = GL_ARRAY_BUFFER;
+  GLsizeiptr size_ = 0;
+  GLintptr head_ = 0;
+  GLintptr frame_begin_ = 0;
+  std::deque<Fence> fences_;
+};
+
+#endif  // __STREAM_BUFFER_H__
@@ -0,0 +1,469 @@
+#include "terrain.h"
+#include "assets.h"
+#include "perf.h"
+#include "shader.h"
+#include "util.h"
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+constexpr int HALF_GRID = CLIPMAP_GRID / 2;
+// texels the resident region may trail its ideal position before it moves;
+// it must always cover the grid plus a texel for normals
+constexpr int UPDATE_STEP = 16;
+static_assert(CLIPMAP_TEXELS / 2 - HALF_GRID - 1 >= UPDATE_STEP,
+              "resident region too small for the grid");
+constexpr size_t TILE_TEXELS = size_t(TILE_SIZE) * size_t(TILE_SIZE);
+constexpr GLsizeiptr STAGING_BYTES = 4 << 20;
+// one full grid, then rings whose hole sits 0 or 1 cells further along x and
+// z; see draw()
+constexpr int GRID_VARIANTS = 5;
+constexpr GLsizei FULL_INDICES = CLIPMAP_GRID * CLIPMAP_GRID * 6;
+constexpr GLsizei RING_INDICES = (CLIPMAP_GRID * CLIPMAP_GRID -
+                                  HALF_GRID * HALF_GRID) * 6;
+
+int floor_div(int a, int b)
+{
+  return (a >= 0) ? (a / b) : -((-a + b - 1) / b);
+}
+
+int wrap(int a, int n)
+{
+  return a - floor_div(a, n) * n;
+}
+
+// Builds quads of the CLIPMAP_GRID square, skipping the HALF_GRID square
+// hole at hole cells from the corner; hole < 0 keeps everything.
+void append_grid(int hole_x, int hole_z, std::vector<uint16_t> *out)
+{
+  constexpr int ROW = CLIPMAP_GRID + 1;
+  for (int z = 0; z < CLIPMAP_GRID; ++z)
+  {
+    for (int x = 0; x < CLIPMAP_GRID; ++x)
+    {
+      if ((hole_x >= 0) &&
+          (x >= hole_x) && (x < hole_x + HALF_GRID) &&
+          (z >= hole_z) && (z < hole_z + HALF_GRID))
+        continue;
+      const auto i = static_cast<uint16_t>(z * ROW + x);
+      const uint16_t quad[6] = {
+        i, static_cast<uint16_t>(i + ROW), static_cast<uint16_t>(i + 1),
+        static_cast<uint16_t>(i + 1), static_cast<uint16_t>(i + ROW),
+        static_cast<uint16_t>(i + ROW + 1)
+      };
+      out->insert(out->end(), quad, quad + 6);
+    }
+  }
+}
+
+}  // unnamed namespace
+
+TileLoader image_tile_loader(std::string pattern, float height_scale)
+{
+  return [pattern, height_scale](int level, const glm::ivec2 &tile,
+                                 float *heights) {
+    char path[512];
+    std::snprintf(path, sizeof(path), pattern.c_str(), level, tile.x, tile.y);
+    int w = 0, h = 0, comp = 0;
+    stbi_us *pixels = stbi_load_16(path, &w, &h, &comp, 1);
+    if (!pixels)
+      return false;
+    const bool ok = (w == TILE_SIZE) && (h == TILE_SIZE);
+    if (ok)
+    {
+      const float scale = height_scale / 65535.0f;
+      for (size_t i = 0; i < TILE_TEXELS; ++i)
+        heights[i] = static_cast<float>(pixels[i]) * scale;
+    }
+    stbi_image_free(pixels);
+    return ok;
+  };
+}
+
+ClipmapTerrain::ClipmapTerrain(JobSystem &jobs, TileLoader loader,
+                               int levels, float spacing)
+  : jobs_(jobs)
+  , loader_(std::move(loader))
+  , level_count_(levels)
+  , spacing_(spacing)
+  , levels_(static_cast<size_t>(levels))
+  , finest_(levels)
+{
+}
+
+ClipmapTerrain::~ClipmapTerrain()
+{
+  // loads write straight into cache slots
+  jobs_.wait(in_flight_);
+  staging_.destroy();
+  glDeleteTextures(1, &height_texture_);
+  glDeleteVertexArrays(1, &vao_);
+  glDeleteBuffers(1, &vertex_buffer_);
+  glDeleteBuffers(1, &index_buffer_);
+  glDeleteProgram(program_);
+}
+
+bool ClipmapTerrain::init_gl()
+{
+  program_ = compile_program("terrain",
+                             asset_text("shaders/terrain.vert").c_str(),
+                             asset_text("shaders/terrain.frag").c_str());
+  if (!program_)
+    return false;
+  u_view_proj_ = glGetUniformLocation(program_, "u_view_proj");
+  u_origin_ = glGetUniformLocation(program_, "u_origin");
+  u_spacing_ = glGetUniformLocation(program_, "u_spacing");
+  u_level_ = glGetUniformLocation(program_, "u_level");
+  u_morph_ = glGetUniformLocation(program_, "u_morph");
+
+  // texels hold the height at their centre; REPEAT makes the toroidal
+  // addressing free, linear filtering samples coarser levels for morphing
+  glGenTextures(1, &height_texture_);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, height_texture_);
+  gl_label(GL_TEXTURE, height_texture_, "terrain heights");
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R32F, CLIPMAP_TEXELS,
+               CLIPMAP_TEXELS, level_count_, 0, GL_RED, GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  std::vector<uint8_t> vertices;
+  for (int z = 0; z <= CLIPMAP_GRID; ++z)
+  {
+    for (int x = 0; x <= CLIPMAP_GRID; ++x)
+    {
+      vertices.push_back(static_cast<uint8_t>(x));
+      vertices.push_back(static_cast<uint8_t>(z));
+    }
+  }
+  std::vector<uint16_t> indices;
+  append_grid(-1, -1, &indices);
+  for (int variant = 1; variant < GRID_VARIANTS; ++variant)
+    append_grid(HALF_GRID / 2 + ((variant - 1) & 1),
+                HALF_GRID / 2 + ((variant - 1) >> 1), &indices);
+
+  glGenVertexArrays(1, &vao_);
+  glGenBuffers(1, &vertex_buffer_);
+  glGenBuffers(1, &index_buffer_);
+  glBindVertexArray(vao_);
+  gl_label(GL_VERTEX_ARRAY_KHR, vao_, "terrain");
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+  gl_label(GL_BUFFER_KHR, vertex_buffer_, "terrain grid vertices");
+  glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(vertices.size()),
+               vertices.data(), GL_STATIC_DRAW);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_UNSIGNED_BYTE, GL_FALSE, 0, nullptr);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+  gl_label(GL_BUFFER_KHR, index_buffer_, "terrain grid indices");
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+               static_cast<GLsizeiptr>(indices.size() * sizeof(uint16_t)),
+               indices.data(), GL_STATIC_DRAW);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  // 16 tiles a level covers the resident region plus half a tile of
+  // prefetch on each side, with room to spare while loads are in flight
+  tiles_.resize(static_cast<size_t>(level_count_) * 16);
+  for (auto &tile : tiles_)
+    tile.heights.resize(TILE_TEXELS);
+
+  // nothing resident: a full region away from where the camera will be
+  for (auto &level : levels_)
+    level.origin = glm::ivec2(1 << 30);
+
+  return staging_.init(GL_PIXEL_UNPACK_BUFFER, STAGING_BYTES,
+                       "terrain staging");
+}
+
+size_t ClipmapTerrain::memory_bytes() const
+{
+  return tiles_.size() * TILE_TEXELS * sizeof(float) +
+         size_t(CLIPMAP_TEXELS) * size_t(CLIPMAP_TEXELS) *
+         static_cast<size_t>(level_count_) * sizeof(float) +
+         static_cast<size_t>(STAGING_BYTES);
+}
+
+uint64_t ClipmapTerrain::key(int level, const glm::ivec2 &tile)
+{
+  constexpr uint64_t MASK = (uint64_t(1) << 28) - 1;
+  return (uint64_t(level) << 56) | ((uint64_t(tile.x) & MASK) << 28) |
+         (uint64_t(tile.y) & MASK);
+}
+
+bool ClipmapTerrain::covers(const Level &level) const
+{
+  const glm::ivec2 lo = level.center - (HALF_GRID + 1);
+  const glm::ivec2 hi = level.center + (HALF_GRID + 1);
+  return (lo.x >= level.origin.x) && (lo.y >= level.origin.y) &&
+         (hi.x < level.origin.x + CLIPMAP_TEXELS) &&
+         (hi.y < level.origin.y + CLIPMAP_TEXELS);
+}
+
+bool ClipmapTerrain::request_tiles(int level, const glm::ivec2 &begin,
+                                   const glm::ivec2 &end)
+{
+  bool ready = true;
+  const glm::ivec2 first(floor_div(begin.x, TILE_SIZE),
+                         floor_div(begin.y, TILE_SIZE));
+  const glm::ivec2 last(floor_div(end.x - 1, TILE_SIZE),
+                        floor_div(end.y - 1, TILE_SIZE));
+  for (int tz = first.y; tz <= last.y; ++tz)
+  {
+    for (int tx = first.x; tx <= last.x; ++tx)
+    {
+      const glm::ivec2 coord(tx, tz);
+      const uint64_t k = key(level, coord);
+      const auto it = tile_slots_.find(k);
+      if (it != tile_slots_.end())
+      {
+        Tile &tile = tiles_[it->second];
+        tile.last_used = frame_;
+        ready = ready && (tile.state == Tile::READY);
+        continue;
+      }
+
+      ready = false;
+      if (!loads_left_)
+        continue;
+      // least recently used slot that nothing this frame asked for
+      size_t slot = tiles_.size();
+      for (size_t i = 0; i < tiles_.size(); ++i)
+      {
+        const Tile &t = tiles_[i];
+        if ((t.state == Tile::LOADING) || (t.last_used == frame_))
+          continue;
+        if ((slot == tiles_.size()) ||
+            (t.state == Tile::EMPTY) ||
+            (t.last_used < tiles_[slot].last_used))
+          slot = i;
+        if (t.state == Tile::EMPTY)
+          break;
+      }
+      if (slot == tiles_.size())
+        continue;
+
+      Tile &tile = tiles_[slot];
+      if (tile.state == Tile::READY)
+        tile_slots_.erase(tile.key);
+      tile.state = Tile::LOADING;
+      tile.key = k;
+      tile.last_used = frame_;
+      tile_slots_.emplace(k, slot);
+      --loads_left_;
+      float *heights = tile.heights.data();
+      jobs_.submit([this, level, coord, heights, slot]() {
+        if (!loader_(level, coord, heights))
+          std::fill_n(heights, TILE_TEXELS, 0.0f);
+        std::lock_guard<std::mutex> lock(results_mutex_);
+        results_.push_back(slot);
+      }, &in_flight_);
+    }
+  }
+  return ready;
+}
+
+void ClipmapTerrain::collect_results()
+{
+  std::vector<size_t> done;
+  {
+    std::lock_guard<std::mutex> lock(results_mutex_);
+    done.swap(results_);
+  }
+  for (const size_t slot : done)
+    tiles_[slot].state = Tile::READY;
+}
+
+// Copies the texels of [begin, end) from the cached tiles into the staging
+// ring, then into the level's layer, split where the rectangle wraps around
+// the texture.
+bool ClipmapTerrain::upload_rect(int level, const glm::ivec2 &begin,
+                                 const glm::ivec2 &end)
+{
+  const glm::ivec2 size = end - begin;
+  const auto bytes = static_cast<GLsizeiptr>(size.x) * size.y *
+                     static_cast<GLsizeiptr>(sizeof(float));
+  GLintptr offset = 0;
+  auto *staging = static_cast<float*>(staging_.map(bytes, sizeof(float),
+                                                   &offset));
+  if (!staging)
+    return false;
+  for (int z = begin.y; z < end.y; ++z)
+  {
+    float *row = staging + static_cast<ptrdiff_t>(z - begin.y) * size.x;
+    const int tz = floor_div(z, TILE_SIZE);
+    for (int x = begin.x; x < end.x; )
+    {
+      const int tx = floor_div(x, TILE_SIZE);
+      const int run = std::min(end.x, (tx + 1) * TILE_SIZE) - x;
+      const Tile &tile = tiles_[tile_slots_.at(key(level, glm::ivec2(tx, tz)))];
+      const float *src = tile.heights.data() +
+                         (z - tz * TILE_SIZE) * TILE_SIZE + (x - tx * TILE_SIZE);
+      std::memcpy(row + (x - begin.x), src, static_cast<size_t>(run) *
+                  sizeof(float));
+      x += run;
+    }
+  }
+  staging_.unmap();
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging_.id());
+  glBindTexture(GL_TEXTURE_2D_ARRAY, height_texture_);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, size.x);
+  for (int z = begin.y; z < end.y; )
+  {
+    const int wz = wrap(z, CLIPMAP_TEXELS);
+    const int rows = std::min(end.y - z, CLIPMAP_TEXELS - wz);
+    for (int x = begin.x; x < end.x; )
+    {
+      const int wx = wrap(x, CLIPMAP_TEXELS);
+      const int cols = std::min(end.x - x, CLIPMAP_TEXELS - wx);
+      const GLintptr src = offset + static_cast<GLintptr>(
+        ((z - begin.y) * size.x + (x - begin.x)) * sizeof(float));
+      glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, wx, wz, level, cols, rows, 1,
+                      GL_RED, GL_FLOAT, reinterpret_cast<const void*>(src));
+      x += cols;
+    }
+    z += rows;
+  }
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  return true;
+}
+
+// Slides the level's resident region towards the camera a strip of columns,
+// then rows, at a time; a strip only goes once all its tiles are cached.
+void ClipmapTerrain::update_level(int l)
+{
+  Level &level = levels_[static_cast<size_t>(l)];
+  const glm::ivec2 want = level.center - CLIPMAP_TEXELS / 2;
+
+  // prefetch half a tile beyond the region so crossing into the next tile
+  // finds it decoded already
+  request_tiles(l, want - TILE_SIZE / 2,
+                want + CLIPMAP_TEXELS + TILE_SIZE / 2);
+
+  // Nothing resident is of use after a jump of a region or more along
+  // either axis, as at init: strips along the other would be cut from the
+  // stale origin.  The whole level goes at once, at the new origin.
+  const glm::ivec2 jump = want - level.origin;
+  if ((std::abs(jump.x) >= CLIPMAP_TEXELS) ||
+      (std::abs(jump.y) >= CLIPMAP_TEXELS))
+  {
+    constexpr size_t LEVEL_TEXELS = size_t(CLIPMAP_TEXELS) * CLIPMAP_TEXELS;
+    const glm::ivec2 end = want + CLIPMAP_TEXELS;
+    if (upload_left_ && request_tiles(l, want, end) &&
+        upload_rect(l, want, end))
+    {
+      level.origin = want;
+      upload_left_ -= std::min(upload_left_, LEVEL_TEXELS);
+    }
+    return;
+  }
+
+  for (int axis = 0; axis < 2; ++axis)
+  {
+    const int other = 1 - axis;
+    const int delta = want[axis] - level.origin[axis];
+    if ((std::abs(delta) < UPDATE_STEP) && covers(level))
+      continue;
+    const int max_step = static_cast<int>(upload_left_ / CLIPMAP_TEXELS);
+    const int step = std::max(-max_step, std::min(delta, max_step));
+    if (!step)
+      continue;
+
+    glm::ivec2 begin, end;
+    begin[other] = level.origin[other];
+    end[other] = level.origin[other] + CLIPMAP_TEXELS;
+    begin[axis] = (step > 0) ? level.origin[axis] + CLIPMAP_TEXELS
+                             : level.origin[axis] + step;
+    end[axis] = begin[axis] + std::abs(step);
+    if (!request_tiles(l, begin, end) || !upload_rect(l, begin, end))
+      continue;
+    level.origin[axis] += step;
+    upload_left_ -= static_cast<size_t>(std::abs(step)) * CLIPMAP_TEXELS;
+  }
+}
+
+void ClipmapTerrain::update(const glm::vec3 &camera)
+{
+  GL_ZONE("terrain uploads");
+  collect_results();
+  ++frame_;
+  loads_left_ = max_loads_per_frame;
+  upload_left_ = upload_budget;
+
+  // coarse levels first: they are what's drawn while finer ones catch up
+  finest_ = level_count_;
+  for (int l = level_count_ - 1; l >= 0; --l)
+  {
+    const float texel = spacing_ * static_cast<float>(1 << l);
+    Level &level = levels_[static_cast<size_t>(l)];
+    // snapped to even texels, so the finer level's hole lines up with the
+    // cells of this one
+    const glm::ivec2 t(static_cast<int>(std::floor(camera.x / texel)),
+                       static_cast<int>(std::floor(camera.z / texel)));
+    level.center = glm::ivec2(floor_div(t.x, 2), floor_div(t.y, 2)) * 2;
+    update_level(l);
+    if (covers(level) && (finest_ == l + 1))
+      finest_ = l;
+  }
+  staging_.end_frame();
+}
+
+void ClipmapTerrain::draw(const glm::mat4 &view_proj)
+{
+  if (finest_ >= level_count_)
+    return;
+  GL_ZONE("terrain");
+  glUseProgram(program_);
+  glUniformMatrix4fv(u_view_proj_, 1, GL_FALSE, &view_proj[0][0]);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, height_texture_);
+  perf_count(PerfCounter::TEXTURE_BINDS);
+  glEnable(GL_DEPTH_TEST);
+  glEnable(GL_CULL_FACE);
+  glBindVertexArray(vao_);
+  for (int l = finest_; l < level_count_; ++l)
+  {
+    const Level &level = levels_[static_cast<size_t>(l)];
+    const float texel = spacing_ * static_cast<float>(1 << l);
+    const glm::vec2 origin = glm::vec2(level.center - HALF_GRID) * texel;
+    glUniform2f(u_origin_, origin.x, origin.y);
+    glUniform1f(u_spacing_, texel);
+    glUniform1i(u_level_, l);
+    glUniform1f(u_morph_, (l + 1 < level_count_) ? 1.0f : 0.0f);
+
+    // the finer centre sits 0 or 1 of this level's cells past this one along
+    // each axis (see the snapping in update), picking one of four rings
+    GLsizei count = FULL_INDICES;
+    size_t first = 0;
+    if (l > finest_)
+    {
+      const glm::ivec2 d = levels_[static_cast<size_t>(l - 1)].center / 2 -
+                           level.center;
+      count = RING_INDICES;
+      first = static_cast<size_t>(FULL_INDICES) +
+              static_cast<size_t>(d.x + 2 * d.y) *
+              static_cast<size_t>(RING_INDICES);
+    }
+    glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_SHORT,
+                   reinterpret_cast<const void*>(first * sizeof(uint16_t)));
+    perf_count(PerfCounter::DRAW_CALLS);
+    perf_count(PerfCounter::TRIANGLES, static_cast<uint64_t>(count / 3));
+  }
+  glBindVertexArray(0);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  // the default, which text and debug lines rely on
+  glDisable(GL_CULL_FACE);
+}
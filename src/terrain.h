@@ -0,0 +1,136 @@
+#ifndef __TERRAIN_H__
+#define __TERRAIN_H__
+
+#include "jobs.h"
+#include "stream_buffer.h"
+
+#include "glad/glad.h"
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Heightmap tiles are TILE_SIZE texels square at every level; level l tiles
+// hold every 2^l-th height of level 0.
+constexpr int TILE_SIZE = 256;
+// texels a side of each level's toroidal height texture
+constexpr int CLIPMAP_TEXELS = 256;
+// cells a side of the grid drawn for each level; the next finer level fills
+// the middle half
+constexpr int CLIPMAP_GRID = 128;
+
+// Fills TILE_SIZE * TILE_SIZE heights, rows along +z; false leaves the tile
+// flat at 0.  Called from worker threads, concurrently.
+using TileLoader = std::function<bool(int level, const glm::ivec2 &tile,
+                                      float *heights)>;
+
+// Loads 16-bit greyscale images named by printf pattern with the level and
+// tile x, z (e.g. "terrain/%d/%d_%d.png"), mapping 0..65535 to 0..scale.
+TileLoader image_tile_loader(std::string pattern, float height_scale);
+
+// Geometry clipmap: every level draws one shared grid mesh, as a ring around
+// the next finer level, scaled by 2^level.  Heights come from a texture array
+// with a layer a level, addressed toroidally, so moving the camera uploads
+// only the newly exposed rows and columns.  Tiles are decoded on jobs into a
+// fixed set of cache slots; memory is constant however large the world is.
+// A level whose tiles aren't in yet keeps its old texture region, and until
+// that again covers the camera the next coarser level draws in its place.
+class ClipmapTerrain
+{
+public:
+  // spacing: world units between level 0 heights
+  ClipmapTerrain(JobSystem &jobs, TileLoader loader, int levels,
+                 float spacing);
+  ~ClipmapTerrain();
+
+  ClipmapTerrain(const ClipmapTerrain&) = delete;
+  ClipmapTerrain& operator=(const ClipmapTerrain&) = delete;
+
+  bool init_gl();
+
+  // Main thread, once a frame: request tiles around the camera, upload
+  // newly exposed texels.
+  void update(const glm::vec3 &camera);
+  void draw(const glm::mat4 &view_proj);
+  // Blocks until the tile loads started so far are done; the next update
+  // picks up all of them, which makes replays deterministic.
+  void wait_idle() { jobs_.wait(in_flight_); }
+
+  // tile cache, height texture and staging; fixed at init_gl
+  size_t memory_bytes() const;
+
+  // tile loads started and texels uploaded per update at most
+  size_t max_loads_per_frame = 8;
+  size_t upload_budget = 4 * TILE_SIZE * CLIPMAP_TEXELS;
+
+private:
+  struct Tile
+  {
+    enum State
+    {
+      EMPTY,
+      LOADING,
+      READY
+    };
+
+    State state = EMPTY;
+    uint64_t key = 0;
+    uint64_t last_used = 0;
+    std::vector<float> heights;
+  };
+
+  struct Level
+  {
+    // texel coordinates of the resident region's corner and of the grid
+    // centre, both in this level's texels
+    glm::ivec2 origin{0};
+    glm::ivec2 center{0};
+  };
+
+  static uint64_t key(int level, const glm::ivec2 &tile);
+  bool covers(const Level &level) const;
+  // tiles under a texel rectangle; requests and returns false while any is
+  // still missing
+  bool request_tiles(int level, const glm::ivec2 &begin,
+                     const glm::ivec2 &end);
+  void collect_results();
+  bool upload_rect(int level, const glm::ivec2 &begin, const glm::ivec2 &end);
+  void update_level(int level);
+
+  JobSystem &jobs_;
+  TileLoader loader_;
+  int level_count_;
+  float spacing_;
+  std::vector<Level> levels_;
+  uint64_t frame_ = 0;
+  size_t loads_left_ = 0;
+  size_t upload_left_ = 0;
+  // finest level drawn this frame; it fills its middle too
+  int finest_ = 0;
+
+  std::vector<Tile> tiles_;
+  std::unordered_map<uint64_t, size_t> tile_slots_;
+  // slots whose loads finished, handed from workers to the main thread
+  std::mutex results_mutex_;
+  std::vector<size_t> results_;
+  JobCounter in_flight_;
+
+  StreamBuffer staging_;
+  GLuint height_texture_ = 0;
+  GLuint vao_ = 0;
+  GLuint vertex_buffer_ = 0;
+  GLuint index_buffer_ = 0;
+  GLuint program_ = 0;
+  GLint u_view_proj_ = -1;
+  GLint u_origin_ = -1;
+  GLint u_spacing_ = -1;
+  GLint u_level_ = -1;
+  GLint u_morph_ = -1;
+};
+
+#endif  // __TERRAIN_H__
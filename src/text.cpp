@@ -0,0 +1,443 @@
+#include "text.h"
+#include "assets.h"
+#include "perf.h"
+#include "shader.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+namespace {
+
+struct FontGlyph
+{
+  uint8_t width, height;
+  int8_t left, top;
+  uint8_t advance;
+  uint32_t offset;
+};
+
+// DejaVu Sans Mono, printable ASCII; the Bitstream Vera licence allows
+// embedding.  Rebuild with tools/font_inc.cpp.
+#include "font_data.inc"
+
+constexpr uint32_t FIRST_CHAR = 32;
+constexpr uint32_t CHAR_COUNT = sizeof(FONT_GLYPHS) / sizeof(FONT_GLYPHS[0]);
+// empty pixels around each glyph so bilinear taps never bleed in neighbours
+constexpr int GUTTER = 1;
+constexpr int TAB_SPACES = 4;
+// frames a layout survives without being drawn
+constexpr uint64_t LAYOUT_LIFETIME = 120;
+constexpr GLsizeiptr RING_BYTES = 4 << 20;
+
+// FNV-1a
+uint64_t hash_text(const char *text, size_t length, int pixel_height)
+{
+  uint64_t h = 0xcbf29ce484222325ull ^ static_cast<uint64_t>(pixel_height);
+  for (size_t i = 0; i < length; ++i)
+  {
+    h ^= static_cast<uint8_t>(text[i]);
+    h *= 0x100000001b3ull;
+  }
+  return h;
+}
+
+// embedded coverage at (x, y), 0..255
+int coverage(const FontGlyph &g, int x, int y)
+{
+  if ((x < 0) || (y < 0) || (x >= g.width) || (y >= g.height))
+    return 0;
+  const size_t row_bytes = (g.width + 1u) / 2u;
+  const uint8_t byte = FONT_BITMAPS[g.offset + static_cast<size_t>(y) *
+                                    row_bytes + static_cast<size_t>(x / 2)];
+  return ((x & 1) ? (byte >> 4) : (byte & 15)) * 17;
+}
+
+// Coverage of a glyph scaled by s at destination pixel (x, y): bilinear when
+// enlarging, the average over the pixel's footprint when shrinking.
+uint8_t sample(const FontGlyph &g, float s, int x, int y)
+{
+  if (s >= 1.0f)
+  {
+    const float fx = (static_cast<float>(x) + 0.5f) / s - 0.5f;
+    const float fy = (static_cast<float>(y) + 0.5f) / s - 0.5f;
+    const int x0 = static_cast<int>(std::floor(fx));
+    const int y0 = static_cast<int>(std::floor(fy));
+    const float tx = fx - static_cast<float>(x0);
+    const float ty = fy - static_cast<float>(y0);
+    const float top = static_cast<float>(coverage(g, x0, y0)) * (1.0f - tx) +
+                      static_cast<float>(coverage(g, x0 + 1, y0)) * tx;
+    const float bottom = static_cast<float>(coverage(g, x0, y0 + 1)) *
+                         (1.0f - tx) +
+                         static_cast<float>(coverage(g, x0 + 1, y0 + 1)) * tx;
+    return static_cast<uint8_t>(top * (1.0f - ty) + bottom * ty + 0.5f);
+  }
+  const int x0 = static_cast<int>(static_cast<float>(x) / s);
+  const int y0 = static_cast<int>(static_cast<float>(y) / s);
+  const int x1 = std::max(x0 + 1, static_cast<int>(
+                            static_cast<float>(x + 1) / s));
+  const int y1 = std::max(y0 + 1, static_cast<int>(
+                            static_cast<float>(y + 1) / s));
+  int sum = 0;
+  for (int sy = y0; sy < y1; ++sy)
+    for (int sx = x0; sx < x1; ++sx)
+      sum += coverage(g, sx, sy);
+  return static_cast<uint8_t>(sum / ((x1 - x0) * (y1 - y0)));
+}
+
+uint16_t to_unorm16(int texel)
+{
+  return static_cast<uint16_t>((texel * 65535 + GlyphAtlas::SIZE / 2) /
+                               GlyphAtlas::SIZE);
+}
+
+}  // unnamed namespace
+
+GlyphAtlas::GlyphAtlas()
+  : pixels_(size_t(SIZE) * size_t(SIZE), 0)
+{
+  reset();
+}
+
+void GlyphAtlas::reset()
+{
+  std::fill(pixels_.begin(), pixels_.end(), uint8_t(0));
+  for (int y = 0; y < SOLID_SIZE; ++y)
+    std::fill_n(&pixels_[static_cast<size_t>(y) * SIZE], SOLID_SIZE,
+                uint8_t(255));
+  shelves_.clear();
+  glyphs_.clear();
+  next_shelf_y_ = SOLID_SIZE + GUTTER;
+  dirty_begin_ = 0;
+  dirty_end_ = SIZE;
+}
+
+bool GlyphAtlas::take_dirty(int *row_begin, int *row_end)
+{
+  if (dirty_begin_ >= dirty_end_)
+    return false;
+  *row_begin = dirty_begin_;
+  *row_end = dirty_end_;
+  dirty_begin_ = SIZE;
+  dirty_end_ = 0;
+  return true;
+}
+
+// Shelf whose height wastes least, among those no more than a quarter taller
+// than the glyph; otherwise a new shelf below the last.
+bool GlyphAtlas::pack(int w, int h, int *x, int *y)
+{
+  Shelf *best = nullptr;
+  for (auto &shelf : shelves_)
+  {
+    if ((shelf.height < h) || (shelf.height > h + h / 4 + 1) ||
+        (shelf.x + w > SIZE))
+      continue;
+    if (!best || (shelf.height < best->height))
+      best = &shelf;
+  }
+  if (!best)
+  {
+    if ((next_shelf_y_ + h > SIZE) || (w > SIZE))
+      return false;
+    shelves_.push_back(Shelf{ next_shelf_y_, h, 0 });
+    next_shelf_y_ += h;
+    best = &shelves_.back();
+  }
+  *x = best->x;
+  *y = best->y;
+  best->x += w;
+  return true;
+}
+
+const GlyphSlot* GlyphAtlas::find_or_add(uint32_t codepoint, int pixel_height)
+{
+  if ((codepoint < FIRST_CHAR) || (codepoint >= FIRST_CHAR + CHAR_COUNT))
+    codepoint = '?';
+  const uint32_t key = codepoint | (static_cast<uint32_t>(pixel_height) << 8);
+  const auto it = glyphs_.find(key);
+  if (it != glyphs_.end())
+    return &it->second;
+
+  const FontGlyph &g = FONT_GLYPHS[codepoint - FIRST_CHAR];
+  const float s = static_cast<float>(pixel_height) / FONT_PIXEL_HEIGHT;
+  auto scaled = [s](int v) {
+    return static_cast<int>(std::lround(static_cast<float>(v) * s));
+  };
+  const int w = g.width ? static_cast<int>(std::ceil(g.width * s)) : 0;
+  const int h = g.height ? static_cast<int>(std::ceil(g.height * s)) : 0;
+  int x = 0, y = 0;
+  if ((w > 0) && !pack(w + GUTTER, h + GUTTER, &x, &y))
+    return nullptr;
+
+  for (int row = 0; row < h; ++row)
+  {
+    uint8_t *dst = &pixels_[static_cast<size_t>(y + row) * SIZE +
+                            static_cast<size_t>(x)];
+    for (int col = 0; col < w; ++col)
+      dst[col] = sample(g, s, col, row);
+  }
+  if (h > 0)
+  {
+    dirty_begin_ = std::min(dirty_begin_, y);
+    dirty_end_ = std::max(dirty_end_, y + h);
+  }
+
+  GlyphSlot slot;
+  slot.x = static_cast<uint16_t>(x);
+  slot.y = static_cast<uint16_t>(y);
+  slot.w = static_cast<uint16_t>(w);
+  slot.h = static_cast<uint16_t>(h);
+  slot.left = static_cast<int16_t>(scaled(g.left));
+  slot.top = static_cast<int16_t>(scaled(g.top));
+  slot.advance = static_cast<int16_t>(scaled(g.advance));
+  return &glyphs_.emplace(key, slot).first->second;
+}
+
+void TextBatch::build(Layout *layout)
+{
+  const float s = static_cast<float>(layout->pixel_height) /
+                  FONT_PIXEL_HEIGHT;
+  const float ascent = std::round(FONT_ASCENT * s);
+  const float line_height = std::round(FONT_LINE_HEIGHT * s);
+
+  for (int attempt = 0; attempt < 2; ++attempt)
+  {
+    layout->glyphs.clear();
+    float pen = 0.0f, baseline = ascent, width = 0.0f;
+    bool full = false;
+    for (const char c : layout->text)
+    {
+      if (c == '\n')
+      {
+        pen = 0.0f;
+        baseline += line_height;
+        continue;
+      }
+      const GlyphSlot *slot = atlas_.find_or_add(
+        (c == '\t') ? ' ' : static_cast<uint8_t>(c), layout->pixel_height);
+      if (!slot)
+      {
+        full = true;
+        break;
+      }
+      if (slot->w)
+      {
+        GlyphInstance g;
+        g.x = pen + slot->left;
+        g.y = baseline - slot->top;
+        g.w = slot->w;
+        g.h = slot->h;
+        g.u0 = to_unorm16(slot->x);
+        g.v0 = to_unorm16(slot->y);
+        g.u1 = to_unorm16(slot->x + slot->w);
+        g.v1 = to_unorm16(slot->y + slot->h);
+        g.color = 0;
+        g.pad = 0;
+        layout->glyphs.push_back(g);
+      }
+      pen += static_cast<float>(slot->advance * ((c == '\t') ? TAB_SPACES : 1));
+      width = std::max(width, pen);
+    }
+    layout->size = glm::vec2(width, baseline - ascent + line_height);
+    if (!full)
+      return;
+
+    // start over with only this frame's glyphs; layouts holding the evicted
+    // ones rebuild on their next use, text already queued this frame may
+    // show wrong glyphs once
+    atlas_.reset();
+    layouts_.clear();
+  }
+}
+
+const TextBatch::Layout& TextBatch::layout(const char *text, size_t length,
+                                           int pixel_height)
+{
+  const uint64_t key = hash_text(text, length, pixel_height);
+  auto it = layouts_.find(key);
+  if ((it == layouts_.end()) ||
+      (it->second.pixel_height != pixel_height) ||
+      (it->second.text.size() != length) ||
+      std::memcmp(it->second.text.data(), text, length))
+  {
+    Layout fresh;
+    fresh.text.assign(text, length);
+    fresh.pixel_height = pixel_height;
+    build(&fresh);
+    // build may have cleared the cache
+    it = layouts_.insert_or_assign(key, std::move(fresh)).first;
+  }
+  it->second.last_used = frame_;
+  return it->second;
+}
+
+void TextBatch::add(const char *text, size_t length, const glm::vec2 &pos,
+                    uint32_t color, int pixel_height)
+{
+  const Layout &l = layout(text, length, pixel_height);
+  const size_t first = instances_.size();
+  instances_.insert(instances_.end(), l.glyphs.begin(), l.glyphs.end());
+  GlyphInstance *g = instances_.data() + first;
+  GlyphInstance *end = instances_.data() + instances_.size();
+  for (; g != end; ++g)
+  {
+    g->x += pos.x;
+    g->y += pos.y;
+    g->color = color;
+  }
+}
+
+void TextBatch::add_rect(const glm::vec2 &pos, const glm::vec2 &size,
+                         uint32_t color)
+{
+  // the inner texels of the solid block, where bilinear taps stay covered
+  GlyphInstance g;
+  g.x = pos.x;
+  g.y = pos.y;
+  g.w = size.x;
+  g.h = size.y;
+  g.u0 = g.v0 = to_unorm16(1);
+  g.u1 = g.v1 = to_unorm16(GlyphAtlas::SOLID_SIZE - 1);
+  g.color = color;
+  g.pad = 0;
+  instances_.push_back(g);
+}
+
+glm::vec2 TextBatch::measure(const char *text, size_t length,
+                             int pixel_height)
+{
+  return layout(text, length, pixel_height).size;
+}
+
+void TextBatch::end_frame()
+{
+  instances_.clear();
+  ++frame_;
+  if (frame_ % LAYOUT_LIFETIME)
+    return;
+  for (auto it = layouts_.begin(); it != layouts_.end(); )
+  {
+    if (it->second.last_used + LAYOUT_LIFETIME < frame_)
+      it = layouts_.erase(it);
+    else
+      ++it;
+  }
+}
+
+TextRenderer::~TextRenderer()
+{
+  ring_.destroy();
+  glDeleteTextures(1, &texture_);
+  glDeleteVertexArrays(1, &vao_);
+  glDeleteProgram(program_);
+}
+
+bool TextRenderer::init_gl()
+{
+  program_ = compile_program("text",
+                             asset_text("shaders/text.vert").c_str(),
+                             asset_text("shaders/text.frag").c_str());
+  if (!program_)
+    return false;
+  u_viewport_ = glGetUniformLocation(program_, "u_viewport");
+
+  glGenTextures(1, &texture_);
+  glBindTexture(GL_TEXTURE_2D, texture_);
+  gl_label(GL_TEXTURE, texture_, "glyph atlas");
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, GlyphAtlas::SIZE, GlyphAtlas::SIZE, 0,
+               GL_RED, GL_UNSIGNED_BYTE, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glGenVertexArrays(1, &vao_);
+  glBindVertexArray(vao_);
+  gl_label(GL_VERTEX_ARRAY_KHR, vao_, "text");
+  for (GLuint i = 0; i < 3; ++i)
+  {
+    glEnableVertexAttribArray(i);
+    glVertexAttribDivisor(i, 1);
+  }
+  glBindVertexArray(0);
+
+  return ring_.init(GL_ARRAY_BUFFER, RING_BYTES, "text ring");
+}
+
+void TextRenderer::draw(TextBatch &batch, int viewport_width,
+                        int viewport_height)
+{
+  GL_ZONE("text");
+  int row_begin = 0, row_end = 0;
+  glBindTexture(GL_TEXTURE_2D, texture_);
+  perf_count(PerfCounter::TEXTURE_BINDS);
+  if (batch.atlas().take_dirty(&row_begin, &row_end))
+  {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, row_begin, GlyphAtlas::SIZE,
+                    row_end - row_begin, GL_RED, GL_UNSIGNED_BYTE,
+                    batch.atlas().pixels() +
+                    static_cast<size_t>(row_begin) * GlyphAtlas::SIZE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  }
+
+  const std::vector<GlyphInstance> &glyphs = batch.instances();
+  if (!glyphs.empty())
+  {
+    glUseProgram(program_);
+    glUniform2f(u_viewport_, static_cast<float>(viewport_width),
+                static_cast<float>(viewport_height));
+    // put back as found, so drawing text doesn't change the caller's state
+    const GLboolean depth_test = glIsEnabled(GL_DEPTH_TEST);
+    const GLboolean blend = glIsEnabled(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glBindVertexArray(vao_);
+
+    // one draw unless a frame holds more text than a third of the ring
+    const size_t per_draw = static_cast<size_t>(RING_BYTES) / 3 /
+                            sizeof(GlyphInstance);
+    for (size_t first = 0; first < glyphs.size(); first += per_draw)
+    {
+      const size_t count = std::min(per_draw, glyphs.size() - first);
+      const auto bytes = static_cast<GLsizeiptr>(count *
+                                                 sizeof(GlyphInstance));
+      GLintptr offset = 0;
+      void *dst = ring_.map(bytes, sizeof(GlyphInstance), &offset);
+      if (!dst)
+        break;
+      std::memcpy(dst, glyphs.data() + first, static_cast<size_t>(bytes));
+      ring_.unmap();
+
+      constexpr auto stride = static_cast<GLsizei>(sizeof(GlyphInstance));
+      glBindBuffer(GL_ARRAY_BUFFER, ring_.id());
+      glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride,
+                            reinterpret_cast<const void*>(offset));
+      glVertexAttribPointer(1, 4, GL_UNSIGNED_SHORT, GL_TRUE, stride,
+                            reinterpret_cast<const void*>(
+                              offset + offsetof(GlyphInstance, u0)));
+      glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+                            reinterpret_cast<const void*>(
+                              offset + offsetof(GlyphInstance, color)));
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+      glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4,
+                            static_cast<GLsizei>(count));
+      perf_count(PerfCounter::DRAW_CALLS);
+      perf_count(PerfCounter::TRIANGLES, 2 * static_cast<uint64_t>(count));
+    }
+
+    glBindVertexArray(0);
+    if (!blend)
+      glDisable(GL_BLEND);
+    if (depth_test)
+      glEnable(GL_DEPTH_TEST);
+    ring_.end_frame();
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  batch.end_frame();
+}
@@ -0,0 +1,135 @@
+#ifndef __TEXT_H__
+#define __TEXT_H__
+
+#include "stream_buffer.h"
+
+#include "glad/glad.h"
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// One glyph quad of screen text; 32 bytes, drawn as an instance.
+struct GlyphInstance
+{
+  float x, y, w, h;           // pixels, top-left origin
+  uint16_t u0, v0, u1, v1;    // atlas rectangle, 0..65535 across the atlas
+  uint32_t color;             // RGBA8, red in the low byte
+  uint32_t pad;
+};
+
+// Atlas placement and metrics of a glyph at one pixel size.
+struct GlyphSlot
+{
+  uint16_t x, y, w, h;
+  int16_t left, top;          // bitmap offset from the pen, y up
+  int16_t advance;
+};
+
+// Single-channel coverage atlas on the CPU.  Glyphs are rasterised from the
+// embedded font on first use, at the requested pixel height, and packed onto
+// shelves: rows as tall as the glyph that opened them, reused by glyphs of
+// about the same height.
+class GlyphAtlas
+{
+public:
+  static constexpr int SIZE = 512;
+
+  GlyphAtlas();
+
+  // Texels of the fully covered block kept in the top-left corner, sampled
+  // by solid rectangles.
+  static constexpr int SOLID_SIZE = 4;
+
+  // nullptr when the atlas is full
+  const GlyphSlot* find_or_add(uint32_t codepoint, int pixel_height);
+  void reset();
+
+  const uint8_t* pixels() const { return pixels_.data(); }
+  // Rows written since the last call; false when there are none.
+  bool take_dirty(int *row_begin, int *row_end);
+
+private:
+  struct Shelf
+  {
+    int y, height, x;
+  };
+
+  bool pack(int w, int h, int *x, int *y);
+
+  std::vector<uint8_t> pixels_;
+  std::vector<Shelf> shelves_;
+  int next_shelf_y_ = 0;
+  int dirty_begin_ = SIZE, dirty_end_ = 0;
+  std::unordered_map<uint32_t, GlyphSlot> glyphs_;
+};
+
+// Screen text collected over a frame.  Layouts (glyph quads relative to the
+// text origin) are cached by a hash of the string and pixel height, so
+// drawing text seen before only offsets and copies its quads.
+class TextBatch
+{
+public:
+  // pos is the top-left of the first line; '\n' starts a new line
+  void add(const char *text, size_t length, const glm::vec2 &pos,
+           uint32_t color, int pixel_height = 16);
+  void add(const std::string &text, const glm::vec2 &pos, uint32_t color,
+           int pixel_height = 16)
+  {
+    add(text.data(), text.size(), pos, color, pixel_height);
+  }
+
+  // untextured rectangle, for panels and graph bars
+  void add_rect(const glm::vec2 &pos, const glm::vec2 &size, uint32_t color);
+
+  glm::vec2 measure(const char *text, size_t length, int pixel_height = 16);
+
+  const std::vector<GlyphInstance>& instances() const { return instances_; }
+  GlyphAtlas& atlas() { return atlas_; }
+
+  // Drops this frame's glyphs; layouts unused for a while are evicted.
+  void end_frame();
+
+private:
+  struct Layout
+  {
+    std::string text;
+    int pixel_height;
+    std::vector<GlyphInstance> glyphs;
+    glm::vec2 size;
+    uint64_t last_used;
+  };
+
+  const Layout& layout(const char *text, size_t length, int pixel_height);
+  void build(Layout *layout);
+
+  GlyphAtlas atlas_;
+  std::unordered_map<uint64_t, Layout> layouts_;
+  std::vector<GlyphInstance> instances_;
+  uint64_t frame_ = 0;
+};
+
+// Draws a TextBatch with one instanced call per frame.
+class TextRenderer
+{
+public:
+  ~TextRenderer();
+
+  bool init_gl();
+
+  // Uploads atlas rows the batch rasterised and draws all its glyphs over
+  // the viewport, alpha blended with depth testing off.
+  void draw(TextBatch &batch, int viewport_width, int viewport_height);
+
+private:
+  StreamBuffer ring_;
+  GLuint texture_ = 0;
+  GLuint vao_ = 0;
+  GLuint program_ = 0;
+  GLint u_viewport_ = -1;
+};
+
+#endif  // __TEXT_H__
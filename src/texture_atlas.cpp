@@ -0,0 +1,409 @@
+#include "texture_atlas.h"
+#include "util.h"
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <numeric>
+#include <utility>
+
+namespace {
+
+bool read_text(const std::string &path, std::string *text)
+{
+  FILE *f = std::fopen(path.c_str(), "rb");
+  if (!f)
+    return false;
+  char buffer[4096];
+  size_t n;
+  while ((n = std::fread(buffer, 1, sizeof(buffer), f)) > 0)
+    text->append(buffer, n);
+  const bool ok = !std::ferror(f);
+  std::fclose(f);
+  return ok;
+}
+
+int round_up(int n, int multiple)
+{
+  return (n + multiple - 1) / multiple * multiple;
+}
+
+// the image's texels, its edges repeated out to fill the slot
+void blit_padded(const AtlasImage &image, int gutter, int slot_w, int slot_h,
+                 uint8_t *page, int page_size, int x, int y)
+{
+  for (int row = 0; row < slot_h; ++row)
+  {
+    const int sy = std::min(std::max(row - gutter, 0), image.height - 1);
+    const uint8_t *src = &image.rgba[static_cast<size_t>(sy) *
+                                     static_cast<size_t>(image.width) * 4];
+    uint8_t *dst = &page[(static_cast<size_t>(y + row) *
+                          static_cast<size_t>(page_size) +
+                          static_cast<size_t>(x)) * 4];
+    for (int col = 0; col < slot_w; ++col)
+    {
+      const int sx = std::min(std::max(col - gutter, 0), image.width - 1);
+      std::memcpy(dst + col * 4, src + sx * 4, 4);
+    }
+  }
+}
+
+}  // unnamed namespace
+
+MaxRects::MaxRects(int width, int height)
+  : free_{ Rect{ 0, 0, width, height } }
+{
+}
+
+bool MaxRects::insert(int w, int h, int *x, int *y)
+{
+  const Rect *best = nullptr;
+  int best_short = 0, best_long = 0;
+  for (const Rect &r : free_)
+  {
+    if ((r.w < w) || (r.h < h))
+      continue;
+    const int short_side = std::min(r.w - w, r.h - h);
+    const int long_side = std::max(r.w - w, r.h - h);
+    if (!best || (short_side < best_short) ||
+        ((short_side == best_short) && (long_side < best_long)))
+    {
+      best = &r;
+      best_short = short_side;
+      best_long = long_side;
+    }
+  }
+  if (!best)
+    return false;
+  const Rect used{ best->x, best->y, w, h };
+  *x = used.x;
+  *y = used.y;
+  split(used);
+  prune();
+  return true;
+}
+
+// Each free rectangle overlapping used gives way to the up to four maximal
+// ones around it.
+void MaxRects::split(const Rect &used)
+{
+  std::vector<Rect> pieces;
+  for (size_t i = 0; i < free_.size();)
+  {
+    const Rect r = free_[i];
+    if ((used.x >= r.x + r.w) || (used.x + used.w <= r.x) ||
+        (used.y >= r.y + r.h) || (used.y + used.h <= r.y))
+    {
+      ++i;
+      continue;
+    }
+    if (used.x > r.x)
+      pieces.push_back(Rect{ r.x, r.y, used.x - r.x, r.h });
+    if (used.x + used.w < r.x + r.w)
+      pieces.push_back(Rect{ used.x + used.w, r.y,
+                             r.x + r.w - used.x - used.w, r.h });
+    if (used.y > r.y)
+      pieces.push_back(Rect{ r.x, r.y, r.w, used.y - r.y });
+    if (used.y + used.h < r.y + r.h)
+      pieces.push_back(Rect{ r.x, used.y + used.h, r.w,
+                             r.y + r.h - used.y - used.h });
+    free_[i] = free_.back();
+    free_.pop_back();
+  }
+  free_.insert(free_.end(), pieces.begin(), pieces.end());
+}
+
+void MaxRects::prune()
+{
+  auto contains = [](const Rect &a, const Rect &b) {
+    return (b.x >= a.x) && (b.y >= a.y) && (b.x + b.w <= a.x + a.w) &&
+           (b.y + b.h <= a.y + a.h);
+  };
+  for (size_t i = 0; i < free_.size(); ++i)
+  {
+    for (size_t j = i + 1; j < free_.size();)
+    {
+      if (contains(free_[i], free_[j]))
+      {
+        free_[j] = free_.back();
+        free_.pop_back();
+      }
+      else if (contains(free_[j], free_[i]))
+      {
+        free_[i] = free_[j];
+        free_[j] = free_.back();
+        free_.pop_back();
+        j = i + 1;
+      }
+      else
+        ++j;
+    }
+  }
+}
+
+// Packs in cells of the smallest mip's texels, so every slot is aligned to
+// them without MaxRects knowing.
+bool pack_atlas(const AtlasSettings &settings,
+                const std::vector<AtlasImage> &images, AtlasLayout *out)
+{
+  int levels = 1;
+  while ((levels < settings.mip_levels) &&
+         ((settings.page_size >> levels) > 0) &&
+         (settings.page_size % (1 << levels) == 0))
+    ++levels;
+  const int cell = 1 << (levels - 1);
+  const int gutter = std::max(settings.padding, 0) * cell;
+  const int cells = settings.page_size / cell;
+
+  struct Slot
+  {
+    int w, h;  // cells
+  };
+  std::vector<Slot> slots(images.size());
+  for (size_t i = 0; i < images.size(); ++i)
+  {
+    const AtlasImage &image = images[i];
+    slots[i] = Slot{ round_up(image.width + 2 * gutter, cell) / cell,
+                     round_up(image.height + 2 * gutter, cell) / cell };
+    if ((image.width <= 0) || (image.height <= 0) ||
+        (image.rgba.size() < static_cast<size_t>(image.width) *
+                             static_cast<size_t>(image.height) * 4) ||
+        (slots[i].w > cells) || (slots[i].h > cells))
+    {
+      std::fprintf(stderr, "%s won't fit on a %d texel page\n",
+                   image.name.c_str(), settings.page_size);
+      return false;
+    }
+  }
+
+  // longest side first, then largest
+  std::vector<size_t> order(images.size());
+  std::iota(order.begin(), order.end(), size_t(0));
+  std::stable_sort(order.begin(), order.end(), [&slots](size_t a, size_t b) {
+    const int side_a = std::max(slots[a].w, slots[a].h);
+    const int side_b = std::max(slots[b].w, slots[b].h);
+    if (side_a != side_b)
+      return side_a > side_b;
+    return slots[a].w * slots[a].h > slots[b].w * slots[b].h;
+  });
+
+  const size_t page_bytes = static_cast<size_t>(settings.page_size) *
+                            static_cast<size_t>(settings.page_size) * 4;
+  std::vector<MaxRects> packers;
+  out->page_size = settings.page_size;
+  out->mip_levels = levels;
+  out->page_files.clear();
+  out->pages.clear();
+  out->entries.assign(images.size(), AtlasEntry());
+  for (const size_t i : order)
+  {
+    const Slot &slot = slots[i];
+    int page = 0, x = 0, y = 0;
+    while ((page < static_cast<int>(packers.size())) &&
+           !packers[static_cast<size_t>(page)].insert(slot.w, slot.h, &x, &y))
+      ++page;
+    if (page == static_cast<int>(packers.size()))
+    {
+      packers.emplace_back(cells, cells);
+      out->pages.emplace_back(page_bytes, uint8_t(0));
+      packers.back().insert(slot.w, slot.h, &x, &y);
+    }
+    const AtlasImage &image = images[i];
+    blit_padded(image, gutter, slot.w * cell, slot.h * cell,
+                out->pages[static_cast<size_t>(page)].data(),
+                settings.page_size, x * cell, y * cell);
+    out->entries[i] = AtlasEntry{ image.name, page, x * cell + gutter,
+                                  y * cell + gutter, image.width,
+                                  image.height };
+  }
+  return true;
+}
+
+std::string write_atlas_manifest(const AtlasLayout &layout)
+{
+  char line[512];
+  std::snprintf(line, sizeof(line), "atlas %d %d\n", layout.page_size,
+                layout.mip_levels);
+  std::string text = line;
+  for (const auto &file : layout.page_files)
+    text += "page " + file + "\n";
+  for (const auto &e : layout.entries)
+  {
+    std::snprintf(line, sizeof(line), "tex %s %d %d %d %d %d\n",
+                  e.name.c_str(), e.page, e.x, e.y, e.width, e.height);
+    text += line;
+  }
+  return text;
+}
+
+bool parse_atlas_manifest(const char *text, AtlasLayout *out)
+{
+  *out = AtlasLayout();
+  int line_number = 0;
+  for (const char *line = text; *line;)
+  {
+    const char *end = std::strchr(line, '\n');
+    const std::string s(line, end ? end : line + std::strlen(line));
+    line = end ? end + 1 : line + s.size();
+    ++line_number;
+
+    char name[256];
+    AtlasEntry e;
+    bool ok = true;
+    if (s.empty())
+      continue;
+    else if (!s.compare(0, 6, "atlas "))
+      ok = (std::sscanf(s.c_str(), "atlas %d %d", &out->page_size,
+                        &out->mip_levels) == 2) &&
+           (out->page_size > 0) && (out->mip_levels > 0);
+    else if (!s.compare(0, 5, "page "))
+      out->page_files.push_back(s.substr(5));
+    else if ((ok = (std::sscanf(s.c_str(), "tex %255s %d %d %d %d %d", name,
+                                &e.page, &e.x, &e.y, &e.width,
+                                &e.height) == 6)))
+    {
+      e.name = name;
+      out->entries.push_back(e);
+    }
+    if (!ok)
+    {
+      std::fprintf(stderr, "atlas manifest line %d: %s\n", line_number,
+                   s.c_str());
+      return false;
+    }
+  }
+  for (const auto &e : out->entries)
+  {
+    if ((e.page < 0) ||
+        (static_cast<size_t>(e.page) >= out->page_files.size()))
+    {
+      std::fprintf(stderr, "atlas manifest: %s is on a missing page\n",
+                   e.name.c_str());
+      return false;
+    }
+  }
+  return out->page_size > 0;
+}
+
+TextureAtlas::~TextureAtlas()
+{
+  if (!textures_.empty())
+    glDeleteTextures(static_cast<GLsizei>(textures_.size()),
+                     textures_.data());
+}
+
+bool TextureAtlas::load(const char *manifest_path, GLenum target)
+{
+  std::string text;
+  if (!read_text(manifest_path, &text))
+  {
+    std::fprintf(stderr, "Unable to read %s\n", manifest_path);
+    return false;
+  }
+  AtlasLayout layout;
+  if (!parse_atlas_manifest(text.c_str(), &layout))
+    return false;
+  const char *slash = std::strrchr(manifest_path, '/');
+  const std::string dir(manifest_path, slash ? slash + 1 : manifest_path);
+
+  const int size = layout.page_size;
+  for (const std::string &file : layout.page_files)
+  {
+    const std::string path = dir + file;
+    int w = 0, h = 0, comp = 0;
+    stbi_uc *pixels = stbi_load(path.c_str(), &w, &h, &comp, 4);
+    if (!pixels || (w != size) || (h != size))
+    {
+      stbi_image_free(pixels);
+      std::fprintf(stderr, "Unable to load atlas page %s\n", path.c_str());
+      return false;
+    }
+    layout.pages.emplace_back(pixels, pixels + static_cast<size_t>(size) *
+                                               static_cast<size_t>(size) * 4);
+    stbi_image_free(pixels);
+  }
+  return load(std::move(layout), target);
+}
+
+bool TextureAtlas::load(AtlasLayout layout, GLenum target)
+{
+  const int size = layout.page_size;
+  const auto layers = static_cast<GLsizei>(layout.pages.size());
+  std::vector<GLuint> textures((target == GL_TEXTURE_2D_ARRAY) ? 1 :
+                                 layout.pages.size());
+  glGenTextures(static_cast<GLsizei>(textures.size()), textures.data());
+  if (target == GL_TEXTURE_2D_ARRAY)
+  {
+    glBindTexture(target, textures[0]);
+    glTexImage3D(target, 0, GL_RGBA8, size, size, layers, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, nullptr);
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (GLsizei page = 0; page < layers; ++page)
+  {
+    const uint8_t *pixels = layout.pages[static_cast<size_t>(page)].data();
+    if (target == GL_TEXTURE_2D_ARRAY)
+      glTexSubImage3D(target, 0, 0, 0, page, size, size, 1, GL_RGBA,
+                      GL_UNSIGNED_BYTE, pixels);
+    else
+    {
+      glBindTexture(target, textures[static_cast<size_t>(page)]);
+      glTexImage2D(target, 0, GL_RGBA8, size, size, 0, GL_RGBA,
+                   GL_UNSIGNED_BYTE, pixels);
+    }
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  // the gutters were cooked for this many levels and no more
+  for (const GLuint texture : textures)
+  {
+    glBindTexture(target, texture);
+    gl_label(GL_TEXTURE, texture, "texture atlas");
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, layout.mip_levels - 1);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glGenerateMipmap(target);
+  }
+  glBindTexture(target, 0);
+
+  if (!textures_.empty())
+    glDeleteTextures(static_cast<GLsizei>(textures_.size()),
+                     textures_.data());
+  textures_ = std::move(textures);
+  target_ = target;
+  page_count_ = layout.pages.size();
+  // the GL has them now
+  layout.pages.clear();
+  layout.pages.shrink_to_fit();
+  layout_ = std::move(layout);
+  index_.clear();
+  for (size_t i = 0; i < layout_.entries.size(); ++i)
+    index_[layout_.entries[i].name] = i;
+  return true;
+}
+
+const AtlasEntry* TextureAtlas::find(const std::string &name) const
+{
+  const auto it = index_.find(name);
+  return (it != index_.end()) ? &layout_.entries[it->second] : nullptr;
+}
+
+glm::vec4 TextureAtlas::uv_transform(const AtlasEntry &entry) const
+{
+  const auto size = static_cast<float>(layout_.page_size);
+  return glm::vec4(static_cast<float>(entry.width) / size,
+                   static_cast<float>(entry.height) / size,
+                   static_cast<float>(entry.x) / size,
+                   static_cast<float>(entry.y) / size);
+}
+
+GLuint TextureAtlas::texture(int page) const
+{
+  if (target_ == GL_TEXTURE_2D_ARRAY)
+    return textures_.empty() ? 0 : textures_[0];
+  return textures_[static_cast<size_t>(page)];
+}
@@ -0,0 +1,124 @@
+#ifndef __TEXTURE_ATLAS_H__
+#define __TEXTURE_ATLAS_H__
+
+#include "glad/glad.h"
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// MaxRects bin packing of a fixed-size page, best short side fit, without
+// rotation.  The free list holds every maximal empty rectangle, so they
+// overlap; a placement splits each one it touches and drops those another
+// contains.
+class MaxRects
+{
+public:
+  MaxRects(int width, int height);
+
+  // false when no free rectangle holds w x h
+  bool insert(int w, int h, int *x, int *y);
+
+private:
+  struct Rect
+  {
+    int x, y, w, h;
+  };
+
+  void split(const Rect &used);
+  void prune();
+
+  std::vector<Rect> free_;
+};
+
+// Cook-time settings.  Every image gets a gutter of its edge texels repeated,
+// padding texels wide at the smallest mip and twice that a level up, and its
+// slot is aligned to the smallest mip's texels: box-filtered mips of the page
+// never mix two images, and bilinear filtering at any level reads only the
+// image or its own gutter.  UVs must stay in [0, 1]; textures that repeat
+// can't share a page.
+struct AtlasSettings
+{
+  int page_size = 1024;
+  int padding = 1;
+  int mip_levels = 4;
+};
+
+// Where an image ended up: texels on page (a layer of the array), without its
+// gutter.
+struct AtlasEntry
+{
+  std::string name;
+  int page;
+  int x, y, width, height;
+};
+
+struct AtlasImage
+{
+  std::string name;
+  int width, height;
+  std::vector<uint8_t> rgba;
+};
+
+// Pages of a packed set, RGBA8 top-down, and where each image went.
+struct AtlasLayout
+{
+  int page_size = 0;
+  int mip_levels = 1;
+  std::vector<std::string> page_files;
+  std::vector<AtlasEntry> entries;
+  std::vector<std::vector<uint8_t>> pages;  // until TextureAtlas::load
+};
+
+// Packs images, largest first, onto as few pages as MaxRects manages; false,
+// with nothing packed, if one won't fit on an empty page.
+bool pack_atlas(const AtlasSettings &settings,
+                const std::vector<AtlasImage> &images, AtlasLayout *out);
+
+// The manifest proto3d-pack writes next to the pages:
+//   atlas PAGE_SIZE MIP_LEVELS
+//   page FILE                         one a page, in layer order
+//   tex NAME PAGE X Y WIDTH HEIGHT    one an image; names without spaces
+std::string write_atlas_manifest(const AtlasLayout &layout);
+bool parse_atlas_manifest(const char *text, AtlasLayout *out);
+
+// A cooked atlas on the GPU, each page a GL_TEXTURE_2D or all of them layers
+// of one GL_TEXTURE_2D_ARRAY, which draws every image in the set with one
+// bind.  Nothing is rewritten on load; callers keep their own texture names
+// and UVs, and find() gives what replaces them: the page or layer to sample
+// and uv_transform(), which maps the image's [0, 1] UVs into the page, as
+// uv * xy + zw.
+class TextureAtlas
+{
+public:
+  TextureAtlas() = default;
+  ~TextureAtlas();
+
+  TextureAtlas(const TextureAtlas&) = delete;
+  TextureAtlas& operator=(const TextureAtlas&) = delete;
+
+  // Reads the manifest and its pages, which sit beside it; target is
+  // GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY.
+  bool load(const char *manifest_path, GLenum target);
+  // An atlas pack_atlas() made at run time, its pages in layout.pages.
+  bool load(AtlasLayout layout, GLenum target);
+
+  const AtlasEntry* find(const std::string &name) const;
+  glm::vec4 uv_transform(const AtlasEntry &entry) const;
+
+  GLenum target() const { return target_; }
+  // the array for every page, or the page's texture
+  GLuint texture(int page) const;
+  size_t page_count() const { return page_count_; }
+
+private:
+  AtlasLayout layout_;
+  std::unordered_map<std::string, size_t> index_;
+  GLenum target_ = GL_TEXTURE_2D;
+  std::vector<GLuint> textures_;
+  size_t page_count_ = 0;
+};
+
+#endif  // __TEXTURE_ATLAS_H__
@@ -1,5 +1,6 @@
 #include "util.h"
 
+#include <cstdio>
 #include <type_traits>
 #include <sstream>
 #include <iostream>
@@ -85,3 +86,33 @@ void gl_debug_logger(GLenum source,
   if (severity == GL_DEBUG_SEVERITY_HIGH_KHR)
     std::cerr << "High severity GL error logged\n";
 }
+
+bool gl_check_errors(const char *call, const char *file, int line)
+{
+  // each error flag is reported once; without a context glGetError may
+  // never return GL_NO_ERROR, so don't loop forever
+  constexpr int MAX_ERRORS = 8;
+  int errors = 0;
+  for (GLenum error = glGetError(); (error != GL_NO_ERROR) &&
+                                    (errors < MAX_ERRORS);
+       error = glGetError(), ++errors)
+  {
+    const char *names[] = {
+      "INVALID_ENUM",
+      "INVALID_VALUE",
+      "INVALID_OPERATION",
+      "STACK_OVERFLOW",
+      "STACK_UNDERFLOW",
+      "OUT_OF_MEMORY",
+      "INVALID_FRAMEBUFFER_OPERATION",
+      "UNDEFINED"
+    };
+    constexpr size_t names_len = std::extent<decltype(names)>::value - 1;
+    const size_t index = diff_or_err(error, GL_INVALID_ENUM,
+                                     GL_INVALID_FRAMEBUFFER_OPERATION,
+                                     names_len);
+    fprintf(stderr, "GLError 0x%x: %s [call=%s at=%s:%d]\n", error,
+            names[index], call, file, line);
+  }
+  return !errors;
+}
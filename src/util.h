@@ -5,6 +5,85 @@
 
 #include <cstddef>
 
+// GL_CHECK(glCall(...)) checks glGetError right after the call in debug
+// builds, logging any error with the call's text, file and line; in Release
+// it is the bare call.  Define PROTO3D_GL_CHECK to 0 or 1 to override.
+// glGetError waits on the driver, so it's worth it only where KHR_debug's
+// synchronous output (see gl_debug_logger) isn't available.
+#ifndef PROTO3D_GL_CHECK
+#  ifdef NDEBUG
+#    define PROTO3D_GL_CHECK 0
+#  else
+#    define PROTO3D_GL_CHECK 1
+#  endif
+#endif
+
+#if PROTO3D_GL_CHECK
+#  define GL_CHECK(call) \
+  gl_checked([&]() -> decltype(auto) { return call; }, #call, __FILE__, \
+             __LINE__)
+#else
+#  define GL_CHECK(call) (call)
+#endif
+
+// GL_ZONE("name") marks the rest of the scope as a KHR_debug group, so GL
+// traces, proto3d-replay and driver captures (RenderDoc, Nsight) show the GL
+// calls under the zone that made them; gl_label names an object in them the
+// same way.  Debug builds only, and only with KHR_debug; define
+// PROTO3D_GL_DEBUG_GROUPS to 0 or 1 to override.
+#ifndef PROTO3D_GL_DEBUG_GROUPS
+#  ifdef NDEBUG
+#    define PROTO3D_GL_DEBUG_GROUPS 0
+#  else
+#    define PROTO3D_GL_DEBUG_GROUPS 1
+#  endif
+#endif
+
+#if PROTO3D_GL_DEBUG_GROUPS
+
+#define GL_ZONE_VAR(line) gl_zone_ ## line
+#define GL_ZONE_AT(line) GlDebugGroup GL_ZONE_VAR(line)
+#define GL_ZONE(name) GL_ZONE_AT(__LINE__)(name)
+
+class GlDebugGroup
+{
+public:
+  explicit GlDebugGroup(const char *name)
+    : pushed_(GLAD_GL_KHR_debug != 0)
+  {
+    if (pushed_)
+      glPushDebugGroupKHR(GL_DEBUG_SOURCE_APPLICATION_KHR, 0, -1, name);
+  }
+
+  ~GlDebugGroup()
+  {
+    if (pushed_)
+      glPopDebugGroupKHR();
+  }
+
+  GlDebugGroup(const GlDebugGroup&) = delete;
+  GlDebugGroup& operator=(const GlDebugGroup&) = delete;
+
+private:
+  bool pushed_;
+};
+
+// identifier is the object's namespace, e.g. GL_BUFFER_KHR or GL_TEXTURE; an
+// object made with glGen* exists only once it has been bound
+inline void gl_label(GLenum identifier, GLuint object, const char *label)
+{
+  if (GLAD_GL_KHR_debug && object)
+    glObjectLabelKHR(identifier, object, -1, label);
+}
+
+#else
+
+#define GL_ZONE(name) static_cast<void>(0)
+
+inline void gl_label(GLenum, GLuint, const char*) { }
+
+#endif  // PROTO3D_GL_DEBUG_GROUPS
+
 inline
 size_t diff_or_err(long val,
                    long min,
@@ -19,4 +98,22 @@ size_t diff_or_err(long val,
 void gl_debug_logger(GLenum source, GLenum type, GLuint id, GLenum severity,
                      GLsizei /*length*/, const char *msg, const void *user_data);
 
+// Logs every error glGetError has queued, blaming call at file:line; false if
+// there were any.
+bool gl_check_errors(const char *call, const char *file, int line);
+
+// What GL_CHECK expands to in debug builds: call(), then the error check.
+template <typename Call>
+inline decltype(auto) gl_checked(Call call, const char *text, const char *file,
+                                 int line)
+{
+  struct Check
+  {
+    const char *text, *file;
+    int line;
+    ~Check() { gl_check_errors(text, file, line); }
+  } check{ text, file, line };
+  return call();
+}
+
 #endif  // __UTIL_H__
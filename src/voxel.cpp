@@ -0,0 +1,666 @@
+#include "voxel.h"
+#include "assets.h"
+#include "debug_draw.h"
+#include "gl_uploader.h"
+#include "perf.h"
+#include "shader.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <utility>
+
+namespace {
+
+constexpr int SLICE = CHUNK_SIZE * CHUNK_SIZE;
+// worst case is a 3D checkerboard: half the cells, all six faces visible
+constexpr size_t MAX_QUADS = CHUNK_VOLUME / 2 * 6;
+constexpr GLsizeiptr STAGING_BYTES = 8 << 20;
+
+int floor_div(int a, int b)
+{
+  return (a >= 0) ? (a / b) : -((-a + b - 1) / b);
+}
+
+glm::ivec3 chunk_of(const glm::ivec3 &pos)
+{
+  return glm::ivec3(floor_div(pos.x, CHUNK_SIZE), floor_div(pos.y, CHUNK_SIZE),
+                    floor_div(pos.z, CHUNK_SIZE));
+}
+
+const glm::ivec3 FACE_DIRS[6] = {
+  { 1, 0, 0 }, { -1, 0, 0 },
+  { 0, 1, 0 }, { 0, -1, 0 },
+  { 0, 0, 1 }, { 0, 0, -1 }
+};
+
+// Border slice of the neighbour across face f, in the (u, v) layout that
+// greedy_mesh reads.
+void copy_border(const PaletteChunk &neighbour, int face, BlockId *slice)
+{
+  const int axis = face / 2;
+  const int ua = (axis + 1) % 3;
+  const int va = (axis + 2) % 3;
+  glm::ivec3 p;
+  p[axis] = (face % 2 == 0) ? 0 : CHUNK_SIZE - 1;
+  for (int v = 0; v < CHUNK_SIZE; ++v)
+  {
+    for (int u = 0; u < CHUNK_SIZE; ++u)
+    {
+      p[ua] = u;
+      p[va] = v;
+      slice[v * CHUNK_SIZE + u] = neighbour.get(p.x, p.y, p.z);
+    }
+  }
+}
+
+}  // unnamed namespace
+
+uint32_t PaletteChunk::read(size_t i) const
+{
+  if (bits_ == 0)
+    return 0;
+  // widths divide 64, so entries never straddle words
+  const size_t bit = i * bits_;
+  const uint64_t mask = (uint64_t(1) << bits_) - 1;
+  return static_cast<uint32_t>((words_[bit / 64] >> (bit % 64)) & mask);
+}
+
+void PaletteChunk::write(size_t i, uint32_t value)
+{
+  const size_t bit = i * bits_;
+  const uint64_t mask = ((uint64_t(1) << bits_) - 1) << (bit % 64);
+  uint64_t &word = words_[bit / 64];
+  word = (word & ~mask) | ((uint64_t(value) << (bit % 64)) & mask);
+}
+
+void PaletteChunk::widen(unsigned bits)
+{
+  std::vector<uint32_t> indices(CHUNK_VOLUME);
+  for (size_t i = 0; i < CHUNK_VOLUME; ++i)
+    indices[i] = read(i);
+  bits_ = bits;
+  words_.assign(CHUNK_VOLUME * bits_ / 64, 0);
+  for (size_t i = 0; i < CHUNK_VOLUME; ++i)
+    write(i, indices[i]);
+}
+
+BlockId PaletteChunk::get(int x, int y, int z) const
+{
+  return palette_[read(index(x, y, z))];
+}
+
+void PaletteChunk::set(int x, int y, int z, BlockId id)
+{
+  const auto it = std::find(palette_.begin(), palette_.end(), id);
+  const auto entry = static_cast<uint32_t>(it - palette_.begin());
+  if (it == palette_.end())
+  {
+    palette_.push_back(id);
+    // 0 -> 1 -> 2 -> 4 -> 8 -> 16 bits
+    unsigned bits = bits_;
+    while ((size_t(1) << bits) < palette_.size())
+      bits = bits ? bits * 2 : 1;
+    if (bits != bits_)
+      widen(bits);
+  }
+  if (bits_)
+    write(index(x, y, z), entry);
+}
+
+void greedy_mesh(const PaletteChunk &chunk,
+                 const ChunkBorders &borders,
+                 std::vector<VoxelVertex> *out)
+{
+  // decode once; the palette lookups would dominate otherwise
+  std::vector<BlockId> blocks(CHUNK_VOLUME);
+  for (int y = 0; y < CHUNK_SIZE; ++y)
+    for (int z = 0; z < CHUNK_SIZE; ++z)
+      for (int x = 0; x < CHUNK_SIZE; ++x)
+        blocks[static_cast<size_t>((y * CHUNK_SIZE + z) * CHUNK_SIZE + x)] =
+          chunk.get(x, y, z);
+  auto at = [&blocks](const glm::ivec3 &p) {
+    return blocks[static_cast<size_t>((p.y * CHUNK_SIZE + p.z) * CHUNK_SIZE +
+                                      p.x)];
+  };
+
+  out->clear();
+  BlockId mask[SLICE];
+  for (int face = 0; face < 6; ++face)
+  {
+    const int axis = face / 2;
+    const int ua = (axis + 1) % 3;
+    const int va = (axis + 2) % 3;
+    const bool positive = (face % 2) == 0;
+    const int step = positive ? 1 : -1;
+
+    for (int s = 0; s < CHUNK_SIZE; ++s)
+    {
+      // visible faces of this slice
+      glm::ivec3 p;
+      p[axis] = s;
+      const int ns = s + step;
+      const bool inside = (ns >= 0) && (ns < CHUNK_SIZE);
+      for (int v = 0; v < CHUNK_SIZE; ++v)
+      {
+        for (int u = 0; u < CHUNK_SIZE; ++u)
+        {
+          p[ua] = u;
+          p[va] = v;
+          const BlockId b = at(p);
+          BlockId n;
+          if (inside)
+          {
+            glm::ivec3 q = p;
+            q[axis] = ns;
+            n = at(q);
+          }
+          else
+          {
+            n = borders.face[face][v * CHUNK_SIZE + u];
+          }
+          mask[v * CHUNK_SIZE + u] = (b && !n) ? b : 0;
+        }
+      }
+
+      // grow each face first along u, then v, while the block matches
+      const auto plane = static_cast<uint8_t>(s + (positive ? 1 : 0));
+      for (int v = 0; v < CHUNK_SIZE; ++v)
+      {
+        for (int u = 0; u < CHUNK_SIZE; )
+        {
+          const BlockId b = mask[v * CHUNK_SIZE + u];
+          if (!b)
+          {
+            ++u;
+            continue;
+          }
+          int w = 1;
+          while ((u + w < CHUNK_SIZE) && (mask[v * CHUNK_SIZE + u + w] == b))
+            ++w;
+          int h = 1;
+          for (; v + h < CHUNK_SIZE; ++h)
+          {
+            const BlockId *row = &mask[(v + h) * CHUNK_SIZE + u];
+            if (std::any_of(row, row + w, [b](BlockId e) { return e != b; }))
+              break;
+          }
+          for (int dv = 0; dv < h; ++dv)
+            std::fill_n(&mask[(v + dv) * CHUNK_SIZE + u], w, BlockId(0));
+
+          // counter-clockwise seen from outside; u x v points along +axis
+          const int corners[4][2] = { { u, v }, { u + w, v },
+                                      { u + w, v + h }, { u, v + h } };
+          for (int c = 0; c < 4; ++c)
+          {
+            const int *corner = corners[positive ? c : (4 - c) % 4];
+            uint8_t pos[3];
+            pos[axis] = plane;
+            pos[ua] = static_cast<uint8_t>(corner[0]);
+            pos[va] = static_cast<uint8_t>(corner[1]);
+            out->push_back(VoxelVertex{ pos[0], pos[1], pos[2],
+                                        static_cast<uint8_t>(face), b, 0 });
+          }
+          u += w;
+        }
+      }
+    }
+  }
+}
+
+void generate_hills(const glm::ivec3 &chunk, PaletteChunk *out)
+{
+  constexpr BlockId STONE = 1;
+  constexpr BlockId GRASS = 2;
+  const glm::ivec3 origin = chunk * CHUNK_SIZE;
+  for (int z = 0; z < CHUNK_SIZE; ++z)
+  {
+    for (int x = 0; x < CHUNK_SIZE; ++x)
+    {
+      const float wx = float(origin.x + x);
+      const float wz = float(origin.z + z);
+      const int height = static_cast<int>(std::floor(
+        16.0f + 8.0f * std::sin(wx * 0.05f) * std::cos(wz * 0.07f)));
+      const int top = std::min(height - origin.y, CHUNK_SIZE - 1);
+      for (int y = 0; y <= top; ++y)
+        out->set(x, y, z, (origin.y + y == height) ? GRASS : STONE);
+    }
+  }
+}
+
+struct VoxelWorld::Chunk
+{
+  glm::ivec3 coord;
+  uint64_t serial;
+  PaletteChunk blocks;
+  bool generated = false;
+  bool meshing = false;
+  bool dirty = false;
+  bool has_pending = false;
+  std::vector<VoxelVertex> pending;
+
+  GLuint vao = 0;
+  GLuint vbo = 0;
+  GLsizei index_count = 0;
+  GLsizeiptr vbo_bytes = 0;
+};
+
+struct VoxelWorld::Result
+{
+  enum Kind
+  {
+    GENERATED,
+    MESHED
+  };
+
+  Kind kind;
+  glm::ivec3 coord;
+  uint64_t serial;
+  PaletteChunk blocks;
+  std::vector<VoxelVertex> vertices;
+};
+
+VoxelWorld::VoxelWorld(JobSystem &jobs, Generator generator, int view_radius)
+  : jobs_(jobs)
+  , generator_(std::move(generator))
+  , view_radius_(view_radius)
+{
+}
+
+VoxelWorld::~VoxelWorld()
+{
+  // jobs hold copies, but they report back into this object
+  jobs_.wait(in_flight_);
+  // so do uploads
+  while (uploader_ && uploader_->in_flight())
+  {
+    if (!uploader_->publish())
+      std::this_thread::yield();
+  }
+  for (auto &c : chunks_)
+    release(*c.second);
+  staging_.destroy();
+  glDeleteBuffers(1, &index_buffer_);
+  glDeleteProgram(program_);
+}
+
+bool VoxelWorld::init_gl()
+{
+  program_ = compile_program("voxel",
+                             asset_text("shaders/voxel.vert").c_str(),
+                             asset_text("shaders/voxel.frag").c_str());
+  if (!program_)
+    return false;
+  u_view_proj_ = glGetUniformLocation(program_, "u_view_proj");
+  u_origin_ = glGetUniformLocation(program_, "u_origin");
+
+  // every chunk draws quads; one shared 0 1 2 0 2 3 pattern serves them all
+  std::vector<uint32_t> indices(MAX_QUADS * 6);
+  for (uint32_t q = 0; q < MAX_QUADS; ++q)
+  {
+    const uint32_t pattern[6] = { 0, 1, 2, 0, 2, 3 };
+    for (int i = 0; i < 6; ++i)
+      indices[q * 6 + i] = q * 4 + pattern[i];
+  }
+  glGenBuffers(1, &index_buffer_);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+  gl_label(GL_BUFFER_KHR, index_buffer_, "voxel quad indices");
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+               static_cast<GLsizeiptr>(indices.size() * sizeof(uint32_t)),
+               indices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+  return staging_.init(GL_COPY_READ_BUFFER, STAGING_BYTES, "voxel staging");
+}
+
+uint64_t VoxelWorld::key(const glm::ivec3 &c)
+{
+  constexpr uint64_t MASK = (1 << 21) - 1;
+  return ((uint64_t(c.x) & MASK) << 42) | ((uint64_t(c.y) & MASK) << 21) |
+         (uint64_t(c.z) & MASK);
+}
+
+VoxelWorld::Chunk* VoxelWorld::find(const glm::ivec3 &c) const
+{
+  const auto it = chunks_.find(key(c));
+  return (it != chunks_.end()) ? it->second.get() : nullptr;
+}
+
+void VoxelWorld::mark_dirty(const glm::ivec3 &c)
+{
+  Chunk *chunk = find(c);
+  if (chunk && chunk->generated)
+    chunk->dirty = true;
+}
+
+BlockId VoxelWorld::get_block(const glm::ivec3 &pos) const
+{
+  const glm::ivec3 c = chunk_of(pos);
+  const Chunk *chunk = find(c);
+  if (!chunk || !chunk->generated)
+    return 0;
+  const glm::ivec3 local = pos - c * CHUNK_SIZE;
+  return chunk->blocks.get(local.x, local.y, local.z);
+}
+
+bool VoxelWorld::set_block(const glm::ivec3 &pos, BlockId id)
+{
+  const glm::ivec3 c = chunk_of(pos);
+  Chunk *chunk = find(c);
+  if (!chunk || !chunk->generated)
+    return false;
+  const glm::ivec3 local = pos - c * CHUNK_SIZE;
+  chunk->blocks.set(local.x, local.y, local.z, id);
+  chunk->dirty = true;
+  // a neighbour only sees the change when it sits on their shared face
+  for (int face = 0; face < 6; ++face)
+  {
+    const int axis = face / 2;
+    const int edge = (face % 2 == 0) ? CHUNK_SIZE - 1 : 0;
+    if (local[axis] == edge)
+      mark_dirty(c + FACE_DIRS[face]);
+  }
+  return true;
+}
+
+void VoxelWorld::dispatch_mesh(Chunk &chunk)
+{
+  struct Task
+  {
+    PaletteChunk blocks;
+    ChunkBorders borders;
+  };
+  auto task = std::make_shared<Task>();
+  task->blocks = chunk.blocks;
+  for (int face = 0; face < 6; ++face)
+  {
+    const Chunk *n = find(chunk.coord + FACE_DIRS[face]);
+    if (n && n->generated)
+      copy_border(n->blocks, face, task->borders.face[face]);
+    else
+      std::fill_n(task->borders.face[face], SLICE, BlockId(0));
+  }
+
+  chunk.dirty = false;
+  chunk.meshing = true;
+  const glm::ivec3 coord = chunk.coord;
+  const uint64_t serial = chunk.serial;
+  jobs_.submit([this, task, coord, serial]() {
+    Result r{ Result::MESHED, coord, serial, {}, {} };
+    greedy_mesh(task->blocks, task->borders, &r.vertices);
+    std::lock_guard<std::mutex> lock(results_mutex_);
+    results_.push_back(std::move(r));
+  }, &in_flight_);
+}
+
+void VoxelWorld::collect_results()
+{
+  std::vector<Result> done;
+  {
+    std::lock_guard<std::mutex> lock(results_mutex_);
+    done.swap(results_);
+  }
+  for (auto &r : done)
+  {
+    Chunk *chunk = find(r.coord);
+    // unloaded, or unloaded and loaded again, while the job ran
+    if (!chunk || (chunk->serial != r.serial))
+      continue;
+
+    if (r.kind == Result::GENERATED)
+    {
+      chunk->blocks = std::move(r.blocks);
+      chunk->generated = true;
+      chunk->dirty = true;
+      // neighbours meshed so far treated this chunk as air
+      for (const auto &dir : FACE_DIRS)
+        mark_dirty(chunk->coord + dir);
+    }
+    else
+    {
+      chunk->meshing = false;
+      chunk->pending = std::move(r.vertices);
+      chunk->has_pending = true;
+    }
+  }
+}
+
+bool VoxelWorld::upload(Chunk &chunk, const std::vector<VoxelVertex> &vertices)
+{
+  const auto bytes = static_cast<GLsizeiptr>(vertices.size() *
+                                             sizeof(VoxelVertex));
+  chunk.index_count = static_cast<GLsizei>(vertices.size() / 4 * 6);
+  if (bytes == 0)
+  {
+    // emptied: its old mesh would otherwise stay resident and counted
+    mesh_bytes_ -= static_cast<size_t>(chunk.vbo_bytes);
+    glDeleteBuffers(1, &chunk.vbo);
+    chunk.vbo = 0;
+    chunk.vbo_bytes = 0;
+    return true;
+  }
+
+  if (!chunk.vbo)
+  {
+    glGenBuffers(1, &chunk.vbo);
+    setup_vertex_array(chunk);
+  }
+
+  mesh_bytes_ = mesh_bytes_ - static_cast<size_t>(chunk.vbo_bytes) +
+                static_cast<size_t>(bytes);
+  chunk.vbo_bytes = bytes;
+  glBindBuffer(GL_COPY_WRITE_BUFFER, chunk.vbo);
+  glBufferData(GL_COPY_WRITE_BUFFER, bytes, nullptr, GL_STATIC_DRAW);
+
+  GLintptr offset = 0;
+  void *staging = staging_.map(bytes, sizeof(VoxelVertex), &offset);
+  if (!staging)
+  {
+    // larger than the ring; rare enough to take the driver's copy path
+    glBufferSubData(GL_COPY_WRITE_BUFFER, 0, bytes, vertices.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return true;
+  }
+  std::memcpy(staging, vertices.data(), static_cast<size_t>(bytes));
+  staging_.unmap();
+  glBindBuffer(GL_COPY_READ_BUFFER, staging_.id());
+  glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, 0,
+                      bytes);
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  return true;
+}
+
+// The buffer is made and filled on the upload thread, the vertex array, which
+// contexts don't share, here once it's ready.  Empty meshes go the same way,
+// so a chunk's uploads land in order.
+void VoxelWorld::upload_async(Chunk &chunk, std::vector<VoxelVertex> vertices)
+{
+  const auto bytes = static_cast<GLsizeiptr>(vertices.size() *
+                                             sizeof(VoxelVertex));
+  const auto index_count = static_cast<GLsizei>(vertices.size() / 4 * 6);
+  auto buffer = std::make_shared<GLuint>(0);
+  auto data = std::make_shared<std::vector<VoxelVertex>>(std::move(vertices));
+  const glm::ivec3 coord = chunk.coord;
+  const uint64_t serial = chunk.serial;
+  uploader_->submit([buffer, data, bytes]() {
+    if (bytes == 0)
+      return;
+    glGenBuffers(1, buffer.get());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, *buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, bytes, nullptr, GL_STATIC_DRAW);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, 0, bytes, data->data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    *data = std::vector<VoxelVertex>();
+  }, [this, buffer, bytes, index_count, coord, serial]() {
+    Chunk *c = find(coord);
+    // unloaded, or unloaded and loaded again, since
+    if (!c || (c->serial != serial))
+    {
+      glDeleteBuffers(1, buffer.get());
+      return;
+    }
+    // an empty mesh frees the old one; buffer is 0
+    mesh_bytes_ = mesh_bytes_ - static_cast<size_t>(c->vbo_bytes) +
+                  static_cast<size_t>(bytes);
+    glDeleteBuffers(1, &c->vbo);
+    c->vbo = *buffer;
+    c->vbo_bytes = bytes;
+    c->index_count = index_count;
+    if (c->vbo)
+      setup_vertex_array(*c);
+  });
+}
+
+// Points the chunk's vertex array, made on first use, at its vertex buffer;
+// binding the buffer here also makes another context's writes to it visible.
+void VoxelWorld::setup_vertex_array(Chunk &chunk)
+{
+  if (!chunk.vao)
+  {
+    glGenVertexArrays(1, &chunk.vao);
+    glBindVertexArray(chunk.vao);
+    gl_label(GL_VERTEX_ARRAY_KHR, chunk.vao, "voxel chunk");
+  }
+  else
+    glBindVertexArray(chunk.vao);
+  glBindBuffer(GL_ARRAY_BUFFER, chunk.vbo);
+  gl_label(GL_BUFFER_KHR, chunk.vbo, "voxel chunk");
+  constexpr auto stride = static_cast<GLsizei>(sizeof(VoxelVertex));
+  glEnableVertexAttribArray(0);
+  glVertexAttribIPointer(0, 4, GL_UNSIGNED_BYTE, stride, nullptr);
+  glEnableVertexAttribArray(1);
+  glVertexAttribIPointer(1, 1, GL_UNSIGNED_SHORT, stride,
+    reinterpret_cast<const void*>(offsetof(VoxelVertex, block)));
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void VoxelWorld::release(Chunk &chunk)
+{
+  mesh_bytes_ -= static_cast<size_t>(chunk.vbo_bytes);
+  glDeleteVertexArrays(1, &chunk.vao);
+  glDeleteBuffers(1, &chunk.vbo);
+  chunk.vao = chunk.vbo = 0;
+  chunk.vbo_bytes = 0;
+  chunk.index_count = 0;
+}
+
+void VoxelWorld::update(const glm::vec3 &camera)
+{
+  GL_ZONE("voxel uploads");
+  collect_results();
+
+  const glm::ivec3 center = chunk_of(glm::ivec3(glm::floor(camera)));
+  auto distance2 = [&center](const glm::ivec3 &c) {
+    const glm::ivec3 d = c - center;
+    return d.x * d.x + d.y * d.y + d.z * d.z;
+  };
+
+  // one chunk of hysteresis so hovering over a boundary doesn't thrash
+  const int unload_radius2 = (view_radius_ + 1) * (view_radius_ + 1);
+  for (auto it = chunks_.begin(); it != chunks_.end(); )
+  {
+    if (distance2(it->second->coord) > unload_radius2)
+    {
+      release(*it->second);
+      it = chunks_.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+
+  // nearest missing chunks first
+  std::vector<std::pair<int, glm::ivec3>> missing;
+  const int r = view_radius_;
+  for (int y = -r; y <= r; ++y)
+    for (int z = -r; z <= r; ++z)
+      for (int x = -r; x <= r; ++x)
+      {
+        const glm::ivec3 c = center + glm::ivec3(x, y, z);
+        const int d2 = distance2(c);
+        if ((d2 <= r * r) && !find(c))
+          missing.emplace_back(d2, c);
+      }
+  const size_t loads = std::min(missing.size(), max_loads_per_frame);
+  std::partial_sort(missing.begin(), missing.begin() + static_cast<std::ptrdiff_t>(loads),
+                    missing.end(),
+                    [](const std::pair<int, glm::ivec3> &a,
+                       const std::pair<int, glm::ivec3> &b) {
+                      return a.first < b.first;
+                    });
+  for (size_t i = 0; i < loads; ++i)
+  {
+    auto chunk = std::make_unique<Chunk>();
+    chunk->coord = missing[i].second;
+    chunk->serial = next_serial_++;
+    const glm::ivec3 coord = chunk->coord;
+    const uint64_t serial = chunk->serial;
+    chunks_.emplace(key(coord), std::move(chunk));
+    jobs_.submit([this, coord, serial]() {
+      Result r{ Result::GENERATED, coord, serial, {}, {} };
+      generator_(coord, &r.blocks);
+      std::lock_guard<std::mutex> lock(results_mutex_);
+      results_.push_back(std::move(r));
+    }, &in_flight_);
+  }
+
+  GLsizeiptr uploaded = 0;
+  for (auto &entry : chunks_)
+  {
+    Chunk &chunk = *entry.second;
+    // at most one mesh job a chunk; edits meanwhile remesh once it's back
+    if (chunk.dirty && !chunk.meshing)
+      dispatch_mesh(chunk);
+    if (chunk.has_pending && (uploaded < upload_budget))
+    {
+      if (uploader_ && uploader_->running())
+      {
+        uploaded += static_cast<GLsizeiptr>(chunk.pending.size() *
+                                            sizeof(VoxelVertex));
+        upload_async(chunk, std::move(chunk.pending));
+      }
+      else
+      {
+        upload(chunk, chunk.pending);
+        uploaded += chunk.vbo_bytes;
+      }
+      chunk.pending = std::vector<VoxelVertex>();
+      chunk.has_pending = false;
+    }
+  }
+  staging_.end_frame();
+}
+
+void VoxelWorld::draw(const glm::mat4 &view_proj)
+{
+  GL_ZONE("voxels");
+  glUseProgram(program_);
+  glUniformMatrix4fv(u_view_proj_, 1, GL_FALSE, &view_proj[0][0]);
+  glEnable(GL_DEPTH_TEST);
+  glEnable(GL_CULL_FACE);
+  for (const auto &entry : chunks_)
+  {
+    const Chunk &chunk = *entry.second;
+    if (!chunk.index_count)
+      continue;
+    const glm::vec3 origin = glm::vec3(chunk.coord * CHUNK_SIZE);
+    glUniform3f(u_origin_, origin.x, origin.y, origin.z);
+    if (DEBUG_DRAW && draw_bounds)
+      debug_aabb(origin, origin + glm::vec3(CHUNK_SIZE), DEBUG_GREEN);
+    glBindVertexArray(chunk.vao);
+    glDrawElements(GL_TRIANGLES, chunk.index_count, GL_UNSIGNED_INT, nullptr);
+    perf_count(PerfCounter::DRAW_CALLS);
+    perf_count(PerfCounter::TRIANGLES,
+               static_cast<uint64_t>(chunk.index_count / 3));
+  }
+  glBindVertexArray(0);
+  glDisable(GL_CULL_FACE);
+}
@@ -0,0 +1,160 @@
+#ifndef __VOXEL_H__
+#define __VOXEL_H__
+
+#include "jobs.h"
+#include "stream_buffer.h"
+
+#include "glad/glad.h"
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+constexpr int CHUNK_SIZE = 32;
+constexpr size_t CHUNK_VOLUME = CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE;
+
+// Block 0 is air; every other id is an opaque cube.
+using BlockId = uint16_t;
+
+// Chunk blocks as indices into a small palette of the ids actually present,
+// bit-packed at the narrowest width that holds the palette (0 bits for a
+// uniform chunk).
+class PaletteChunk
+{
+public:
+  PaletteChunk() : palette_{0} { }
+
+  BlockId get(int x, int y, int z) const;
+  void set(int x, int y, int z, BlockId id);
+
+  size_t size_bytes() const
+  {
+    return palette_.size() * sizeof(BlockId) + words_.size() * sizeof(uint64_t);
+  }
+
+private:
+  static size_t index(int x, int y, int z)
+  {
+    return static_cast<size_t>((y * CHUNK_SIZE + z) * CHUNK_SIZE + x);
+  }
+  uint32_t read(size_t i) const;
+  void write(size_t i, uint32_t value);
+  void widen(unsigned bits);
+
+  std::vector<BlockId> palette_;
+  std::vector<uint64_t> words_;
+  unsigned bits_ = 0;
+};
+
+// Chunk-local quad corner; 8 bytes, positions are 0..CHUNK_SIZE inclusive.
+struct VoxelVertex
+{
+  uint8_t x, y, z;
+  uint8_t face;  // 0..5: +x -x +y -y +z -z
+  BlockId block;
+  uint16_t pad;
+};
+
+// Face-neighbour blocks of a chunk, for culling faces on its border; order
+// matches VoxelVertex::face.  Missing neighbours read as air.
+struct ChunkBorders
+{
+  BlockId face[6][CHUNK_SIZE * CHUNK_SIZE];
+};
+
+// Merges coplanar faces of equal blocks into quads; four vertices a quad.
+void greedy_mesh(const PaletteChunk &chunk,
+                 const ChunkBorders &borders,
+                 std::vector<VoxelVertex> *out);
+
+// Rolling sine hills, grass over stone; a stand-in Generator.
+void generate_hills(const glm::ivec3 &chunk, PaletteChunk *out);
+
+class GlUploader;
+
+// Chunks streamed in and out around the camera.  Generation and meshing run
+// as jobs on private copies of the chunk data; the main thread only swaps in
+// results, and uploads meshes through a staging ring under a byte budget, or
+// hands them to a GlUploader.
+class VoxelWorld
+{
+public:
+  // called from worker threads, concurrently
+  using Generator = std::function<void(const glm::ivec3 &chunk,
+                                       PaletteChunk *out)>;
+
+  VoxelWorld(JobSystem &jobs, Generator generator, int view_radius);
+  ~VoxelWorld();
+
+  VoxelWorld(const VoxelWorld&) = delete;
+  VoxelWorld& operator=(const VoxelWorld&) = delete;
+
+  bool init_gl();
+  // Uploads meshes on uploader's thread from now on, each into a new buffer
+  // swapped in when it's ready; the chunk draws its old mesh meanwhile.
+  // uploader must outlive the world, and be published from update's thread.
+  void set_uploader(GlUploader *uploader) { uploader_ = uploader; }
+
+  // Main thread, once a frame: load/unload around camera, dispatch meshing of
+  // edited chunks, upload finished meshes.
+  void update(const glm::vec3 &camera);
+  void draw(const glm::mat4 &view_proj);
+  // Blocks until the jobs started so far are done; the next update picks up
+  // all of them, which makes replays deterministic.
+  void wait_idle() { jobs_.wait(in_flight_); }
+
+  // Air for blocks in chunks not loaded.
+  BlockId get_block(const glm::ivec3 &pos) const;
+  // Remeshes the owning chunk, plus the neighbour across a chunk face when
+  // the block lies on it; false when the chunk isn't loaded.
+  bool set_block(const glm::ivec3 &pos, BlockId id);
+
+  size_t chunk_count() const { return chunks_.size(); }
+  size_t mesh_bytes() const { return mesh_bytes_; }
+
+  // chunks generated and meshes uploaded per update at most
+  size_t max_loads_per_frame = 8;
+  GLsizeiptr upload_budget = 4 << 20;
+  // outline every chunk drawn with debug_aabb, in debug builds
+  bool draw_bounds = false;
+
+private:
+  struct Chunk;
+  struct Result;
+
+  static uint64_t key(const glm::ivec3 &c);
+  Chunk* find(const glm::ivec3 &c) const;
+  void mark_dirty(const glm::ivec3 &c);
+  void dispatch_mesh(Chunk &chunk);
+  void collect_results();
+  bool upload(Chunk &chunk, const std::vector<VoxelVertex> &vertices);
+  void upload_async(Chunk &chunk, std::vector<VoxelVertex> vertices);
+  void setup_vertex_array(Chunk &chunk);
+  void release(Chunk &chunk);
+
+  JobSystem &jobs_;
+  Generator generator_;
+  int view_radius_;
+  std::unordered_map<uint64_t, std::unique_ptr<Chunk>> chunks_;
+  uint64_t next_serial_ = 1;
+
+  // finished jobs, handed from workers to the main thread
+  std::mutex results_mutex_;
+  std::vector<Result> results_;
+  JobCounter in_flight_;
+
+  StreamBuffer staging_;
+  GlUploader *uploader_ = nullptr;
+  GLuint index_buffer_ = 0;
+  GLuint program_ = 0;
+  GLint u_view_proj_ = -1;
+  GLint u_origin_ = -1;
+  size_t mesh_bytes_ = 0;
+};
+
+#endif  // __VOXEL_H__
@@ -0,0 +1,71 @@
+// Renders printable ASCII of a TrueType font into the glyph tables text.cpp
+// embeds; coverage is kept at 4 bits, two pixels a byte, rows byte aligned.
+//
+//   c++ tools/font_inc.cpp $(pkg-config --cflags --libs freetype2) -o font_inc
+//   ./font_inc DejaVuSansMono.ttf 16 > src/font_data.inc
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+int main(int argc, char **argv)
+{
+  if (argc != 3)
+  {
+    std::fprintf(stderr, "usage: %s font.ttf pixel_height\n", argv[0]);
+    return 1;
+  }
+  FT_Library library;
+  FT_Face face;
+  if (FT_Init_FreeType(&library) ||
+      FT_New_Face(library, argv[1], 0, &face) ||
+      FT_Set_Pixel_Sizes(face, 0, static_cast<FT_UInt>(std::atoi(argv[2]))))
+  {
+    std::fprintf(stderr, "unable to load %s\n", argv[1]);
+    return 1;
+  }
+
+  std::vector<unsigned char> bits;
+  const char *name = std::strrchr(argv[1], '/');
+  std::printf("// Generated by tools/font_inc.cpp from %s at %s px; do not "
+              "edit.\n", name ? name + 1 : argv[1], argv[2]);
+  std::printf("constexpr int FONT_PIXEL_HEIGHT = %s;\n", argv[2]);
+  std::printf("constexpr int FONT_ASCENT = %ld;\n",
+              face->size->metrics.ascender >> 6);
+  std::printf("constexpr int FONT_LINE_HEIGHT = %ld;\n\n",
+              face->size->metrics.height >> 6);
+  std::printf("// width, height, left, top, advance, first byte\n");
+  std::printf("constexpr FontGlyph FONT_GLYPHS[] = {\n");
+  for (int c = 32; c < 127; ++c)
+  {
+    if (FT_Load_Char(face, static_cast<FT_ULong>(c), FT_LOAD_RENDER))
+      return 1;
+    const FT_GlyphSlot g = face->glyph;
+    const FT_Bitmap &b = g->bitmap;
+    std::printf("  { %u, %u, %d, %d, %ld, %zu },  // '%c'\n", b.width,
+                b.rows, g->bitmap_left, g->bitmap_top, g->advance.x >> 6,
+                bits.size(), c == '\\' ? '/' : c);
+    for (unsigned y = 0; y < b.rows; ++y)
+    {
+      const unsigned char *row = b.buffer + static_cast<long>(y) * b.pitch;
+      for (unsigned x = 0; x < b.width; x += 2)
+      {
+        const unsigned lo = (row[x] * 15u + 127u) / 255u;
+        const unsigned hi = (x + 1 < b.width)
+                              ? (row[x + 1] * 15u + 127u) / 255u : 0u;
+        bits.push_back(static_cast<unsigned char>(lo | (hi << 4)));
+      }
+    }
+  }
+  std::printf("};\n\nconstexpr unsigned char FONT_BITMAPS[] = {");
+  for (size_t i = 0; i < bits.size(); ++i)
+    std::printf("%s0x%02x,", (i % 12) ? " " : "\n  ", bits[i]);
+  std::printf("\n};\n");
+
+  FT_Done_Face(face);
+  FT_Done_FreeType(library);
+}
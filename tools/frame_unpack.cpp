@@ -0,0 +1,136 @@
+// Converts a frame archive (see src/frame_codec.h) to one PNG a frame, offline.
+//
+//   proto3d-unpack ARCHIVE PATTERN [--alpha] [--qoi]
+//
+// PATTERN is a printf format taking the frame number as an int, e.g.
+// "frames/frame_%05d.png"; the frame number is the one the app captured it
+// as.  Alpha is dropped unless --alpha is given, as capture's image files do;
+// --qoi writes QOI instead of PNG.  Frames are written on all cores.
+
+#include "frame_codec.h"
+#include "image_write.h"
+#include "jobs.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+bool read_file(const char *path, std::vector<uint8_t> *bytes)
+{
+  FILE *f = std::fopen(path, "rb");
+  if (!f)
+    return false;
+  uint8_t buffer[1 << 16];
+  size_t n;
+  while ((n = std::fread(buffer, 1, sizeof(buffer), f)) > 0)
+    bytes->insert(bytes->end(), buffer, buffer + n);
+  const bool ok = !std::ferror(f);
+  std::fclose(f);
+  return ok;
+}
+
+}  // unnamed namespace
+
+int main(int argc, char **argv)
+{
+  const char *archive = nullptr, *pattern = nullptr;
+  int channels = 3;
+  ImageFormat format = ImageFormat::PNG;
+  bool usage = false;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (!std::strcmp(argv[i], "--alpha"))
+      channels = 4;
+    else if (!std::strcmp(argv[i], "--qoi"))
+      format = ImageFormat::QOI;
+    else if (!archive)
+      archive = argv[i];
+    else if (!pattern)
+      pattern = argv[i];
+    else
+      usage = true;
+  }
+  if (usage || !archive || !pattern)
+  {
+    std::fprintf(stderr, "usage: %s ARCHIVE PATTERN [--alpha] [--qoi]\n",
+                 argv[0]);
+    return 2;
+  }
+
+  std::vector<uint8_t> bytes;
+  if (!read_file(archive, &bytes))
+  {
+    std::fprintf(stderr, "Unable to read %s\n", archive);
+    return 2;
+  }
+  constexpr size_t HEADER = sizeof(FRAME_ARCHIVE_MAGIC) + 4;
+  if ((bytes.size() < HEADER) ||
+      std::memcmp(bytes.data(), FRAME_ARCHIVE_MAGIC,
+                  sizeof(FRAME_ARCHIVE_MAGIC)) ||
+      (bytes[8] != FRAME_ARCHIVE_VERSION) || bytes[9] || bytes[10] ||
+      bytes[11])
+  {
+    std::fprintf(stderr, "%s isn't a version %u frame archive\n", archive,
+                 FRAME_ARCHIVE_VERSION);
+    return 2;
+  }
+
+  // Decoding is sequential, each frame predicting from the last; the PNGs
+  // are encoded and written on the pool.
+  JobSystem jobs;
+  JobCounter writing;
+  FrameDecoder decoder;
+  int status = 0;
+  std::atomic<bool> unwritten{ false };
+  uint64_t frames = 0;
+  const auto start = std::chrono::steady_clock::now();
+  size_t at = HEADER;
+  while (at < bytes.size())
+  {
+    FrameInfo info;
+    const size_t n = decoder.decode(bytes.data() + at, bytes.size() - at,
+                                    &info);
+    if (!n)
+    {
+      std::fprintf(stderr, "%s: bad record at byte %zu, after %llu frames\n",
+                   archive, at, static_cast<unsigned long long>(frames));
+      status = 1;
+      break;
+    }
+    at += n;
+    ++frames;
+
+    std::vector<char> path(std::strlen(pattern) + 32);
+    std::snprintf(path.data(), path.size(), pattern,
+                  static_cast<int>(info.frame));
+    // bound the frames held in memory to what the pool can encode at once
+    if (writing.pending.load(std::memory_order_acquire) >= jobs.thread_count())
+      jobs.wait(writing);
+    jobs.submit([pixels = decoder.frame(), info, channels, format,
+                 file = std::string(path.data()), &unwritten]() {
+      std::vector<uint8_t> encoded;
+      encode_image(format, pixels.data(), info.width, info.height,
+                   static_cast<ptrdiff_t>(info.width) * 4, channels, &encoded);
+      if (!write_file(file.c_str(), encoded))
+      {
+        std::fprintf(stderr, "Unable to write %s\n", file.c_str());
+        unwritten.store(true, std::memory_order_relaxed);
+      }
+    }, &writing);
+  }
+  jobs.wait(writing);
+  if (unwritten.load(std::memory_order_relaxed))
+    status = 1;
+
+  const double s = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start).count();
+  std::fprintf(stderr, "%llu frames in %.2f s, %.1f frames/s\n",
+               static_cast<unsigned long long>(frames), s,
+               s > 0.0 ? static_cast<double>(frames) / s : 0.0);
+  return status;
+}
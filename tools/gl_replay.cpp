@@ -0,0 +1,602 @@
+// Re-issues a GL trace (see src/gl_trace.h) in a hidden window and times
+// every call, so driver-side costs can be profiled and bisected without the
+// app.  Prints the slowest frames and a table of entry points by total time.
+//
+//   proto3d-replay TRACE [--frames FIRST:LAST] [--finish] [--calls FILE]
+//                        [--top N]
+//
+// Every call is replayed, since later ones depend on the state earlier ones
+// set, but only frames FIRST to LAST are timed; replay stops after LAST.  A
+// call's time is what the driver spends on the CPU in it; --finish follows
+// each timed call with glFinish so its GPU work counts too.  Each frame ends
+// in glFinish, timed apart, so frames don't overlap.  --calls writes every
+// timed call as CSV: frame, index within the frame, entry point, microseconds.
+// Objects are remapped to the names this context gives them.
+
+#include "gl_trace.h"
+
+#include "glad/glad.h"
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+enum NameKind
+{
+  NAME_BUFFER,
+  NAME_TEXTURE,
+  NAME_QUERY,
+  NAME_RENDERBUFFER,
+  NAME_FRAMEBUFFER,
+  NAME_VERTEX_ARRAY,
+  NAME_SAMPLER,
+  NAME_PROGRAM,
+  NAME_SHADER,
+  NAME_KIND_COUNT
+};
+
+#define GL_TRACE_REPLAY
+#include "gl_trace.inc"
+
+// for outputs whose size the trace doesn't say; GL reads nothing back from
+// these, so only the size matters
+constexpr size_t DEFAULT_SCRATCH = 64 * 1024;
+
+using Clock = std::chrono::steady_clock;
+
+struct CallStats
+{
+  uint64_t calls = 0;
+  uint64_t total_ns = 0;
+  uint64_t max_ns = 0;
+};
+
+struct FrameStats
+{
+  uint64_t index;
+  uint64_t calls;
+  double gl_ms;
+  double finish_ms;
+};
+
+// Decodes a trace's records and keeps what replaying them needs: the names
+// this context gave objects the trace created, uniform locations, fences and
+// mappings.  Pointers decoded for a call stay valid until the next call.
+class Replay
+{
+public:
+  Replay(const uint8_t *begin, const uint8_t *end) : p_(begin), end_(end) { }
+
+  bool ok() const { return ok_; }
+  bool at_end() const { return p_ >= end_; }
+
+  uint64_t get_varint()
+  {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+      if (p_ >= end_)
+      {
+        ok_ = false;
+        return 0;
+      }
+      const uint8_t b = *p_++;
+      v |= static_cast<uint64_t>(b & 0x7f) << shift;
+      if (!(b & 0x80))
+        return v;
+    }
+    ok_ = false;
+    return 0;
+  }
+
+  int64_t get_int()
+  {
+    const uint64_t v = get_varint();
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+  }
+
+  float get_float()
+  {
+    float v = 0.0f;
+    get_raw(&v, sizeof(v));
+    return v;
+  }
+
+  double get_double()
+  {
+    double v = 0.0;
+    get_raw(&v, sizeof(v));
+    return v;
+  }
+
+  const void* get_pointer(size_t *size = nullptr) { return pointer(size); }
+  void* get_out() { return pointer(nullptr); }
+
+  const GLchar *const* get_strings()
+  {
+    strings_.resize(static_cast<size_t>(get_varint()));
+    for (auto &s : strings_)
+      s = static_cast<const GLchar*>(pointer(nullptr));
+    return strings_.data();
+  }
+
+  const GLuint* get_names(NameKind kind)
+  {
+    size_t size = 0;
+    const void *p = pointer(&size);
+    if (!p)
+      return nullptr;
+    auto *names = static_cast<GLuint*>(scratch(size));
+    std::memcpy(names, p, size);
+    for (size_t i = 0; i < size / sizeof(GLuint); ++i)
+      names[i] = name(kind, names[i]);
+    return names;
+  }
+
+  const void *const* get_offsets()
+  {
+    const auto count = static_cast<size_t>(get_varint());
+    auto **offsets = static_cast<const void**>(scratch(count * sizeof(void*)));
+    for (size_t i = 0; i < count; ++i)
+      offsets[i] = reinterpret_cast<const void*>(
+                     static_cast<uintptr_t>(get_varint()));
+    return offsets;
+  }
+
+  GLsync get_sync()
+  {
+    const auto it = syncs_.find(get_id());
+    return (it == syncs_.end()) ? nullptr : it->second;
+  }
+
+  void* scratch(size_t bytes = DEFAULT_SCRATCH)
+  {
+    if (used_ == blocks_.size())
+      blocks_.emplace_back();
+    auto &block = blocks_[used_++];
+    // one more byte, so strings recorded by length end in NUL
+    const size_t words = bytes / sizeof(uint64_t) + 1;
+    if (block.size() < words)
+      block.resize(words);
+    block[words - 1] = 0;
+    return block.data();
+  }
+
+  // names the trace didn't see created pass through unchanged
+  GLuint name(NameKind kind, GLuint recorded) const
+  {
+    const auto it = names_[kind].find(recorded);
+    return (it == names_[kind].end()) ? recorded : it->second;
+  }
+
+  GLuint label_name(GLenum identifier, GLuint recorded) const
+  {
+    switch (identifier)
+    {
+    case GL_BUFFER: return name(NAME_BUFFER, recorded);
+    case GL_TEXTURE: return name(NAME_TEXTURE, recorded);
+    case GL_QUERY: return name(NAME_QUERY, recorded);
+    case GL_RENDERBUFFER: return name(NAME_RENDERBUFFER, recorded);
+    case GL_FRAMEBUFFER: return name(NAME_FRAMEBUFFER, recorded);
+    case GL_VERTEX_ARRAY: return name(NAME_VERTEX_ARRAY, recorded);
+    case GL_SAMPLER: return name(NAME_SAMPLER, recorded);
+    case GL_PROGRAM: return name(NAME_PROGRAM, recorded);
+    case GL_SHADER: return name(NAME_SHADER, recorded);
+    default: return recorded;
+    }
+  }
+
+  // of the program in use
+  GLint location(GLint recorded) const
+  {
+    const auto it = locations_.find(location_key(program_, recorded));
+    return (it == locations_.end()) ? recorded : it->second;
+  }
+
+  void gen_names(NameKind kind, GLsizei count, const GLuint *actual)
+  {
+    for (GLsizei i = 0; i < count; ++i)
+      note_name(kind, static_cast<GLuint>(get_int()), actual[i]);
+  }
+
+  void note_name(NameKind kind, GLuint recorded, GLuint actual)
+  {
+    names_[kind][recorded] = actual;
+  }
+
+  void note_location(GLuint program, GLint recorded, GLint actual)
+  {
+    locations_[location_key(program, recorded)] = actual;
+  }
+
+  void note_sync(GLsync actual)
+  {
+    syncs_[get_id()] = actual;
+  }
+
+  void note_map(GLenum target, void *data)
+  {
+    mappings_[target] = static_cast<uint8_t*>(data);
+  }
+
+  void use_program(GLuint program)
+  {
+    program_ = program;
+  }
+
+  // GL_TRACE_MAP_DATA: what the app wrote to a mapping before unmapping or
+  // flushing it
+  void map_data()
+  {
+    const auto target = static_cast<GLenum>(get_int());
+    const auto offset = static_cast<size_t>(get_int());
+    size_t size = 0;
+    const void *data = pointer(&size);
+    const auto it = mappings_.find(target);
+    if (data && (it != mappings_.end()) && it->second)
+      std::memcpy(it->second + offset, data, size);
+  }
+
+  // Starts a record: what the previous one decoded is released.
+  void next_record()
+  {
+    used_ = 0;
+  }
+
+  // Time the call between these.
+  void begin()
+  {
+    start_ = Clock::now();
+  }
+
+  void end(uint32_t call)
+  {
+    if (!timing_)
+      return;
+    if (finish_)
+      glad_glFinish();
+    const auto ns = static_cast<uint64_t>(
+                      std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        Clock::now() - start_).count());
+    CallStats &s = stats_[call - GL_TRACE_FIRST_CALL];
+    ++s.calls;
+    s.total_ns += ns;
+    s.max_ns = std::max(s.max_ns, ns);
+    frame_ns_ += ns;
+    if (calls_csv_)
+      std::fprintf(calls_csv_, "%llu,%llu,%s,%.3f\n",
+                   static_cast<unsigned long long>(frame_),
+                   static_cast<unsigned long long>(frame_calls_),
+                   GL_TRACE_CALL_NAMES[call - GL_TRACE_FIRST_CALL],
+                   static_cast<double>(ns) * 1e-3);
+    ++frame_calls_;
+  }
+
+  void set_timing(bool timing) { timing_ = timing; }
+  void set_finish(bool finish) { finish_ = finish; }
+  void set_calls_csv(FILE *file) { calls_csv_ = file; }
+
+  // the GL time and call count of the frame so far, which then starts over
+  FrameStats take_frame()
+  {
+    const FrameStats f{ frame_++, frame_calls_,
+                        static_cast<double>(frame_ns_) * 1e-6, 0.0 };
+    frame_ns_ = 0;
+    frame_calls_ = 0;
+    return f;
+  }
+
+  const std::vector<CallStats>& stats() const { return stats_; }
+
+private:
+  static uint64_t location_key(GLuint program, GLint location)
+  {
+    return (static_cast<uint64_t>(program) << 32) |
+           static_cast<uint32_t>(location);
+  }
+
+  // fence ids, as the recorder numbered them
+  uint64_t get_id()
+  {
+    return static_cast<uint64_t>(get_int());
+  }
+
+  void get_raw(void *out, size_t size)
+  {
+    if (static_cast<size_t>(end_ - p_) < size)
+    {
+      ok_ = false;
+      p_ = end_;
+      return;
+    }
+    std::memcpy(out, p_, size);
+    p_ += size;
+  }
+
+  void* pointer(size_t *size)
+  {
+    if (size)
+      *size = 0;
+    switch (get_varint())
+    {
+    case GL_TRACE_NULL:
+      return nullptr;
+    case GL_TRACE_OFFSET:
+      return reinterpret_cast<void*>(static_cast<uintptr_t>(get_varint()));
+    case GL_TRACE_BYTES:
+    {
+      const auto bytes = static_cast<size_t>(get_varint());
+      // copied out, as arguments in the trace aren't aligned
+      void *p = scratch(bytes);
+      get_raw(p, bytes);
+      if (size)
+        *size = bytes;
+      return p;
+    }
+    case GL_TRACE_OUT:
+    {
+      const auto bytes = static_cast<size_t>(get_varint());
+      return scratch(bytes ? bytes : DEFAULT_SCRATCH);
+    }
+    default:
+      ok_ = false;
+      return nullptr;
+    }
+  }
+
+  const uint8_t *p_;
+  const uint8_t *end_;
+  bool ok_ = true;
+
+  std::vector<std::vector<uint64_t>> blocks_;
+  size_t used_ = 0;
+  std::vector<const GLchar*> strings_;
+
+  std::unordered_map<GLuint, GLuint> names_[NAME_KIND_COUNT];
+  std::unordered_map<uint64_t, GLint> locations_;
+  std::unordered_map<uint64_t, GLsync> syncs_;
+  std::unordered_map<GLenum, uint8_t*> mappings_;
+  GLuint program_ = 0;
+
+  bool timing_ = false;
+  bool finish_ = false;
+  FILE *calls_csv_ = nullptr;
+  Clock::time_point start_;
+  uint64_t frame_ = 0;
+  uint64_t frame_calls_ = 0;
+  uint64_t frame_ns_ = 0;
+  std::vector<CallStats> stats_ = std::vector<CallStats>(GL_TRACE_CALL_END -
+                                                         GL_TRACE_FIRST_CALL);
+};
+
+bool load(const char *path, std::vector<uint8_t> *out)
+{
+  FILE *f = std::fopen(path, "rb");
+  if (!f)
+  {
+    std::fprintf(stderr, "Unable to open %s\n", path);
+    return false;
+  }
+  uint8_t buffer[1 << 16];
+  size_t n = 0;
+  while ((n = std::fread(buffer, 1, sizeof(buffer), f)) > 0)
+    out->insert(out->end(), buffer, buffer + n);
+  std::fclose(f);
+  return true;
+}
+
+double percentile(std::vector<double> v, int percent)
+{
+  if (v.empty())
+    return 0.0;
+  const auto nth = v.begin() + (static_cast<long>(v.size()) - 1) * percent /
+                               100;
+  std::nth_element(v.begin(), nth, v.end());
+  return *nth;
+}
+
+}  // unnamed namespace
+
+int main(int argc, char **argv)
+{
+  const char *path = nullptr;
+  const char *calls_path = nullptr;
+  unsigned long long first = 0, last = ~0ull;
+  bool finish = false;
+  bool usage = false;
+  int top = 25;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (!std::strcmp(argv[i], "--frames") && (i + 1 < argc))
+      usage |= std::sscanf(argv[++i], "%llu:%llu", &first, &last) != 2;
+    else if (!std::strcmp(argv[i], "--finish"))
+      finish = true;
+    else if (!std::strcmp(argv[i], "--calls") && (i + 1 < argc))
+      calls_path = argv[++i];
+    else if (!std::strcmp(argv[i], "--top") && (i + 1 < argc))
+      top = std::atoi(argv[++i]);
+    else if (!path && (argv[i][0] != '-'))
+      path = argv[i];
+    else
+      usage = true;
+  }
+  if (usage || !path || (first > last))
+  {
+    std::fprintf(stderr, "usage: %s TRACE [--frames FIRST:LAST] [--finish] "
+                 "[--calls FILE] [--top N]\n", argv[0]);
+    return 2;
+  }
+
+  std::vector<uint8_t> trace;
+  if (!load(path, &trace))
+    return 1;
+  if ((trace.size() < sizeof(GL_TRACE_MAGIC)) ||
+      std::memcmp(trace.data(), GL_TRACE_MAGIC, sizeof(GL_TRACE_MAGIC)))
+  {
+    std::fprintf(stderr, "%s isn't a GL trace\n", path);
+    return 1;
+  }
+  Replay replay(trace.data() + sizeof(GL_TRACE_MAGIC),
+                trace.data() + trace.size());
+  const uint64_t version = replay.get_varint();
+  const uint64_t calls = replay.get_varint();
+  const uint64_t api = replay.get_varint();
+  const auto width = static_cast<int>(replay.get_varint());
+  const auto height = static_cast<int>(replay.get_varint());
+  if ((version != GL_TRACE_VERSION) ||
+      (calls != GL_TRACE_CALL_END - GL_TRACE_FIRST_CALL) ||
+      (api != GL_TRACE_API_HASH))
+  {
+    std::fprintf(stderr, "%s was recorded by another version of the "
+                 "recorder or GL loader\n", path);
+    return 1;
+  }
+
+  FILE *calls_csv = nullptr;
+  if (calls_path)
+  {
+    calls_csv = std::fopen(calls_path, "w");
+    if (!calls_csv)
+    {
+      std::fprintf(stderr, "Unable to open %s\n", calls_path);
+      return 1;
+    }
+    std::fprintf(calls_csv, "frame,call,name,us\n");
+  }
+
+  if (!glfwInit())
+  {
+    std::fprintf(stderr, "Unable to initialise GLFW\n");
+    return 1;
+  }
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  GLFWwindow *window = glfwCreateWindow(std::max(width, 1),
+                                        std::max(height, 1), "proto3d-replay",
+                                        nullptr, nullptr);
+  if (!window)
+  {
+    std::fprintf(stderr, "Unable to create a GL 3.3 context\n");
+    glfwTerminate();
+    return 1;
+  }
+  glfwMakeContextCurrent(window);
+  if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress)))
+  {
+    std::fprintf(stderr, "Unable to load GL\n");
+    glfwTerminate();
+    return 1;
+  }
+
+  replay.set_finish(finish);
+  replay.set_calls_csv(calls_csv);
+  replay.set_timing(first == 0);
+  std::vector<FrameStats> frames;
+  uint64_t frame = 0;
+  bool failed = false;
+  while (!replay.at_end() && (frame <= last))
+  {
+    replay.next_record();
+    const auto record = static_cast<uint32_t>(replay.get_varint());
+    if (record == GL_TRACE_FRAME)
+    {
+      const auto start = Clock::now();
+      glFinish();
+      FrameStats stats = replay.take_frame();
+      stats.finish_ms = std::chrono::duration<double, std::milli>(
+                          Clock::now() - start).count();
+      if (frame >= first)
+        frames.push_back(stats);
+      ++frame;
+      replay.set_timing((frame >= first) && (frame <= last));
+    }
+    else if (record == GL_TRACE_MAP_DATA)
+      replay.map_data();
+    else if (!replay_call(replay, record))
+    {
+      std::fprintf(stderr, "%s: unknown record %u in frame %llu\n", path,
+                   record, static_cast<unsigned long long>(frame));
+      failed = true;
+      break;
+    }
+    if (!replay.ok())
+    {
+      std::fprintf(stderr, "%s: truncated in frame %llu\n", path,
+                   static_cast<unsigned long long>(frame));
+      failed = true;
+      break;
+    }
+  }
+  glFinish();
+  if (calls_csv)
+    std::fclose(calls_csv);
+
+  std::printf("renderer  %s\n", reinterpret_cast<const char*>(
+                                  glGetString(GL_RENDERER)));
+  std::vector<double> gl_ms, finish_ms;
+  for (const auto &f : frames)
+  {
+    gl_ms.push_back(f.gl_ms);
+    finish_ms.push_back(f.finish_ms);
+  }
+  std::printf("frames    %zu timed of %llu replayed\n", frames.size(),
+              static_cast<unsigned long long>(frame));
+  std::printf("frame GL ms      p50 %8.3f   p99 %8.3f\n",
+              percentile(gl_ms, 50), percentile(gl_ms, 99));
+  std::printf("frame finish ms  p50 %8.3f   p99 %8.3f\n\n",
+              percentile(finish_ms, 50), percentile(finish_ms, 99));
+
+  std::sort(frames.begin(), frames.end(),
+            [](const FrameStats &a, const FrameStats &b) {
+              return a.gl_ms + a.finish_ms > b.gl_ms + b.finish_ms; });
+  std::printf("%-8s %8s %10s %10s\n", "frame", "calls", "GL ms", "finish ms");
+  for (size_t i = 0; i < std::min<size_t>(frames.size(), 5); ++i)
+    std::printf("%-8llu %8llu %10.3f %10.3f\n",
+                static_cast<unsigned long long>(frames[i].index),
+                static_cast<unsigned long long>(frames[i].calls),
+                frames[i].gl_ms, frames[i].finish_ms);
+
+  const std::vector<CallStats> &stats = replay.stats();
+  std::vector<size_t> order;
+  uint64_t total_ns = 0;
+  for (size_t i = 0; i < stats.size(); ++i)
+  {
+    total_ns += stats[i].total_ns;
+    if (stats[i].calls)
+      order.push_back(i);
+  }
+  std::sort(order.begin(), order.end(), [&stats](size_t a, size_t b) {
+    return stats[a].total_ns > stats[b].total_ns; });
+  std::printf("\n%-34s %10s %10s %10s %10s %7s\n", "entry point", "calls",
+              "total ms", "mean us", "max us", "share");
+  for (size_t i = 0; i < std::min(order.size(), static_cast<size_t>(
+                                    std::max(top, 0))); ++i)
+  {
+    const CallStats &s = stats[order[i]];
+    std::printf("%-34s %10llu %10.3f %10.3f %10.3f %6.1f%%\n",
+                GL_TRACE_CALL_NAMES[order[i]],
+                static_cast<unsigned long long>(s.calls),
+                static_cast<double>(s.total_ns) * 1e-6,
+                static_cast<double>(s.total_ns) * 1e-3 /
+                static_cast<double>(s.calls),
+                static_cast<double>(s.max_ns) * 1e-3,
+                total_ns ? 100.0 * static_cast<double>(s.total_ns) /
+                           static_cast<double>(total_ns) : 0.0);
+  }
+
+  glfwDestroyWindow(window);
+  glfwTerminate();
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,792 @@
+// Generates the per entry point code of the GL call recorder from glad.h: a
+// wrapper that records each call before forwarding it, the tables that swap
+// the wrappers in over the glad_gl* pointers, and the decoder proto3d-replay
+// re-issues calls with; plain wrappers calling hooks before and after,
+// which gl_profile.cpp times calls with; and the stubs gl_lazy.cpp hands GLAD
+// so entry points are looked up on first use.  How a parameter is recorded follows
+// from its type and name (see classify()); an entry point no rule covers
+// stops generation, so a regenerated loader can't quietly record garbage.
+//
+//   c++ -std=c++17 tools/gl_trace_gen.cpp -o gl_trace_gen
+//   ./gl_trace_gen third_party/GLAD/include/glad/glad.h > src/gl_trace.inc
+
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Param
+{
+  std::string type;
+  std::string name;
+};
+
+struct Function
+{
+  std::string name;  // glCullFace
+  std::string ret;
+  std::vector<Param> params;
+
+  // without the gl prefix and any KHR suffix, which record alike
+  std::string base() const
+  {
+    std::string b = name.substr(2);
+    if ((b.size() > 3) && !b.compare(b.size() - 3, 3, "KHR"))
+      b.resize(b.size() - 3);
+    return b;
+  }
+
+  const Param* param(const char *n) const
+  {
+    for (const auto &p : params)
+      if (p.name == n)
+        return &p;
+    return nullptr;
+  }
+};
+
+enum Kind
+{
+  INT,
+  FLOAT,
+  DOUBLE,
+  SYNC,         // GLsync, or the pointer ObjectPtrLabel names one by
+  NAME,         // a GL object, remapped on replay
+  LABEL_NAME,   // an object of the type identifier says
+  LOCATION,     // a uniform location of the current program
+  NONE,         // callbacks; replayed as null
+  OUT,          // written by GL; nothing recorded
+  OUT_SIZED,    // written by GL, size recorded for the replay's buffer
+  PACK_OUT,     // as OUT_SIZED, or an offset with a pixel pack buffer bound
+  GEN,          // names written by Gen*, recorded after the call
+  STRING,
+  STRINGS,
+  IGNORED,      // consumed by another parameter's rule
+  BYTES,        // count elements of the pointed to type
+  NAMES,        // names to delete
+  IMAGE,        // texel data as the unpack state lays it out, or an offset
+  COMPRESSED,   // imageSize bytes, or an offset
+  OFFSET,       // into a bound buffer
+  OFFSETS
+};
+
+struct Rule
+{
+  Kind kind = INT;
+  std::string name_kind;  // NAME_BUFFER...
+  std::string count;      // element count, byte size or image arguments
+  std::string element;    // size of a BYTES element
+};
+
+std::string trim(const std::string &s)
+{
+  const size_t b = s.find_first_not_of(" \t");
+  const size_t e = s.find_last_not_of(" \t");
+  return (b == std::string::npos) ? std::string() : s.substr(b, e - b + 1);
+}
+
+bool starts_with(const std::string &s, const char *prefix)
+{
+  return !s.compare(0, std::strlen(prefix), prefix);
+}
+
+bool ends_with(const std::string &s, const char *suffix)
+{
+  const size_t n = std::strlen(suffix);
+  return (s.size() >= n) && !s.compare(s.size() - n, n, suffix);
+}
+
+int pointer_depth(const std::string &type)
+{
+  int n = 0;
+  for (const char c : type)
+    n += (c == '*') ? 1 : 0;
+  return n;
+}
+
+bool is_const(const std::string &type)
+{
+  return starts_with(type, "const ");
+}
+
+// the type pointed to, qualifiers dropped: GLchar for const GLchar *const*
+std::string element(const std::string &type)
+{
+  std::string t = type;
+  if (is_const(t))
+    t = t.substr(6);
+  return trim(t.substr(0, t.find('*')));
+}
+
+std::vector<Param> parse_params(const std::string &list)
+{
+  std::vector<Param> params;
+  if (trim(list) == "void")
+    return params;
+  size_t start = 0;
+  while (start <= list.size())
+  {
+    size_t end = list.find(',', start);
+    if (end == std::string::npos)
+      end = list.size();
+    const std::string p = trim(list.substr(start, end - start));
+    size_t n = p.size();
+    while (n && (std::isalnum(static_cast<unsigned char>(p[n - 1])) ||
+                 (p[n - 1] == '_')))
+      --n;
+    params.push_back(Param{ trim(p.substr(0, n)), p.substr(n) });
+    start = end + 1;
+  }
+  return params;
+}
+
+// objects named by the noun of a Gen/Delete entry point
+const char* object_kind(const std::string &noun)
+{
+  static const std::map<std::string, const char*> KINDS = {
+    { "Buffers", "NAME_BUFFER" }, { "Textures", "NAME_TEXTURE" },
+    { "Queries", "NAME_QUERY" }, { "Renderbuffers", "NAME_RENDERBUFFER" },
+    { "Framebuffers", "NAME_FRAMEBUFFER" },
+    { "VertexArrays", "NAME_VERTEX_ARRAY" }, { "Samplers", "NAME_SAMPLER" }
+  };
+  const auto it = KINDS.find(noun);
+  return (it == KINDS.end()) ? nullptr : it->second;
+}
+
+// objects named by a GLuint parameter's name
+const char* param_kind(const Function &f, const std::string &name)
+{
+  static const std::map<std::string, const char*> KINDS = {
+    { "buffer", "NAME_BUFFER" }, { "texture", "NAME_TEXTURE" },
+    { "program", "NAME_PROGRAM" }, { "shader", "NAME_SHADER" },
+    { "framebuffer", "NAME_FRAMEBUFFER" },
+    { "renderbuffer", "NAME_RENDERBUFFER" }, { "array", "NAME_VERTEX_ARRAY" },
+    { "sampler", "NAME_SAMPLER" }
+  };
+  if ((name == "id") && (f.name.find("Query") != std::string::npos))
+    return "NAME_QUERY";
+  const auto it = KINDS.find(name);
+  return (it == KINDS.end()) ? nullptr : it->second;
+}
+
+// values a typed const pointer holds, as an expression of the parameters
+std::string element_count(const Function &f, const Param &p)
+{
+  const std::string b = f.base();
+  unsigned n = 0, m = 0;
+  char kind[8] = {};
+  if (std::sscanf(b.c_str(), "UniformMatrix%ux%u", &n, &m) == 2)
+    return "count * " + std::to_string(n * m);
+  if (std::sscanf(b.c_str(), "UniformMatrix%u", &n) == 1)
+    return "count * " + std::to_string(n * n);
+  if ((std::sscanf(b.c_str(), "Uniform%u%7[a-z]", &n, kind) == 2) &&
+      ends_with(b, "v"))
+    return "count * " + std::to_string(n);
+  // packed attributes: VertexAttribP4uiv, NormalP3uiv...
+  for (size_t i = 0; i + 1 < b.size(); ++i)
+    if ((b[i] == 'P') && std::isdigit(static_cast<unsigned char>(b[i + 1])) &&
+        ends_with(b, "uiv"))
+      return "1";
+  if (starts_with(b, "VertexAttrib"))
+  {
+    const char *s = b.c_str() + std::strlen("VertexAttrib");
+    if (*s == 'I')
+      ++s;
+    if (std::isdigit(static_cast<unsigned char>(*s)))
+      return std::string(1, *s);
+  }
+  if (starts_with(b, "TexParameter") || starts_with(b, "SamplerParameter"))
+    return "((pname == GL_TEXTURE_BORDER_COLOR) || "
+           "(pname == GL_TEXTURE_SWIZZLE_RGBA)) ? 4 : 1";
+  if (starts_with(b, "PointParameter"))
+    return "1";
+  if (starts_with(b, "ClearBuffer"))
+    return "(buffer == GL_COLOR) ? 4 : 1";
+  if (b == "DrawBuffers")
+    return "n";
+  if (starts_with(b, "MultiDraw"))
+    return "drawcount";
+  if ((b == "DebugMessageControl") && (p.name == "ids"))
+    return "count";
+  if ((b == "GetActiveUniformsiv") && (p.name == "uniformIndices"))
+    return "uniformCount";
+  return std::string();
+}
+
+bool classify(const Function &f, const Param &p, Rule *rule)
+{
+  const std::string b = f.base();
+  const std::string el = element(p.type);
+  const int depth = pointer_depth(p.type);
+  if (!depth)
+  {
+    if ((p.type == "GLfloat") || (p.type == "GLclampf"))
+      rule->kind = FLOAT;
+    else if ((p.type == "GLdouble") || (p.type == "GLclampd"))
+      rule->kind = DOUBLE;
+    else if (p.type == "GLsync")
+      rule->kind = SYNC;
+    else if (starts_with(p.type, "GLDEBUGPROC"))
+      rule->kind = NONE;
+    else if ((p.type == "GLuint") && (p.name == "name") &&
+             ends_with(b, "ObjectLabel"))
+      rule->kind = LABEL_NAME;
+    else if ((p.type == "GLuint") && param_kind(f, p.name))
+    {
+      rule->kind = NAME;
+      rule->name_kind = param_kind(f, p.name);
+    }
+    else if ((p.type == "GLint") && (p.name == "location"))
+      rule->kind = LOCATION;
+    else
+      rule->kind = INT;
+    return true;
+  }
+
+  if (p.name == "userParam")
+  {
+    rule->kind = NONE;
+    return true;
+  }
+  if (!is_const(p.type))
+  {
+    if (starts_with(b, "Gen") && (el == "GLuint") && object_kind(b.substr(3)))
+    {
+      rule->kind = GEN;
+      rule->name_kind = object_kind(b.substr(3));
+      rule->count = f.params[0].name;
+    }
+    else if (b == "ReadPixels")
+    {
+      rule->kind = PACK_OUT;
+      rule->count = "image_bytes(trace.pack, format, type, width, height, 1)";
+    }
+    else if ((b == "GetTexImage") || (b == "GetCompressedTexImage"))
+    {
+      rule->kind = PACK_OUT;
+      rule->count = "0";
+    }
+    else if (b == "GetBufferSubData")
+    {
+      rule->kind = OUT_SIZED;
+      rule->count = "size";
+    }
+    else if ((el == "GLchar") && f.param("bufSize"))
+    {
+      rule->kind = OUT_SIZED;
+      rule->count = "bufSize";
+    }
+    else
+      rule->kind = OUT;
+    return true;
+  }
+
+  if (el == "GLchar")
+  {
+    if (depth == 2)
+    {
+      rule->kind = STRINGS;
+      rule->count = f.params[1].name;
+    }
+    else
+    {
+      rule->kind = STRING;
+      const Param *length = f.param("length");
+      rule->count = (length && (length->type == "GLsizei")) ? "length" : "-1";
+    }
+    return true;
+  }
+  if ((b == "ShaderSource") && (p.name == "length"))
+  {
+    rule->kind = IGNORED;
+    return true;
+  }
+  if (el == "void")
+  {
+    if (depth == 2)
+    {
+      rule->kind = OFFSETS;
+      rule->count = "drawcount";
+    }
+    else if ((b == "BufferData") || (b == "BufferSubData"))
+    {
+      rule->kind = BYTES;
+      rule->count = "size";
+      rule->element = "1";
+    }
+    else if (starts_with(b, "TexImage") || starts_with(b, "TexSubImage"))
+    {
+      rule->kind = IMAGE;
+      const char dims = b[b.size() - 2];
+      rule->count = std::string("format, type, width, ") +
+                    ((dims >= '2') ? "height, " : "1, ") +
+                    ((dims >= '3') ? "depth" : "1");
+    }
+    else if (starts_with(b, "CompressedTex"))
+    {
+      rule->kind = COMPRESSED;
+      rule->count = "imageSize";
+    }
+    else if ((p.name == "indices") ||
+             ((p.name == "pointer") && starts_with(b, "VertexAttrib")))
+      rule->kind = OFFSET;
+    else if (p.name == "ptr")
+      rule->kind = SYNC;
+    else
+      return false;
+    return true;
+  }
+  if (starts_with(b, "Delete") && (el == "GLuint") && object_kind(b.substr(6)))
+  {
+    rule->kind = NAMES;
+    rule->name_kind = object_kind(b.substr(6));
+    rule->count = f.params[0].name;
+    return true;
+  }
+  rule->kind = BYTES;
+  rule->count = element_count(f, p);
+  rule->element = "sizeof(" + el + ")";
+  return !rule->count.empty();
+}
+
+std::string call_args(const Function &f)
+{
+  std::string args;
+  for (size_t i = 0; i < f.params.size(); ++i)
+    args += (i ? ", " : "") + f.params[i].name;
+  return args;
+}
+
+// type name, or type *name
+std::string declare(const std::string &type, const std::string &name)
+{
+  return type + (ends_with(type, "*") ? "" : " ") + name;
+}
+
+std::string declaration(const Param &p)
+{
+  return declare(p.type, p.name);
+}
+
+void emit_recorder(const Function &f, const std::vector<Rule> &rules)
+{
+  const std::string b = f.base();
+  std::string params;
+  for (size_t i = 0; i < f.params.size(); ++i)
+    params += (i ? ", " : "") + declaration(f.params[i]);
+  std::printf("%s(%s)\n{\n",
+              declare(f.ret, "APIENTRY trace_" + f.name).c_str(),
+              params.c_str());
+  std::printf("  const std::lock_guard<std::mutex> lock(trace.mutex);\n");
+  if (b == "UnmapBuffer")
+    std::printf("  write_mapped(target);\n");
+  else if (b == "FlushMappedBufferRange")
+    std::printf("  write_mapped_range(target, offset, length);\n");
+  std::printf("  put_call(CALL_%s);\n", f.name.c_str());
+  for (size_t i = 0; i < f.params.size(); ++i)
+  {
+    const char *n = f.params[i].name.c_str();
+    const Rule &r = rules[i];
+    switch (r.kind)
+    {
+    case INT:
+    case NAME:
+    case LABEL_NAME:
+    case LOCATION:
+      std::printf("  put_int(%s);\n", n);
+      break;
+    case FLOAT:
+      std::printf("  put_float(%s);\n", n);
+      break;
+    case DOUBLE:
+      std::printf("  put_double(%s);\n", n);
+      break;
+    case SYNC:
+      std::printf("  put_sync(%s);\n", n);
+      break;
+    case OUT_SIZED:
+      std::printf("  put_out(%s);\n", r.count.c_str());
+      break;
+    case PACK_OUT:
+      std::printf("  put_pack_out(%s, %s);\n", n, r.count.c_str());
+      break;
+    case STRING:
+      std::printf("  put_string(%s, %s);\n", n, r.count.c_str());
+      break;
+    case STRINGS:
+      std::printf("  put_strings(%s, %s, %s);\n", r.count.c_str(), n,
+                  f.param("length") ? "length" : "nullptr");
+      break;
+    case BYTES:
+      std::printf("  put_bytes(%s, %s, %s);\n", n, r.count.c_str(),
+                  r.element.c_str());
+      break;
+    case NAMES:
+      std::printf("  put_bytes(%s, %s, sizeof(GLuint));\n", n,
+                  r.count.c_str());
+      break;
+    case IMAGE:
+      std::printf("  put_image(%s, %s);\n", n, r.count.c_str());
+      break;
+    case COMPRESSED:
+      std::printf("  put_compressed(%s, %s);\n", n, r.count.c_str());
+      break;
+    case OFFSET:
+      std::printf("  put_offset(%s);\n", n);
+      break;
+    case OFFSETS:
+      std::printf("  put_offsets(%s, %s);\n", n, r.count.c_str());
+      break;
+    case NONE:
+    case OUT:
+    case GEN:
+    case IGNORED:
+      break;
+    }
+  }
+  const bool returns = (f.ret != "void");
+  std::printf("  %sreal_%s(%s);\n",
+              returns ? (declare(f.ret, "result") + " = ").c_str() : "",
+              f.name.c_str(),
+              call_args(f).c_str());
+  for (size_t i = 0; i < f.params.size(); ++i)
+    if (rules[i].kind == GEN)
+      std::printf("  put_names(%s, %s);\n", rules[i].count.c_str(),
+                  f.params[i].name.c_str());
+  if ((b == "CreateProgram") || (b == "CreateShader") ||
+      (b == "GetUniformLocation"))
+    std::printf("  put_int(result);\n");
+  else if (b == "FenceSync")
+    std::printf("  put_new_sync(result);\n");
+  else if (b == "MapBufferRange")
+    std::printf("  note_map(target, length, access, result);\n");
+  else if (b == "MapBuffer")
+    std::printf("  note_map_buffer(target, access, result);\n");
+  else if (b == "BindBuffer")
+    std::printf("  note_bind_buffer(target, buffer);\n");
+  else if (b == "PixelStorei")
+    std::printf("  note_pixel_store(pname, param);\n");
+  else if (b == "PixelStoref")
+    std::printf("  note_pixel_store(pname, static_cast<GLint>(param));\n");
+  else if (b == "DeleteSync")
+    std::printf("  forget_sync(sync);\n");
+  if (returns)
+    std::printf("  return result;\n");
+  std::printf("}\n\n");
+}
+
+// Calls pre_call(id) and post_call(id, what pre_call returned) around the
+// call, as GLAD's debug mode does its callbacks.
+void emit_hook(const Function &f)
+{
+  std::string params;
+  for (size_t i = 0; i < f.params.size(); ++i)
+    params += (i ? ", " : "") + declaration(f.params[i]);
+  std::printf("%s(%s)\n{\n",
+              declare(f.ret, "APIENTRY hook_" + f.name).c_str(),
+              params.c_str());
+  std::printf("  const auto token = pre_call(CALL_%s);\n", f.name.c_str());
+  const bool returns = (f.ret != "void");
+  std::printf("  %sreal_%s(%s);\n",
+              returns ? (declare(f.ret, "result") + " = ").c_str() : "",
+              f.name.c_str(), call_args(f).c_str());
+  std::printf("  post_call(CALL_%s, token);\n", f.name.c_str());
+  if (returns)
+    std::printf("  return result;\n");
+  std::printf("}\n\n");
+}
+
+// Looks its entry point up with resolve(id) and calls it; the first call
+// also puts it in its glad_gl* pointer, unless a wrapper has taken that.
+void emit_lazy(const Function &f)
+{
+  std::string params;
+  for (size_t i = 0; i < f.params.size(); ++i)
+    params += (i ? ", " : "") + declaration(f.params[i]);
+  std::string upper = f.name;
+  for (auto &c : upper)
+    c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+  std::printf("%s(%s)\n{\n",
+              declare(f.ret, "APIENTRY lazy_" + f.name).c_str(),
+              params.c_str());
+  std::printf("  const auto real = reinterpret_cast<PFN%sPROC>(\n"
+              "    resolve(CALL_%s));\n", upper.c_str(), f.name.c_str());
+  std::printf("  if (glad_%s == lazy_%s)\n    glad_%s = real;\n",
+              f.name.c_str(), f.name.c_str(), f.name.c_str());
+  std::printf("  %sreal(%s);\n", (f.ret != "void") ? "return " : "",
+              call_args(f).c_str());
+  std::printf("}\n\n");
+}
+
+void emit_real_pointers(const std::vector<Function> &functions)
+{
+  for (const auto &f : functions)
+  {
+    std::string upper = f.name;
+    for (auto &c : upper)
+      c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    std::printf("PFN%sPROC real_%s;\n", upper.c_str(), f.name.c_str());
+  }
+  std::printf("\n");
+}
+
+// install_wrappers() and uninstall_wrappers() for the prefix's wrappers
+void emit_install(const std::vector<Function> &functions, const char *prefix)
+{
+  std::printf("// only entry points the context has are wrapped\n");
+  std::printf("void install_wrappers()\n{\n");
+  for (const auto &f : functions)
+    std::printf("  real_%s = glad_%s;\n  if (glad_%s)\n    glad_%s = "
+                "%s%s;\n", f.name.c_str(), f.name.c_str(), f.name.c_str(),
+                f.name.c_str(), prefix, f.name.c_str());
+  std::printf("}\n\n");
+  std::printf("void uninstall_wrappers()\n{\n");
+  for (const auto &f : functions)
+    std::printf("  if (glad_%s == %s%s)\n    glad_%s = real_%s;\n",
+                f.name.c_str(), prefix, f.name.c_str(), f.name.c_str(),
+                f.name.c_str());
+  std::printf("}\n\n");
+}
+
+void emit_replay(const Function &f, const std::vector<Rule> &rules)
+{
+  const std::string b = f.base();
+  std::printf("  case CALL_%s:\n  {\n", f.name.c_str());
+  for (size_t i = 0; i < f.params.size(); ++i)
+  {
+    const Param &p = f.params[i];
+    const Rule &r = rules[i];
+    const std::string decl = declaration(p);
+    const char *d = decl.c_str();
+    const char *t = p.type.c_str();
+    switch (r.kind)
+    {
+    case INT:
+      std::printf("    const %s = static_cast<%s>(replay.get_int());\n", d, t);
+      break;
+    case FLOAT:
+      std::printf("    const %s = replay.get_float();\n", d);
+      break;
+    case DOUBLE:
+      std::printf("    const %s = replay.get_double();\n", d);
+      break;
+    case SYNC:
+      std::printf("    %s = replay.get_sync();\n", d);
+      break;
+    case NAME:
+      std::printf("    const %s = replay.name(%s, static_cast<GLuint>("
+                  "replay.get_int()));\n", d, r.name_kind.c_str());
+      break;
+    case LABEL_NAME:
+      std::printf("    const %s = replay.label_name(identifier, "
+                  "static_cast<GLuint>(replay.get_int()));\n", d);
+      break;
+    case LOCATION:
+      std::printf("    const %s = replay.location(static_cast<GLint>("
+                  "replay.get_int()));\n", d);
+      break;
+    case NONE:
+    case IGNORED:
+      std::printf("    %s = nullptr;\n", d);
+      break;
+    case OUT:
+    case GEN:
+      std::printf("    %s = static_cast<%s>(replay.scratch());\n", d, t);
+      break;
+    case OUT_SIZED:
+    case PACK_OUT:
+      std::printf("    %s = static_cast<%s>(replay.get_out());\n", d, t);
+      break;
+    case STRINGS:
+      std::printf("    %s = replay.get_strings();\n", d);
+      break;
+    case NAMES:
+      std::printf("    %s = replay.get_names(%s);\n", d, r.name_kind.c_str());
+      break;
+    case OFFSETS:
+      std::printf("    %s = replay.get_offsets();\n", d);
+      break;
+    case STRING:
+    case BYTES:
+    case IMAGE:
+    case COMPRESSED:
+    case OFFSET:
+      std::printf("    %s = static_cast<%s>(replay.get_pointer());\n", d, t);
+      break;
+    }
+  }
+  const bool keep = (b == "CreateProgram") || (b == "CreateShader") ||
+                    (b == "GetUniformLocation") || (b == "FenceSync") ||
+                    (b == "MapBuffer") || (b == "MapBufferRange");
+  std::printf("    replay.begin();\n");
+  std::printf("    %sglad_%s(%s);\n",
+              keep ? (declare(f.ret, "result") + " = ").c_str() : "",
+              f.name.c_str(), call_args(f).c_str());
+  std::printf("    replay.end(call);\n");
+  for (size_t i = 0; i < f.params.size(); ++i)
+    if (rules[i].kind == GEN)
+      std::printf("    replay.gen_names(%s, %s, %s);\n",
+                  rules[i].name_kind.c_str(), rules[i].count.c_str(),
+                  f.params[i].name.c_str());
+  if (b == "CreateProgram")
+    std::printf("    replay.note_name(NAME_PROGRAM, static_cast<GLuint>("
+                "replay.get_int()), result);\n");
+  else if (b == "CreateShader")
+    std::printf("    replay.note_name(NAME_SHADER, static_cast<GLuint>("
+                "replay.get_int()), result);\n");
+  else if (b == "GetUniformLocation")
+    std::printf("    replay.note_location(program, static_cast<GLint>("
+                "replay.get_int()), result);\n");
+  else if (b == "FenceSync")
+    std::printf("    replay.note_sync(result);\n");
+  else if ((b == "MapBuffer") || (b == "MapBufferRange"))
+    std::printf("    replay.note_map(target, result);\n");
+  else if (b == "UseProgram")
+    std::printf("    replay.use_program(program);\n");
+  std::printf("    return true;\n  }\n");
+}
+
+uint64_t fnv1a(uint64_t h, const std::string &s)
+{
+  for (const char c : s)
+    h = (h ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+  return h;
+}
+
+}  // unnamed namespace
+
+int main(int argc, char **argv)
+{
+  if (argc != 2)
+  {
+    std::fprintf(stderr, "usage: %s glad.h\n", argv[0]);
+    return 1;
+  }
+  FILE *in = std::fopen(argv[1], "r");
+  if (!in)
+  {
+    std::fprintf(stderr, "unable to open %s\n", argv[1]);
+    return 1;
+  }
+
+  // typedef RET (APIENTRYP PFNGLXPROC)(PARAMS); then GLAPI PFNGLXPROC glad_glX;
+  std::map<std::string, Function> typedefs;
+  std::vector<Function> functions;
+  char line[4096];
+  while (std::fgets(line, sizeof(line), in))
+  {
+    const std::string s = trim(std::string(line, std::strcspn(line, "\r\n")));
+    const size_t pfn = s.find("(APIENTRYP PFNGL");
+    if (starts_with(s, "typedef ") && (pfn != std::string::npos))
+    {
+      const size_t open = s.find(")(", pfn);
+      Function f;
+      f.ret = trim(s.substr(8, pfn - 8));
+      f.params = parse_params(s.substr(open + 2, s.rfind(");") - open - 2));
+      typedefs[s.substr(pfn + 11, open - pfn - 11)] = f;
+    }
+    else if (starts_with(s, "GLAPI PFNGL") &&
+             (s.find(" glad_gl") != std::string::npos))
+    {
+      const size_t space = s.find(' ', 6);
+      const auto it = typedefs.find(s.substr(6, space - 6));
+      if (it == typedefs.end())
+        continue;
+      Function f = it->second;
+      f.name = s.substr(space + 6, s.size() - space - 7);
+      functions.push_back(f);
+    }
+  }
+  std::fclose(in);
+
+  std::vector<std::vector<Rule>> rules(functions.size());
+  uint64_t hash = 0xcbf29ce484222325ull;
+  int failures = 0;
+  for (size_t i = 0; i < functions.size(); ++i)
+  {
+    const Function &f = functions[i];
+    hash = fnv1a(hash, f.ret + " " + f.name);
+    for (const auto &p : f.params)
+    {
+      if ((p.name == "result") || (p.name == "replay") || (p.name == "call") ||
+          (p.name == "lock") || (p.name == "trace") || (p.name == "token") ||
+          (p.name == "real"))
+      {
+        std::fprintf(stderr, "%s: parameter %s clashes with generated code\n",
+                     f.name.c_str(), p.name.c_str());
+        ++failures;
+      }
+      hash = fnv1a(hash, declaration(p));
+      rules[i].emplace_back();
+      if (!classify(f, p, &rules[i].back()))
+      {
+        std::fprintf(stderr, "%s: no rule records %s %s\n", f.name.c_str(),
+                     p.type.c_str(), p.name.c_str());
+        ++failures;
+      }
+    }
+  }
+  if (failures || functions.empty())
+    return 1;
+
+  const char *name = std::strrchr(argv[1], '/');
+  std::printf("// Generated by tools/gl_trace_gen.cpp from %s; do not edit.\n",
+              name ? name + 1 : argv[1]);
+  std::printf("// Include with GL_TRACE_RECORD defined for the recording "
+              "wrappers,\n// GL_TRACE_HOOKS for wrappers calling pre_call() and "
+              "post_call(),\n// GL_TRACE_LAZY for stubs calling resolve(), or "
+              "GL_TRACE_REPLAY for the\n// decoder.\n\n");
+  std::printf("enum GlTraceCall : uint32_t\n{\n");
+  for (size_t i = 0; i < functions.size(); ++i)
+    std::printf("  CALL_%s%s,\n", functions[i].name.c_str(),
+                i ? "" : " = GL_TRACE_FIRST_CALL");
+  std::printf("  GL_TRACE_CALL_END\n};\n\n");
+  std::printf("// identifies the entry points and signatures above\n");
+  std::printf("constexpr uint64_t GL_TRACE_API_HASH = 0x%016llxull;\n\n",
+              static_cast<unsigned long long>(hash));
+  std::printf("constexpr const char *GL_TRACE_CALL_NAMES[] = {\n");
+  for (const auto &f : functions)
+    std::printf("  \"%s\",\n", f.name.c_str());
+  std::printf("};\n\n");
+
+  std::printf("#ifdef GL_TRACE_RECORD\n\n");
+  emit_real_pointers(functions);
+  for (size_t i = 0; i < functions.size(); ++i)
+    emit_recorder(functions[i], rules[i]);
+  emit_install(functions, "trace_");
+  std::printf("#endif  // GL_TRACE_RECORD\n\n");
+
+  std::printf("#ifdef GL_TRACE_HOOKS\n\n");
+  emit_real_pointers(functions);
+  for (const auto &f : functions)
+    emit_hook(f);
+  emit_install(functions, "hook_");
+  std::printf("#endif  // GL_TRACE_HOOKS\n\n");
+
+  std::printf("#ifdef GL_TRACE_LAZY\n\n");
+  for (const auto &f : functions)
+    emit_lazy(f);
+  std::printf("// in call order, from GL_TRACE_FIRST_CALL\n");
+  std::printf("void *const LAZY_STUBS[] = {\n");
+  for (const auto &f : functions)
+    std::printf("  reinterpret_cast<void*>(lazy_%s),\n", f.name.c_str());
+  std::printf("};\n\n");
+  std::printf("#endif  // GL_TRACE_LAZY\n\n");
+
+  std::printf("#ifdef GL_TRACE_REPLAY\n\n");
+  std::printf("// false for an unknown call; Replay decodes arguments and "
+              "remaps objects\n");
+  std::printf("template <typename Replay>\n"
+              "bool replay_call(Replay &replay, uint32_t call)\n{\n");
+  std::printf("  switch (call)\n  {\n");
+  for (size_t i = 0; i < functions.size(); ++i)
+    emit_replay(functions[i], rules[i]);
+  std::printf("  default:\n    return false;\n  }\n}\n\n");
+  std::printf("#endif  // GL_TRACE_REPLAY\n");
+  return 0;
+}
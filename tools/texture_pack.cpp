@@ -0,0 +1,133 @@
+// Packs small textures onto atlas pages at cook time (see src/texture_atlas.h)
+// so a set of them draws with one bind: each page a texture, or all of them
+// layers of one array, picked when TextureAtlas loads them.
+//
+//   proto3d-pack OUT [--size N] [--padding N] [--mips N] IMAGE...
+//
+// Writes OUT_N.png, a page each, and the manifest OUT.atlas that maps each
+// image's name, its file name without directories or extension, to its page
+// and texels.  Names must be unique and without spaces.  --padding is the
+// gutter at the smallest of --mips levels, doubling each level up.
+
+#include "image_write.h"
+#include "texture_atlas.h"
+
+#include "stb_image.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace {
+
+std::string image_name(const char *path)
+{
+  const char *slash = std::strrchr(path, '/');
+  std::string name = slash ? slash + 1 : path;
+  const size_t dot = name.rfind('.');
+  return (dot != std::string::npos) ? name.substr(0, dot) : name;
+}
+
+}  // unnamed namespace
+
+int main(int argc, char **argv)
+{
+  const char *out = nullptr;
+  AtlasSettings settings;
+  std::vector<const char*> paths;
+  bool usage = false;
+  for (int i = 1; i < argc; ++i)
+  {
+    const bool has_value = (i + 1 < argc);
+    if (!std::strcmp(argv[i], "--size") && has_value)
+      settings.page_size = std::atoi(argv[++i]);
+    else if (!std::strcmp(argv[i], "--padding") && has_value)
+      settings.padding = std::atoi(argv[++i]);
+    else if (!std::strcmp(argv[i], "--mips") && has_value)
+      settings.mip_levels = std::atoi(argv[++i]);
+    else if (!std::strncmp(argv[i], "--", 2))
+      usage = true;
+    else if (!out)
+      out = argv[i];
+    else
+      paths.push_back(argv[i]);
+  }
+  if (usage || !out || paths.empty() || (settings.page_size <= 0))
+  {
+    std::fprintf(stderr, "usage: %s OUT [--size N] [--padding N] [--mips N] "
+                 "IMAGE...\n", argv[0]);
+    return 2;
+  }
+
+  std::vector<AtlasImage> images;
+  std::unordered_set<std::string> names;
+  for (const char *path : paths)
+  {
+    AtlasImage image;
+    image.name = image_name(path);
+    if (!names.insert(image.name).second ||
+        (image.name.find_first_of(" \t") != std::string::npos))
+    {
+      std::fprintf(stderr, "%s: image names must be unique, without "
+                   "spaces\n", path);
+      return 2;
+    }
+    int comp = 0;
+    stbi_uc *pixels = stbi_load(path, &image.width, &image.height, &comp, 4);
+    if (!pixels)
+    {
+      std::fprintf(stderr, "Unable to load %s\n", path);
+      return 2;
+    }
+    image.rgba.assign(pixels, pixels + static_cast<size_t>(image.width) *
+                                       static_cast<size_t>(image.height) * 4);
+    stbi_image_free(pixels);
+    images.push_back(std::move(image));
+  }
+
+  AtlasLayout layout;
+  if (!pack_atlas(settings, images, &layout))
+    return 1;
+
+  const std::string base = image_name(out);
+  size_t used = 0;
+  for (const auto &image : images)
+    used += static_cast<size_t>(image.width) *
+            static_cast<size_t>(image.height);
+  for (size_t page = 0; page < layout.pages.size(); ++page)
+  {
+    const std::string file = base + "_" + std::to_string(page) + ".png";
+    layout.page_files.push_back(file);
+    const std::string path = std::string(out) + "_" + std::to_string(page) +
+                             ".png";
+    std::vector<uint8_t> png;
+    encode_png(layout.pages[page].data(), layout.page_size, layout.page_size,
+               static_cast<ptrdiff_t>(layout.page_size) * 4, 4, &png);
+    if (!write_file(path.c_str(), png))
+    {
+      std::fprintf(stderr, "Unable to write %s\n", path.c_str());
+      return 1;
+    }
+  }
+  const std::string manifest = write_atlas_manifest(layout);
+  const std::string manifest_path = std::string(out) + ".atlas";
+  if (!write_file(manifest_path.c_str(),
+                  std::vector<uint8_t>(manifest.begin(), manifest.end())))
+  {
+    std::fprintf(stderr, "Unable to write %s\n", manifest_path.c_str());
+    return 1;
+  }
+
+  const double texels = static_cast<double>(layout.pages.size()) *
+                        static_cast<double>(layout.page_size) *
+                        static_cast<double>(layout.page_size);
+  std::fprintf(stderr, "%zu images on %zu pages of %d texels, %d mip levels; "
+               "%.1f%% of the texels are images\n", images.size(),
+               layout.pages.size(), layout.page_size, layout.mip_levels,
+               100.0 * static_cast<double>(used) / texels);
+  return 0;
+}